@@ -0,0 +1,299 @@
+# Copyright 2016 The Brotli Authors. All rights reserved.
+#
+# Distributed under MIT license.
+# See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+"""Functions to compress and decompress data using the Brotli library."""
+
+import io
+import os
+
+import _brotli
+
+
+# The library version.
+__version__ = _brotli.__version__
+
+# The compression mode.
+MODE_GENERIC = _brotli.MODE_GENERIC
+MODE_TEXT = _brotli.MODE_TEXT
+MODE_FONT = _brotli.MODE_FONT
+
+# The Compressor object.
+Compressor = _brotli.Compressor
+
+# The Decompressor object.
+Decompressor = _brotli.Decompressor
+
+# Compress a byte string.
+def compress(string, mode=MODE_GENERIC, quality=11, lgwin=22, lgblock=0):
+    """Compress a byte string.
+
+    Args:
+      string (bytes): The input data.
+      mode (int, optional): The compression mode can be MODE_GENERIC (default),
+        MODE_TEXT (for UTF-8 format text input) or MODE_FONT (for WOFF 2.0).
+      quality (int, optional): Controls the compression-speed vs compression-
+        density tradeoff. The higher the quality, the slower the compression.
+        Range is 0 to 11. Defaults to 11.
+      lgwin (int, optional): Base 2 logarithm of the sliding window size. Range
+        is 10 to 24. Defaults to 22.
+      lgblock (int, optional): Base 2 logarithm of the maximum input block size.
+        Range is 16 to 24. If set to 0, the value will be set based on the
+        quality. Defaults to 0.
+
+    Returns:
+      The compressed byte string.
+
+    Raises:
+      brotli.error: If arguments are invalid, or compressor fails.
+    """
+    compressor = Compressor(mode=mode, quality=quality, lgwin=lgwin,
+                            lgblock=lgblock)
+    return compressor.process(string) + compressor.finish()
+
+# Decompress a compressed byte string.
+decompress = _brotli.decompress
+
+# Raised if compression or decompression fails.
+error = _brotli.error
+
+# Size of chunks read from / written to the underlying file.
+BUFFER_SIZE = 1 << 20
+
+_PATH_TYPES = (str, bytes) + ((os.PathLike,) if hasattr(os, 'PathLike') else ())
+
+
+class _DecompressReader(io.RawIOBase):
+    """Raw reader that decompresses directly into the caller's buffer."""
+
+    def __init__(self, fileobj):
+        self._fileobj = fileobj
+        self._decompressor = Decompressor()
+        self._input = memoryview(b'')
+        # Output buffer was not filled in the last call, so decoder has no
+        # pending output and needs more input (unless it is finished).
+        self._needs_input = True
+        self._eof = False
+
+    def readable(self):
+        return True
+
+    def readinto(self, b):
+        with memoryview(b) as view, view.cast('B') as output:
+            while not self._eof:
+                if (not self._input and self._needs_input and
+                        not self._decompressor.is_finished()):
+                    data = self._fileobj.read(BUFFER_SIZE)
+                    if not data:
+                        raise EOFError('Compressed file ended before the '
+                                       'end-of-stream marker was reached')
+                    self._input = memoryview(data)
+                consumed, written = self._decompressor.process_into(
+                    self._input, output)
+                self._input = self._input[consumed:]
+                self._needs_input = written < len(output)
+                if self._decompressor.is_finished():
+                    if self._input or self._fileobj.read(1):
+                        raise error('Garbage after the end of the stream')
+                    self._eof = True
+                if written or not output:
+                    return written
+            return 0
+
+    def readall(self):
+        chunks = []
+        while True:
+            chunk = bytearray(BUFFER_SIZE)
+            size = self.readinto(chunk)
+            if not size:
+                return b''.join(chunks)
+            del chunk[size:]
+            chunks.append(chunk)
+
+
+class BrotliFile(io.BufferedIOBase):
+    """A file object providing transparent Brotli (de)compression.
+
+    A BrotliFile can act as a wrapper for an existing file object, or refer
+    directly to a named file on disk. Reading decompresses directly into the
+    buffer passed to "readinto()"; writes are accumulated in BUFFER_SIZE chunks
+    before they are passed to the encoder. Compression and decompression run
+    without holding the GIL. Requires Python 3.
+    """
+
+    def __init__(self, filename, mode='r', quality=11, lgwin=22, lgblock=0):
+        """Open a Brotli-compressed file in binary mode.
+
+        Args:
+          filename (str, bytes, os.PathLike or file object): The file to wrap.
+          mode (str, optional): 'r' or 'rb' for reading (default), 'w' or 'wb'
+            for writing, 'x' or 'xb' for exclusive creation.
+          quality (int, optional): See "compress()". Used only for writing.
+          lgwin (int, optional): See "compress()". Used only for writing.
+          lgblock (int, optional): See "compress()". Used only for writing.
+
+        Raises:
+          ValueError: If mode is invalid.
+          brotli.error: If compression parameters are invalid.
+        """
+        self._fileobj = None
+        self._close_fileobj = False
+        if mode in ('r', 'rb'):
+            self._mode = 'r'
+        elif mode in ('w', 'wb', 'x', 'xb'):
+            self._mode = 'w'
+            self._compressor = Compressor(quality=quality, lgwin=lgwin,
+                                          lgblock=lgblock)
+            self._pending = bytearray()
+        else:
+            raise ValueError('Invalid mode: {!r}'.format(mode))
+        if isinstance(filename, _PATH_TYPES):
+            if 'b' not in mode:
+                mode += 'b'
+            self._fileobj = io.open(filename, mode)
+            self._close_fileobj = True
+        elif hasattr(filename, 'read') or hasattr(filename, 'write'):
+            self._fileobj = filename
+        else:
+            raise TypeError('filename must be a str, bytes, file or PathLike '
+                            'object')
+        if self._mode == 'r':
+            self._buffer = io.BufferedReader(_DecompressReader(self._fileobj),
+                                             BUFFER_SIZE)
+
+    @property
+    def closed(self):
+        return self._fileobj is None
+
+    def close(self):
+        """Flush and close the file; finish the stream when writing."""
+        if self._fileobj is None:
+            return
+        try:
+            if self._mode == 'w':
+                self._write_pending()
+                self._fileobj.write(self._compressor.finish())
+            else:
+                self._buffer.close()
+        finally:
+            try:
+                if self._close_fileobj:
+                    self._fileobj.close()
+            finally:
+                self._fileobj = None
+                self._buffer = None
+                self._compressor = None
+
+    def fileno(self):
+        self._check_not_closed()
+        return self._fileobj.fileno()
+
+    def readable(self):
+        self._check_not_closed()
+        return self._mode == 'r'
+
+    def writable(self):
+        self._check_not_closed()
+        return self._mode == 'w'
+
+    def seekable(self):
+        return False
+
+    def read(self, size=-1):
+        self._check_mode('r')
+        return self._buffer.read(size)
+
+    def read1(self, size=-1):
+        self._check_mode('r')
+        if size < 0:
+            size = BUFFER_SIZE
+        return self._buffer.read1(size)
+
+    def readinto(self, b):
+        self._check_mode('r')
+        return self._buffer.readinto(b)
+
+    def readinto1(self, b):
+        self._check_mode('r')
+        return self._buffer.readinto1(b)
+
+    def peek(self, size=0):
+        self._check_mode('r')
+        return self._buffer.peek(size)
+
+    def readline(self, size=-1):
+        self._check_mode('r')
+        return self._buffer.readline(size)
+
+    def write(self, data):
+        """Compress data and write it to the file.
+
+        Returns the number of uncompressed bytes written.
+        """
+        self._check_mode('w')
+        with memoryview(data) as view, view.cast('B') as chunk:
+            length = len(chunk)
+            if len(self._pending) + length < BUFFER_SIZE:
+                self._pending += chunk
+            else:
+                self._write_pending()
+                self._fileobj.write(self._compressor.process(chunk))
+        return length
+
+    def flush(self):
+        """Write all pending data so that it could be decompressed."""
+        self._check_not_closed()
+        if self._mode == 'w':
+            self._write_pending()
+            self._fileobj.write(self._compressor.flush())
+            self._fileobj.flush()
+
+    def _write_pending(self):
+        if self._pending:
+            self._fileobj.write(self._compressor.process(self._pending))
+            del self._pending[:]
+
+    def _check_not_closed(self):
+        if self.closed:
+            raise ValueError('I/O operation on closed file')
+
+    def _check_mode(self, mode):
+        self._check_not_closed()
+        if self._mode != mode:
+            raise io.UnsupportedOperation(
+                'File not open for {}'.format('reading' if mode == 'r' else
+                                              'writing'))
+
+
+def open(filename, mode='rb', quality=11, lgwin=22, lgblock=0, encoding=None,
+         errors=None, newline=None):
+    """Open a Brotli-compressed file in binary or text mode.
+
+    Args:
+      filename (str, bytes, os.PathLike or file object): The file to open.
+      mode (str, optional): 'r', 'w' or 'x' for binary mode, or 'rt', 'wt'
+        or 'xt' for text mode. Defaults to 'rb'.
+      quality, lgwin, lgblock (int, optional): See "compress()".
+      encoding, errors, newline (str, optional): See "io.TextIOWrapper"; only
+        allowed in text mode.
+
+    Returns:
+      A BrotliFile in binary mode, or a BrotliFile wrapped in an
+      io.TextIOWrapper in text mode.
+    """
+    if 't' in mode:
+        if 'b' in mode:
+            raise ValueError('Invalid mode: {!r}'.format(mode))
+    else:
+        if encoding is not None:
+            raise ValueError("Argument 'encoding' not supported in binary mode")
+        if errors is not None:
+            raise ValueError("Argument 'errors' not supported in binary mode")
+        if newline is not None:
+            raise ValueError("Argument 'newline' not supported in binary mode")
+    binary_file = BrotliFile(filename, mode.replace('t', ''), quality=quality,
+                             lgwin=lgwin, lgblock=lgblock)
+    if 't' in mode:
+        return io.TextIOWrapper(binary_file, encoding, errors, newline)
+    return binary_file
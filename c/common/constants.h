@@ -102,6 +102,13 @@
 #define BROTLI_WINDOW_GAP 16
 #define BROTLI_MAX_BACKWARD_LIMIT(W) (((size_t)1 << (W)) - BROTLI_WINDOW_GAP)
 
+/* Content size header: the first meta-block of the stream could be a metadata
+   block of BROTLI_CONTENT_SIZE_METADATA_LENGTH bytes: "BRSZ" signature
+   followed by the total uncompressed size as 64-bit little-endian value.
+   Decoders that are not aware of it just skip it. */
+#define BROTLI_CONTENT_SIZE_MAGIC 0x5A535242u
+#define BROTLI_CONTENT_SIZE_METADATA_LENGTH 12
+
 typedef struct BrotliDistanceCodeLimit {
   uint32_t max_alphabet_size;
   uint32_t max_distance;
@@ -0,0 +1,154 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+#include "./filter.h"
+
+#include <string.h>  /* memcpy, memset */
+
+#include "./platform.h"
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+BROTLI_BOOL BrotliFilterInit(
+    BrotliFilter* filter, int id, int param, BROTLI_BOOL encode) {
+  switch (id) {
+    case BROTLI_FILTER_ID_NONE:
+    case BROTLI_FILTER_ID_X86:
+      param = 0;
+      break;
+
+    case BROTLI_FILTER_ID_DELTA:
+      if (param < 1 || param > 255) return BROTLI_FALSE;
+      break;
+
+    case BROTLI_FILTER_ID_TRANSPOSE:
+      if (param < 2 || param > 255) return BROTLI_FALSE;
+      break;
+
+    default: return BROTLI_FALSE;
+  }
+  filter->id = (uint8_t)id;
+  filter->param = (uint8_t)param;
+  filter->history_pos = 0;
+  filter->encode = encode;
+  filter->position = 0;
+  memset(filter->history, 0, sizeof(filter->history));
+  return BROTLI_TRUE;
+}
+
+static size_t DeltaFilter(BrotliFilter* f, uint8_t* data, size_t size) {
+  const size_t distance = f->param;
+  size_t pos = f->history_pos;
+  size_t i;
+  if (f->encode) {
+    for (i = 0; i < size; ++i) {
+      uint8_t raw = data[i];
+      data[i] = (uint8_t)(raw - f->history[pos]);
+      f->history[pos] = raw;
+      if (++pos == distance) pos = 0;
+    }
+  } else {
+    for (i = 0; i < size; ++i) {
+      uint8_t raw = (uint8_t)(data[i] + f->history[pos]);
+      data[i] = raw;
+      f->history[pos] = raw;
+      if (++pos == distance) pos = 0;
+    }
+  }
+  f->history_pos = (uint8_t)pos;
+  return size;
+}
+
+/* CALL (E8) and JMP (E9) with 32-bit relative target. Only targets in
+   +-16MiB range are converted; the result is kept in the same range, so that
+   the decoder makes the same decisions looking at the filtered data. Operand
+   is skipped even if it is not converted; otherwise the next decision could
+   look at the bytes that are modified afterwards. */
+static size_t X86Filter(BrotliFilter* f, uint8_t* data, size_t size,
+                        BROTLI_BOOL is_last) {
+  size_t i = 0;
+  if (size >= 5) {
+    const size_t limit = size - 4;
+    while (i < limit) {
+      uint8_t* p = &data[i];
+      if ((p[0] & 0xFE) != 0xE8) {
+        ++i;
+        continue;
+      }
+      if ((uint8_t)(p[4] + 1) <= 1) {
+        uint32_t pc = f->position + (uint32_t)i + 5;
+        uint32_t v = (uint32_t)p[1] | ((uint32_t)p[2] << 8) |
+            ((uint32_t)p[3] << 16) | ((uint32_t)p[4] << 24);
+        v = f->encode ? v + pc : v - pc;
+        v = ((v & 0x01FFFFFFu) ^ 0x01000000u) - 0x01000000u;
+        p[1] = (uint8_t)v;
+        p[2] = (uint8_t)(v >> 8);
+        p[3] = (uint8_t)(v >> 16);
+        p[4] = (uint8_t)(v >> 24);
+      }
+      i += 5;
+    }
+  }
+  if (is_last) i = size;
+  f->position += (uint32_t)i;
+  return i;
+}
+
+static size_t TransposeFilter(BrotliFilter* f, uint8_t* data, size_t size,
+                              uint8_t* scratch, BROTLI_BOOL is_last) {
+  const size_t stride = f->param;
+  const size_t block_size = (BROTLI_FILTER_BUFFER_SIZE / stride) * stride;
+  size_t done = 0;
+  while (size - done >= block_size || (is_last && done < size)) {
+    const size_t len = BROTLI_MIN(size_t, block_size, size - done);
+    /* Trailing incomplete record is left as is. */
+    const size_t rows = len / stride;
+    uint8_t* block = &data[done];
+    size_t r;
+    size_t c;
+    if (f->encode) {
+      for (r = 0; r < rows; ++r) {
+        for (c = 0; c < stride; ++c) {
+          scratch[c * rows + r] = block[r * stride + c];
+        }
+      }
+    } else {
+      for (r = 0; r < rows; ++r) {
+        for (c = 0; c < stride; ++c) {
+          scratch[r * stride + c] = block[c * rows + r];
+        }
+      }
+    }
+    memcpy(block, scratch, rows * stride);
+    done += len;
+  }
+  f->position += (uint32_t)done;
+  return done;
+}
+
+size_t BrotliFilterApply(BrotliFilter* filter,
+    uint8_t* data, size_t size, uint8_t* scratch, BROTLI_BOOL is_last) {
+  switch (filter->id) {
+    case BROTLI_FILTER_ID_DELTA:
+      return DeltaFilter(filter, data, size);
+
+    case BROTLI_FILTER_ID_TRANSPOSE:
+      return TransposeFilter(filter, data, size, scratch, is_last);
+
+    case BROTLI_FILTER_ID_X86:
+      return X86Filter(filter, data, size, is_last);
+
+    default:
+      filter->position += (uint32_t)size;
+      return size;
+  }
+}
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}  /* extern "C" */
+#endif
@@ -0,0 +1,77 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Reversible pre-filters applied to the data before compression and after
+   decompression.
+
+   Filtered data is wrapped into a tiny container: 4-byte header followed by
+   a regular brotli stream of the filtered data. The first header byte is
+   never a valid start of a brotli stream (it encodes the "large window"
+   marker with the reserved bit set), so containers are told apart from plain
+   streams by the first byte.
+
+     byte 0: BROTLI_FILTER_MAGIC
+     byte 1: BROTLI_FILTER_VERSION
+     byte 2: filter id
+     byte 3: filter parameter (delta distance / transposition stride)
+
+   Like transform.h, this is a part of ABI, but not API. */
+
+#ifndef BROTLI_COMMON_FILTER_H_
+#define BROTLI_COMMON_FILTER_H_
+
+#include <brotli/port.h>
+#include <brotli/types.h>
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+#define BROTLI_FILTER_MAGIC 0x91
+#define BROTLI_FILTER_VERSION 0x01
+#define BROTLI_FILTER_HEADER_SIZE 4
+
+/* Values match BrotliEncoderFilter. */
+#define BROTLI_FILTER_ID_NONE 0
+#define BROTLI_FILTER_ID_DELTA 1
+#define BROTLI_FILTER_ID_TRANSPOSE 2
+#define BROTLI_FILTER_ID_X86 3
+
+/* Size of buffers passed to BrotliFilterApply; transposition works in blocks
+   of (BROTLI_FILTER_BUFFER_SIZE / stride) records. */
+#define BROTLI_FILTER_BUFFER_SIZE (1u << 16)
+
+typedef struct BrotliFilter {
+  uint8_t id;
+  uint8_t param;
+  /* For BROTLI_FILTER_ID_DELTA: index of the oldest byte in |history|. */
+  uint8_t history_pos;
+  BROTLI_BOOL encode;
+  /* Number of bytes passed through filter; used by BROTLI_FILTER_ID_X86. */
+  uint32_t position;
+  /* For BROTLI_FILTER_ID_DELTA: last |param| unfiltered bytes. */
+  uint8_t history[256];
+} BrotliFilter;
+
+/* Returns BROTLI_FALSE if |id| / |param| combination is not supported. */
+BROTLI_COMMON_API BROTLI_BOOL BrotliFilterInit(
+    BrotliFilter* filter, int id, int param, BROTLI_BOOL encode);
+
+/* Filters (or unfilters) |data| in place. |scratch| should have room for
+   BROTLI_FILTER_BUFFER_SIZE bytes; |size| should not exceed that too.
+
+   Returns the number of leading bytes that are processed; remaining bytes
+   are left intact and should be passed again, followed by the rest of the
+   stream. Unless |is_last| is set, X86 filter keeps the last 4 bytes and
+   transposition keeps incomplete block. */
+BROTLI_COMMON_API size_t BrotliFilterApply(BrotliFilter* filter,
+    uint8_t* data, size_t size, uint8_t* scratch, BROTLI_BOOL is_last);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}  /* extern "C" */
+#endif
+
+#endif  /* BROTLI_COMMON_FILTER_H_ */
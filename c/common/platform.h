@@ -461,6 +461,14 @@ static BROTLI_INLINE void BROTLI_UNALIGNED_STORE64LE(void* p, uint64_t v) {
 #define BROTLI_IS_CONSTANT(x) (!!0)
 #endif
 
+/* BROTLI_PREFETCH hints that memory at given address is about to be read. */
+#if BROTLI_GNUC_HAS_BUILTIN(__builtin_prefetch, 3, 1, 0) || \
+    BROTLI_INTEL_VERSION_CHECK(16, 0, 0)
+#define BROTLI_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define BROTLI_PREFETCH(p)
+#endif
+
 #if defined(BROTLI_TARGET_ARMV7) || defined(BROTLI_TARGET_ARMV8_ANY)
 #define BROTLI_HAS_UBFX (!!1)
 #else
@@ -12,6 +12,7 @@
 #include "../common/constants.h"
 #include "../common/context.h"
 #include "../common/dictionary.h"
+#include "../common/filter.h"
 #include "../common/platform.h"
 #include "../common/transform.h"
 #include "../common/version.h"
@@ -40,11 +41,16 @@ extern "C" {
 #define HUFFMAN_TABLE_MASK 0xFF
 
 /* We need the slack region for the following reasons:
-    - doing up to two 16-byte copies for fast backward copying
+    - doing 16-byte block copies for fast backward copying; the last block
+      may overrun the end of a copy by up to 15 bytes
     - inserting transformed dictionary word:
         5 prefix + 24 base + 8 suffix */
 static const uint32_t kRingBufferWriteAheadSlack = 42;
 
+/* BrotliFillBitWindow16 leaves at least 32 (16) bits in the accumulator;
+   a code length with extra bits takes up to 8 of them. */
+#define BROTLI_CODE_LENGTHS_PER_FILL (BROTLI_64_BITS ? 4 : 2)
+
 static const uint8_t kCodeLengthCodeOrder[BROTLI_CODE_LENGTH_CODES] = {
   1, 2, 3, 4, 0, 5, 17, 6, 16, 7, 8, 9, 10, 11, 12, 13, 14, 15,
 };
@@ -70,6 +76,11 @@ BROTLI_BOOL BrotliDecoderSetParameter(
       state->large_window = TO_BROTLI_BOOL(!!value);
       return BROTLI_TRUE;
 
+    case BROTLI_DECODER_PARAM_FILTERS:
+      state->substate_filter = !!value ?
+          BROTLI_STATE_FILTER_NONE : BROTLI_STATE_FILTER_DISABLED;
+      return BROTLI_TRUE;
+
     default: return BROTLI_FALSE;
   }
 }
@@ -514,18 +525,23 @@ static BrotliDecoderErrorCode ReadSimpleHuffmanSymbols(
     B) remember code length (if it is not 0)
     C) extend corresponding index-chain
     D) reduce the Huffman space
-    E) update the histogram */
+    E) update the histogram
+
+   Symbols with zero code length are chained to the list 0 and counted in
+   histogram[0]; neither is used when the table is built, but that way the
+   hot path has no data-dependent branches. */
 static BROTLI_INLINE void ProcessSingleCodeLength(uint32_t code_len,
     uint32_t* symbol, uint32_t* repeat, uint32_t* space,
     uint32_t* prev_code_len, uint16_t* symbol_lists,
     uint16_t* code_length_histo, int* next_symbol) {
   *repeat = 0;
-  if (code_len != 0) {  /* code_len == 1..15 */
-    symbol_lists[next_symbol[code_len]] = (uint16_t)(*symbol);
-    next_symbol[code_len] = (int)(*symbol);
-    *prev_code_len = code_len;
-    *space -= 32768U >> code_len;
-    code_length_histo[code_len]++;
+  symbol_lists[next_symbol[code_len]] = (uint16_t)(*symbol);
+  next_symbol[code_len] = (int)(*symbol);
+  *prev_code_len = (code_len != 0) ? code_len : *prev_code_len;
+  /* 32768 >> 0 is masked out. */
+  *space -= (32768U >> code_len) & 0x7FFFU;
+  code_length_histo[code_len]++;
+  if (code_len != 0) {
     BROTLI_LOG(("[ReadHuffmanCode] code_length[%d] = %d\n",
         (int)*symbol, (int)code_len));
   }
@@ -606,9 +622,7 @@ static BrotliDecoderErrorCode ReadSymbolCodeLengths(
     return BROTLI_DECODER_NEEDS_MORE_INPUT;
   }
   while (symbol < alphabet_size && space > 0) {
-    const HuffmanCode* p = h->table;
-    uint32_t code_len;
-    BROTLI_HC_MARK_TABLE_FOR_FAST_LOAD(p);
+    uint32_t batch = BROTLI_CODE_LENGTHS_PER_FILL;
     if (!BrotliCheckInputAmount(br, BROTLI_SHORT_FILL_BIT_WINDOW_READ)) {
       h->symbol = symbol;
       h->repeat = repeat;
@@ -618,23 +632,30 @@ static BrotliDecoderErrorCode ReadSymbolCodeLengths(
       return BROTLI_DECODER_NEEDS_MORE_INPUT;
     }
     BrotliFillBitWindow16(br);
-    BROTLI_HC_ADJUST_TABLE_INDEX(p, BrotliGetBitsUnmasked(br) &
-        BitMask(BROTLI_HUFFMAN_MAX_CODE_LENGTH_CODE_LENGTH));
-    BrotliDropBits(br, BROTLI_HC_FAST_LOAD_BITS(p));  /* Use 1..5 bits. */
-    code_len = BROTLI_HC_FAST_LOAD_VALUE(p);  /* code_len == 0..17 */
-    if (code_len < BROTLI_REPEAT_PREVIOUS_CODE_LENGTH) {
-      ProcessSingleCodeLength(code_len, &symbol, &repeat, &space,
-          &prev_code_len, symbol_lists, code_length_histo, next_symbol);
-    } else {  /* code_len == 16..17, extra_bits == 2..3 */
-      uint32_t extra_bits =
-          (code_len == BROTLI_REPEAT_PREVIOUS_CODE_LENGTH) ? 2 : 3;
-      uint32_t repeat_delta =
-          (uint32_t)BrotliGetBitsUnmasked(br) & BitMask(extra_bits);
-      BrotliDropBits(br, extra_bits);
-      ProcessRepeatedCodeLength(code_len, repeat_delta, alphabet_size,
-          &symbol, &repeat, &space, &prev_code_len, &repeat_code_len,
-          symbol_lists, code_length_histo, next_symbol);
-    }
+    /* Each code length with its extra bits takes at most 8 bits; decode as
+       many of them as the accumulator is guaranteed to hold. */
+    do {
+      const HuffmanCode* p = h->table;
+      uint32_t code_len;
+      BROTLI_HC_MARK_TABLE_FOR_FAST_LOAD(p);
+      BROTLI_HC_ADJUST_TABLE_INDEX(p, BrotliGetBitsUnmasked(br) &
+          BitMask(BROTLI_HUFFMAN_MAX_CODE_LENGTH_CODE_LENGTH));
+      BrotliDropBits(br, BROTLI_HC_FAST_LOAD_BITS(p));  /* Use 1..5 bits. */
+      code_len = BROTLI_HC_FAST_LOAD_VALUE(p);  /* code_len == 0..17 */
+      if (code_len < BROTLI_REPEAT_PREVIOUS_CODE_LENGTH) {
+        ProcessSingleCodeLength(code_len, &symbol, &repeat, &space,
+            &prev_code_len, symbol_lists, code_length_histo, next_symbol);
+      } else {  /* code_len == 16..17, extra_bits == 2..3 */
+        uint32_t extra_bits =
+            (code_len == BROTLI_REPEAT_PREVIOUS_CODE_LENGTH) ? 2 : 3;
+        uint32_t repeat_delta =
+            (uint32_t)BrotliGetBitsUnmasked(br) & BitMask(extra_bits);
+        BrotliDropBits(br, extra_bits);
+        ProcessRepeatedCodeLength(code_len, repeat_delta, alphabet_size,
+            &symbol, &repeat, &space, &prev_code_len, &repeat_code_len,
+            symbol_lists, code_length_histo, next_symbol);
+      }
+    } while (--batch != 0 && symbol < alphabet_size && space > 0);
   }
   h->space = space;
   return BROTLI_DECODER_SUCCESS;
@@ -919,14 +940,14 @@ static BROTLI_INLINE BROTLI_BOOL SafeReadBlockLength(
    To reduce the cost of initialization, we reuse L, remember the upper bound
    of Y values, and reinitialize only first elements in L.
 
-   Most of input values are 0 and 1. To reduce number of branches, we replace
-   inner for loop with do-while. */
+   Most of input values are small, so the first 8 elements of L are shifted
+   as a single 64-bit word, without a per-element loop. */
 static BROTLI_NOINLINE void InverseMoveToFrontTransform(
     uint8_t* v, uint32_t v_len, BrotliDecoderState* state) {
   /* Reinitialize elements that could have been changed. */
   uint32_t i = 1;
   uint32_t upper_bound = state->mtf_upper_bound;
-  uint32_t* mtf = &state->mtf[1];  /* Make mtf[-1] addressable. */
+  uint32_t* mtf = state->mtf;
   uint8_t* mtf_u8 = (uint8_t*)mtf;
   /* Load endian-aware constant. */
   const uint8_t b0123[4] = {0, 1, 2, 3};
@@ -944,15 +965,20 @@ static BROTLI_NOINLINE void InverseMoveToFrontTransform(
   /* Transform the input. */
   upper_bound = 0;
   for (i = 0; i < v_len; ++i) {
-    int index = v[i];
+    uint32_t index = v[i];
     uint8_t value = mtf_u8[index];
-    upper_bound |= v[i];
+    upper_bound |= index;
     v[i] = value;
-    mtf_u8[-1] = value;
-    do {
-      index--;
-      mtf_u8[index + 1] = mtf_u8[index];
-    } while (index >= 0);
+    if (index < 8) {
+      /* Bytes 0..index are moved up by one, the rest of the word is kept. */
+      uint64_t head = BROTLI_UNALIGNED_LOAD64LE(mtf_u8);
+      uint64_t mask = ((uint64_t)2 << (8 * index + 7)) - 1;
+      head = (((head << 8) | value) & mask) | (head & ~mask);
+      BROTLI_UNALIGNED_STORE64LE(mtf_u8, head);
+    } else {
+      memmove(&mtf_u8[1], mtf_u8, index);
+      mtf_u8[0] = value;
+    }
   }
   /* Remember amount of elements to be reinitialized. */
   state->mtf_upper_bound = upper_bound >> 2;
@@ -980,6 +1006,54 @@ static BrotliDecoderErrorCode HuffmanTreeGroupDecode(
   return BROTLI_DECODER_SUCCESS;
 }
 
+/* Reorders literal Huffman tables so that tables referenced by more contexts
+   come first and lie next to each other. Tables are moved as a whole (root
+   table along with its 2nd level tables), so the relative offsets stored in
+   root entries remain valid. Small groups fit the L1 cache anyway and are left
+   as is; if memory for the copy can not be allocated, nothing is changed. */
+static void PackLiteralHuffmanTables(BrotliDecoderState* s, HuffmanCode* end) {
+  HuffmanTreeGroup* group = &s->literal_hgroup;
+  uint32_t num_htrees = group->num_htrees;
+  size_t num_contexts =
+      (size_t)s->num_block_types[0] << BROTLI_LITERAL_CONTEXT_BITS;
+  size_t used = (size_t)(end - group->codes);
+  uint32_t uses[BROTLI_MAX_NUMBER_OF_BLOCK_TYPES];
+  uint32_t sizes[BROTLI_MAX_NUMBER_OF_BLOCK_TYPES];
+  uint8_t order[BROTLI_MAX_NUMBER_OF_BLOCK_TYPES];
+  HuffmanCode* copy;
+  HuffmanCode* next;
+  BROTLI_BOOL sorted = BROTLI_TRUE;
+  uint32_t i;
+  if (num_htrees < 2 || used * sizeof(HuffmanCode) <= 16384) return;
+  memset(uses, 0, num_htrees * sizeof(uses[0]));
+  for (i = 0; i < num_contexts; ++i) ++uses[s->context_map[i]];
+  /* Stable insertion sort by descending number of uses. */
+  for (i = 0; i < num_htrees; ++i) {
+    uint32_t j = i;
+    while (j > 0 && uses[order[j - 1]] < uses[i]) {
+      order[j] = order[j - 1];
+      --j;
+    }
+    order[j] = (uint8_t)i;
+    if (j != i) sorted = BROTLI_FALSE;
+    sizes[i] = (uint32_t)(((i + 1 < num_htrees) ? group->htrees[i + 1] : end) -
+        group->htrees[i]);
+  }
+  if (sorted) return;
+  copy = (HuffmanCode*)BROTLI_DECODER_ALLOC(s, used * sizeof(HuffmanCode));
+  if (copy == 0) return;
+  memcpy(copy, group->codes, used * sizeof(HuffmanCode));
+  next = group->codes;
+  for (i = 0; i < num_htrees; ++i) {
+    uint32_t k = order[i];
+    HuffmanCode* table = copy + (group->htrees[k] - group->codes);
+    memcpy(next, table, sizes[k] * sizeof(HuffmanCode));
+    group->htrees[k] = next;
+    next += sizes[k];
+  }
+  BROTLI_DECODER_FREE(s, copy);
+}
+
 /* Decodes a context map.
    Decoding is done in 4 phases:
     1) Read auxiliary information (6..16 bits) and allocate memory.
@@ -1053,6 +1127,28 @@ static BrotliDecoderErrorCode DecodeContextMap(uint32_t context_map_size,
       uint8_t* context_map = *context_map_arg;
       uint32_t code = h->code;
       BROTLI_BOOL skip_preamble = (code != 0xFFFF);
+      /* Fast path: each item takes at most 15 + 16 bits; while there is
+         enough input, decode without saving state after each of them. */
+      if (!skip_preamble && BrotliWarmupBitReader(br)) {
+        while (context_index < context_map_size &&
+            BrotliCheckInputAmount(br, 16)) {
+          code = ReadSymbol(h->context_map_table, br);
+          if (code == 0) {
+            context_map[context_index++] = 0;
+          } else if (code > max_run_length_prefix) {
+            context_map[context_index++] =
+                (uint8_t)(code - max_run_length_prefix);
+          } else {
+            uint32_t reps = (1U << code) + BrotliReadBits24(br, code);
+            if (context_index + reps > context_map_size) {
+              return BROTLI_FAILURE(
+                  BROTLI_DECODER_ERROR_FORMAT_CONTEXT_MAP_REPEAT);
+            }
+            memset(&context_map[context_index], 0, reps);
+            context_index += reps;
+          }
+        }
+      }
       while (context_index < context_map_size || skip_preamble) {
         if (!skip_preamble) {
           if (!SafeReadSymbol(h->context_map_table, br, &code)) {
@@ -1188,6 +1284,14 @@ static BROTLI_INLINE void PrepareLiteralDecoding(BrotliDecoderState* s) {
   trivial = s->trivial_literal_contexts[block_type >> 5];
   s->trivial_literal_context = (trivial >> (block_type & 31)) & 1;
   s->literal_htree = s->literal_hgroup.htrees[s->context_map_slice[0]];
+  if (!s->trivial_literal_context) {
+    HuffmanCode** htrees = s->literal_hgroup.htrees;
+    const uint8_t* slice = s->context_map_slice;
+    size_t i;
+    for (i = 0; i < (1u << BROTLI_LITERAL_CONTEXT_BITS); ++i) {
+      s->literal_context_htrees[i] = htrees[slice[i]];
+    }
+  }
   context_mode = s->context_modes[block_type] & 3;
   s->context_lookup = BROTLI_CONTEXT_LUT(context_mode);
 }
@@ -1838,7 +1942,7 @@ CommandInner:
       }
       context = BROTLI_CONTEXT(p1, p2, s->context_lookup);
       BROTLI_LOG_UINT(context);
-      hc = s->literal_hgroup.htrees[s->context_map_slice[context]];
+      hc = s->literal_context_htrees[context];
       p2 = p1;
       if (!safe) {
         p1 = (uint8_t)ReadSymbol(hc, br);
@@ -1958,6 +2062,7 @@ CommandPostDecodeLiterals:
     uint8_t* copy_src = &s->ringbuffer[src_start];
     int dst_end = pos + i;
     int src_end = src_start + i;
+    int j;
     /* Update the recent distances cache. */
     s->dist_rb[s->dist_rb_idx & 3] = s->distance_code;
     ++s->dist_rb_idx;
@@ -1966,22 +2071,41 @@ CommandPostDecodeLiterals:
        Also, we have 16 short codes, that make these 16 bytes irrelevant
        in the ring-buffer. Let's copy over them as a first guess. */
     memmove16(copy_dst, copy_src);
-    if (src_end > pos && dst_end > src_start) {
-      /* Regions intersect. */
-      goto CommandPostWrapCopy;
-    }
     if (dst_end >= s->ringbuffer_size || src_end >= s->ringbuffer_size) {
       /* At least one region wraps. */
       goto CommandPostWrapCopy;
     }
-    pos += i;
-    if (i > 16) {
-      if (i > 32) {
-        memcpy(copy_dst + 16, copy_src + 16, (size_t)(i - 16));
-      } else {
-        /* This branch covers about 45% cases.
-           Fixed size short copy allows more compiler optimizations. */
-        memmove16(copy_dst + 16, copy_src + 16);
+    if (src_end > pos && dst_end > src_start) {
+      /* Regions intersect. */
+      if (src_start > pos) {
+        goto CommandPostWrapCopy;
+      }
+      pos += i;
+      if (s->distance_code < 16) {
+        /* Output repeats with the period |distance_code|; expand the first
+           16 bytes and continue with the smallest multiple of the period
+           that is not less than 16, so that blocks never read ahead. */
+        int distance = s->distance_code;
+        for (j = distance; j < 16; ++j) {
+          copy_dst[j] = copy_dst[j - distance];
+        }
+        copy_src = copy_dst - ((15 + distance) / distance) * distance;
+      }
+      /* Over-copy in whole blocks; the tail lands on the irrelevant bytes
+         mentioned above. */
+      for (j = 16; j < i; j += 16) {
+        memmove16(copy_dst + j, copy_src + j);
+      }
+    } else {
+      pos += i;
+      if (i > 16) {
+        if (i > 32) {
+          memcpy(copy_dst + 16, copy_src + 16, (size_t)(i - 16));
+        } else {
+          /* This branch covers about 45% cases.
+             Fixed size short copy allows more compiler optimizations. */
+          memmove16(copy_dst + 16, copy_src + 16);
+        }
       }
     }
   }
@@ -2055,6 +2179,18 @@ BrotliDecoderResult BrotliDecoderDecompress(
   return result;
 }
 
+/* Calculates the number of stream bits consumed so far. |input_size| is the
+   value of |*available_in| on entry to BrotliDecoderDecompressStream. */
+static uint64_t GetStreamBitOffset(const BrotliDecoderState* s,
+    size_t input_size, size_t available_in) {
+  uint64_t consumed = s->consumed_input + input_size - s->br.avail_in;
+  if (s->buffer_length != 0) {
+    /* Bytes taken into internal buffer are already subtracted. */
+    consumed -= available_in;
+  }
+  return (consumed << 3) - BrotliGetAvailableBits(&s->br);
+}
+
 /* Invariant: input stream is never overconsumed:
     - invalid input implies that the whole stream is invalid -> any amount of
       input could be read and discarded
@@ -2066,11 +2202,12 @@ BrotliDecoderResult BrotliDecoderDecompress(
       buffer ahead of time
     - when result is "success" decoder MUST return all unused data back to input
       buffer; this is possible because the invariant is held on enter */
-BrotliDecoderResult BrotliDecoderDecompressStream(
+static BrotliDecoderResult DecompressStream(
     BrotliDecoderState* s, size_t* available_in, const uint8_t** next_in,
     size_t* available_out, uint8_t** next_out, size_t* total_out) {
   BrotliDecoderErrorCode result = BROTLI_DECODER_SUCCESS;
   BrotliBitReader* br = &s->br;
+  size_t input_size = *available_in;
   /* Ensure that |total_out| is set, even if no data will ever be pushed out. */
   if (total_out) {
     *total_out = s->partial_pos_out;
@@ -2217,6 +2354,8 @@ BrotliDecoderResult BrotliDecoderDecompressStream(
 
       case BROTLI_STATE_METABLOCK_BEGIN:
         BrotliDecoderStateMetablockBegin(s);
+        s->metablock_offset =
+            GetStreamBitOffset(s, input_size, *available_in);
         BROTLI_LOG_UINT(s->pos);
         s->state = BROTLI_STATE_METABLOCK_HEADER;
       /* Fall through. */
@@ -2230,6 +2369,18 @@ BrotliDecoderResult BrotliDecoderDecompressStream(
         BROTLI_LOG_UINT(s->meta_block_remaining_len);
         BROTLI_LOG_UINT(s->is_metadata);
         BROTLI_LOG_UINT(s->is_uncompressed);
+        if (s->is_last_metablock) {
+          /* ISLAST + ISEMPTY + MNIBBLES + MLEN-1 has the same length as
+             ISLAST + MNIBBLES + MLEN-1 + ISUNCOMPRESSED. */
+          if (s->meta_block_remaining_len == 0) {
+            s->append_header = 0;
+            s->append_header_bits = 0;
+          } else {
+            s->append_header = ((uint32_t)(s->size_nibbles - 4) << 1) |
+                ((uint32_t)(s->meta_block_remaining_len - 1) << 3);
+            s->append_header_bits = 4 + 4 * (uint32_t)s->size_nibbles;
+          }
+        }
         if (s->is_metadata || s->is_uncompressed) {
           if (!BrotliJumpToByteBoundary(br)) {
             result = BROTLI_FAILURE(BROTLI_DECODER_ERROR_FORMAT_PADDING_1);
@@ -2433,6 +2584,9 @@ BrotliDecoderResult BrotliDecoderDecompressStream(
         }
         result = HuffmanTreeGroupDecode(hgroup, s);
         if (result != BROTLI_DECODER_SUCCESS) break;
+        if (s->loop_counter == 0) {
+          PackLiteralHuffmanTables(s, s->arena.header.next);
+        }
         s->loop_counter++;
         if (s->loop_counter < 3) {
           break;
@@ -2513,6 +2667,7 @@ BrotliDecoderResult BrotliDecoderDecompressStream(
           s->state = BROTLI_STATE_METABLOCK_BEGIN;
           break;
         }
+        s->end_offset = GetStreamBitOffset(s, input_size, *available_in);
         if (!BrotliJumpToByteBoundary(br)) {
           result = BROTLI_FAILURE(BROTLI_DECODER_ERROR_FORMAT_PADDING_2);
           break;
@@ -2533,22 +2688,170 @@ BrotliDecoderResult BrotliDecoderDecompressStream(
             break;
           }
         }
+        s->consumed_input += input_size - *available_in;
         return SaveErrorCode(s, result);
     }
   }
+  s->consumed_input += input_size - *available_in;
   return SaveErrorCode(s, result);
 }
 
+static BrotliDecoderErrorCode ReadFilterHeader(BrotliDecoderState* s,
+    size_t* available_in, const uint8_t** next_in) {
+  while (s->filter_header_length < BROTLI_FILTER_HEADER_SIZE) {
+    if (*available_in == 0) return BROTLI_DECODER_NEEDS_MORE_INPUT;
+    s->filter_header[s->filter_header_length++] = **next_in;
+    (*next_in)++;
+    (*available_in)--;
+    s->consumed_input++;
+  }
+  if (s->filter_header[1] != BROTLI_FILTER_VERSION ||
+      !BrotliFilterInit(&s->filter, s->filter_header[2], s->filter_header[3],
+                        BROTLI_FALSE)) {
+    return BROTLI_FAILURE(BROTLI_DECODER_ERROR_FORMAT_FILTER);
+  }
+  s->filter_buffer = (uint8_t*)BROTLI_DECODER_ALLOC(s,
+      2 * (size_t)BROTLI_FILTER_BUFFER_SIZE);
+  if (s->filter_buffer == 0) {
+    return BROTLI_FAILURE(BROTLI_DECODER_ERROR_ALLOC_FILTER_BUFFER);
+  }
+  s->substate_filter = BROTLI_STATE_FILTER_ACTIVE;
+  return BROTLI_DECODER_SUCCESS;
+}
+
+/* Drops the bytes passed to the client and unfilters the new ones. */
+static void UnfilterBuffer(BrotliDecoderState* s, BROTLI_BOOL is_last) {
+  uint8_t* buffer = s->filter_buffer;
+  if (s->filter_ready != 0) {
+    memmove(buffer, buffer + s->filter_ready, s->filter_size - s->filter_ready);
+    s->filter_size -= s->filter_ready;
+    s->filter_ready = 0;
+    s->filter_taken = 0;
+  }
+  s->filter_ready = BrotliFilterApply(&s->filter, buffer, s->filter_size,
+      buffer + BROTLI_FILTER_BUFFER_SIZE, is_last);
+}
+
+/* Regular stream is decoded into |filter_buffer|. */
+static BrotliDecoderResult DecompressStreamFiltered(
+    BrotliDecoderState* s, size_t* available_in, const uint8_t** next_in,
+    size_t* available_out, uint8_t** next_out, size_t* total_out) {
+  if (total_out) *total_out = s->filter_pos_out;
+  if ((int)s->error_code < 0) return BROTLI_DECODER_RESULT_ERROR;
+  if (*available_out && (!next_out || !*next_out)) {
+    return SaveErrorCode(
+        s, BROTLI_FAILURE(BROTLI_DECODER_ERROR_INVALID_ARGUMENTS));
+  }
+  if (s->substate_filter == BROTLI_STATE_FILTER_HEADER) {
+    BrotliDecoderErrorCode status = ReadFilterHeader(s, available_in, next_in);
+    if (status != BROTLI_DECODER_SUCCESS) return SaveErrorCode(s, status);
+  }
+  for (;;) {
+    BrotliDecoderResult result;
+    size_t available = s->filter_ready - s->filter_taken;
+    uint8_t* out;
+    if (available != 0 && *available_out != 0) {
+      available = BROTLI_MIN(size_t, available, *available_out);
+      memcpy(*next_out, s->filter_buffer + s->filter_taken, available);
+      *next_out += available;
+      *available_out -= available;
+      s->filter_taken += available;
+      s->filter_pos_out += available;
+      if (total_out) *total_out = s->filter_pos_out;
+    }
+    if (s->filter_taken != s->filter_ready) {
+      return SaveErrorCode(s, BROTLI_DECODER_NEEDS_MORE_OUTPUT);
+    }
+    UnfilterBuffer(s, BROTLI_FALSE);
+    available = BROTLI_FILTER_BUFFER_SIZE - s->filter_size;
+    out = s->filter_buffer + s->filter_size;
+    result = DecompressStream(s, available_in, next_in, &available, &out, 0);
+    if (result == BROTLI_DECODER_RESULT_ERROR) return result;
+    s->filter_size = BROTLI_FILTER_BUFFER_SIZE - available;
+    UnfilterBuffer(s, TO_BROTLI_BOOL(result == BROTLI_DECODER_RESULT_SUCCESS));
+    if (s->filter_ready == 0) {
+      /* Full buffer is always processed. */
+      if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT) {
+        return SaveErrorCode(s,
+            BROTLI_FAILURE(BROTLI_DECODER_ERROR_UNREACHABLE));
+      }
+      return result;
+    }
+  }
+}
+
+BrotliDecoderResult BrotliDecoderDecompressStream(
+    BrotliDecoderState* s, size_t* available_in, const uint8_t** next_in,
+    size_t* available_out, uint8_t** next_out, size_t* total_out) {
+  if (s->substate_filter == BROTLI_STATE_FILTER_NONE && *available_in != 0) {
+    s->substate_filter = (**next_in == BROTLI_FILTER_MAGIC) ?
+        BROTLI_STATE_FILTER_HEADER : BROTLI_STATE_FILTER_PLAIN;
+  }
+  if (s->substate_filter == BROTLI_STATE_FILTER_HEADER ||
+      s->substate_filter == BROTLI_STATE_FILTER_ACTIVE) {
+    return DecompressStreamFiltered(
+        s, available_in, next_in, available_out, next_out, total_out);
+  }
+  return DecompressStream(
+      s, available_in, next_in, available_out, next_out, total_out);
+}
+
+BrotliDecoderResult BrotliDecoderDecompressStreamVec(
+    BrotliDecoderState* s, BrotliInputSegment* input, size_t num_input,
+    BrotliOutputSegment* output, size_t num_output, size_t* total_out) {
+  size_t i = 0;
+  size_t j = 0;
+  for (;;) {
+    BrotliDecoderResult result;
+    size_t available_in = 0;
+    const uint8_t* next_in = NULL;
+    size_t available_out = 0;
+    uint8_t* next_out = NULL;
+    while (i < num_input && input[i].size == 0) ++i;
+    while (j < num_output && output[j].size == 0) ++j;
+    if (i < num_input) {
+      available_in = input[i].size;
+      next_in = input[i].data;
+    }
+    if (j < num_output) {
+      available_out = output[j].size;
+      next_out = output[j].data;
+    }
+    result = BrotliDecoderDecompressStream(
+        s, &available_in, &next_in, &available_out, &next_out, total_out);
+    if (i < num_input) {
+      input[i].size = available_in;
+      input[i].data = next_in;
+    }
+    if (j < num_output) {
+      output[j].size = available_out;
+      output[j].data = next_out;
+    }
+    /* Move on to the next segment only if current one is depleted; otherwise
+       the decoder is blocked for some other reason. */
+    if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT &&
+        i < num_input && available_in == 0) {
+      continue;
+    }
+    if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT &&
+        j < num_output && available_out == 0) {
+      continue;
+    }
+    return result;
+  }
+}
+
 BROTLI_BOOL BrotliDecoderHasMoreOutput(const BrotliDecoderState* s) {
   /* After unrecoverable error remaining output is considered nonsensical. */
   if ((int)s->error_code < 0) {
     return BROTLI_FALSE;
   }
+  if (s->filter_taken != s->filter_ready) return BROTLI_TRUE;
   return TO_BROTLI_BOOL(
       s->ringbuffer != 0 && UnwrittenBytes(s, BROTLI_FALSE) != 0);
 }
 
-const uint8_t* BrotliDecoderTakeOutput(BrotliDecoderState* s, size_t* size) {
+static const uint8_t* TakeOutput(BrotliDecoderState* s, size_t* size) {
   uint8_t* result = 0;
   size_t available_out = *size ? *size : 1u << 24;
   size_t requested_out = available_out;
@@ -2573,6 +2876,36 @@ const uint8_t* BrotliDecoderTakeOutput(BrotliDecoderState* s, size_t* size) {
   return result;
 }
 
+const uint8_t* BrotliDecoderTakeOutput(BrotliDecoderState* s, size_t* size) {
+  const uint8_t* result;
+  size_t available;
+  if (s->substate_filter != BROTLI_STATE_FILTER_ACTIVE) {
+    return TakeOutput(s, size);
+  }
+  if ((int)s->error_code < 0) {
+    *size = 0;
+    return 0;
+  }
+  if (s->filter_taken == s->filter_ready) {
+    UnfilterBuffer(s, BROTLI_FALSE);
+    available = BROTLI_FILTER_BUFFER_SIZE - s->filter_size;
+    if (available != 0) {
+      const uint8_t* data = TakeOutput(s, &available);
+      if (data) memcpy(s->filter_buffer + s->filter_size, data, available);
+      s->filter_size += available;
+    }
+    UnfilterBuffer(s, TO_BROTLI_BOOL(s->state == BROTLI_STATE_DONE &&
+        !BrotliDecoderHasMoreOutput(s)));
+  }
+  available = s->filter_ready - s->filter_taken;
+  if (*size) available = BROTLI_MIN(size_t, available, *size);
+  result = available ? s->filter_buffer + s->filter_taken : 0;
+  s->filter_taken += available;
+  s->filter_pos_out += available;
+  *size = available;
+  return result;
+}
+
 BROTLI_BOOL BrotliDecoderIsUsed(const BrotliDecoderState* s) {
   return TO_BROTLI_BOOL(s->state != BROTLI_STATE_UNINITED ||
       BrotliGetAvailableBits(&s->br) != 0);
@@ -2580,7 +2913,92 @@ BROTLI_BOOL BrotliDecoderIsUsed(const BrotliDecoderState* s) {
 
 BROTLI_BOOL BrotliDecoderIsFinished(const BrotliDecoderState* s) {
   return TO_BROTLI_BOOL(s->state == BROTLI_STATE_DONE) &&
-      !BrotliDecoderHasMoreOutput(s);
+      !BrotliDecoderHasMoreOutput(s) && s->filter_taken == s->filter_size;
+}
+
+BROTLI_BOOL BrotliDecoderGetAppendPoint(const BrotliDecoderState* s,
+    uint32_t* window_bits, BROTLI_BOOL* large_window, uint64_t* header_offset,
+    uint32_t* header, uint32_t* header_bits, uint64_t* end_offset) {
+  if (s->state != BROTLI_STATE_DONE) return BROTLI_FALSE;
+  *window_bits = s->window_bits;
+  *large_window = TO_BROTLI_BOOL(s->large_window);
+  *header_offset = s->metablock_offset;
+  *header = s->append_header;
+  *header_bits = s->append_header_bits;
+  /* Empty last meta-block is just dropped. */
+  *end_offset = s->append_header_bits ? s->end_offset : s->metablock_offset;
+  return BROTLI_TRUE;
+}
+
+/* Reads |n_bits| starting at bit |*pos|, unless input is too short. */
+static BROTLI_BOOL PeekBits(size_t size, const uint8_t* input, size_t* pos,
+                            uint32_t n_bits, uint32_t* value) {
+  uint32_t i;
+  if (*pos + n_bits > 8 * size) return BROTLI_FALSE;
+  *value = 0;
+  for (i = 0; i < n_bits; ++i, ++(*pos)) {
+    *value |= (uint32_t)((input[*pos >> 3] >> (*pos & 7)) & 1) << i;
+  }
+  return BROTLI_TRUE;
+}
+
+/* Finds the content size header; |*offset| is set to the byte offset of the
+   size value. */
+static BROTLI_BOOL FindContentSize(
+    size_t size, const uint8_t* input, size_t* offset) {
+  size_t pos = 0;
+  size_t skip = 0;
+  uint32_t bits;
+  uint32_t i;
+  if (size > 0 && input[0] == BROTLI_FILTER_MAGIC) {
+    if (size < BROTLI_FILTER_HEADER_SIZE) return BROTLI_FALSE;
+    skip = BROTLI_FILTER_HEADER_SIZE;
+    input += skip;
+    size -= skip;
+  }
+  /* Stream header: 1, 4, 7 or 14 bits, see DecodeWindowBits. */
+  if (!PeekBits(size, input, &pos, 1, &bits)) return BROTLI_FALSE;
+  if (bits != 0) {
+    if (!PeekBits(size, input, &pos, 3, &bits)) return BROTLI_FALSE;
+    if (bits == 0) {
+      if (!PeekBits(size, input, &pos, 3, &bits)) return BROTLI_FALSE;
+      if (bits == 1) pos += 7;
+    }
+  }
+  /* Meta-block header: ISLAST = 0, MNIBBLES = 0, reserved bit,
+     MSKIPBYTES = 1, MSKIPLEN - 1. */
+  if (!PeekBits(size, input, &pos, 6, &bits) || bits != (1u << 4 | 6u)) {
+    return BROTLI_FALSE;
+  }
+  if (!PeekBits(size, input, &pos, 8, &bits) ||
+      bits != BROTLI_CONTENT_SIZE_METADATA_LENGTH - 1) {
+    return BROTLI_FALSE;
+  }
+  pos = (pos + 7) >> 3;
+  if (pos + BROTLI_CONTENT_SIZE_METADATA_LENGTH > size) return BROTLI_FALSE;
+  for (i = 0; i < 4; ++i) {
+    if (input[pos + i] != (uint8_t)(BROTLI_CONTENT_SIZE_MAGIC >> (8 * i))) {
+      return BROTLI_FALSE;
+    }
+  }
+  *offset = skip + pos + 4;
+  return BROTLI_TRUE;
+}
+
+BROTLI_BOOL BrotliDecoderPeekContentSize(
+    size_t size, const uint8_t* input, uint64_t* content_size) {
+  size_t offset;
+  if (!FindContentSize(size, input, &offset)) return BROTLI_FALSE;
+  *content_size = BROTLI_UNALIGNED_LOAD64LE(&input[offset]);
+  return BROTLI_TRUE;
+}
+
+BROTLI_BOOL BrotliDecoderUpdateContentSize(
+    size_t size, uint8_t* input, uint64_t content_size) {
+  size_t offset;
+  if (!FindContentSize(size, input, &offset)) return BROTLI_FALSE;
+  BROTLI_UNALIGNED_STORE64LE(&input[offset], content_size);
+  return BROTLI_TRUE;
 }
 
 BrotliDecoderErrorCode BrotliDecoderGetErrorCode(const BrotliDecoderState* s) {
@@ -42,6 +42,19 @@ BROTLI_BOOL BrotliDecoderStateInit(BrotliDecoderState* s,
   s->pos = 0;
   s->rb_roundtrips = 0;
   s->partial_pos_out = 0;
+  s->consumed_input = 0;
+  s->metablock_offset = 0;
+  s->end_offset = 0;
+  s->append_header = 0;
+  s->append_header_bits = 0;
+
+  s->substate_filter = BROTLI_STATE_FILTER_DISABLED;
+  s->filter_header_length = 0;
+  s->filter_buffer = NULL;
+  s->filter_size = 0;
+  s->filter_ready = 0;
+  s->filter_taken = 0;
+  s->filter_pos_out = 0;
 
   s->block_type_trees = NULL;
   s->block_len_trees = NULL;
@@ -131,6 +144,7 @@ void BrotliDecoderStateCleanup(BrotliDecoderState* s) {
 
   BROTLI_DECODER_FREE(s, s->ringbuffer);
   BROTLI_DECODER_FREE(s, s->block_type_trees);
+  BROTLI_DECODER_FREE(s, s->filter_buffer);
 }
 
 BROTLI_BOOL BrotliDecoderHuffmanTreeGroupInit(BrotliDecoderState* s,
@@ -11,6 +11,7 @@
 
 #include "../common/constants.h"
 #include "../common/dictionary.h"
+#include "../common/filter.h"
 #include "../common/platform.h"
 #include "../common/transform.h"
 #include <brotli/types.h>
@@ -189,6 +190,14 @@ typedef enum {
   BROTLI_STATE_READ_BLOCK_LENGTH_SUFFIX
 } BrotliRunningReadBlockLengthState;
 
+typedef enum {
+  BROTLI_STATE_FILTER_DISABLED,
+  BROTLI_STATE_FILTER_NONE,
+  BROTLI_STATE_FILTER_HEADER,
+  BROTLI_STATE_FILTER_PLAIN,
+  BROTLI_STATE_FILTER_ACTIVE
+} BrotliRunningFilterState;
+
 typedef struct BrotliMetablockHeaderArena {
   BrotliRunningTreeGroupState substate_tree_group;
   BrotliRunningContextMapState substate_context_map;
@@ -292,6 +301,8 @@ struct BrotliDecoderStateStruct {
   uint8_t* dist_context_map;
   HuffmanCode* literal_htree;
   uint8_t dist_htree_index;
+  /* Literal Huffman tables of the current block type, indexed by context. */
+  HuffmanCode* literal_context_htrees[1 << BROTLI_LITERAL_CONTEXT_BITS];
 
   int copy_length;
   int distance_code;
@@ -302,7 +313,7 @@ struct BrotliDecoderStateStruct {
 
   /* For InverseMoveToFrontTransform. */
   uint32_t mtf_upper_bound;
-  uint32_t mtf[64 + 1];
+  uint32_t mtf[64];
 
   /* Less used attributes are at the end of this struct. */
 
@@ -332,6 +343,29 @@ struct BrotliDecoderStateStruct {
 
   uint32_t trivial_literal_contexts[8];  /* 256 bits */
 
+  /* For BrotliDecoderGetAppendPoint. */
+  uint64_t consumed_input;  /* input bytes taken by previous calls */
+  uint64_t metablock_offset;  /* bit offset of the current meta-block */
+  uint64_t end_offset;  /* bit offset of the stream end before padding */
+  uint32_t append_header;  /* non-last header replacing the last one */
+  uint32_t append_header_bits;
+
+  /* Pre-filter container; stream is decoded into |filter_buffer|, which is
+     unfiltered and only then passed to the client. */
+  BrotliRunningFilterState substate_filter;
+  uint32_t filter_header_length;
+  uint8_t filter_header[BROTLI_FILTER_HEADER_SIZE];
+  BrotliFilter filter;
+  /* BROTLI_FILTER_BUFFER_SIZE bytes of output followed by the same amount of
+     filter scratch space. */
+  uint8_t* filter_buffer;
+  size_t filter_size;
+  /* Leading |filter_ready| bytes are unfiltered; |filter_taken| of them are
+     already passed to the client. */
+  size_t filter_ready;
+  size_t filter_taken;
+  size_t filter_pos_out;  /* how much output to the user in total */
+
   union {
     BrotliMetablockHeaderArena header;
     BrotliMetablockBodyArena body;
@@ -46,6 +46,27 @@ static BROTLI_INLINE size_t ComputeDistanceCode(size_t distance,
   return distance + BROTLI_NUM_DISTANCE_SHORT_CODES - 1;
 }
 
+/* Replaces |sr| with the hinted match, if the latter has better score. */
+static BROTLI_INLINE BROTLI_BOOL ApplyMatchHints(const MatchHint* hints,
+    size_t num_hints, size_t* hint_ix, const uint8_t* ringbuffer,
+    size_t ringbuffer_mask, size_t position, size_t max_length,
+    size_t max_distance, HasherSearchResult* sr) {
+  size_t distance = 0;
+  size_t len = FindHintedMatch(hints, num_hints, hint_ix, ringbuffer,
+      ringbuffer_mask, position, max_length, max_distance, &distance);
+  if (len != 0) {
+    const score_t score = BackwardReferenceScore(len, distance);
+    if (score > sr->score) {
+      sr->len = len;
+      sr->len_code_delta = 0;
+      sr->distance = distance;
+      sr->score = score;
+      return BROTLI_TRUE;
+    }
+  }
+  return BROTLI_FALSE;
+}
+
 #define EXPAND_CAT(a, b) CAT(a, b)
 #define CAT(a, b) a ## b
 #define FN(X) EXPAND_CAT(X, HASHER())
@@ -78,6 +99,26 @@ static BROTLI_INLINE size_t ComputeDistanceCode(size_t distance,
 #include "./backward_references_inc.h"
 #undef HASHER
 
+#define HASHER() H12
+/* NOLINTNEXTLINE(build/include) */
+#include "./backward_references_inc.h"
+#undef HASHER
+
+#define HASHER() H13
+/* NOLINTNEXTLINE(build/include) */
+#include "./backward_references_inc.h"
+#undef HASHER
+
+#define HASHER() H14
+/* NOLINTNEXTLINE(build/include) */
+#include "./backward_references_inc.h"
+#undef HASHER
+
+#define HASHER() H15
+/* NOLINTNEXTLINE(build/include) */
+#include "./backward_references_inc.h"
+#undef HASHER
+
 #define HASHER() H40
 /* NOLINTNEXTLINE(build/include) */
 #include "./backward_references_inc.h"
@@ -123,15 +164,17 @@ static BROTLI_INLINE size_t ComputeDistanceCode(size_t distance,
 void BrotliCreateBackwardReferences(size_t num_bytes,
     size_t position, const uint8_t* ringbuffer, size_t ringbuffer_mask,
     ContextLut literal_context_lut, const BrotliEncoderParams* params,
-    Hasher* hasher, int* dist_cache, size_t* last_insert_len,
-    Command* commands, size_t* num_commands, size_t* num_literals) {
+    Hasher* hasher, const MatchHint* hints, size_t num_hints, int* dist_cache,
+    size_t* last_insert_len, Command* commands, size_t* num_commands,
+    size_t* num_literals) {
   switch (params->hasher.type) {
 #define CASE_(N)                                                  \
     case N:                                                       \
       CreateBackwardReferencesNH ## N(num_bytes,                  \
           position, ringbuffer, ringbuffer_mask,                  \
-          literal_context_lut, params, hasher, dist_cache,        \
-          last_insert_len, commands, num_commands, num_literals); \
+          literal_context_lut, params, hasher, hints, num_hints,  \
+          dist_cache, last_insert_len, commands, num_commands,    \
+          num_literals);                                          \
       return;
     FOR_GENERIC_HASHERS(CASE_)
 #undef CASE_
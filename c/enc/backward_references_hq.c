@@ -653,11 +653,29 @@ static size_t ZopfliIterate(size_t num_bytes, size_t position,
   return ComputeShortestPathFromNodes(num_bytes, nodes);
 }
 
+/* Appends the hinted match, if it is longer than the ones found. Returns the
+   new number of matches. */
+static size_t AddHintedMatch(const MatchHint* hints, size_t num_hints,
+    size_t* hint_ix, const uint8_t* ringbuffer, size_t ringbuffer_mask,
+    size_t pos, size_t max_length, size_t max_distance,
+    BackwardMatch* matches, size_t num_matches) {
+  size_t distance = 0;
+  size_t len = FindHintedMatch(hints, num_hints, hint_ix, ringbuffer,
+      ringbuffer_mask, pos, max_length, max_distance, &distance);
+  if (len == 0 || (num_matches != 0 &&
+      BackwardMatchLength(&matches[num_matches - 1]) >= len)) {
+    return num_matches;
+  }
+  InitBackwardMatch(&matches[num_matches], distance, len);
+  return num_matches + 1;
+}
+
 /* REQUIRES: nodes != NULL and len(nodes) >= num_bytes + 1 */
 size_t BrotliZopfliComputeShortestPath(MemoryManager* m, size_t num_bytes,
     size_t position, const uint8_t* ringbuffer, size_t ringbuffer_mask,
     ContextLut literal_context_lut, const BrotliEncoderParams* params,
-    const int* dist_cache, Hasher* hasher, ZopfliNode* nodes) {
+    const int* dist_cache, Hasher* hasher, const MatchHint* hints,
+    size_t num_hints, ZopfliNode* nodes) {
   const size_t stream_offset = params->stream_offset;
   const size_t max_backward_limit = BROTLI_MAX_BACKWARD_LIMIT(params->lgwin);
   const size_t max_zopfli_len = MaxZopfliLen(params);
@@ -669,6 +687,7 @@ size_t BrotliZopfliComputeShortestPath(MemoryManager* m, size_t num_bytes,
   size_t i;
   size_t gap = 0;
   size_t lz_matches_offset = 0;
+  size_t hint_ix = 0;
   BROTLI_UNUSED(literal_context_lut);
   nodes[0].length = 0;
   nodes[0].u.cost = 0;
@@ -688,6 +707,11 @@ size_t BrotliZopfliComputeShortestPath(MemoryManager* m, size_t num_bytes,
         &params->dictionary,
         ringbuffer, ringbuffer_mask, pos, num_bytes - i, max_distance,
         dictionary_start + gap, params, &matches[lz_matches_offset]);
+    if (num_hints != 0) {
+      num_matches = AddHintedMatch(hints, num_hints, &hint_ix, ringbuffer,
+          ringbuffer_mask, pos, num_bytes - i, max_distance, matches,
+          num_matches);
+    }
     if (num_matches > 0 &&
         BackwardMatchLength(&matches[num_matches - 1]) > max_zopfli_len) {
       matches[0] = matches[num_matches - 1];
@@ -722,14 +746,15 @@ size_t BrotliZopfliComputeShortestPath(MemoryManager* m, size_t num_bytes,
 void BrotliCreateZopfliBackwardReferences(MemoryManager* m, size_t num_bytes,
     size_t position, const uint8_t* ringbuffer, size_t ringbuffer_mask,
     ContextLut literal_context_lut, const BrotliEncoderParams* params,
-    Hasher* hasher, int* dist_cache, size_t* last_insert_len,
-    Command* commands, size_t* num_commands, size_t* num_literals) {
+    Hasher* hasher, const MatchHint* hints, size_t num_hints, int* dist_cache,
+    size_t* last_insert_len, Command* commands, size_t* num_commands,
+    size_t* num_literals) {
   ZopfliNode* nodes = BROTLI_ALLOC(m, ZopfliNode, num_bytes + 1);
   if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(nodes)) return;
   BrotliInitZopfliNodes(nodes, num_bytes + 1);
   *num_commands += BrotliZopfliComputeShortestPath(m, num_bytes,
       position, ringbuffer, ringbuffer_mask, literal_context_lut, params,
-      dist_cache, hasher, nodes);
+      dist_cache, hasher, hints, num_hints, nodes);
   if (BROTLI_IS_OOM(m)) return;
   BrotliZopfliCreateCommands(num_bytes, position, nodes, dist_cache,
       last_insert_len, params, commands, num_literals);
@@ -739,8 +764,9 @@ void BrotliCreateZopfliBackwardReferences(MemoryManager* m, size_t num_bytes,
 void BrotliCreateHqZopfliBackwardReferences(MemoryManager* m, size_t num_bytes,
     size_t position, const uint8_t* ringbuffer, size_t ringbuffer_mask,
     ContextLut literal_context_lut, const BrotliEncoderParams* params,
-    Hasher* hasher, int* dist_cache, size_t* last_insert_len,
-    Command* commands, size_t* num_commands, size_t* num_literals) {
+    Hasher* hasher, const MatchHint* hints, size_t num_hints, int* dist_cache,
+    size_t* last_insert_len, Command* commands, size_t* num_commands,
+    size_t* num_literals) {
   const size_t stream_offset = params->stream_offset;
   const size_t max_backward_limit = BROTLI_MAX_BACKWARD_LIMIT(params->lgwin);
   uint32_t* num_matches = BROTLI_ALLOC(m, uint32_t, num_bytes);
@@ -758,6 +784,7 @@ void BrotliCreateHqZopfliBackwardReferences(MemoryManager* m, size_t num_bytes,
   BackwardMatch* matches = BROTLI_ALLOC(m, BackwardMatch, matches_size);
   size_t gap = 0;
   size_t shadow_matches = 0;
+  size_t hint_ix = 0;
   BROTLI_UNUSED(literal_context_lut);
   if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(num_matches) ||
       BROTLI_IS_NULL(matches)) {
@@ -774,13 +801,18 @@ void BrotliCreateHqZopfliBackwardReferences(MemoryManager* m, size_t num_bytes,
     size_t j;
     /* Ensure that we have enough free slots. */
     BROTLI_ENSURE_CAPACITY(m, BackwardMatch, matches, matches_size,
-        cur_match_pos + MAX_NUM_MATCHES_H10 + shadow_matches);
+        cur_match_pos + MAX_NUM_MATCHES_H10 + shadow_matches + 1);
     if (BROTLI_IS_OOM(m)) return;
     num_found_matches = FindAllMatchesH10(&hasher->privat._H10,
         &params->dictionary,
         ringbuffer, ringbuffer_mask, pos, max_length,
         max_distance, dictionary_start + gap, params,
         &matches[cur_match_pos + shadow_matches]);
+    if (num_hints != 0) {
+      num_found_matches = AddHintedMatch(hints, num_hints, &hint_ix,
+          ringbuffer, ringbuffer_mask, pos, max_length, max_distance,
+          &matches[cur_match_pos + shadow_matches], num_found_matches);
+    }
     cur_match_end = cur_match_pos + num_found_matches;
     for (j = cur_match_pos; j + 1 < cur_match_end; ++j) {
       BROTLI_DCHECK(BackwardMatchLength(&matches[j]) <=
@@ -11,8 +11,9 @@ static BROTLI_NOINLINE void EXPORT_FN(CreateBackwardReferences)(
     size_t num_bytes, size_t position,
     const uint8_t* ringbuffer, size_t ringbuffer_mask,
     ContextLut literal_context_lut, const BrotliEncoderParams* params,
-    Hasher* hasher, int* dist_cache, size_t* last_insert_len,
-    Command* commands, size_t* num_commands, size_t* num_literals) {
+    Hasher* hasher, const MatchHint* hints, size_t num_hints, int* dist_cache,
+    size_t* last_insert_len, Command* commands, size_t* num_commands,
+    size_t* num_literals) {
   HASHER()* privat = &hasher->privat.FN(_);
   /* Set maximum distance, see section 9.1. of the spec. */
   const size_t max_backward_limit = BROTLI_MAX_BACKWARD_LIMIT(params->lgwin);
@@ -29,6 +30,7 @@ static BROTLI_NOINLINE void EXPORT_FN(CreateBackwardReferences)(
       LiteralSpreeLengthForSparseSearch(params);
   size_t apply_random_heuristics = position + random_heuristics_window_size;
   const size_t gap = 0;
+  size_t hint_ix = 0;
 
   /* Minimum score to accept a backward reference. */
   const score_t kMinScore = BROTLI_SCORE_BASE + 100;
@@ -43,6 +45,7 @@ static BROTLI_NOINLINE void EXPORT_FN(CreateBackwardReferences)(
     size_t dictionary_start = BROTLI_MIN(size_t,
         position + position_offset, max_backward_limit);
     HasherSearchResult sr;
+    BROTLI_BOOL is_hinted = BROTLI_FALSE;
     sr.len = 0;
     sr.len_code_delta = 0;
     sr.distance = 0;
@@ -50,6 +53,10 @@ static BROTLI_NOINLINE void EXPORT_FN(CreateBackwardReferences)(
     FN(FindLongestMatch)(privat, &params->dictionary,
         ringbuffer, ringbuffer_mask, dist_cache, position, max_length,
         max_distance, dictionary_start + gap, params->dist.max_distance, &sr);
+    if (num_hints != 0) {
+      is_hinted = ApplyMatchHints(hints, num_hints, &hint_ix, ringbuffer,
+          ringbuffer_mask, position, max_length, max_distance, &sr);
+    }
     if (sr.score > kMinScore) {
       /* Found a match. Let's look for something even better ahead. */
       int delayed_backward_references_in_row = 0;
@@ -57,6 +64,7 @@ static BROTLI_NOINLINE void EXPORT_FN(CreateBackwardReferences)(
       for (;; --max_length) {
         const score_t cost_diff_lazy = 175;
         HasherSearchResult sr2;
+        BROTLI_BOOL is_hinted2 = BROTLI_FALSE;
         sr2.len = params->quality < MIN_QUALITY_FOR_EXTENSIVE_REFERENCE_SEARCH ?
             BROTLI_MIN(size_t, sr.len - 1, max_length) : 0;
         sr2.len_code_delta = 0;
@@ -70,12 +78,18 @@ static BROTLI_NOINLINE void EXPORT_FN(CreateBackwardReferences)(
             ringbuffer, ringbuffer_mask, dist_cache, position + 1, max_length,
             max_distance, dictionary_start + gap, params->dist.max_distance,
             &sr2);
+        if (num_hints != 0) {
+          is_hinted2 = ApplyMatchHints(hints, num_hints, &hint_ix,
+              ringbuffer, ringbuffer_mask, position + 1, max_length,
+              max_distance, &sr2);
+        }
         if (sr2.score >= sr.score + cost_diff_lazy) {
           /* Ok, let's just write one byte for now and start a match from the
              next byte. */
           ++position;
           ++insert_length;
           sr = sr2;
+          is_hinted = is_hinted2;
           if (++delayed_backward_references_in_row < 4 &&
               position + FN(HashTypeLength)() < pos_end) {
             continue;
@@ -115,6 +129,9 @@ static BROTLI_NOINLINE void EXPORT_FN(CreateBackwardReferences)(
           range_start = BROTLI_MIN(size_t, range_end, BROTLI_MAX(size_t,
               range_start, position + sr.len - (sr.distance << 2)));
         }
+        if (is_hinted && range_start + BROTLI_HINT_STORE_TAIL < range_end) {
+          range_start = range_end - BROTLI_HINT_STORE_TAIL;
+        }
         FN(StoreRange)(privat, ringbuffer, ringbuffer_mask, range_start,
                        range_end);
       }
@@ -27,7 +27,6 @@
 extern "C" {
 #endif
 
-#define MAX_HUFFMAN_TREE_SIZE (2 * BROTLI_NUM_COMMAND_SYMBOLS + 1)
 /* The maximum size of Huffman dictionary for distances assuming that
    NPOSTFIX = 0 and NDIRECT = 0. */
 #define MAX_SIMPLE_DISTANCE_ALPHABET_SIZE \
@@ -165,47 +164,59 @@ static void BrotliStoreUncompressedMetaBlockHeader(size_t length,
   BrotliWriteBits(1, 1, storage_ix, storage);
 }
 
-static void BrotliStoreHuffmanTreeOfHuffmanTreeToBitMask(
+/* The order in which the code length code lengths are stored. */
+static const uint8_t kStorageOrder[BROTLI_CODE_LENGTH_CODES] = {
+  1, 2, 3, 4, 0, 5, 17, 6, 16, 7, 8, 9, 10, 11, 12, 13, 14, 15
+};
+/* The bit lengths of the Huffman code over the code length alphabet
+   are compressed with the following static Huffman code:
+     Symbol   Code
+     ------   ----
+     0          00
+     1        1110
+     2         110
+     3          01
+     4          10
+     5        1111 */
+static const uint8_t kHuffmanBitLengthHuffmanCodeSymbols[6] = {
+   0, 7, 3, 2, 1, 15
+};
+static const uint8_t kHuffmanBitLengthHuffmanCodeBitLengths[6] = {
+  2, 4, 3, 2, 2, 4
+};
+
+/* Finds the range [*skip_some, *codes_to_store) of the code length code
+   lengths (in storage order) that has to be stored. */
+static void GetCodeLengthCodeRange(
     const int num_codes, const uint8_t* code_length_bitdepth,
-    size_t* storage_ix, uint8_t* storage) {
-  static const uint8_t kStorageOrder[BROTLI_CODE_LENGTH_CODES] = {
-    1, 2, 3, 4, 0, 5, 17, 6, 16, 7, 8, 9, 10, 11, 12, 13, 14, 15
-  };
-  /* The bit lengths of the Huffman code over the code length alphabet
-     are compressed with the following static Huffman code:
-       Symbol   Code
-       ------   ----
-       0          00
-       1        1110
-       2         110
-       3          01
-       4          10
-       5        1111 */
-  static const uint8_t kHuffmanBitLengthHuffmanCodeSymbols[6] = {
-     0, 7, 3, 2, 1, 15
-  };
-  static const uint8_t kHuffmanBitLengthHuffmanCodeBitLengths[6] = {
-    2, 4, 3, 2, 2, 4
-  };
-
-  size_t skip_some = 0;  /* skips none. */
+    size_t* skip_some, size_t* codes_to_store) {
+  *skip_some = 0;  /* skips none. */
 
   /* Throw away trailing zeros: */
-  size_t codes_to_store = BROTLI_CODE_LENGTH_CODES;
+  *codes_to_store = BROTLI_CODE_LENGTH_CODES;
   if (num_codes > 1) {
-    for (; codes_to_store > 0; --codes_to_store) {
-      if (code_length_bitdepth[kStorageOrder[codes_to_store - 1]] != 0) {
+    for (; *codes_to_store > 0; --(*codes_to_store)) {
+      if (code_length_bitdepth[kStorageOrder[*codes_to_store - 1]] != 0) {
         break;
       }
     }
   }
   if (code_length_bitdepth[kStorageOrder[0]] == 0 &&
       code_length_bitdepth[kStorageOrder[1]] == 0) {
-    skip_some = 2;  /* skips two. */
+    *skip_some = 2;  /* skips two. */
     if (code_length_bitdepth[kStorageOrder[2]] == 0) {
-      skip_some = 3;  /* skips three. */
+      *skip_some = 3;  /* skips three. */
     }
   }
+}
+
+static void BrotliStoreHuffmanTreeOfHuffmanTreeToBitMask(
+    const int num_codes, const uint8_t* code_length_bitdepth,
+    size_t* storage_ix, uint8_t* storage) {
+  size_t skip_some;
+  size_t codes_to_store;
+  GetCodeLengthCodeRange(
+      num_codes, code_length_bitdepth, &skip_some, &codes_to_store);
   BrotliWriteBits(2, skip_some, storage_ix, storage);
   {
     size_t i;
@@ -239,6 +250,11 @@ static void BrotliStoreHuffmanTreeToBitMask(
   }
 }
 
+/* Returns the number of bits used by StoreSimpleHuffmanTree. */
+static size_t SimpleHuffmanTreeBitCost(size_t num_symbols, size_t max_bits) {
+  return 4 + num_symbols * max_bits + (num_symbols == 4 ? 1 : 0);
+}
+
 static void StoreSimpleHuffmanTree(const uint8_t* depths,
                                    size_t symbols[4],
                                    size_t num_symbols,
@@ -278,41 +294,45 @@ static void StoreSimpleHuffmanTree(const uint8_t* depths,
   }
 }
 
-/* num = alphabet size
-   depths = symbol depths */
-void BrotliStoreHuffmanTree(const uint8_t* depths, size_t num,
-                            HuffmanTree* tree,
-                            size_t* storage_ix, uint8_t* storage) {
-  /* Write the Huffman tree into the brotli-representation.
-     The command alphabet is the largest, so this allocation will fit all
-     alphabets. */
-  uint8_t huffman_tree[BROTLI_NUM_COMMAND_SYMBOLS];
-  uint8_t huffman_tree_extra_bits[BROTLI_NUM_COMMAND_SYMBOLS];
-  size_t huffman_tree_size = 0;
-  uint8_t code_length_bitdepth[BROTLI_CODE_LENGTH_CODES] = { 0 };
-  uint16_t code_length_bitdepth_symbols[BROTLI_CODE_LENGTH_CODES];
-  uint32_t huffman_tree_histogram[BROTLI_CODE_LENGTH_CODES] = { 0 };
+/* Complex prefix code in the brotli-representation: run-length coded bit
+   depths and the code length code they are compressed with. */
+typedef struct ComplexHuffmanTree {
+  uint8_t tokens[BROTLI_NUM_COMMAND_SYMBOLS];
+  uint8_t extra_bits[BROTLI_NUM_COMMAND_SYMBOLS];
+  size_t num_tokens;
+  uint8_t code_length_bitdepth[BROTLI_CODE_LENGTH_CODES];
+  int num_codes;
+  size_t code;  /* The only code length symbol in use if num_codes == 1. */
+  size_t bit_cost;  /* Exact number of bits needed to store the tree. */
+} ComplexHuffmanTree;
+
+static void BuildComplexHuffmanTree(const uint8_t* depths, size_t num,
+    BROTLI_BOOL use_rle_for_non_zero, BROTLI_BOOL use_rle_for_zero,
+    HuffmanTree* tree, ComplexHuffmanTree* self) {
+  uint32_t histogram[BROTLI_CODE_LENGTH_CODES] = { 0 };
+  size_t skip_some;
+  size_t codes_to_store;
+  size_t bit_cost = 2;
   size_t i;
-  int num_codes = 0;
-  size_t code = 0;
-
-  BROTLI_DCHECK(num <= BROTLI_NUM_COMMAND_SYMBOLS);
 
-  BrotliWriteHuffmanTree(depths, num, &huffman_tree_size, huffman_tree,
-                         huffman_tree_extra_bits);
+  self->num_tokens = 0;
+  self->num_codes = 0;
+  self->code = 0;
+  BrotliWriteHuffmanTreeWithRle(depths, num, use_rle_for_non_zero,
+      use_rle_for_zero, &self->num_tokens, self->tokens, self->extra_bits);
 
   /* Calculate the statistics of the Huffman tree in brotli-representation. */
-  for (i = 0; i < huffman_tree_size; ++i) {
-    ++huffman_tree_histogram[huffman_tree[i]];
+  for (i = 0; i < self->num_tokens; ++i) {
+    ++histogram[self->tokens[i]];
   }
 
   for (i = 0; i < BROTLI_CODE_LENGTH_CODES; ++i) {
-    if (huffman_tree_histogram[i]) {
-      if (num_codes == 0) {
-        code = i;
-        num_codes = 1;
-      } else if (num_codes == 1) {
-        num_codes = 2;
+    if (histogram[i]) {
+      if (self->num_codes == 0) {
+        self->code = i;
+        self->num_codes = 1;
+      } else if (self->num_codes == 1) {
+        self->num_codes = 2;
         break;
       }
     }
@@ -320,29 +340,112 @@ void BrotliStoreHuffmanTree(const uint8_t* depths, size_t num,
 
   /* Calculate another Huffman tree to use for compressing both the
      earlier Huffman tree with. */
-  BrotliCreateHuffmanTree(huffman_tree_histogram, BROTLI_CODE_LENGTH_CODES,
-                          5, tree, code_length_bitdepth);
+  memset(self->code_length_bitdepth, 0, sizeof(self->code_length_bitdepth));
+  BrotliCreateHuffmanTree(histogram, BROTLI_CODE_LENGTH_CODES,
+                          5, tree, self->code_length_bitdepth);
+
+  GetCodeLengthCodeRange(self->num_codes, self->code_length_bitdepth,
+                         &skip_some, &codes_to_store);
+  for (i = skip_some; i < codes_to_store; ++i) {
+    bit_cost += kHuffmanBitLengthHuffmanCodeBitLengths[
+        self->code_length_bitdepth[kStorageOrder[i]]];
+  }
+  if (self->num_codes > 1) {
+    for (i = 0; i < BROTLI_CODE_LENGTH_CODES; ++i) {
+      bit_cost += histogram[i] * self->code_length_bitdepth[i];
+    }
+  }
+  bit_cost += 2 * histogram[BROTLI_REPEAT_PREVIOUS_CODE_LENGTH];
+  bit_cost += 3 * histogram[BROTLI_REPEAT_ZERO_CODE_LENGTH];
+  self->bit_cost = bit_cost;
+}
+
+/* Tries all combinations of run-length coding of zero and non-zero bit
+   depths and keeps the one that needs the fewest bits. */
+static void BuildBestComplexHuffmanTree(const uint8_t* depths, size_t num,
+    HuffmanTree* tree, ComplexHuffmanTree* best) {
+  ComplexHuffmanTree candidate;
+  int i;
+  BuildComplexHuffmanTree(
+      depths, num, BROTLI_FALSE, BROTLI_FALSE, tree, best);
+  for (i = 1; i < 4; ++i) {
+    BuildComplexHuffmanTree(depths, num, TO_BROTLI_BOOL(i & 1),
+        TO_BROTLI_BOOL(i & 2), tree, &candidate);
+    if (candidate.bit_cost < best->bit_cost) {
+      memcpy(best, &candidate, sizeof(candidate));
+    }
+  }
+}
+
+static void StoreComplexHuffmanTree(const ComplexHuffmanTree* self,
+                                    size_t* storage_ix, uint8_t* storage) {
+  uint8_t code_length_bitdepth[BROTLI_CODE_LENGTH_CODES];
+  uint16_t code_length_bitdepth_symbols[BROTLI_CODE_LENGTH_CODES];
+  memcpy(code_length_bitdepth, self->code_length_bitdepth,
+         sizeof(code_length_bitdepth));
   BrotliConvertBitDepthsToSymbols(code_length_bitdepth,
                                   BROTLI_CODE_LENGTH_CODES,
                                   code_length_bitdepth_symbols);
 
   /* Now, we have all the data, let's start storing it */
-  BrotliStoreHuffmanTreeOfHuffmanTreeToBitMask(num_codes, code_length_bitdepth,
-                                               storage_ix, storage);
+  BrotliStoreHuffmanTreeOfHuffmanTreeToBitMask(self->num_codes,
+      code_length_bitdepth, storage_ix, storage);
 
-  if (num_codes == 1) {
-    code_length_bitdepth[code] = 0;
+  if (self->num_codes == 1) {
+    code_length_bitdepth[self->code] = 0;
   }
 
   /* Store the real Huffman tree now. */
-  BrotliStoreHuffmanTreeToBitMask(huffman_tree_size,
-                                  huffman_tree,
-                                  huffman_tree_extra_bits,
+  BrotliStoreHuffmanTreeToBitMask(self->num_tokens,
+                                  self->tokens,
+                                  self->extra_bits,
                                   code_length_bitdepth,
                                   code_length_bitdepth_symbols,
                                   storage_ix, storage);
 }
 
+/* num = alphabet size
+   depths = symbol depths */
+void BrotliStoreHuffmanTree(const uint8_t* depths, size_t num,
+                            HuffmanTree* tree,
+                            size_t* storage_ix, uint8_t* storage) {
+  /* Write the Huffman tree into the brotli-representation.
+     The command alphabet is the largest, so this allocation will fit all
+     alphabets. */
+  ComplexHuffmanTree complex_tree;
+  BROTLI_DCHECK(num <= BROTLI_NUM_COMMAND_SYMBOLS);
+  BuildBestComplexHuffmanTree(depths, num, tree, &complex_tree);
+  StoreComplexHuffmanTree(&complex_tree, storage_ix, storage);
+}
+
+static size_t AlphabetMaxBits(size_t alphabet_size) {
+  size_t max_bits = 0;
+  size_t max_bits_counter = alphabet_size - 1;
+  while (max_bits_counter) {
+    max_bits_counter >>= 1;
+    ++max_bits;
+  }
+  return max_bits;
+}
+
+size_t BrotliHuffmanTreeBitCost(const uint8_t* depths, size_t num,
+                                size_t alphabet_size, HuffmanTree* tree) {
+  const size_t max_bits = AlphabetMaxBits(alphabet_size);
+  ComplexHuffmanTree complex_tree;
+  size_t count = 0;
+  size_t i;
+  for (i = 0; i < num && count <= 4; ++i) {
+    if (depths[i]) ++count;
+  }
+  if (count <= 1) return 4 + max_bits;
+  BuildBestComplexHuffmanTree(depths, num, tree, &complex_tree);
+  if (count <= 4) {
+    return BROTLI_MIN(size_t, complex_tree.bit_cost,
+                      SimpleHuffmanTreeBitCost(count, max_bits));
+  }
+  return complex_tree.bit_cost;
+}
+
 /* Builds a Huffman tree from histogram[0:length] into depth[0:length] and
    bits[0:length] and stores the encoded tree to the bit stream. */
 static void BuildAndStoreHuffmanTree(const uint32_t* histogram,
@@ -356,7 +459,7 @@ static void BuildAndStoreHuffmanTree(const uint32_t* histogram,
   size_t count = 0;
   size_t s4[4] = { 0 };
   size_t i;
-  size_t max_bits = 0;
+  const size_t max_bits = AlphabetMaxBits(alphabet_size);
   for (i = 0; i < histogram_length; i++) {
     if (histogram[i]) {
       if (count < 4) {
@@ -368,14 +471,6 @@ static void BuildAndStoreHuffmanTree(const uint32_t* histogram,
     }
   }
 
-  {
-    size_t max_bits_counter = alphabet_size - 1;
-    while (max_bits_counter) {
-      max_bits_counter >>= 1;
-      ++max_bits;
-    }
-  }
-
   if (count <= 1) {
     BrotliWriteBits(4, 1, storage_ix, storage);
     BrotliWriteBits(max_bits, s4[0], storage_ix, storage);
@@ -388,10 +483,17 @@ static void BuildAndStoreHuffmanTree(const uint32_t* histogram,
   BrotliCreateHuffmanTree(histogram, histogram_length, 15, tree, depth);
   BrotliConvertBitDepthsToSymbols(depth, histogram_length, bits);
 
-  if (count <= 4) {
-    StoreSimpleHuffmanTree(depth, s4, count, max_bits, storage_ix, storage);
-  } else {
-    BrotliStoreHuffmanTree(depth, histogram_length, tree, storage_ix, storage);
+  {
+    /* Few symbols with small indices are sometimes cheaper to store as
+       a complex tree than to list in full as a simple one. */
+    ComplexHuffmanTree complex_tree;
+    BuildBestComplexHuffmanTree(depth, histogram_length, tree, &complex_tree);
+    if (count <= 4 && complex_tree.bit_cost >=
+        SimpleHuffmanTreeBitCost(count, max_bits)) {
+      StoreSimpleHuffmanTree(depth, s4, count, max_bits, storage_ix, storage);
+    } else {
+      StoreComplexHuffmanTree(&complex_tree, storage_ix, storage);
+    }
   }
 }
 
@@ -677,6 +779,53 @@ static void RunLengthCodeZeros(const size_t in_size,
 
 #define SYMBOL_BITS 9
 
+/* Run-length codes the zeros of the (optionally move-to-front transformed)
+   context map in transformed[] into rle_symbols[] and counts the resulting
+   symbols. */
+static void BuildContextMapSymbols(const uint32_t* transformed,
+    size_t context_map_size, uint32_t* max_run_length_prefix,
+    uint32_t* rle_symbols, size_t* num_rle_symbols, uint32_t* histogram) {
+  static const uint32_t kSymbolMask = (1u << SYMBOL_BITS) - 1u;
+  size_t i;
+  memcpy(rle_symbols, transformed, context_map_size * sizeof(rle_symbols[0]));
+  RunLengthCodeZeros(context_map_size, rle_symbols,
+                     num_rle_symbols, max_run_length_prefix);
+  memset(histogram, 0, BROTLI_MAX_CONTEXT_MAP_SYMBOLS * sizeof(histogram[0]));
+  for (i = 0; i < *num_rle_symbols; ++i) {
+    ++histogram[rle_symbols[i] & kSymbolMask];
+  }
+}
+
+/* Returns the number of bits EncodeContextMap needs after the number of
+   clusters for the given symbol histogram. */
+static size_t ContextMapBitCost(const uint32_t* histogram,
+    size_t num_clusters, uint32_t max_run_length_prefix, HuffmanTree* tree,
+    uint8_t* depths) {
+  const size_t alphabet_size = num_clusters + max_run_length_prefix;
+  /* RLEMAX, the prefix code and IMTF bit. */
+  size_t bits = (max_run_length_prefix > 0 ? 5u : 1u) + 1u;
+  size_t count = 0;
+  size_t i;
+  for (i = 0; i < alphabet_size; ++i) {
+    if (histogram[i]) ++count;
+  }
+  for (i = 1; i <= max_run_length_prefix; ++i) {
+    bits += histogram[i] * i;  /* Extra bits of run lengths. */
+  }
+  memset(depths, 0, alphabet_size * sizeof(depths[0]));
+  /* A single symbol is stored with zero bits per occurrence. */
+  if (count > 1) {
+    BrotliCreateHuffmanTree(histogram, alphabet_size, 15, tree, depths);
+    for (i = 0; i < alphabet_size; ++i) {
+      bits += histogram[i] * depths[i];
+    }
+  }
+  return bits +
+      BrotliHuffmanTreeBitCost(depths, alphabet_size, alphabet_size, tree);
+}
+
+/* Stores the context map choosing the move-to-front transform and the
+   largest run length prefix code by their exact bit cost. */
 static void EncodeContextMap(MemoryManager* m,
                              const uint32_t* context_map,
                              size_t context_map_size,
@@ -684,13 +833,17 @@ static void EncodeContextMap(MemoryManager* m,
                              HuffmanTree* tree,
                              size_t* storage_ix, uint8_t* storage) {
   size_t i;
+  uint32_t* transformed;
   uint32_t* rle_symbols;
-  uint32_t max_run_length_prefix = 6;
+  uint32_t max_run_length_prefix = 0;
   size_t num_rle_symbols = 0;
   uint32_t histogram[BROTLI_MAX_CONTEXT_MAP_SYMBOLS];
   static const uint32_t kSymbolMask = (1u << SYMBOL_BITS) - 1u;
   uint8_t depths[BROTLI_MAX_CONTEXT_MAP_SYMBOLS];
   uint16_t bits[BROTLI_MAX_CONTEXT_MAP_SYMBOLS];
+  BROTLI_BOOL use_mtf = BROTLI_TRUE;
+  size_t best_cost = 0;
+  int mtf;
 
   StoreVarLenUint8(num_clusters - 1, storage_ix, storage);
 
@@ -698,15 +851,42 @@ static void EncodeContextMap(MemoryManager* m,
     return;
   }
 
-  rle_symbols = BROTLI_ALLOC(m, uint32_t, context_map_size);
-  if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(rle_symbols)) return;
-  MoveToFrontTransform(context_map, context_map_size, rle_symbols);
-  RunLengthCodeZeros(context_map_size, rle_symbols,
-                     &num_rle_symbols, &max_run_length_prefix);
-  memset(histogram, 0, sizeof(histogram));
-  for (i = 0; i < num_rle_symbols; ++i) {
-    ++histogram[rle_symbols[i] & kSymbolMask];
+  transformed = BROTLI_ALLOC(m, uint32_t, 2 * context_map_size);
+  if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(transformed)) return;
+  rle_symbols = &transformed[context_map_size];
+  for (mtf = 1; mtf >= 0; --mtf) {
+    uint32_t max_prefix = 16;
+    uint32_t prefix;
+    if (mtf) {
+      MoveToFrontTransform(context_map, context_map_size, transformed);
+    } else {
+      memcpy(transformed, context_map,
+             context_map_size * sizeof(transformed[0]));
+    }
+    /* Longer prefix codes than the longest run of zeros are never used. */
+    BuildContextMapSymbols(transformed, context_map_size, &max_prefix,
+                           rle_symbols, &num_rle_symbols, histogram);
+    for (prefix = 0; prefix <= max_prefix; ++prefix) {
+      uint32_t run_length_prefix = prefix;
+      size_t cost;
+      BuildContextMapSymbols(transformed, context_map_size,
+          &run_length_prefix, rle_symbols, &num_rle_symbols, histogram);
+      cost = ContextMapBitCost(
+          histogram, num_clusters, run_length_prefix, tree, depths);
+      if (best_cost == 0 || cost < best_cost) {
+        best_cost = cost;
+        use_mtf = TO_BROTLI_BOOL(mtf);
+        max_run_length_prefix = run_length_prefix;
+      }
+    }
+  }
+  if (use_mtf) {
+    MoveToFrontTransform(context_map, context_map_size, transformed);
+  } else {
+    memcpy(transformed, context_map, context_map_size * sizeof(transformed[0]));
   }
+  BuildContextMapSymbols(transformed, context_map_size, &max_run_length_prefix,
+                         rle_symbols, &num_rle_symbols, histogram);
   {
     BROTLI_BOOL use_rle = TO_BROTLI_BOOL(max_run_length_prefix > 0);
     BrotliWriteBits(1, (uint64_t)use_rle, storage_ix, storage);
@@ -725,8 +905,8 @@ static void EncodeContextMap(MemoryManager* m,
       BrotliWriteBits(rle_symbol, extra_bits_val, storage_ix, storage);
     }
   }
-  BrotliWriteBits(1, 1, storage_ix, storage);  /* use move-to-front */
-  BROTLI_FREE(m, rle_symbols);
+  BrotliWriteBits(1, (uint64_t)use_mtf, storage_ix, storage);  /* IMTF */
+  BROTLI_FREE(m, transformed);
 }
 
 /* Stores the block switch command with index block_ix to the bit stream. */
@@ -31,9 +31,18 @@ extern "C" {
 /* All Store functions here will use a storage_ix, which is always the bit
    position for the current storage. */
 
+/* Number of HuffmanTree nodes needed for building a tree over any alphabet. */
+#define MAX_HUFFMAN_TREE_SIZE (2 * BROTLI_NUM_COMMAND_SYMBOLS + 1)
+
 BROTLI_INTERNAL void BrotliStoreHuffmanTree(const uint8_t* depths, size_t num,
     HuffmanTree* tree, size_t* storage_ix, uint8_t* storage);
 
+/* Returns the number of bits needed to store the prefix code with the given
+   bit depths of the first num symbols of an alphabet with alphabet_size
+   symbols, using the cheapest of the encodings BrotliStoreMetaBlock tries. */
+BROTLI_INTERNAL size_t BrotliHuffmanTreeBitCost(const uint8_t* depths,
+    size_t num, size_t alphabet_size, HuffmanTree* tree);
+
 BROTLI_INTERNAL void BrotliBuildAndStoreHuffmanTreeFast(
     MemoryManager* m, const uint32_t* histogram, const size_t histogram_total,
     const size_t max_bits, uint8_t* depth, uint16_t* bits, size_t* storage_ix,
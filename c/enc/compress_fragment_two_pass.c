@@ -12,13 +12,14 @@
 
 #include "./compress_fragment_two_pass.h"
 
-#include <string.h>  /* memcmp, memcpy, memset */
+#include <string.h>  /* memchr, memcmp, memcpy, memset */
 
 #include "../common/constants.h"
 #include "../common/platform.h"
 #include <brotli/types.h>
 #include "./bit_cost.h"
 #include "./brotli_bit_stream.h"
+#include "./encoder_dict.h"
 #include "./entropy_encode.h"
 #include "./fast_log.h"
 #include "./find_match_length.h"
@@ -218,6 +219,122 @@ static BROTLI_INLINE void EmitDistance(uint32_t distance, uint32_t** commands) {
   ++(*commands);
 }
 
+/* Returns BROTLI_TRUE if 5 bytes at "p" look like a beginning of a word that
+   is long enough to be looked up in the static dictionary: all of them are
+   lowercase ASCII letters (first one could be capital) or non-ASCII bytes. */
+static BROTLI_INLINE BROTLI_BOOL IsLongWord(const uint8_t* p) {
+  const uint64_t kHighBits = BROTLI_MAKE_UINT64_T(0x80, 0x80808080);
+  const uint64_t v = BROTLI_UNALIGNED_LOAD64LE(p) | 0x20;
+  const uint64_t low = v & BROTLI_MAKE_UINT64_T(0x7F, 0x7F7F7F7F);
+  /* High bit of each byte: (low >= 'a') && !(low > 'z'); no carries. */
+  const uint64_t t = ((low + BROTLI_MAKE_UINT64_T(0x1F, 0x1F1F1F1F)) &
+      ~(low + BROTLI_MAKE_UINT64_T(0x05, 0x05050505))) | v;
+  return TO_BROTLI_BOOL((t & kHighBits) == kHighBits);
+}
+
+/* Looks up the whole static dictionary word "p" starts with, in the same hash
+   table that is used by hashers of higher qualities. Returns the word length,
+   or 0 if there is no such word of at least "min_length" bytes. */
+static BROTLI_INLINE size_t FindDictionaryWord(
+    const BrotliEncoderDictionary* dictionary, const uint8_t* p,
+    size_t min_length, size_t max_length, size_t* word_idx) {
+  const size_t key = (size_t)(
+      (BROTLI_UNALIGNED_LOAD32LE(p) * kHashMul32) >> (32 - 14)) << 1;
+  size_t len = 0;
+  size_t i;
+  for (i = 0; i < 2; ++i) {
+    const size_t word_len = dictionary->hash_table_lengths[key + i];
+    if (word_len >= min_length && word_len <= max_length && word_len > len) {
+      const size_t idx = dictionary->hash_table_words[key + i];
+      const uint8_t* word = &dictionary->words->data[
+          dictionary->words->offsets_by_length[word_len] + word_len * idx];
+      if (FindMatchLengthWithLimit(p, word, word_len) == word_len) {
+        len = word_len;
+        *word_idx = idx;
+      }
+    }
+  }
+  return len;
+}
+
+/* Returns the distance to the closest earlier occurrence of two bytes that
+   precede "p", or 0 if there is none nearby. */
+static BROTLI_INLINE uint32_t FindBigram(const uint8_t* p, size_t max_back) {
+  const uint16_t bigram = BrotliUnalignedRead16(p - 2);
+  uint32_t distance;
+  max_back = BROTLI_MIN(size_t, max_back, 64);
+  for (distance = 1; distance <= max_back; ++distance) {
+    if (BrotliUnalignedRead16(p - 2 - distance) == bigram) return distance;
+  }
+  return 0;
+}
+
+/* Replaces long words in the literal run ["*next_emit", "end") with static
+   dictionary references. Words are looked up at the beginning of the run,
+   and after spaces; the last word could stretch up to "limit". There are no
+   command codes with both insert and long copy lengths, so in the latter case
+   the two bytes preceding the word are emitted as a short copy; insert length
+   of such command is kept non-zero, as BuildAndStoreCommandPrefixCode
+   requires. Dictionary references do not change the last distance.
+   Like in SearchInStaticDictionary, dictionary is not probed anymore when
+   less than 1 of 128 word beginnings is replaced.
+   REQUIRES: "end" <= "limit"; 3 bytes after "end" are readable. */
+static void EmitDictionaryWords(const BrotliEncoderDictionary* dictionary,
+    const uint8_t* base_ip, size_t dictionary_start, size_t max_backward_limit,
+    const uint8_t* end, const uint8_t* limit,
+    size_t* num_lookups, size_t* num_matches,
+    int* last_distance, const uint8_t** next_emit,
+    uint8_t** literals, uint32_t** commands) {
+  const uint8_t* p = *next_emit;
+  while (end - p >= 5 && *num_matches >= (*num_lookups >> 7)) {
+    ++(*num_lookups);
+    if ((p == *next_emit || p - *next_emit > 2) && IsLongWord(p)) {
+      const size_t max_distance = BROTLI_MIN(size_t,
+          dictionary_start + (size_t)(p - base_ip), max_backward_limit);
+      /* Reference costs about 12 bits plus distance extra bits, while
+         literal in text costs about 4 bits. */
+      const size_t min_length =
+          3 + (Log2FloorNonZero(max_distance + 1) >> 2);
+      size_t word_idx;
+      size_t len;
+      uint32_t bigram_distance = 0;
+      len = FindDictionaryWord(dictionary, p, min_length + (p != *next_emit),
+                               (size_t)(limit - p), &word_idx);
+      if (len != 0 && p != *next_emit) {
+        bigram_distance = FindBigram(p, (size_t)(p - base_ip) - 2);
+        if (bigram_distance == 0) len = 0;
+      }
+      if (len != 0) {
+        ++(*num_matches);
+        if (p != *next_emit) {
+          const uint32_t insert = (uint32_t)(p - *next_emit) - 2;
+          EmitInsertLen(insert, commands);
+          memcpy(*literals, *next_emit, insert);
+          *literals += insert;
+          if (bigram_distance == (uint32_t)*last_distance) {
+            **commands = 64;
+            ++(*commands);
+          } else {
+            EmitDistance(bigram_distance, commands);
+            *last_distance = (int)bigram_distance;
+          }
+        }
+        EmitCopyLen(len, commands);
+        EmitDistance((uint32_t)(max_distance + 1 + word_idx), commands);
+        p += len;
+        *next_emit = p;
+        continue;
+      }
+    }
+    {
+      const uint8_t* space =
+          (const uint8_t*)memchr(p, ' ', (size_t)(end - p));
+      if (!space) break;
+      p = space + 1;
+    }
+  }
+}
+
 /* REQUIRES: len <= 1 << 24. */
 static void BrotliStoreMetaBlockHeader(
     size_t len, BROTLI_BOOL is_uncompressed, size_t* storage_ix,
@@ -239,7 +356,8 @@ static void BrotliStoreMetaBlockHeader(
 static BROTLI_INLINE void CreateCommands(const uint8_t* input,
     size_t block_size, size_t input_size, const uint8_t* base_ip, int* table,
     size_t table_bits, size_t min_match,
-    uint8_t** literals, uint32_t** commands) {
+    const BrotliEncoderDictionary* dictionary, size_t dictionary_start,
+    size_t max_backward_limit, uint8_t** literals, uint32_t** commands) {
   /* "ip" is the input pointer. */
   const uint8_t* ip = input;
   const size_t shift = 64u - table_bits;
@@ -252,6 +370,12 @@ static BROTLI_INLINE void CreateCommands(const uint8_t* input,
   int last_distance = -1;
   const size_t kInputMarginBytes = BROTLI_WINDOW_GAP;
 
+  size_t dict_num_lookups = 0;
+  size_t dict_num_matches = 0;
+  /* Dictionary reference distance is "max_distance" + 1 + 16-bit word index;
+     it should fit into distance codes 16..63. */
+  if (max_backward_limit + 0x10000 > BROTLI_MAX_DISTANCE) dictionary = NULL;
+
   if (BROTLI_PREDICT_TRUE(block_size >= kInputMarginBytes)) {
     /* For the last block, we need to keep a 16 bytes margin so that we can be
        sure that all distances are at most window size - 16.
@@ -313,6 +437,21 @@ trawl:
          Checking is done outside of hot loop to reduce overhead. */
       if (ip - candidate > MAX_DISTANCE) goto trawl;
 
+      if (dictionary) {
+        EmitDictionaryWords(dictionary, base_ip, dictionary_start,
+            max_backward_limit, ip, ip_limit, &dict_num_lookups,
+            &dict_num_matches, &last_distance, &next_emit, literals, commands);
+        if (next_emit >= ip) {
+          /* Dictionary word overlaps the match; search again after it. */
+          ip = next_emit;
+          if (BROTLI_PREDICT_FALSE(ip >= ip_limit)) {
+            goto emit_remainder;
+          }
+          next_hash = Hash(++ip, shift, min_match);
+          continue;
+        }
+      }
+
       /* Step 2: Emit the found match together with the literal bytes from
          "next_emit", and then see if we can find a next match immediately
          afterwards. Repeat until we find no match for the input
@@ -443,6 +582,14 @@ trawl:
 
 emit_remainder:
   BROTLI_DCHECK(next_emit <= ip_end);
+  if (dictionary && block_size >= kInputMarginBytes) {
+    /* Last 3 bytes of input are not readable past "end". */
+    const uint8_t* end = (ip_end + 3 <= input + input_size) ?
+        ip_end : input + input_size - 3;
+    EmitDictionaryWords(dictionary, base_ip, dictionary_start,
+        max_backward_limit, end, end, &dict_num_lookups, &dict_num_matches,
+        &last_distance, &next_emit, literals, commands);
+  }
   /* Emit the remaining bytes as literals. */
   if (next_emit < ip_end) {
     const uint32_t insert = (uint32_t)(ip_end - next_emit);
@@ -554,14 +701,16 @@ static void EmitUncompressedMetaBlock(const uint8_t* input, size_t input_size,
   storage[*storage_ix >> 3] = 0;
 }
 
-static BROTLI_INLINE void BrotliCompressFragmentTwoPassImpl(
+static BROTLI_INLINE BROTLI_BOOL BrotliCompressFragmentTwoPassImpl(
     MemoryManager* m, const uint8_t* input, size_t input_size,
     BROTLI_BOOL is_last, uint32_t* command_buf, uint8_t* literal_buf,
     int* table, size_t table_bits, size_t min_match,
-    size_t* storage_ix, uint8_t* storage) {
+    const BrotliEncoderDictionary* dictionary, size_t dictionary_start,
+    size_t max_backward_limit, size_t* storage_ix, uint8_t* storage) {
   /* Save the start of the first block for position and distance computations.
   */
   const uint8_t* base_ip = input;
+  BROTLI_BOOL is_relocatable = BROTLI_TRUE;
   BROTLI_UNUSED(is_last);
 
   while (input_size > 0) {
@@ -571,7 +720,8 @@ static BROTLI_INLINE void BrotliCompressFragmentTwoPassImpl(
     uint8_t* literals = literal_buf;
     size_t num_literals;
     CreateCommands(input, block_size, input_size, base_ip, table,
-                   table_bits, min_match, &literals, &commands);
+                   table_bits, min_match, dictionary, dictionary_start,
+                   max_backward_limit, &literals, &commands);
     num_literals = (size_t)(literals - literal_buf);
     if (ShouldCompress(input, block_size, num_literals)) {
       const size_t num_commands = (size_t)(commands - command_buf);
@@ -580,45 +730,54 @@ static BROTLI_INLINE void BrotliCompressFragmentTwoPassImpl(
       BrotliWriteBits(13, 0, storage_ix, storage);
       StoreCommands(m, literal_buf, num_literals, command_buf, num_commands,
                     storage_ix, storage);
-      if (BROTLI_IS_OOM(m)) return;
+      if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
     } else {
       /* Since we did not find many backward references and the entropy of
          the data is close to 8 bits, we can simply emit an uncompressed block.
          This makes compression speed of uncompressible data about 3x faster. */
       EmitUncompressedMetaBlock(input, block_size, storage_ix, storage);
+      is_relocatable = BROTLI_FALSE;
     }
     input += block_size;
     input_size -= block_size;
   }
+  return is_relocatable;
 }
 
 #define FOR_TABLE_BITS_(X) \
   X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16) X(17)
 
 #define BAKE_METHOD_PARAM_(B)                                                  \
-static BROTLI_NOINLINE void BrotliCompressFragmentTwoPassImpl ## B(            \
+static BROTLI_NOINLINE BROTLI_BOOL BrotliCompressFragmentTwoPassImpl ## B(     \
     MemoryManager* m, const uint8_t* input, size_t input_size,                 \
     BROTLI_BOOL is_last, uint32_t* command_buf, uint8_t* literal_buf,          \
-    int* table, size_t* storage_ix, uint8_t* storage) {                        \
+    int* table, const BrotliEncoderDictionary* dictionary,                     \
+    size_t dictionary_start, size_t max_backward_limit,                        \
+    size_t* storage_ix, uint8_t* storage) {                                    \
   size_t min_match = (B <= 15) ? 4 : 6;                                        \
-  BrotliCompressFragmentTwoPassImpl(m, input, input_size, is_last, command_buf,\
-      literal_buf, table, B, min_match, storage_ix, storage);                  \
+  return BrotliCompressFragmentTwoPassImpl(m, input, input_size, is_last,      \
+      command_buf, literal_buf, table, B, min_match, dictionary,               \
+      dictionary_start, max_backward_limit, storage_ix, storage);              \
 }
 FOR_TABLE_BITS_(BAKE_METHOD_PARAM_)
 #undef BAKE_METHOD_PARAM_
 
-void BrotliCompressFragmentTwoPass(
+BROTLI_BOOL BrotliCompressFragmentTwoPass(
     MemoryManager* m, const uint8_t* input, size_t input_size,
     BROTLI_BOOL is_last, uint32_t* command_buf, uint8_t* literal_buf,
-    int* table, size_t table_size, size_t* storage_ix, uint8_t* storage) {
+    int* table, size_t table_size, const BrotliEncoderDictionary* dictionary,
+    size_t dictionary_start, size_t max_backward_limit,
+    size_t* storage_ix, uint8_t* storage) {
   const size_t initial_storage_ix = *storage_ix;
   const size_t table_bits = Log2FloorNonZero(table_size);
+  BROTLI_BOOL is_relocatable = BROTLI_FALSE;
   switch (table_bits) {
-#define CASE_(B)                                      \
-    case B:                                           \
-      BrotliCompressFragmentTwoPassImpl ## B(         \
-          m, input, input_size, is_last, command_buf, \
-          literal_buf, table, storage_ix, storage);   \
+#define CASE_(B)                                                     \
+    case B:                                                          \
+      is_relocatable = BrotliCompressFragmentTwoPassImpl ## B(       \
+          m, input, input_size, is_last, command_buf,                \
+          literal_buf, table, dictionary, dictionary_start,          \
+          max_backward_limit, storage_ix, storage);                  \
       break;
     FOR_TABLE_BITS_(CASE_)
 #undef CASE_
@@ -629,13 +788,16 @@ void BrotliCompressFragmentTwoPass(
   if (*storage_ix - initial_storage_ix > 31 + (input_size << 3)) {
     RewindBitPosition(initial_storage_ix, storage_ix, storage);
     EmitUncompressedMetaBlock(input, input_size, storage_ix, storage);
+    is_relocatable = BROTLI_FALSE;
   }
 
   if (is_last) {
     BrotliWriteBits(1, 1, storage_ix, storage);  /* islast */
     BrotliWriteBits(1, 1, storage_ix, storage);  /* isempty */
     *storage_ix = (*storage_ix + 7u) & ~7u;
+    is_relocatable = BROTLI_FALSE;
   }
+  return is_relocatable;
 }
 
 #undef FOR_TABLE_BITS_
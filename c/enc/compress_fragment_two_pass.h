@@ -15,6 +15,7 @@
 
 #include "../common/platform.h"
 #include <brotli/types.h>
+#include "./encoder_dict.h"
 #include "./memory.h"
 
 #if defined(__cplusplus) || defined(c_plusplus)
@@ -35,17 +36,20 @@ static const size_t kCompressFragmentTwoPassBlockSize = 1 << 17;
    REQUIRES: All elements in "table[0..table_size-1]" are initialized to zero.
    REQUIRES: "table_size" is a power of two
    OUTPUT: maximal copy distance <= |input_size|
-   OUTPUT: maximal copy distance <= BROTLI_MAX_BACKWARD_LIMIT(18) */
-BROTLI_INTERNAL void BrotliCompressFragmentTwoPass(MemoryManager* m,
-                                                   const uint8_t* input,
-                                                   size_t input_size,
-                                                   BROTLI_BOOL is_last,
-                                                   uint32_t* command_buf,
-                                                   uint8_t* literal_buf,
-                                                   int* table,
-                                                   size_t table_size,
-                                                   size_t* storage_ix,
-                                                   uint8_t* storage);
+   OUTPUT: maximal copy distance <= BROTLI_MAX_BACKWARD_LIMIT(18)
+
+   If "dictionary" is not NULL, some words are encoded as static dictionary
+   references. "dictionary_start" is the stream position of "input" clamped to
+   "max_backward_limit", the window size declared in the stream header.
+
+   Returns BROTLI_FALSE if output contains byte-aligned parts (uncompressed
+   meta-blocks or stream end), i.e. it depends on the initial "*storage_ix".
+   Otherwise the same bits would be produced at any other position. */
+BROTLI_INTERNAL BROTLI_BOOL BrotliCompressFragmentTwoPass(MemoryManager* m,
+    const uint8_t* input, size_t input_size, BROTLI_BOOL is_last,
+    uint32_t* command_buf, uint8_t* literal_buf, int* table, size_t table_size,
+    const BrotliEncoderDictionary* dictionary, size_t dictionary_start,
+    size_t max_backward_limit, size_t* storage_ix, uint8_t* storage);
 
 #if defined(__cplusplus) || defined(c_plusplus)
 }  /* extern "C" */
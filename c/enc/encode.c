@@ -13,6 +13,7 @@
 
 #include "../common/constants.h"
 #include "../common/context.h"
+#include "../common/filter.h"
 #include "../common/platform.h"
 #include "../common/version.h"
 #include "./backward_references.h"
@@ -28,6 +29,8 @@
 #include "./histogram.h"
 #include "./memory.h"
 #include "./metablock.h"
+#include "./parallel.h"
+#include "./prefilter.h"
 #include "./prefix.h"
 #include "./quality.h"
 #include "./ringbuffer.h"
@@ -62,6 +65,36 @@ typedef enum BrotliEncoderFlintState {
   BROTLI_FLINT_DONE = -2
 } BrotliEncoderFlintState;
 
+typedef enum BrotliEncoderContentSizeState {
+  /* Header is not requested, or size is not known. */
+  BROTLI_CONTENT_SIZE_NONE = 0,
+  /* Size is decided on the first BrotliEncoderCompressStream call. */
+  BROTLI_CONTENT_SIZE_REQUESTED = 1,
+  /* Size is known; header goes first to output. */
+  BROTLI_CONTENT_SIZE_PENDING = 2,
+  /* Header is written; input should match the declared size. */
+  BROTLI_CONTENT_SIZE_EMITTED = 3
+} BrotliEncoderContentSizeState;
+
+/* Reorder buffer slot for multi-threaded FAST_TWO_PASS_COMPRESSION_QUALITY
+   streaming. */
+typedef struct FastBlockTask {
+  MemoryManager memory_manager;
+  const uint8_t* input;
+  size_t input_size;
+  int* table;
+  size_t table_size;
+  uint32_t* command_buf;
+  uint8_t* literal_buf;
+  uint8_t* storage;
+  size_t storage_size;
+  size_t storage_ix;
+  size_t dictionary_start;
+  const BrotliEncoderDictionary* dictionary;
+  size_t max_backward_limit;
+  BROTLI_BOOL is_relocatable;
+} FastBlockTask;
+
 typedef struct BrotliEncoderStateStruct {
   BrotliEncoderParams params;
 
@@ -112,6 +145,13 @@ typedef struct BrotliEncoderStateStruct {
   /* Command and literal buffers for FAST_TWO_PASS_COMPRESSION_QUALITY. */
   uint32_t* command_buf_;
   uint8_t* literal_buf_;
+  /* Blocks compressed concurrently in FAST_TWO_PASS_COMPRESSION_QUALITY. */
+  size_t num_threads_;
+  /* Meta-block is emitted as soon as that many input bytes are held;
+     0 means no limit. */
+  uint32_t max_delay_bytes_;
+  FastBlockTask* fast_tasks_;
+  size_t num_fast_tasks_;
 
   uint8_t* next_out_;
   size_t available_out_;
@@ -124,6 +164,51 @@ typedef struct BrotliEncoderStateStruct {
   uint32_t remaining_metadata_bytes_;
   BrotliEncoderStreamState stream_state_;
 
+  /* Parameters changed after the start of encoding; applied at the next
+     meta-block boundary. */
+  int pending_quality_;
+  int pending_lgblock_;
+  BrotliEncoderMode pending_mode_;
+  BROTLI_BOOL pending_disable_literal_context_modeling_;
+  BROTLI_BOOL has_pending_params_;
+
+  /* Pre-filter container; input is gathered in |filter_buf_|, filtered and
+     only then passed to the encoder. */
+  BrotliEncoderFilter filter_mode_;
+  int filter_distance_;
+  BrotliFilter filter_;
+  /* BROTLI_FILTER_BUFFER_SIZE bytes of input followed by the same amount of
+     filter scratch space. */
+  uint8_t* filter_buf_;
+  size_t filter_size_;
+  /* Leading |filter_ready_| bytes are filtered; |filter_fed_| of them are
+     already passed to the encoder. */
+  size_t filter_ready_;
+  size_t filter_fed_;
+  uint8_t filter_header_[BROTLI_FILTER_HEADER_SIZE];
+  BROTLI_BOOL is_filter_started_;
+
+  /* Content size header; |content_consumed_| counts input bytes. */
+  BrotliEncoderContentSizeState content_size_state_;
+  uint64_t content_size_;
+  uint64_t content_consumed_;
+
+  /* Tight window header; |known_input_size_| is the total input size, if it
+     is known before initialization, or 0. */
+  BROTLI_BOOL tight_window_;
+  uint64_t known_input_size_;
+
+  /* Caller-supplied match hints, sorted by position; positions are relative
+     to |hint_origin_|. Leading |next_hint_| of them are already behind. */
+  BrotliEncoderMatchHint* hints_;
+  size_t hints_size_;
+  size_t num_hints_;
+  size_t next_hint_;
+  uint64_t hint_origin_;
+  /* Hints for the block being processed, in ring-buffer positions. */
+  MatchHint* block_hints_;
+  size_t block_hints_size_;
+
   BROTLI_BOOL is_last_block_emitted_;
   BROTLI_BOOL is_initialized_;
 } BrotliEncoderStateStruct;
@@ -132,6 +217,11 @@ static size_t InputBlockSize(BrotliEncoderState* s) {
   return (size_t)1 << s->params.lgblock;
 }
 
+/* Fast qualities always have at least 18-bit window in header. */
+static size_t FastMaxBackwardLimit(BrotliEncoderState* s) {
+  return BROTLI_MAX_BACKWARD_LIMIT(BROTLI_MAX(int, s->params.lgwin, 18));
+}
+
 static uint64_t UnprocessedInputSize(BrotliEncoderState* s) {
   return s->input_pos_ - s->last_processed_pos_;
 }
@@ -143,10 +233,84 @@ static size_t RemainingInputBlockSize(BrotliEncoderState* s) {
   return block_size - (size_t)delta;
 }
 
+/* Returns the number of input bytes that could be taken before the held
+   input reaches BROTLI_PARAM_MAX_DELAY_BYTES. */
+static size_t RemainingDelayBytes(BrotliEncoderState* s) {
+  const uint64_t held = s->input_pos_ - s->last_flush_pos_;
+  if (s->max_delay_bytes_ == 0) return BROTLI_UINT32_MAX;
+  if (held >= s->max_delay_bytes_) return 0;
+  return (size_t)(s->max_delay_bytes_ - held);
+}
+
+static BROTLI_BOOL IsFastQuality(int quality) {
+  return TO_BROTLI_BOOL(quality == FAST_ONE_PASS_COMPRESSION_QUALITY ||
+                        quality == FAST_TWO_PASS_COMPRESSION_QUALITY);
+}
+
+/* Only parameters that do not affect the stream header could be changed on
+   the fly. */
+static BROTLI_BOOL SetPendingParameter(
+    BrotliEncoderState* s, BrotliEncoderParameter p, uint32_t value) {
+  if (s->stream_state_ == BROTLI_STREAM_FINISHED) return BROTLI_FALSE;
+  if (!s->has_pending_params_) {
+    s->pending_quality_ = s->params.quality;
+    s->pending_lgblock_ = 0;
+    s->pending_mode_ = s->params.mode;
+    s->pending_disable_literal_context_modeling_ =
+        s->params.disable_literal_context_modeling;
+  }
+  switch (p) {
+    case BROTLI_PARAM_MODE:
+      s->pending_mode_ = (BrotliEncoderMode)value;
+      break;
+
+    case BROTLI_PARAM_QUALITY: {
+      int quality = (int)BROTLI_MIN(uint32_t, value, BROTLI_MAX_QUALITY);
+      /* Fast qualities could refer up to 256KiB back; the stream header
+         reserves that window only if encoding was started with them. */
+      if (IsFastQuality(quality) && s->params.lgwin < 18 &&
+          !IsFastQuality(s->params.quality)) {
+        return BROTLI_FALSE;
+      }
+      /* Low qualities do not support large window distance codes. */
+      if (quality <= MAX_QUALITY_FOR_STATIC_ENTROPY_CODES &&
+          s->params.large_window) {
+        return BROTLI_FALSE;
+      }
+      s->pending_quality_ = quality;
+      break;
+    }
+
+    case BROTLI_PARAM_LGBLOCK:
+      s->pending_lgblock_ = (int)value;
+      break;
+
+    case BROTLI_PARAM_DISABLE_LITERAL_CONTEXT_MODELING:
+      if ((value != 0) && (value != 1)) return BROTLI_FALSE;
+      s->pending_disable_literal_context_modeling_ = TO_BROTLI_BOOL(!!value);
+      break;
+
+    default: return BROTLI_FALSE;
+  }
+  s->has_pending_params_ = BROTLI_TRUE;
+  return BROTLI_TRUE;
+}
+
 BROTLI_BOOL BrotliEncoderSetParameter(
     BrotliEncoderState* state, BrotliEncoderParameter p, uint32_t value) {
-  /* Changing parameters on the fly is not implemented yet. */
-  if (state->is_initialized_) return BROTLI_FALSE;
+  /* Number of threads does not affect output; it could be changed any time. */
+  if (p == BROTLI_PARAM_NUM_THREADS) {
+    if (value == 0) return BROTLI_FALSE;
+    state->num_threads_ =
+        BROTLI_MIN(size_t, value, BROTLI_MAX_PARALLEL_TASKS);
+    return BROTLI_TRUE;
+  }
+  /* Delay bound does not affect the stream header either. */
+  if (p == BROTLI_PARAM_MAX_DELAY_BYTES) {
+    state->max_delay_bytes_ = value;
+    return BROTLI_TRUE;
+  }
+  if (state->is_initialized_) return SetPendingParameter(state, p, value);
   /* TODO: Validate/clamp parameters here. */
   switch (p) {
     case BROTLI_PARAM_MODE:
@@ -191,6 +355,27 @@ BROTLI_BOOL BrotliEncoderSetParameter(
       state->params.stream_offset = value;
       return BROTLI_TRUE;
 
+    case BROTLI_PARAM_FILTER:
+      if (value > BROTLI_FILTER_AUTO) return BROTLI_FALSE;
+      state->filter_mode_ = (BrotliEncoderFilter)value;
+      return BROTLI_TRUE;
+
+    case BROTLI_PARAM_FILTER_DISTANCE:
+      if (value > 255) return BROTLI_FALSE;
+      state->filter_distance_ = (int)value;
+      return BROTLI_TRUE;
+
+    case BROTLI_PARAM_CONTENT_SIZE_HEADER:
+      if ((value != 0) && (value != 1)) return BROTLI_FALSE;
+      state->content_size_state_ = value ?
+          BROTLI_CONTENT_SIZE_REQUESTED : BROTLI_CONTENT_SIZE_NONE;
+      return BROTLI_TRUE;
+
+    case BROTLI_PARAM_TIGHT_WINDOW:
+      if ((value != 0) && (value != 1)) return BROTLI_FALSE;
+      state->tight_window_ = TO_BROTLI_BOOL(!!value);
+      return BROTLI_TRUE;
+
     default: return BROTLI_FALSE;
   }
 }
@@ -261,6 +446,18 @@ static int* GetHashTable(BrotliEncoderState* s, int quality,
   return table;
 }
 
+/* Returns the smallest window that covers |input_size| bytes, but not bigger
+   than |lgwin|. Backward distances, as well as positions of static dictionary
+   references, are less than input size; so the stream is decoded the same
+   with that window in the header. */
+static int TightWindowBits(int lgwin, uint64_t input_size) {
+  int result = BROTLI_MIN_WINDOW_BITS;
+  while (result < lgwin && BROTLI_MAX_BACKWARD_LIMIT(result) < input_size) {
+    result++;
+  }
+  return result;
+}
+
 static void EncodeWindowBits(int lgwin, BROTLI_BOOL large_window,
     uint16_t* last_bytes, uint8_t* last_bytes_bits) {
   if (large_window) {
@@ -556,6 +753,7 @@ static void WriteMetaBlockInternal(MemoryManager* m,
                                    const uint64_t last_flush_pos,
                                    const size_t bytes,
                                    const BROTLI_BOOL is_last,
+                                   const BROTLI_BOOL allow_uncompressed,
                                    ContextType literal_context_mode,
                                    const BrotliEncoderParams* params,
                                    const uint8_t prev_byte,
@@ -580,8 +778,8 @@ static void WriteMetaBlockInternal(MemoryManager* m,
     return;
   }
 
-  if (!ShouldCompress(data, mask, last_flush_pos, bytes,
-                      num_literals, num_commands)) {
+  if (allow_uncompressed && !ShouldCompress(data, mask, last_flush_pos, bytes,
+                                            num_literals, num_commands)) {
     /* Restore the distance cache, as its last update by
        CreateBackwardReferences is now unused. */
     memcpy(dist_cache, saved_dist_cache, 4 * sizeof(dist_cache[0]));
@@ -634,7 +832,8 @@ static void WriteMetaBlockInternal(MemoryManager* m,
       /* The number of distance symbols effectively used for distance
          histograms. It might be less than distance alphabet size
          for "Large Window Brotli" (32-bit). */
-      BrotliOptimizeHistograms(block_params.dist.alphabet_size_limit, &mb);
+      BrotliOptimizeHistograms(m, block_params.dist.alphabet_size_limit, &mb);
+      if (BROTLI_IS_OOM(m)) return;
     }
     BrotliStoreMetaBlock(m, data, wrapped_last_flush_pos, bytes, mask,
                          prev_byte, prev_byte2,
@@ -647,7 +846,7 @@ static void WriteMetaBlockInternal(MemoryManager* m,
     if (BROTLI_IS_OOM(m)) return;
     DestroyMetaBlockSplit(m, &mb);
   }
-  if (bytes + 4 < (*storage_ix >> 3)) {
+  if (allow_uncompressed && bytes + 4 < (*storage_ix >> 3)) {
     /* Restore the distance cache and last byte. */
     memcpy(dist_cache, saved_dist_cache, 4 * sizeof(dist_cache[0]));
     storage[0] = (uint8_t)last_bytes;
@@ -699,6 +898,10 @@ static BROTLI_BOOL EnsureInitialized(BrotliEncoderState* s) {
   ChooseDistanceParams(&s->params);
 
   if (s->params.stream_offset != 0) {
+    /* Container / content size headers could not be placed in the middle of
+       the stream. */
+    s->filter_mode_ = BROTLI_FILTER_NONE;
+    s->content_size_state_ = BROTLI_CONTENT_SIZE_NONE;
     s->flint_ = BROTLI_FLINT_NEEDS_2_BYTES;
     /* Poison the distance cache. -16 +- 3 is still less than zero (invalid). */
     s->dist_cache_[0] = -16;
@@ -717,6 +920,10 @@ static BROTLI_BOOL EnsureInitialized(BrotliEncoderState* s) {
         s->params.quality == FAST_TWO_PASS_COMPRESSION_QUALITY) {
       lgwin = BROTLI_MAX(int, lgwin, 18);
     }
+    if (s->tight_window_ && s->known_input_size_ != 0 &&
+        !s->params.large_window && s->params.stream_offset == 0) {
+      lgwin = TightWindowBits(lgwin, s->known_input_size_);
+    }
     if (s->params.stream_offset == 0) {
       EncodeWindowBits(lgwin, s->params.large_window,
                        &s->last_bytes_, &s->last_bytes_bits_);
@@ -772,10 +979,34 @@ static void BrotliEncoderInitState(BrotliEncoderState* s) {
   s->cmd_code_numbits_ = 0;
   s->command_buf_ = NULL;
   s->literal_buf_ = NULL;
+  s->num_threads_ = 1;
+  s->max_delay_bytes_ = 0;
+  s->fast_tasks_ = NULL;
+  s->num_fast_tasks_ = 0;
   s->next_out_ = NULL;
   s->available_out_ = 0;
   s->total_out_ = 0;
   s->stream_state_ = BROTLI_STREAM_PROCESSING;
+  s->has_pending_params_ = BROTLI_FALSE;
+  s->filter_mode_ = BROTLI_FILTER_NONE;
+  s->filter_distance_ = 0;
+  s->filter_buf_ = NULL;
+  s->filter_size_ = 0;
+  s->filter_ready_ = 0;
+  s->filter_fed_ = 0;
+  s->is_filter_started_ = BROTLI_FALSE;
+  s->content_size_state_ = BROTLI_CONTENT_SIZE_NONE;
+  s->content_size_ = 0;
+  s->content_consumed_ = 0;
+  s->tight_window_ = BROTLI_FALSE;
+  s->known_input_size_ = 0;
+  s->hints_ = NULL;
+  s->hints_size_ = 0;
+  s->num_hints_ = 0;
+  s->next_hint_ = 0;
+  s->hint_origin_ = 0;
+  s->block_hints_ = NULL;
+  s->block_hints_size_ = 0;
   s->is_last_block_emitted_ = BROTLI_FALSE;
   s->is_initialized_ = BROTLI_FALSE;
 
@@ -814,6 +1045,7 @@ BrotliEncoderState* BrotliEncoderCreateInstance(
 
 static void BrotliEncoderCleanupState(BrotliEncoderState* s) {
   MemoryManager* m = &s->memory_manager_;
+  size_t i;
   if (BROTLI_IS_OOM(m)) {
     BrotliWipeOutMemoryManager(m);
     return;
@@ -825,6 +1057,17 @@ static void BrotliEncoderCleanupState(BrotliEncoderState* s) {
   BROTLI_FREE(m, s->large_table_);
   BROTLI_FREE(m, s->command_buf_);
   BROTLI_FREE(m, s->literal_buf_);
+  BROTLI_FREE(m, s->filter_buf_);
+  BROTLI_FREE(m, s->hints_);
+  BROTLI_FREE(m, s->block_hints_);
+  for (i = 0; i < s->num_fast_tasks_; ++i) {
+    FastBlockTask* task = &s->fast_tasks_[i];
+    BROTLI_FREE(m, task->table);
+    BROTLI_FREE(m, task->command_buf);
+    BROTLI_FREE(m, task->literal_buf);
+    BROTLI_FREE(m, task->storage);
+  }
+  BROTLI_FREE(m, s->fast_tasks_);
 }
 
 /* Deinitializes and frees BrotliEncoderState instance. */
@@ -902,6 +1145,186 @@ static void CopyInputToRingBuffer(BrotliEncoderState* s,
   }
 }
 
+BROTLI_BOOL BrotliEncoderResumeStream(
+    BrotliEncoderState* s, size_t history_size, const uint8_t* history,
+    uint64_t total_size, uint32_t last_byte_bits, uint8_t last_byte) {
+  MemoryManager* m = &s->memory_manager_;
+  size_t max_history_size;
+  if (s->is_initialized_) return BROTLI_FALSE;
+  if (last_byte_bits > 7 || history_size > total_size) return BROTLI_FALSE;
+  /* Last 2 bytes are required for literal context modeling. */
+  if (history_size < 2 && history_size != total_size) return BROTLI_FALSE;
+  /* Fast qualities could refer up to 256KiB back. */
+  if (s->params.lgwin < 18 &&
+      (s->params.quality == FAST_ONE_PASS_COMPRESSION_QUALITY ||
+       s->params.quality == FAST_TWO_PASS_COMPRESSION_QUALITY)) {
+    s->params.quality = FAST_TWO_PASS_COMPRESSION_QUALITY + 1;
+  }
+  if (!EnsureInitialized(s)) return BROTLI_FALSE;
+
+  /* Container / content size headers could not be placed in the middle of
+     the stream. */
+  s->filter_mode_ = BROTLI_FILTER_NONE;
+  s->content_size_state_ = BROTLI_CONTENT_SIZE_NONE;
+  /* Replace stream header with the tail of the existing stream. */
+  s->last_bytes_ = (uint16_t)(last_byte & ((1u << last_byte_bits) - 1));
+  s->last_bytes_bits_ = (uint8_t)last_byte_bits;
+
+  /* Decoder distance cache is unknown; make it unusable. */
+  s->dist_cache_[0] = -16;
+  s->dist_cache_[1] = -16;
+  s->dist_cache_[2] = -16;
+  s->dist_cache_[3] = -16;
+  memcpy(s->saved_dist_cache_, s->dist_cache_, sizeof(s->saved_dist_cache_));
+
+  max_history_size = BROTLI_MAX_BACKWARD_LIMIT(s->params.lgwin);
+  if (history_size > max_history_size) {
+    history += history_size - max_history_size;
+    history_size = max_history_size;
+  }
+  /* Positions before the history are not addressable, but they still count
+     for static dictionary references. */
+  s->params.stream_offset = total_size - history_size > max_history_size ?
+      max_history_size : (size_t)(total_size - history_size);
+  if (history_size > 0) s->prev_byte_ = history[history_size - 1];
+  if (history_size > 1) s->prev_byte2_ = history[history_size - 2];
+
+  /* Fast qualities do not look beyond the current block; history is skipped
+     as a whole. */
+  if (s->params.quality == FAST_ONE_PASS_COMPRESSION_QUALITY ||
+      s->params.quality == FAST_TWO_PASS_COMPRESSION_QUALITY) {
+    s->params.stream_offset = total_size > max_history_size ?
+        max_history_size : (size_t)total_size;
+    return BROTLI_TRUE;
+  }
+  if (history_size == 0) return BROTLI_TRUE;
+  CopyInputToRingBuffer(s, history_size, history);
+  if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
+  s->last_flush_pos_ = history_size;
+  s->last_processed_pos_ = history_size;
+  s->hint_origin_ = history_size;
+  HasherPrependHistory(m, &s->hasher_, &s->params, s->ringbuffer_.buffer_,
+      s->ringbuffer_.mask_, history_size, history_size);
+  if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
+  return BROTLI_TRUE;
+}
+
+/* Hint is behind if it ends before |pos|. */
+static BROTLI_INLINE BROTLI_BOOL IsHintBehind(
+    const BrotliEncoderState* s, const BrotliEncoderMatchHint* hint,
+    uint64_t pos) {
+  return TO_BROTLI_BOOL(
+      s->hint_origin_ + hint->position + hint->length <= pos);
+}
+
+BROTLI_BOOL BrotliEncoderAddMatchHints(BrotliEncoderState* s,
+    size_t num_hints, const BrotliEncoderMatchHint* hints) {
+  MemoryManager* m = &s->memory_manager_;
+  uint64_t last_position = (s->num_hints_ != 0) ?
+      s->hints_[s->num_hints_ - 1].position : 0;
+  size_t i;
+  for (i = 0; i < num_hints; ++i) {
+    if (hints[i].position < last_position || hints[i].distance == 0 ||
+        hints[i].length == 0) {
+      return BROTLI_FALSE;
+    }
+    last_position = hints[i].position;
+  }
+  if (num_hints == 0) return BROTLI_TRUE;
+
+  /* Drop hints that are already behind; fast qualities never consume them. */
+  while (s->next_hint_ < s->num_hints_ &&
+         IsHintBehind(s, &s->hints_[s->next_hint_], s->last_processed_pos_)) {
+    s->next_hint_++;
+  }
+  if (s->next_hint_ != 0) {
+    memmove(s->hints_, &s->hints_[s->next_hint_],
+        (s->num_hints_ - s->next_hint_) * sizeof(s->hints_[0]));
+    s->num_hints_ -= s->next_hint_;
+    s->next_hint_ = 0;
+  }
+  BROTLI_ENSURE_CAPACITY(m, BrotliEncoderMatchHint, s->hints_, s->hints_size_,
+      s->num_hints_ + num_hints);
+  if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(s->hints_)) {
+    s->hints_size_ = 0;
+    s->num_hints_ = 0;
+    return BROTLI_FALSE;
+  }
+  memcpy(&s->hints_[s->num_hints_], hints, num_hints * sizeof(hints[0]));
+  s->num_hints_ += num_hints;
+  return BROTLI_TRUE;
+}
+
+/* Applies parameters changed on the fly. Does nothing unless all the input
+   is already emitted, i.e. next block starts a new meta-block. */
+static void ApplyPendingParams(BrotliEncoderState* s) {
+  MemoryManager* m = &s->memory_manager_;
+  const int old_quality = s->params.quality;
+  BrotliHasherParams hasher_params;
+  if (!s->has_pending_params_) return;
+  if (s->input_pos_ != s->last_flush_pos_ ||
+      (s->flint_ != BROTLI_FLINT_DONE && s->input_pos_ != 0) ||
+      s->stream_state_ != BROTLI_STREAM_PROCESSING) {
+    return;
+  }
+  s->has_pending_params_ = BROTLI_FALSE;
+
+  s->params.quality = s->pending_quality_;
+  s->params.mode = s->pending_mode_;
+  s->params.lgblock = s->pending_lgblock_;
+  s->params.disable_literal_context_modeling =
+      s->pending_disable_literal_context_modeling_;
+  if (s->input_pos_ == 0) {
+    /* Ring-buffer is not used yet, so it could be reshaped. Streams started
+       with fast quality have at least 18-bit window in header. */
+    if (IsFastQuality(old_quality)) {
+      s->params.lgwin = BROTLI_MAX(int, s->params.lgwin, 18);
+    }
+    s->params.lgblock = ComputeLgBlock(&s->params);
+    RingBufferSetup(&s->params, &s->ringbuffer_);
+  } else {
+    /* Input block must fit the tail of existing ring-buffer. */
+    s->params.lgblock = BROTLI_MIN(int, ComputeLgBlock(&s->params),
+        (int)Log2FloorNonZero(s->ringbuffer_.tail_size_));
+  }
+  ChooseDistanceParams(&s->params);
+
+  if (IsFastQuality(s->params.quality)) {
+    if (s->params.quality == FAST_ONE_PASS_COMPRESSION_QUALITY &&
+        old_quality != FAST_ONE_PASS_COMPRESSION_QUALITY) {
+      InitCommandPrefixCodes(s->cmd_depths_, s->cmd_bits_,
+                             s->cmd_code_, &s->cmd_code_numbits_);
+    }
+    return;
+  }
+
+  if (IsFastQuality(old_quality)) {
+    /* Fast qualities do not track the distance cache. */
+    s->dist_cache_[0] = -16;
+    s->dist_cache_[1] = -16;
+    s->dist_cache_[2] = -16;
+    s->dist_cache_[3] = -16;
+    memcpy(s->saved_dist_cache_, s->dist_cache_, sizeof(s->saved_dist_cache_));
+  }
+
+  /* Rebuild hasher from the window, unless the old one is still good. */
+  ChooseHasher(&s->params, &hasher_params);
+  if (s->hasher_.common.extra != NULL && !IsFastQuality(old_quality) &&
+      memcmp(&hasher_params, &s->hasher_.common.params,
+             sizeof(hasher_params)) == 0) {
+    return;
+  }
+  DestroyHasher(m, &s->hasher_);
+  HasherInit(&s->hasher_);
+  if (s->input_pos_ != 0) {
+    uint64_t max_history = BROTLI_MAX_BACKWARD_LIMIT(s->params.lgwin);
+    size_t history_size = (size_t)(s->input_pos_ < max_history ?
+        s->input_pos_ : max_history);
+    HasherPrependHistory(m, &s->hasher_, &s->params, s->ringbuffer_.buffer_,
+        s->ringbuffer_.mask_, WrapPosition(s->input_pos_), history_size);
+  }
+}
+
 /* Marks all input as processed.
    Returns true if position wrapping occurs. */
 static BROTLI_BOOL UpdateLastProcessedPos(BrotliEncoderState* s) {
@@ -945,6 +1368,146 @@ static void ExtendLastCommand(BrotliEncoderState* s, uint32_t* bytes,
   }
 }
 
+/* Converts hints that overlap the last |bytes| of input to ring-buffer
+   positions; block starts at |wrapped_pos|. Returns the number of hints. */
+static size_t PrepareBlockHints(BrotliEncoderState* s, uint32_t bytes,
+                                uint32_t wrapped_pos) {
+  MemoryManager* m = &s->memory_manager_;
+  const uint64_t block_end = s->input_pos_;
+  const uint64_t block_start = block_end - bytes;
+  size_t num_block_hints = 0;
+  size_t i;
+  if (s->filter_mode_ != BROTLI_FILTER_NONE) return 0;
+  for (i = s->next_hint_; i < s->num_hints_; ++i) {
+    const BrotliEncoderMatchHint* hint = &s->hints_[i];
+    uint64_t start = s->hint_origin_ + hint->position;
+    const uint64_t end = start + hint->length;
+    MatchHint* block_hint;
+    if (start >= block_end) break;
+    if (end <= block_start) continue;
+    if (start < block_start) start = block_start;
+    BROTLI_ENSURE_CAPACITY(m, MatchHint, s->block_hints_,
+        s->block_hints_size_, num_block_hints + 1);
+    if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(s->block_hints_)) return 0;
+    block_hint = &s->block_hints_[num_block_hints++];
+    block_hint->position = wrapped_pos + (size_t)(start - block_start);
+    block_hint->distance = hint->distance;
+    block_hint->length = (size_t)(end - start);
+  }
+  while (s->next_hint_ < s->num_hints_ &&
+         IsHintBehind(s, &s->hints_[s->next_hint_], block_end)) {
+    s->next_hint_++;
+  }
+  return num_block_hints;
+}
+
+/* Narrow hasher is chosen by size hint; once input outgrows the hint, the hint
+   is corrected and the hasher is replaced with a regular one. */
+static void CheckNarrowHasher(BrotliEncoderState* s) {
+  MemoryManager* m = &s->memory_manager_;
+  if (s->input_pos_ <= MAX_INPUT_SIZE_FOR_NARROW_HASHER ||
+      s->params.size_hint > MAX_INPUT_SIZE_FOR_NARROW_HASHER) {
+    return;
+  }
+  s->params.size_hint = s->input_pos_ < (1u << 30) ?
+      (size_t)s->input_pos_ : (1u << 30);
+  if (s->hasher_.common.extra == NULL || s->params.lgwin <= 16 ||
+      !IsNarrowHasher(s->hasher_.common.params.type)) {
+    return;
+  }
+  if (s->last_processed_pos_ <= MAX_INPUT_SIZE_FOR_NARROW_HASHER) {
+    HasherWiden(m, &s->hasher_, &s->params);
+  } else {
+    /* Hasher was built after the input had outgrown it; start over. */
+    uint64_t max_history = BROTLI_MAX_BACKWARD_LIMIT(s->params.lgwin);
+    size_t history_size = (size_t)(s->last_processed_pos_ < max_history ?
+        s->last_processed_pos_ : max_history);
+    DestroyHasher(m, &s->hasher_);
+    HasherInit(&s->hasher_);
+    HasherPrependHistory(m, &s->hasher_, &s->params, s->ringbuffer_.buffer_,
+        s->ringbuffer_.mask_, WrapPosition(s->last_processed_pos_),
+        history_size);
+  }
+}
+
+/* Finds backward references for the unprocessed input; new commands are
+   appended to the pending ones. */
+static BROTLI_BOOL CreateCommands(BrotliEncoderState* s,
+    const BROTLI_BOOL is_last, ContextType* literal_context_mode) {
+  uint32_t bytes = (uint32_t)UnprocessedInputSize(s);
+  uint32_t wrapped_last_processed_pos = WrapPosition(s->last_processed_pos_);
+  uint8_t* data = s->ringbuffer_.buffer_;
+  uint32_t mask = s->ringbuffer_.mask_;
+  MemoryManager* m = &s->memory_manager_;
+  ContextLut literal_context_lut;
+  size_t num_hints = 0;
+
+  {
+    /* Theoretical max number of commands is 1 per 2 bytes. */
+    size_t newsize = s->num_commands_ + bytes / 2 + 1;
+    if (newsize > s->cmd_alloc_size_) {
+      Command* new_commands;
+      /* Reserve a bit more memory to allow merging with a next block
+         without reallocation: that would impact speed. */
+      newsize += (bytes / 4) + 16;
+      s->cmd_alloc_size_ = newsize;
+      new_commands = BROTLI_ALLOC(m, Command, newsize);
+      if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(new_commands)) return BROTLI_FALSE;
+      if (s->commands_) {
+        memcpy(new_commands, s->commands_, sizeof(Command) * s->num_commands_);
+        BROTLI_FREE(m, s->commands_);
+      }
+      s->commands_ = new_commands;
+    }
+  }
+
+  CheckNarrowHasher(s);
+  if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
+  InitOrStitchToPreviousBlock(m, &s->hasher_, data, mask, &s->params,
+      wrapped_last_processed_pos, bytes, is_last);
+
+  *literal_context_mode = ChooseContextMode(
+      &s->params, data, WrapPosition(s->last_flush_pos_),
+      mask, (size_t)(s->input_pos_ - s->last_flush_pos_));
+  literal_context_lut = BROTLI_CONTEXT_LUT(*literal_context_mode);
+
+  if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
+
+  if (s->num_commands_ && s->last_insert_len_ == 0) {
+    ExtendLastCommand(s, &bytes, &wrapped_last_processed_pos);
+  }
+
+  if (s->next_hint_ < s->num_hints_) {
+    num_hints = PrepareBlockHints(s, bytes, wrapped_last_processed_pos);
+    if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
+  }
+
+  if (s->params.quality == ZOPFLIFICATION_QUALITY) {
+    BROTLI_DCHECK(s->params.hasher.type == 10);
+    BrotliCreateZopfliBackwardReferences(m, bytes, wrapped_last_processed_pos,
+        data, mask, literal_context_lut, &s->params,
+        &s->hasher_, s->block_hints_, num_hints, s->dist_cache_,
+        &s->last_insert_len_, &s->commands_[s->num_commands_],
+        &s->num_commands_, &s->num_literals_);
+    if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
+  } else if (s->params.quality == HQ_ZOPFLIFICATION_QUALITY) {
+    BROTLI_DCHECK(s->params.hasher.type == 10);
+    BrotliCreateHqZopfliBackwardReferences(m, bytes, wrapped_last_processed_pos,
+        data, mask, literal_context_lut, &s->params,
+        &s->hasher_, s->block_hints_, num_hints, s->dist_cache_,
+        &s->last_insert_len_, &s->commands_[s->num_commands_],
+        &s->num_commands_, &s->num_literals_);
+    if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
+  } else {
+    BrotliCreateBackwardReferences(bytes, wrapped_last_processed_pos,
+        data, mask, literal_context_lut, &s->params,
+        &s->hasher_, s->block_hints_, num_hints, s->dist_cache_,
+        &s->last_insert_len_, &s->commands_[s->num_commands_],
+        &s->num_commands_, &s->num_literals_);
+  }
+  return BROTLI_TRUE;
+}
+
 /*
    Processes the accumulated input data and sets |*out_size| to the length of
    the new output meta-block, or to zero if no new output meta-block has been
@@ -967,7 +1530,6 @@ static BROTLI_BOOL EncodeData(
   uint32_t mask;
   MemoryManager* m = &s->memory_manager_;
   ContextType literal_context_mode;
-  ContextLut literal_context_lut;
 
   data = s->ringbuffer_.buffer_;
   mask = s->ringbuffer_.mask_;
@@ -1020,78 +1582,36 @@ static BROTLI_BOOL EncodeData(
           &storage_ix, storage);
       if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
     } else {
+      const size_t max_backward_limit = FastMaxBackwardLimit(s);
+      const uint64_t position =
+          s->last_processed_pos_ + s->params.stream_offset;
+      const size_t dictionary_start = position < max_backward_limit ?
+          (size_t)position : max_backward_limit;
       BrotliCompressFragmentTwoPass(
           m, &data[wrapped_last_processed_pos & mask],
           bytes, is_last,
           s->command_buf_, s->literal_buf_,
           table, table_size,
+          &s->params.dictionary, dictionary_start, max_backward_limit,
           &storage_ix, storage);
       if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
     }
     s->last_bytes_ = (uint16_t)(storage[storage_ix >> 3]);
     s->last_bytes_bits_ = storage_ix & 7u;
     UpdateLastProcessedPos(s);
+    s->last_flush_pos_ = s->input_pos_;
+    if (bytes > 0) {
+      s->prev_byte2_ = bytes > 1 ?
+          data[(wrapped_last_processed_pos + bytes - 2) & mask] :
+          s->prev_byte_;
+      s->prev_byte_ = data[(wrapped_last_processed_pos + bytes - 1) & mask];
+    }
     *output = &storage[0];
     *out_size = storage_ix >> 3;
     return BROTLI_TRUE;
   }
 
-  {
-    /* Theoretical max number of commands is 1 per 2 bytes. */
-    size_t newsize = s->num_commands_ + bytes / 2 + 1;
-    if (newsize > s->cmd_alloc_size_) {
-      Command* new_commands;
-      /* Reserve a bit more memory to allow merging with a next block
-         without reallocation: that would impact speed. */
-      newsize += (bytes / 4) + 16;
-      s->cmd_alloc_size_ = newsize;
-      new_commands = BROTLI_ALLOC(m, Command, newsize);
-      if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(new_commands)) return BROTLI_FALSE;
-      if (s->commands_) {
-        memcpy(new_commands, s->commands_, sizeof(Command) * s->num_commands_);
-        BROTLI_FREE(m, s->commands_);
-      }
-      s->commands_ = new_commands;
-    }
-  }
-
-  InitOrStitchToPreviousBlock(m, &s->hasher_, data, mask, &s->params,
-      wrapped_last_processed_pos, bytes, is_last);
-
-  literal_context_mode = ChooseContextMode(
-      &s->params, data, WrapPosition(s->last_flush_pos_),
-      mask, (size_t)(s->input_pos_ - s->last_flush_pos_));
-  literal_context_lut = BROTLI_CONTEXT_LUT(literal_context_mode);
-
-  if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
-
-  if (s->num_commands_ && s->last_insert_len_ == 0) {
-    ExtendLastCommand(s, &bytes, &wrapped_last_processed_pos);
-  }
-
-  if (s->params.quality == ZOPFLIFICATION_QUALITY) {
-    BROTLI_DCHECK(s->params.hasher.type == 10);
-    BrotliCreateZopfliBackwardReferences(m, bytes, wrapped_last_processed_pos,
-        data, mask, literal_context_lut, &s->params,
-        &s->hasher_, s->dist_cache_,
-        &s->last_insert_len_, &s->commands_[s->num_commands_],
-        &s->num_commands_, &s->num_literals_);
-    if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
-  } else if (s->params.quality == HQ_ZOPFLIFICATION_QUALITY) {
-    BROTLI_DCHECK(s->params.hasher.type == 10);
-    BrotliCreateHqZopfliBackwardReferences(m, bytes, wrapped_last_processed_pos,
-        data, mask, literal_context_lut, &s->params,
-        &s->hasher_, s->dist_cache_,
-        &s->last_insert_len_, &s->commands_[s->num_commands_],
-        &s->num_commands_, &s->num_literals_);
-    if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
-  } else {
-    BrotliCreateBackwardReferences(bytes, wrapped_last_processed_pos,
-        data, mask, literal_context_lut, &s->params,
-        &s->hasher_, s->dist_cache_,
-        &s->last_insert_len_, &s->commands_[s->num_commands_],
-        &s->num_commands_, &s->num_literals_);
-  }
+  if (!CreateCommands(s, is_last, &literal_context_mode)) return BROTLI_FALSE;
 
   {
     const size_t max_length = MaxMetablockSize(&s->params);
@@ -1107,7 +1627,10 @@ static BROTLI_BOOL EncodeData(
     const BROTLI_BOOL should_flush = TO_BROTLI_BOOL(
         s->params.quality < MIN_QUALITY_FOR_BLOCK_SPLIT &&
         s->num_literals_ + s->num_commands_ >= MAX_NUM_DELAYED_SYMBOLS);
-    if (!is_last && !force_flush && !should_flush &&
+    /* Held input reached the delay bound; emit it without padding. */
+    const BROTLI_BOOL is_delay_reached =
+        TO_BROTLI_BOOL(RemainingDelayBytes(s) == 0);
+    if (!is_last && !force_flush && !should_flush && !is_delay_reached &&
         next_input_fits_metablock &&
         s->num_literals_ < max_literals &&
         s->num_commands_ < max_commands) {
@@ -1146,9 +1669,10 @@ static BROTLI_BOOL EncodeData(
     storage[1] = (uint8_t)(s->last_bytes_ >> 8);
     WriteMetaBlockInternal(
         m, data, mask, s->last_flush_pos_, metablock_size, is_last,
-        literal_context_mode, &s->params, s->prev_byte_, s->prev_byte2_,
-        s->num_literals_, s->num_commands_, s->commands_, s->saved_dist_cache_,
-        s->dist_cache_, &storage_ix, storage);
+        BROTLI_TRUE, literal_context_mode, &s->params,
+        s->prev_byte_, s->prev_byte2_, s->num_literals_, s->num_commands_,
+        s->commands_, s->saved_dist_cache_, s->dist_cache_, &storage_ix,
+        storage);
     if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
     s->last_bytes_ = (uint16_t)(storage[storage_ix >> 3]);
     s->last_bytes_bits_ = storage_ix & 7u;
@@ -1247,7 +1771,9 @@ static BROTLI_BOOL BrotliCompressBufferQuality10(
   BrotliInitMemoryManager(m, 0, 0, 0);
 
   BROTLI_DCHECK(input_size <= mask + 1);
-  EncodeWindowBits(lgwin, params.large_window, &last_bytes, &last_bytes_bits);
+  EncodeWindowBits(params.large_window ? lgwin :
+      TightWindowBits(lgwin, input_size), params.large_window,
+      &last_bytes, &last_bytes_bits);
   InitOrStitchToPreviousBlock(m, &hasher, input_buffer, mask, &params,
       0, hasher_eff_size, BROTLI_TRUE);
   if (BROTLI_IS_OOM(m)) goto oom;
@@ -1284,7 +1810,7 @@ static BROTLI_BOOL BrotliCompressBufferQuality10(
                                input_buffer, mask);
       path_size = BrotliZopfliComputeShortestPath(m, block_size, block_start,
           input_buffer, mask, literal_context_lut, &params, dist_cache, &hasher,
-          nodes);
+          NULL, 0, nodes);
       if (BROTLI_IS_OOM(m)) goto oom;
       /* We allocate a command buffer in the first iteration of this loop that
          will be likely big enough for the whole metablock, so that for most
@@ -1362,7 +1888,9 @@ static BROTLI_BOOL BrotliCompressBufferQuality10(
         /* The number of distance symbols effectively used for distance
            histograms. It might be less than distance alphabet size
            for "Large Window Brotli" (32-bit). */
-        BrotliOptimizeHistograms(block_params.dist.alphabet_size_limit, &mb);
+        BrotliOptimizeHistograms(m, block_params.dist.alphabet_size_limit,
+                                 &mb);
+        if (BROTLI_IS_OOM(m)) goto oom;
       }
       storage = BROTLI_ALLOC(m, uint8_t, 2 * metablock_size + 503);
       if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(storage)) goto oom;
@@ -1513,6 +2041,7 @@ BROTLI_BOOL BrotliEncoderCompress(
     BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, (uint32_t)lgwin);
     BrotliEncoderSetParameter(s, BROTLI_PARAM_MODE, (uint32_t)mode);
     BrotliEncoderSetParameter(s, BROTLI_PARAM_SIZE_HINT, (uint32_t)input_size);
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_TIGHT_WINDOW, BROTLI_TRUE);
     if (lgwin > BROTLI_MAX_WINDOW_BITS) {
       BrotliEncoderSetParameter(s, BROTLI_PARAM_LARGE_WINDOW, BROTLI_TRUE);
     }
@@ -1594,6 +2123,183 @@ static void CheckFlushComplete(BrotliEncoderState* s) {
   }
 }
 
+/* Makes sure there are |num_tasks| reorder buffer slots, each able to hold
+   a block of |block_size| bytes. */
+static BROTLI_BOOL EnsureFastTasks(
+    BrotliEncoderState* s, size_t num_tasks, size_t block_size) {
+  MemoryManager* m = &s->memory_manager_;
+  const size_t max_table_size =
+      MaxHashTableSize(FAST_TWO_PASS_COMPRESSION_QUALITY);
+  const size_t storage_size = 2 * block_size + 503;
+  size_t i;
+  if (num_tasks > s->num_fast_tasks_) {
+    FastBlockTask* tasks = BROTLI_ALLOC(m, FastBlockTask, num_tasks);
+    if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(tasks)) return BROTLI_FALSE;
+    if (s->fast_tasks_) {
+      memcpy(tasks, s->fast_tasks_, sizeof(FastBlockTask) * s->num_fast_tasks_);
+      BROTLI_FREE(m, s->fast_tasks_);
+    }
+    for (i = s->num_fast_tasks_; i < num_tasks; ++i) {
+      tasks[i].table = NULL;
+      tasks[i].command_buf = NULL;
+      tasks[i].literal_buf = NULL;
+      tasks[i].storage = NULL;
+      tasks[i].storage_size = 0;
+    }
+    s->fast_tasks_ = tasks;
+    s->num_fast_tasks_ = num_tasks;
+  }
+  for (i = 0; i < num_tasks; ++i) {
+    FastBlockTask* task = &s->fast_tasks_[i];
+    if (!task->table) {
+      task->table = BROTLI_ALLOC(m, int, max_table_size);
+      task->command_buf =
+          BROTLI_ALLOC(m, uint32_t, kCompressFragmentTwoPassBlockSize);
+      task->literal_buf =
+          BROTLI_ALLOC(m, uint8_t, kCompressFragmentTwoPassBlockSize);
+      if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(task->table) ||
+          BROTLI_IS_NULL(task->command_buf) ||
+          BROTLI_IS_NULL(task->literal_buf)) {
+        return BROTLI_FALSE;
+      }
+    }
+    if (task->storage_size < storage_size) {
+      BROTLI_FREE(m, task->storage);
+      task->storage = BROTLI_ALLOC(m, uint8_t, storage_size);
+      if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(task->storage)) return BROTLI_FALSE;
+      task->storage_size = storage_size;
+    }
+  }
+  return BROTLI_TRUE;
+}
+
+/* Runs on a worker thread; compresses block from the bit position 0. */
+static void CompressFastBlockTask(void* arg) {
+  FastBlockTask* task = (FastBlockTask*)arg;
+  task->storage[0] = 0;
+  task->storage_ix = 0;
+  memset(task->table, 0, task->table_size * sizeof(*task->table));
+  task->is_relocatable = BrotliCompressFragmentTwoPass(&task->memory_manager,
+      task->input, task->input_size, BROTLI_FALSE, task->command_buf,
+      task->literal_buf, task->table, task->table_size, task->dictionary,
+      task->dictionary_start, task->max_backward_limit,
+      &task->storage_ix, task->storage);
+}
+
+/* Appends |num_bits| bits to the storage.
+   REQUIRED: |bits| has at least 7 bytes of readable slack. */
+static void AppendBits(const uint8_t* bits, size_t num_bits,
+                       size_t* storage_ix, uint8_t* storage) {
+  const uint64_t kMask56 = (((uint64_t)1) << 56) - 1;
+  size_t pos = 0;
+  for (; pos + 56 <= num_bits; pos += 56) {
+    BrotliWriteBits(56, BROTLI_UNALIGNED_LOAD64LE(&bits[pos >> 3]) & kMask56,
+                    storage_ix, storage);
+  }
+  if (pos < num_bits) {
+    const size_t tail_bits = num_bits - pos;
+    BrotliWriteBits(tail_bits, BROTLI_UNALIGNED_LOAD64LE(&bits[pos >> 3]) &
+                    ((((uint64_t)1) << tail_bits) - 1), storage_ix, storage);
+  }
+}
+
+/* Advances input, keeping track of stream position and last bytes, in case
+   quality is raised later. */
+static void ConsumeFastInput(BrotliEncoderState* s, size_t size,
+    size_t* available_in, const uint8_t** next_in) {
+  const size_t max_offset = FastMaxBackwardLimit(s);
+  if (size == 0) return;
+  s->params.stream_offset =
+      BROTLI_MIN(size_t, s->params.stream_offset + size, max_offset);
+  s->prev_byte2_ = size > 1 ? (*next_in)[size - 2] : s->prev_byte_;
+  s->prev_byte_ = (*next_in)[size - 1];
+  *next_in += size;
+  *available_in -= size;
+}
+
+/* Publishes output produced by fast qualities. */
+static void EmitFastOutput(BrotliEncoderState* s, uint8_t* storage,
+    size_t storage_ix, BROTLI_BOOL inplace, size_t* available_out,
+    uint8_t** next_out, size_t* total_out) {
+  size_t out_bytes = storage_ix >> 3;
+  if (inplace) {
+    BROTLI_DCHECK(out_bytes <= *available_out);
+    BROTLI_DCHECK((storage_ix & 7) == 0 || out_bytes < *available_out);
+    *next_out += out_bytes;
+    *available_out -= out_bytes;
+    s->total_out_ += out_bytes;
+    if (total_out) *total_out = s->total_out_;
+  } else {
+    s->next_out_ = storage;
+    s->available_out_ = out_bytes;
+  }
+  s->last_bytes_ = (uint16_t)(storage[storage_ix >> 3]);
+  s->last_bytes_bits_ = storage_ix & 7u;
+}
+
+/* Compresses several FAST_TWO_PASS_COMPRESSION_QUALITY blocks concurrently.
+   Blocks do not share any state, so each one is compressed from the bit
+   position 0, and then shifted in place; blocks that contain byte-aligned
+   parts are compressed again. Output is the same as if blocks were compressed
+   one by one. The last block of input is left for the caller, as it might
+   need to be finished or flushed. */
+static BROTLI_BOOL CompressFastBlocksInParallel(BrotliEncoderState* s,
+    size_t* available_in, const uint8_t** next_in, size_t* available_out,
+    uint8_t** next_out, size_t* total_out) {
+  MemoryManager* m = &s->memory_manager_;
+  const size_t block_size = (size_t)1 << s->params.lgwin;
+  const size_t num_tasks = BROTLI_MIN(size_t, s->num_threads_,
+      (*available_in - 1) / block_size);
+  const size_t table_size = HashTableSize(
+      MaxHashTableSize(FAST_TWO_PASS_COMPRESSION_QUALITY), block_size);
+  const size_t max_out_size = num_tasks * (2 * block_size + 503);
+  const BROTLI_BOOL inplace = TO_BROTLI_BOOL(max_out_size <= *available_out);
+  uint8_t* storage;
+  size_t storage_ix = s->last_bytes_bits_;
+  size_t i;
+
+  if (!EnsureFastTasks(s, num_tasks, block_size)) return BROTLI_FALSE;
+  for (i = 0; i < num_tasks; ++i) {
+    FastBlockTask* task = &s->fast_tasks_[i];
+    BrotliInitMemoryManager(&task->memory_manager,
+        m->alloc_func, m->free_func, m->opaque);
+    task->input = *next_in + i * block_size;
+    task->input_size = block_size;
+    task->table_size = table_size;
+    task->dictionary = &s->params.dictionary;
+    task->max_backward_limit = FastMaxBackwardLimit(s);
+    task->dictionary_start = BROTLI_MIN(size_t,
+        s->params.stream_offset + i * block_size, task->max_backward_limit);
+  }
+  BrotliRunInParallel(CompressFastBlockTask,
+      s->fast_tasks_, sizeof(FastBlockTask), num_tasks);
+  for (i = 0; i < num_tasks; ++i) {
+    if (BROTLI_IS_OOM(&s->fast_tasks_[i].memory_manager)) return BROTLI_FALSE;
+  }
+
+  storage = inplace ? *next_out : GetBrotliStorage(s, max_out_size);
+  if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
+  storage[0] = (uint8_t)s->last_bytes_;
+  storage[1] = (uint8_t)(s->last_bytes_ >> 8);
+  for (i = 0; i < num_tasks; ++i) {
+    FastBlockTask* task = &s->fast_tasks_[i];
+    if (task->is_relocatable) {
+      AppendBits(task->storage, task->storage_ix, &storage_ix, storage);
+    } else {
+      memset(task->table, 0, table_size * sizeof(*task->table));
+      BrotliCompressFragmentTwoPass(m, task->input, block_size, BROTLI_FALSE,
+          task->command_buf, task->literal_buf, task->table, table_size,
+          task->dictionary, task->dictionary_start, task->max_backward_limit,
+          &storage_ix, storage);
+      if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
+    }
+  }
+  ConsumeFastInput(s, num_tasks * block_size, available_in, next_in);
+  EmitFastOutput(s, storage, storage_ix, inplace,
+      available_out, next_out, total_out);
+  return BROTLI_TRUE;
+}
+
 static BROTLI_BOOL BrotliEncoderCompressStreamFast(
     BrotliEncoderState* s, BrotliEncoderOperation op, size_t* available_in,
     const uint8_t** next_in, size_t* available_out, uint8_t** next_out,
@@ -1647,18 +2353,32 @@ static BROTLI_BOOL BrotliEncoderCompressStreamFast(
     if (s->available_out_ == 0 &&
         s->stream_state_ == BROTLI_STREAM_PROCESSING &&
         (*available_in != 0 || op != BROTLI_OPERATION_PROCESS)) {
-      size_t block_size = BROTLI_MIN(size_t, block_size_limit, *available_in);
-      BROTLI_BOOL is_last =
-          (*available_in == block_size) && (op == BROTLI_OPERATION_FINISH);
-      BROTLI_BOOL force_flush =
-          (*available_in == block_size) && (op == BROTLI_OPERATION_FLUSH);
-      size_t max_out_size = 2 * block_size + 503;
+      size_t block_size;
+      BROTLI_BOOL is_last;
+      BROTLI_BOOL force_flush;
+      size_t max_out_size;
       BROTLI_BOOL inplace = BROTLI_TRUE;
       uint8_t* storage = NULL;
       size_t storage_ix = s->last_bytes_bits_;
       size_t table_size;
       int* table;
 
+      if (s->params.quality == FAST_TWO_PASS_COMPRESSION_QUALITY &&
+          s->num_threads_ > 1 && *available_in > 2 * block_size_limit) {
+        if (!CompressFastBlocksInParallel(s, available_in, next_in,
+            available_out, next_out, total_out)) {
+          return BROTLI_FALSE;
+        }
+        continue;
+      }
+
+      block_size = BROTLI_MIN(size_t, block_size_limit, *available_in);
+      is_last =
+          (*available_in == block_size) && (op == BROTLI_OPERATION_FINISH);
+      force_flush =
+          (*available_in == block_size) && (op == BROTLI_OPERATION_FLUSH);
+      max_out_size = 2 * block_size + 503;
+
       if (force_flush && block_size == 0) {
         s->stream_state_ = BROTLI_STREAM_FLUSH_REQUESTED;
         continue;
@@ -1683,28 +2403,13 @@ static BROTLI_BOOL BrotliEncoderCompressStreamFast(
       } else {
         BrotliCompressFragmentTwoPass(m, *next_in, block_size, is_last,
             command_buf, literal_buf, table, table_size,
-            &storage_ix, storage);
+            &s->params.dictionary, s->params.stream_offset,
+            FastMaxBackwardLimit(s), &storage_ix, storage);
         if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
       }
-      if (block_size != 0) {
-        *next_in += block_size;
-        *available_in -= block_size;
-      }
-      if (inplace) {
-        size_t out_bytes = storage_ix >> 3;
-        BROTLI_DCHECK(out_bytes <= *available_out);
-        BROTLI_DCHECK((storage_ix & 7) == 0 || out_bytes < *available_out);
-        *next_out += out_bytes;
-        *available_out -= out_bytes;
-        s->total_out_ += out_bytes;
-        if (total_out) *total_out = s->total_out_;
-      } else {
-        size_t out_bytes = storage_ix >> 3;
-        s->next_out_ = storage;
-        s->available_out_ = out_bytes;
-      }
-      s->last_bytes_ = (uint16_t)(storage[storage_ix >> 3]);
-      s->last_bytes_bits_ = storage_ix & 7u;
+      ConsumeFastInput(s, block_size, available_in, next_in);
+      EmitFastOutput(s, storage, storage_ix, inplace,
+          available_out, next_out, total_out);
 
       if (force_flush) s->stream_state_ = BROTLI_STREAM_FLUSH_REQUESTED;
       if (is_last) s->stream_state_ = BROTLI_STREAM_FINISHED;
@@ -1801,12 +2506,37 @@ static void UpdateSizeHint(BrotliEncoderState* s, size_t available_in) {
   }
 }
 
-BROTLI_BOOL BrotliEncoderCompressStream(
+/* Schedules content size metadata block for output. */
+static void WriteContentSizeHeader(BrotliEncoderState* s) {
+  uint8_t* header = s->tiny_buf_.u8;
+  size_t size = WriteMetadataHeader(
+      s, BROTLI_CONTENT_SIZE_METADATA_LENGTH, header);
+  size_t i;
+  for (i = 0; i < 4; ++i) {
+    header[size + i] = (uint8_t)(BROTLI_CONTENT_SIZE_MAGIC >> (8 * i));
+  }
+  BROTLI_UNALIGNED_STORE64LE(&header[size + 4], s->content_size_);
+  s->next_out_ = header;
+  s->available_out_ = size + BROTLI_CONTENT_SIZE_METADATA_LENGTH;
+  s->content_size_state_ = BROTLI_CONTENT_SIZE_EMITTED;
+}
+
+static BROTLI_BOOL CompressStream(
     BrotliEncoderState* s, BrotliEncoderOperation op, size_t* available_in,
     const uint8_t** next_in, size_t* available_out,uint8_t** next_out,
     size_t* total_out) {
   if (!EnsureInitialized(s)) return BROTLI_FALSE;
 
+  if (s->content_size_state_ == BROTLI_CONTENT_SIZE_PENDING) {
+    /* Container header goes first. */
+    while (s->available_out_ != 0) {
+      if (!InjectFlushOrPushOutput(s, available_out, next_out, total_out)) {
+        return BROTLI_TRUE;
+      }
+    }
+    WriteContentSizeHeader(s);
+  }
+
   /* Unfinished metadata block; check requirements. */
   if (s->remaining_metadata_bytes_ != BROTLI_UINT32_MAX) {
     if (*available_in != s->remaining_metadata_bytes_) return BROTLI_FALSE;
@@ -1827,17 +2557,23 @@ BROTLI_BOOL BrotliEncoderCompressStream(
   if (s->stream_state_ != BROTLI_STREAM_PROCESSING && *available_in != 0) {
     return BROTLI_FALSE;
   }
-  if (s->params.quality == FAST_ONE_PASS_COMPRESSION_QUALITY ||
-      s->params.quality == FAST_TWO_PASS_COMPRESSION_QUALITY) {
+  ApplyPendingParams(s);
+  /* Once ring-buffer is in use, fast qualities are served by EncodeData. */
+  if (IsFastQuality(s->params.quality) && s->input_pos_ == 0) {
     return BrotliEncoderCompressStreamFast(s, op, available_in, next_in,
         available_out, next_out, total_out);
   }
   while (BROTLI_TRUE) {
-    size_t remaining_block_size = RemainingInputBlockSize(s);
+    size_t remaining_block_size;
+    ApplyPendingParams(s);
+    remaining_block_size = RemainingInputBlockSize(s);
     /* Shorten input to flint size. */
     if (s->flint_ >= 0 && remaining_block_size > (size_t)s->flint_) {
       remaining_block_size = (size_t)s->flint_;
     }
+    /* Stop at delay bound; held input is emitted as a meta-block below. */
+    remaining_block_size =
+        BROTLI_MIN(size_t, remaining_block_size, RemainingDelayBytes(s));
 
     if (remaining_block_size != 0 && *available_in != 0) {
       size_t copy_input_size =
@@ -1890,6 +2626,476 @@ BROTLI_BOOL BrotliEncoderCompressStream(
   return BROTLI_TRUE;
 }
 
+/* Chooses the filter looking at the buffered input and schedules container
+   header for output. */
+static void StartFilter(BrotliEncoderState* s) {
+  int id;
+  int param;
+  BrotliSelectFilter(s->filter_mode_, s->filter_distance_,
+      s->filter_buf_, s->filter_size_, &id, &param);
+  if (!BrotliFilterInit(&s->filter_, id, param, BROTLI_TRUE)) {
+    /* Distance is out of range for transposition; fall back to plain. */
+    BrotliFilterInit(&s->filter_, BROTLI_FILTER_ID_NONE, 0, BROTLI_TRUE);
+  }
+  if (s->filter_.id != BROTLI_FILTER_ID_NONE) {
+    s->filter_header_[0] = BROTLI_FILTER_MAGIC;
+    s->filter_header_[1] = BROTLI_FILTER_VERSION;
+    s->filter_header_[2] = s->filter_.id;
+    s->filter_header_[3] = s->filter_.param;
+    /* Nothing is produced yet; header goes first. */
+    s->next_out_ = s->filter_header_;
+    s->available_out_ = BROTLI_FILTER_HEADER_SIZE;
+  }
+  s->is_filter_started_ = BROTLI_TRUE;
+}
+
+static BROTLI_BOOL CompressStreamFiltered(
+    BrotliEncoderState* s, BrotliEncoderOperation op, size_t* available_in,
+    const uint8_t** next_in, size_t* available_out, uint8_t** next_out,
+    size_t* total_out) {
+  MemoryManager* m = &s->memory_manager_;
+  if (!s->filter_buf_) {
+    s->filter_buf_ = BROTLI_ALLOC(m, uint8_t, 2 * BROTLI_FILTER_BUFFER_SIZE);
+    if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(s->filter_buf_)) {
+      return BROTLI_FALSE;
+    }
+  }
+  /* Metadata is not filtered. */
+  if (op == BROTLI_OPERATION_EMIT_METADATA ||
+      s->remaining_metadata_bytes_ != BROTLI_UINT32_MAX) {
+    if (!s->is_filter_started_) StartFilter(s);
+    return CompressStream(s, op, available_in, next_in,
+        available_out, next_out, total_out);
+  }
+  if (s->stream_state_ != BROTLI_STREAM_PROCESSING && *available_in != 0) {
+    return BROTLI_FALSE;
+  }
+  while (BROTLI_TRUE) {
+    BROTLI_BOOL is_last;
+    if (s->filter_fed_ != s->filter_ready_) {
+      size_t available = s->filter_ready_ - s->filter_fed_;
+      const uint8_t* next = s->filter_buf_ + s->filter_fed_;
+      if (!CompressStream(s, BROTLI_OPERATION_PROCESS, &available, &next,
+          available_out, next_out, total_out)) {
+        return BROTLI_FALSE;
+      }
+      s->filter_fed_ = s->filter_ready_ - available;
+      if (available != 0) return BROTLI_TRUE;
+      /* Move the unfiltered tail to the front. */
+      memmove(s->filter_buf_, s->filter_buf_ + s->filter_ready_,
+          s->filter_size_ - s->filter_ready_);
+      s->filter_size_ -= s->filter_ready_;
+      s->filter_ready_ = 0;
+      s->filter_fed_ = 0;
+    }
+    if (*available_in != 0) {
+      size_t copy_size = BROTLI_MIN(size_t, *available_in,
+          BROTLI_FILTER_BUFFER_SIZE - s->filter_size_);
+      memcpy(s->filter_buf_ + s->filter_size_, *next_in, copy_size);
+      s->filter_size_ += copy_size;
+      *next_in += copy_size;
+      *available_in -= copy_size;
+    }
+    if (s->filter_size_ != BROTLI_FILTER_BUFFER_SIZE &&
+        op == BROTLI_OPERATION_PROCESS) {
+      return BROTLI_TRUE;
+    }
+    if (!s->is_filter_started_) StartFilter(s);
+    is_last = TO_BROTLI_BOOL(
+        op == BROTLI_OPERATION_FINISH && *available_in == 0);
+    s->filter_ready_ = BrotliFilterApply(&s->filter_, s->filter_buf_,
+        s->filter_size_, s->filter_buf_ + BROTLI_FILTER_BUFFER_SIZE, is_last);
+    if (s->filter_ready_ == 0) break;
+  }
+  {
+    size_t available = 0;
+    const uint8_t* next = NULL;
+    return CompressStream(s, op, &available, &next,
+        available_out, next_out, total_out);
+  }
+}
+
+/* Decides the content size on the first call; then checks that input does
+   not deviate from it. */
+static BROTLI_BOOL CheckContentSize(BrotliEncoderState* s,
+    BrotliEncoderOperation op, size_t available_in) {
+  uint64_t remaining;
+  if (s->content_size_state_ == BROTLI_CONTENT_SIZE_REQUESTED) {
+    if (s->params.size_hint != 0) {
+      s->content_size_ = s->params.size_hint;
+    } else if (op == BROTLI_OPERATION_FINISH) {
+      s->content_size_ = available_in;
+    } else {
+      s->content_size_state_ = BROTLI_CONTENT_SIZE_NONE;
+      return BROTLI_TRUE;
+    }
+    s->content_size_state_ = BROTLI_CONTENT_SIZE_PENDING;
+  }
+  if (op == BROTLI_OPERATION_EMIT_METADATA) return BROTLI_TRUE;
+  remaining = s->content_size_ - s->content_consumed_;
+  if (available_in > remaining) return BROTLI_FALSE;
+  if (op == BROTLI_OPERATION_FINISH && available_in != remaining) {
+    return BROTLI_FALSE;
+  }
+  return BROTLI_TRUE;
+}
+
+BROTLI_BOOL BrotliEncoderCompressStream(
+    BrotliEncoderState* s, BrotliEncoderOperation op, size_t* available_in,
+    const uint8_t** next_in, size_t* available_out,uint8_t** next_out,
+    size_t* total_out) {
+  const size_t in_size = *available_in;
+  BROTLI_BOOL result;
+  if (!s->is_initialized_) {
+    if (op == BROTLI_OPERATION_FINISH) {
+      s->known_input_size_ = in_size;
+    } else if (s->content_size_state_ == BROTLI_CONTENT_SIZE_REQUESTED &&
+               s->params.size_hint != 0) {
+      s->known_input_size_ = s->params.size_hint;
+    }
+  }
+  if (!EnsureInitialized(s)) return BROTLI_FALSE;
+  if (s->content_size_state_ != BROTLI_CONTENT_SIZE_NONE &&
+      !CheckContentSize(s, op, in_size)) {
+    return BROTLI_FALSE;
+  }
+  if (s->filter_mode_ != BROTLI_FILTER_NONE) {
+    result = CompressStreamFiltered(s, op, available_in, next_in,
+        available_out, next_out, total_out);
+  } else {
+    result = CompressStream(s, op, available_in, next_in,
+        available_out, next_out, total_out);
+  }
+  if (op != BROTLI_OPERATION_EMIT_METADATA) {
+    s->content_consumed_ += in_size - *available_in;
+  }
+  return result;
+}
+
+BROTLI_BOOL BrotliEncoderCompressStreamVec(
+    BrotliEncoderState* s, BrotliEncoderOperation op,
+    BrotliInputSegment* input, size_t num_input,
+    BrotliOutputSegment* output, size_t num_output, size_t* total_out) {
+  size_t i = 0;
+  size_t j = 0;
+  /* Index of the last non-empty input segment; only it is passed with |op|,
+     the preceding ones are just "processed". */
+  size_t last = num_input;
+  while (last > 0 && input[last - 1].size == 0) --last;
+  last = (last > 0) ? last - 1 : 0;
+  if (op == BROTLI_OPERATION_EMIT_METADATA) {
+    size_t k;
+    for (k = 0; k < last; ++k) {
+      if (input[k].size != 0) return BROTLI_FALSE;
+    }
+  }
+  for (;;) {
+    size_t available_in = 0;
+    const uint8_t* next_in = NULL;
+    size_t available_out = 0;
+    uint8_t* next_out = NULL;
+    size_t consumed;
+    size_t produced;
+    while (i < num_input && input[i].size == 0) ++i;
+    while (j < num_output && output[j].size == 0) ++j;
+    if (i < num_input) {
+      available_in = input[i].size;
+      next_in = input[i].data;
+    }
+    if (j < num_output) {
+      available_out = output[j].size;
+      next_out = output[j].data;
+    }
+    if (!BrotliEncoderCompressStream(s,
+        (i < last) ? BROTLI_OPERATION_PROCESS : op,
+        &available_in, &next_in, &available_out, &next_out, total_out)) {
+      return BROTLI_FALSE;
+    }
+    consumed = (i < num_input) ? input[i].size - available_in : 0;
+    produced = (j < num_output) ? output[j].size - available_out : 0;
+    if (i < num_input) {
+      input[i].size = available_in;
+      input[i].data = next_in;
+    }
+    if (j < num_output) {
+      output[j].size = available_out;
+      output[j].data = next_out;
+    }
+    if (consumed == 0 && produced == 0) return BROTLI_TRUE;
+  }
+}
+
+/* Finds the longest prefix of pending data, not longer than |max_bytes|, that
+   ends at a command boundary or inside a run of literals. The prefix consists
+   of |*num_commands| whole commands and |*num_literals| literals from the next
+   command (or from the trailing run). Returns the prefix length. */
+static size_t PendingPrefix(const BrotliEncoderState* s, size_t max_bytes,
+    size_t* num_commands, size_t* num_literals) {
+  size_t pos = 0;
+  size_t i;
+  for (i = 0; i < s->num_commands_; ++i) {
+    const Command* cmd = &s->commands_[i];
+    size_t length = cmd->insert_len_ + CommandCopyLen(cmd);
+    if (pos + length > max_bytes) {
+      *num_commands = i;
+      *num_literals = BROTLI_MIN(size_t, cmd->insert_len_, max_bytes - pos);
+      return pos + *num_literals;
+    }
+    pos += length;
+  }
+  *num_commands = s->num_commands_;
+  *num_literals = BROTLI_MIN(size_t, s->last_insert_len_, max_bytes - pos);
+  return pos + *num_literals;
+}
+
+static const uint32_t kDistanceCacheIndex[] = {
+  0, 1, 2, 3, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1,
+};
+static const int kDistanceCacheOffset[] = {
+  0, 0, 0, 0, -1, 1, -2, 2, -3, 3, -1, 1, -2, 2, -3, 3
+};
+
+/* Calculates the decoder distance cache after the first |num_commands| pending
+   commands. */
+static void ReplayDistanceCache(const BrotliEncoderState* s,
+    size_t num_commands, int* dist_cache) {
+  const uint64_t max_backward_limit =
+      BROTLI_MAX_BACKWARD_LIMIT(s->params.lgwin);
+  uint64_t pos = s->last_flush_pos_ + s->params.stream_offset;
+  size_t i;
+  memcpy(dist_cache, s->saved_dist_cache_, 4 * sizeof(dist_cache[0]));
+  for (i = 0; i < num_commands; ++i) {
+    const Command* cmd = &s->commands_[i];
+    uint32_t code = CommandRestoreDistanceCode(cmd, &s->params.dist);
+    int distance;
+    pos += cmd->insert_len_;
+    if (code == 0) {
+      pos += CommandCopyLen(cmd);
+      continue;
+    }
+    if (code < BROTLI_NUM_DISTANCE_SHORT_CODES) {
+      distance = dist_cache[kDistanceCacheIndex[code]] +
+          kDistanceCacheOffset[code];
+    } else {
+      uint64_t dictionary_start =
+          pos < max_backward_limit ? pos : max_backward_limit;
+      uint64_t backward = code - (BROTLI_NUM_DISTANCE_SHORT_CODES - 1);
+      distance = (int)backward;
+      /* Static dictionary references do not update the cache. */
+      if (backward > dictionary_start) {
+        pos += CommandCopyLen(cmd);
+        continue;
+      }
+    }
+    dist_cache[3] = dist_cache[2];
+    dist_cache[2] = dist_cache[1];
+    dist_cache[1] = dist_cache[0];
+    dist_cache[0] = distance;
+    pos += CommandCopyLen(cmd);
+  }
+}
+
+/* Compresses the first |bytes| of pending data into a byte-aligned meta-block
+   (see PendingPrefix) without changing the encoder state. Sets |dist_cache|
+   to the decoder distance cache after the meta-block. Returns the size of the
+   output, or 0 on OOM. */
+static size_t WriteBudgetedMetaBlock(BrotliEncoderState* s, size_t bytes,
+    Command* commands, uint8_t* storage, int* dist_cache) {
+  MemoryManager* m = &s->memory_manager_;
+  const uint8_t* data = s->ringbuffer_.buffer_;
+  const uint32_t mask = s->ringbuffer_.mask_;
+  const uint32_t wrapped_last_flush_pos = WrapPosition(s->last_flush_pos_);
+  size_t num_commands;
+  size_t num_literals;
+  size_t total_literals;
+  size_t storage_ix = s->last_bytes_bits_;
+  BROTLI_BOOL allow_uncompressed;
+  size_t i;
+  PendingPrefix(s, bytes, &num_commands, &num_literals);
+  total_literals = num_literals;
+  for (i = 0; i < num_commands; ++i) {
+    total_literals += s->commands_[i].insert_len_;
+  }
+  /* Commands left for the next meta-block expect the distance cache updated
+     by the emitted ones; uncompressed meta-block would not do that. */
+  ReplayDistanceCache(s, num_commands, dist_cache);
+  allow_uncompressed = TO_BROTLI_BOOL(
+      bytes == s->input_pos_ - s->last_flush_pos_ ||
+      memcmp(dist_cache, s->saved_dist_cache_, 4 * sizeof(int)) == 0);
+  if (num_commands != 0) {
+    memcpy(commands, s->commands_, num_commands * sizeof(Command));
+  }
+  if (num_literals != 0) InitInsertCommand(&commands[num_commands++],
+                                           num_literals);
+  storage[0] = (uint8_t)s->last_bytes_;
+  storage[1] = (uint8_t)(s->last_bytes_ >> 8);
+  WriteMetaBlockInternal(m, data, mask, s->last_flush_pos_, bytes,
+      BROTLI_FALSE, allow_uncompressed,
+      ChooseContextMode(&s->params, data, wrapped_last_flush_pos, mask, bytes),
+      &s->params, s->prev_byte_, s->prev_byte2_, total_literals, num_commands,
+      commands, s->saved_dist_cache_, dist_cache, &storage_ix, storage);
+  if (BROTLI_IS_OOM(m)) return 0;
+  if ((storage_ix & 7) != 0) {
+    /* Pad with empty meta-data block, same as BROTLI_OPERATION_FLUSH. */
+    BrotliWriteBits(6, 6, &storage_ix, storage);
+  }
+  return (storage_ix + 7) >> 3;
+}
+
+/* Marks the first |bytes| of pending data as emitted; |dist_cache| is the
+   one reported by WriteBudgetedMetaBlock. */
+static void ConsumePendingPrefix(BrotliEncoderState* s, size_t bytes,
+    const int* dist_cache) {
+  const uint8_t* data = s->ringbuffer_.buffer_;
+  const uint32_t mask = s->ringbuffer_.mask_;
+  size_t num_commands;
+  size_t num_literals;
+  size_t i;
+  PendingPrefix(s, bytes, &num_commands, &num_literals);
+  memcpy(s->saved_dist_cache_, dist_cache, sizeof(s->saved_dist_cache_));
+  if (bytes == s->input_pos_ - s->last_flush_pos_) {
+    /* Differs from the current one if meta-block is uncompressed. */
+    memcpy(s->dist_cache_, dist_cache, sizeof(s->saved_dist_cache_));
+    s->num_commands_ = 0;
+    s->last_insert_len_ = 0;
+  } else {
+    s->num_commands_ -= num_commands;
+    memmove(s->commands_, &s->commands_[num_commands],
+        s->num_commands_ * sizeof(Command));
+    if (s->num_commands_ == 0) {
+      s->last_insert_len_ -= num_literals;
+    } else if (num_literals != 0) {
+      Command* cmd = &s->commands_[0];
+      cmd->insert_len_ -= (uint32_t)num_literals;
+      GetLengthCode(cmd->insert_len_, CommandCopyLenCode(cmd),
+          TO_BROTLI_BOOL((cmd->dist_prefix_ & 0x3FF) == 0), &cmd->cmd_prefix_);
+    }
+  }
+  s->num_literals_ = 0;
+  for (i = 0; i < s->num_commands_; ++i) {
+    s->num_literals_ += s->commands_[i].insert_len_;
+  }
+  s->last_flush_pos_ += bytes;
+  s->last_bytes_ = 0;
+  s->last_bytes_bits_ = 0;
+  if (s->last_flush_pos_ > 0) {
+    s->prev_byte_ = data[((uint32_t)s->last_flush_pos_ - 1) & mask];
+  }
+  if (s->last_flush_pos_ > 1) {
+    s->prev_byte2_ = data[(uint32_t)(s->last_flush_pos_ - 2) & mask];
+  }
+}
+
+BROTLI_BOOL BrotliEncoderCompressWithBudget(
+    BrotliEncoderState* s, size_t* available_in, const uint8_t** next_in,
+    size_t* available_out, uint8_t** next_out, size_t* encoded_size) {
+  MemoryManager* m = &s->memory_manager_;
+  const size_t budget = *available_out;
+  Command* commands;
+  uint8_t* storage = NULL;
+  int dist_cache[4];
+  size_t max_pending;
+  size_t pending;
+  size_t size = 0;
+  size_t lo;
+  size_t hi;
+  size_t lo_bytes = 0;
+  *encoded_size = 0;
+  if (!EnsureInitialized(s)) return BROTLI_FALSE;
+  if (s->filter_mode_ != BROTLI_FILTER_NONE ||
+      s->content_size_state_ != BROTLI_CONTENT_SIZE_NONE ||
+      s->remaining_metadata_bytes_ != BROTLI_UINT32_MAX ||
+      s->stream_state_ != BROTLI_STREAM_PROCESSING ||
+      s->flint_ != BROTLI_FLINT_DONE || s->available_out_ != 0) {
+    return BROTLI_FALSE;
+  }
+  ApplyPendingParams(s);
+  if (IsFastQuality(s->params.quality)) return BROTLI_FALSE;
+  UpdateSizeHint(s, *available_in);
+  max_pending = BROTLI_MIN(size_t, MaxMetablockSize(&s->params), 1u << 24);
+
+  /* Take input until the pending data does not fit the budget. Amount of the
+     next portion is projected from the compression ratio achieved so far. */
+  pending = (size_t)(s->input_pos_ - s->last_flush_pos_);
+  while (BROTLI_TRUE) {
+    size_t portion;
+    ContextType literal_context_mode;
+    if (pending != 0) {
+      storage = GetBrotliStorage(s, 2 * pending + 503);
+      commands = BROTLI_ALLOC(m, Command, s->num_commands_ + 1);
+      if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(storage) ||
+          BROTLI_IS_NULL(commands)) {
+        return BROTLI_FALSE;
+      }
+      size = WriteBudgetedMetaBlock(s, pending, commands, storage, dist_cache);
+      BROTLI_FREE(m, commands);
+      if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
+      if (size > budget) break;
+    }
+    if (*available_in == 0 || pending >= max_pending) break;
+    portion = (size == 0) ? 2 * budget :
+        (size_t)((uint64_t)(budget - size) * pending / size);
+    portion += (portion >> 2) + 16;
+    portion = BROTLI_MIN(size_t, portion, *available_in);
+    portion = BROTLI_MIN(size_t, portion, RemainingInputBlockSize(s));
+    portion = BROTLI_MIN(size_t, portion, max_pending - pending);
+    CopyInputToRingBuffer(s, portion, *next_in);
+    if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
+    *next_in += portion;
+    *available_in -= portion;
+    if (!CreateCommands(s, BROTLI_FALSE, &literal_context_mode)) {
+      return BROTLI_FALSE;
+    }
+    if (UpdateLastProcessedPos(s)) HasherReset(&s->hasher_);
+    pending += portion;
+  }
+  if (pending == 0) return BROTLI_TRUE;
+
+  commands = BROTLI_ALLOC(m, Command, s->num_commands_ + 1);
+  if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(commands)) return BROTLI_FALSE;
+  if (size > budget) {
+    /* Binary search for the longest prefix that fits; prefix of |lo| bytes
+       fits, prefix of |hi| bytes does not. */
+    lo = 0;
+    hi = pending;
+    while (hi - lo > 1) {
+      size_t mid = lo + (hi - lo) / 2;
+      size_t num_commands;
+      size_t num_literals;
+      size_t mid_bytes = PendingPrefix(s, mid, &num_commands, &num_literals);
+      if (mid_bytes != lo_bytes) {
+        size = WriteBudgetedMetaBlock(
+            s, mid_bytes, commands, storage, dist_cache);
+        if (BROTLI_IS_OOM(m)) break;
+        if (size > budget) {
+          hi = mid;
+          continue;
+        }
+      }
+      lo = mid;
+      lo_bytes = mid_bytes;
+    }
+    size = 0;
+    if (!BROTLI_IS_OOM(m) && lo_bytes != 0) {
+      size = WriteBudgetedMetaBlock(
+          s, lo_bytes, commands, storage, dist_cache);
+    }
+  } else {
+    lo_bytes = pending;
+  }
+  BROTLI_FREE(m, commands);
+  if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
+  if (lo_bytes == 0) return BROTLI_TRUE;
+
+  memcpy(*next_out, storage, size);
+  *next_out += size;
+  *available_out -= size;
+  s->total_out_ += size;
+  ConsumePendingPrefix(s, lo_bytes, dist_cache);
+  *encoded_size = lo_bytes;
+  return BROTLI_TRUE;
+}
+
 BROTLI_BOOL BrotliEncoderIsFinished(BrotliEncoderState* s) {
   return TO_BROTLI_BOOL(s->stream_state_ == BROTLI_STREAM_FINISHED &&
       !BrotliEncoderHasMoreOutput(s));
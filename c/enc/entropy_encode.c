@@ -407,7 +407,6 @@ void BrotliWriteHuffmanTree(const uint8_t* depth,
                             size_t* tree_size,
                             uint8_t* tree,
                             uint8_t* extra_bits_data) {
-  uint8_t previous_value = BROTLI_INITIAL_REPEATED_CODE_LENGTH;
   size_t i;
   BROTLI_BOOL use_rle_for_non_zero = BROTLI_FALSE;
   BROTLI_BOOL use_rle_for_zero = BROTLI_FALSE;
@@ -430,14 +429,31 @@ void BrotliWriteHuffmanTree(const uint8_t* depth,
                      &use_rle_for_non_zero, &use_rle_for_zero);
   }
 
+  BrotliWriteHuffmanTreeWithRle(depth, new_length, use_rle_for_non_zero,
+      use_rle_for_zero, tree_size, tree, extra_bits_data);
+}
+
+void BrotliWriteHuffmanTreeWithRle(const uint8_t* depth,
+                                   size_t length,
+                                   BROTLI_BOOL use_rle_for_non_zero,
+                                   BROTLI_BOOL use_rle_for_zero,
+                                   size_t* tree_size,
+                                   uint8_t* tree,
+                                   uint8_t* extra_bits_data) {
+  uint8_t previous_value = BROTLI_INITIAL_REPEATED_CODE_LENGTH;
+  size_t i;
+
+  /* Throw away trailing zeros. */
+  while (length > 0 && depth[length - 1] == 0) --length;
+
   /* Actual RLE coding. */
-  for (i = 0; i < new_length;) {
+  for (i = 0; i < length;) {
     const uint8_t value = depth[i];
     size_t reps = 1;
     if ((value != 0 && use_rle_for_non_zero) ||
         (value == 0 && use_rle_for_zero)) {
       size_t k;
-      for (k = i + 1; k < new_length && depth[k] == value; ++k) {
+      for (k = i + 1; k < length && depth[k] == value; ++k) {
         ++reps;
       }
     }
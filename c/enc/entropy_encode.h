@@ -71,6 +71,12 @@ BROTLI_INTERNAL void BrotliWriteHuffmanTree(const uint8_t* depth,
                                             uint8_t* tree,
                                             uint8_t* extra_bits_data);
 
+/* Same as BrotliWriteHuffmanTree, but the caller decides whether runs of
+   zero and non-zero bit depths are run-length coded. */
+BROTLI_INTERNAL void BrotliWriteHuffmanTreeWithRle(const uint8_t* depth,
+    size_t num, BROTLI_BOOL use_rle_for_non_zero, BROTLI_BOOL use_rle_for_zero,
+    size_t* tree_size, uint8_t* tree, uint8_t* extra_bits_data);
+
 /* Get the actual bit values for a tree of bit depths. */
 BROTLI_INTERNAL void BrotliConvertBitDepthsToSymbols(const uint8_t* depth,
                                                      size_t len,
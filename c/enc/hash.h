@@ -95,6 +95,37 @@ static BROTLI_INLINE void PrepareDistanceCache(
   }
 }
 
+/* Checks all distance cache candidates in one pass and returns a bit mask of
+   those that are in range and share a prefix with the current position:
+   2 bytes for the first two candidates, 3 bytes for the rest. Others can not
+   produce an acceptable match, so only survivors need the full-length check.
+   The loop has no data-dependent branches, unlike the per-candidate checks
+   it replaces. */
+static BROTLI_INLINE uint32_t FilterDistanceCache(
+    const uint8_t* BROTLI_RESTRICT data, const size_t ring_buffer_mask,
+    const int* BROTLI_RESTRICT distance_cache, const size_t num_distances,
+    const size_t cur_ix, const size_t max_backward) {
+  const uint32_t current =
+      BROTLI_UNALIGNED_LOAD32LE(&data[cur_ix & ring_buffer_mask]);
+  /* Valid backward distance is in [1, limit]; 0 and negative values wrap. */
+  const size_t limit = BROTLI_MIN(size_t, cur_ix, max_backward);
+  uint32_t result = 0;
+  size_t i;
+  for (i = 0; i < num_distances; ++i) {
+    const size_t backward = (size_t)distance_cache[i];
+    const uint32_t in_range = (backward - 1 < limit) ? 1 : 0;
+    /* Ring buffer might be not fully allocated yet; out of range candidates
+       are redirected to the current position. */
+    const size_t prev_ix = in_range ? cur_ix - backward : cur_ix;
+    const uint32_t prefix_mask = (i < 2) ? 0xFFFFu : 0xFFFFFFu;
+    const uint32_t prefix =
+        BROTLI_UNALIGNED_LOAD32LE(&data[prev_ix & ring_buffer_mask]);
+    const uint32_t match = ((prefix ^ current) & prefix_mask) ? 0 : 1;
+    result |= (match & in_range) << i;
+  }
+  return result;
+}
+
 #define BROTLI_LITERAL_BYTE_SCORE 135
 #define BROTLI_DISTANCE_BIT_PENALTY 30
 /* Score must be positive after applying maximal penalty. */
@@ -224,6 +255,48 @@ static BROTLI_INLINE size_t BackwardMatchLengthCode(const BackwardMatch* self) {
   return code ? code : BackwardMatchLength(self);
 }
 
+/* Caller-supplied match candidate: |length| bytes at |position| likely repeat
+   the bytes |distance| back. Position is (wrapped) ring-buffer position. */
+typedef struct MatchHint {
+  size_t position;
+  size_t distance;
+  size_t length;
+} MatchHint;
+
+/* Hinted matches are not hashed, except for this many last positions. */
+#define BROTLI_HINT_STORE_TAIL 64
+
+/* Verifies hints that cover |cur_ix| and returns the length of the longest
+   actual match (at least 4), or 0. Hints are sorted by position; |*hint_ix|
+   is advanced past the hints that end before |cur_ix|. */
+static BROTLI_INLINE size_t FindHintedMatch(const MatchHint* hints,
+    size_t num_hints, size_t* hint_ix, const uint8_t* data,
+    size_t ring_buffer_mask, size_t cur_ix, size_t max_length,
+    size_t max_distance, size_t* distance) {
+  size_t best_len = 3;
+  size_t i;
+  while (*hint_ix < num_hints &&
+         hints[*hint_ix].position + hints[*hint_ix].length <= cur_ix) {
+    ++(*hint_ix);
+  }
+  for (i = *hint_ix; i < num_hints && hints[i].position <= cur_ix; ++i) {
+    const MatchHint* hint = &hints[i];
+    size_t len;
+    if (hint->position + hint->length <= cur_ix ||
+        hint->distance > max_distance) {
+      continue;
+    }
+    len = FindMatchLengthWithLimit(
+        &data[(cur_ix - hint->distance) & ring_buffer_mask],
+        &data[cur_ix & ring_buffer_mask], max_length);
+    if (len > best_len) {
+      best_len = len;
+      *distance = hint->distance;
+    }
+  }
+  return best_len > 3 ? best_len : 0;
+}
+
 #define EXPAND_CAT(a, b) CAT(a, b)
 #define CAT(a, b) a ## b
 #define FN(X) EXPAND_CAT(X, HASHER())
@@ -244,6 +317,8 @@ static BROTLI_INLINE size_t BackwardMatchLengthCode(const BackwardMatch* self) {
    a little faster (0.5% - 1%) and it compresses 0.15% better on small text
    and HTML inputs. */
 
+#define POSITION_TYPE uint32_t
+
 #define HASHER() H2
 #define BUCKET_BITS 16
 #define BUCKET_SWEEP_BITS 0
@@ -278,6 +353,50 @@ static BROTLI_INLINE size_t BackwardMatchLengthCode(const BackwardMatch* self) {
 #include "./hash_longest_match_inc.h"  /* NOLINT(build/include) */
 #undef HASHER
 
+#undef POSITION_TYPE
+
+/* H12, H13, H14 and H15 are H2, H3, H4 and H5 that keep only the lower 16 bits
+   of positions; tables become twice denser. Backward distance is restored
+   modulo 64KiB, thus farther matches are not found; stale entries turn into
+   nearer candidates, which are verified against the data anyway. */
+#define POSITION_TYPE uint16_t
+
+#define HASHER() H12
+#define BUCKET_BITS 16
+#define BUCKET_SWEEP_BITS 0
+#define HASH_LEN 5
+#define USE_DICTIONARY 1
+#include "./hash_longest_match_quickly_inc.h"  /* NOLINT(build/include) */
+#undef BUCKET_SWEEP_BITS
+#undef USE_DICTIONARY
+#undef HASHER
+
+#define HASHER() H13
+#define BUCKET_SWEEP_BITS 1
+#define USE_DICTIONARY 0
+#include "./hash_longest_match_quickly_inc.h"  /* NOLINT(build/include) */
+#undef USE_DICTIONARY
+#undef BUCKET_SWEEP_BITS
+#undef BUCKET_BITS
+#undef HASHER
+
+#define HASHER() H14
+#define BUCKET_BITS 17
+#define BUCKET_SWEEP_BITS 2
+#define USE_DICTIONARY 1
+#include "./hash_longest_match_quickly_inc.h"  /* NOLINT(build/include) */
+#undef USE_DICTIONARY
+#undef HASH_LEN
+#undef BUCKET_SWEEP_BITS
+#undef BUCKET_BITS
+#undef HASHER
+
+#define HASHER() H15
+#include "./hash_longest_match_inc.h"  /* NOLINT(build/include) */
+#undef HASHER
+
+#undef POSITION_TYPE
+
 #define HASHER() H6
 #include "./hash_longest_match64_inc.h"  /* NOLINT(build/include) */
 #undef HASHER
@@ -317,7 +436,9 @@ static BROTLI_INLINE size_t BackwardMatchLengthCode(const BackwardMatch* self) {
 #define BUCKET_SWEEP_BITS 2
 #define HASH_LEN 7
 #define USE_DICTIONARY 0
+#define POSITION_TYPE uint32_t
 #include "./hash_longest_match_quickly_inc.h"  /* NOLINT(build/include) */
+#undef POSITION_TYPE
 #undef USE_DICTIONARY
 #undef HASH_LEN
 #undef BUCKET_SWEEP_BITS
@@ -373,7 +494,8 @@ static BROTLI_INLINE size_t BackwardMatchLengthCode(const BackwardMatch* self) {
 #undef CAT
 #undef EXPAND_CAT
 
-#define FOR_SIMPLE_HASHERS(H) H(2) H(3) H(4) H(5) H(6) H(40) H(41) H(42) H(54)
+#define FOR_SIMPLE_HASHERS(H) H(2) H(3) H(4) H(5) H(6) H(12) H(13) H(14) \
+    H(15) H(40) H(41) H(42) H(54)
 #define FOR_COMPOSITE_HASHERS(H) H(35) H(55) H(65)
 #define FOR_GENERIC_HASHERS(H) FOR_SIMPLE_HASHERS(H) FOR_COMPOSITE_HASHERS(H)
 #define FOR_ALL_HASHERS(H) FOR_GENERIC_HASHERS(H) H(10)
@@ -481,6 +603,72 @@ static BROTLI_INLINE void InitOrStitchToPreviousBlock(
   }
 }
 
+/* Fills the hasher with |size| bytes of history already placed in the
+   ring-buffer right before |position|. The last few positions are left for
+   StitchToPreviousBlock, which needs the bytes that follow them. */
+static BROTLI_INLINE void HasherPrependHistory(
+    MemoryManager* m, Hasher* hasher, BrotliEncoderParams* params,
+    const uint8_t* data, size_t mask, size_t position, size_t size) {
+  size_t overlap;
+  size_t i;
+  HasherSetup(m, hasher, params, data, position - size, size, BROTLI_FALSE);
+  if (BROTLI_IS_OOM(m)) return;
+  switch (hasher->common.params.type) {
+#define PREPEND_(N)                                             \
+    case N:                                                     \
+      overlap = (StoreLookaheadH ## N()) - 1;                   \
+      for (i = position - size; i + overlap < position; i++) {  \
+        StoreH ## N(&hasher->privat._H ## N, data, mask, i);    \
+      }                                                         \
+      break;
+    FOR_ALL_HASHERS(PREPEND_)
+#undef PREPEND_
+    default: break;
+  }
+}
+
+/* Replaces narrow hasher with its regular counterpart, keeping the contents.
+   REQUIRES: all the positions stored so far fit 16 bits. */
+static BROTLI_INLINE void HasherWiden(
+    MemoryManager* m, Hasher* hasher, BrotliEncoderParams* params) {
+  const uint16_t* narrow = (const uint16_t*)hasher->common.extra;
+  size_t narrow_size;
+  size_t num_size = 0;
+  uint8_t* extra;
+  uint32_t* wide;
+  size_t i;
+  BROTLI_DCHECK(IsNarrowHasher(hasher->common.params.type));
+  params->hasher = hasher->common.params;
+  narrow_size = HasherSize(params, BROTLI_FALSE, 0);
+  params->hasher.type -= 10;
+  if (params->hasher.type == 5) {
+    /* Entry counters of buckets precede the positions; those are kept. */
+    num_size = sizeof(uint16_t) << params->hasher.bucket_bits;
+  }
+  extra = BROTLI_ALLOC(m, uint8_t, HasherSize(params, BROTLI_FALSE, 0));
+  if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(extra)) return;
+  memcpy(extra, narrow, num_size);
+  wide = (uint32_t*)&extra[num_size];
+  narrow += num_size / sizeof(uint16_t);
+  for (i = 0; i < (narrow_size - num_size) / sizeof(uint16_t); ++i) {
+    wide[i] = narrow[i];
+  }
+  BROTLI_FREE(m, hasher->common.extra);
+  hasher->common.extra = extra;
+  hasher->common.params = params->hasher;
+  switch (hasher->common.params.type) {
+#define INITIALIZE_(N)                        \
+    case N:                                   \
+      InitializeH ## N(&hasher->common,       \
+          &hasher->privat._H ## N, params);   \
+      break;
+    FOR_ALL_HASHERS(INITIALIZE_);
+#undef INITIALIZE_
+    default:
+      break;
+  }
+}
+
 #if defined(__cplusplus) || defined(c_plusplus)
 }  /* extern "C" */
 #endif
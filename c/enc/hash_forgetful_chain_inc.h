@@ -52,6 +52,12 @@ typedef struct HashForgetfulChain {
   void* extra;
   HasherCommon* common;
 
+  /* Best match of the last search; see FN(FindLongestMatch). */
+  size_t last_ix;
+  size_t last_backward;
+  size_t last_len;
+  size_t last_max_length;
+
   /* --- Dynamic size members --- */
 
   /* uint32_t addr[BUCKET_SIZE]; */
@@ -87,6 +93,7 @@ static void FN(Initialize)(
   self->extra = common->extra;
 
   self->max_hops = (params->quality > 6 ? 7u : 8u) << (params->quality - 4);
+  self->last_len = 0;
 }
 
 static void FN(Prepare)(
@@ -114,6 +121,7 @@ static void FN(Prepare)(
   }
   memset(tiny_hash, 0, sizeof(uint8_t) * 65536);
   memset(self->free_slot_idx, 0, sizeof(self->free_slot_idx));
+  self->last_len = 0;
 }
 
 static BROTLI_INLINE size_t FN(HashMemAllocInBytes)(
@@ -187,7 +195,11 @@ static BROTLI_INLINE void FN(PrepareDistanceCache)(
    Does not look for matches longer than max_length.
    Does not look for matches further away than max_backward.
    Writes the best match into |out|.
-   |out|->score is updated only if a better match is found. */
+   |out|->score is updated only if a better match is found.
+
+   The best match is remembered; when the next search is at cur_ix + 1 with
+   max_length - 1 (lazy matching), the length of the match at the same
+   distance is known to be one less, and the bytes are not compared again. */
 static BROTLI_INLINE void FN(FindLongestMatch)(
     HashForgetfulChain* BROTLI_RESTRICT self,
     const BrotliEncoderDictionary* dictionary,
@@ -205,11 +217,18 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
   score_t min_score = out->score;
   score_t best_score = out->score;
   size_t best_len = out->len;
+  size_t known_backward = 0;
+  size_t known_len = 0;
   size_t i;
   const size_t key = FN(HashBytes)(&data[cur_ix_masked]);
   const uint8_t tiny_hash = (uint8_t)(key);
   out->len = 0;
   out->len_code_delta = 0;
+  if (cur_ix == self->last_ix + 1 &&
+      max_length + 1 == self->last_max_length && self->last_len > 1) {
+    known_backward = self->last_backward;
+    known_len = self->last_len - 1;
+  }
   /* Try last distance first. */
   for (i = 0; i < NUM_LAST_DISTANCES_TO_CHECK; ++i) {
     const size_t backward = (size_t)distance_cache[i];
@@ -221,9 +240,9 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
     }
     prev_ix &= ring_buffer_mask;
     {
-      const size_t len = FindMatchLengthWithLimit(&data[prev_ix],
-                                                  &data[cur_ix_masked],
-                                                  max_length);
+      const size_t len = (backward == known_backward) ? known_len :
+          FindMatchLengthWithLimit(&data[prev_ix], &data[cur_ix_masked],
+                                   max_length);
       if (len >= 2) {
         score_t score = BackwardReferenceScoreUsingLastDistance(len);
         if (best_score < score) {
@@ -259,9 +278,9 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
         continue;
       }
       {
-        const size_t len = FindMatchLengthWithLimit(&data[prev_ix],
-                                                    &data[cur_ix_masked],
-                                                    max_length);
+        const size_t len = (backward == known_backward) ? known_len :
+            FindMatchLengthWithLimit(&data[prev_ix], &data[cur_ix_masked],
+                                     max_length);
         if (len >= 4) {
           /* Comparing for >= 3 does not change the semantics, but just saves
              for a few unnecessary binary logarithms in backward reference
@@ -279,6 +298,10 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
     }
     FN(Store)(self, data, ring_buffer_mask, cur_ix);
   }
+  self->last_ix = cur_ix;
+  self->last_backward = out->distance;
+  self->last_len = out->len;
+  self->last_max_length = max_length;
   if (out->score == min_score) {
     SearchInStaticDictionary(dictionary,
         self->common, &data[cur_ix_masked], max_length, dictionary_distance,
@@ -48,6 +48,12 @@ typedef struct HashLongestMatch {
   /* Shortcuts. */
   HasherCommon* common_;
 
+  /* Best match of the last search; see FN(FindLongestMatch). */
+  size_t last_ix_;
+  size_t last_backward_;
+  size_t last_len_;
+  size_t last_max_length_;
+
   /* --- Dynamic size members --- */
 
   /* Number of entries in a particular bucket. */
@@ -73,6 +79,8 @@ static void FN(Initialize)(
       common->params.num_last_distances_to_check;
   self->num_ = (uint16_t*)common->extra;
   self->buckets_ = (uint32_t*)&self->num_[self->bucket_size_];
+  self->last_ix_ = 0;
+  self->last_len_ = 0;
 }
 
 static void FN(Prepare)(
@@ -81,6 +89,8 @@ static void FN(Prepare)(
   uint16_t* BROTLI_RESTRICT num = self->num_;
   /* Partial preparation is 100 times slower (per socket). */
   size_t partial_prepare_threshold = self->bucket_size_ >> 6;
+  self->last_ix_ = 0;
+  self->last_len_ = 0;
   if (one_shot && input_size <= partial_prepare_threshold) {
     size_t i;
     for (i = 0; i < input_size; ++i) {
@@ -158,7 +168,11 @@ static BROTLI_INLINE void FN(PrepareDistanceCache)(
    Does not look for matches longer than max_length.
    Does not look for matches further away than max_backward.
    Writes the best match into |out|.
-   |out|->score is updated only if a better match is found. */
+   |out|->score is updated only if a better match is found.
+
+   The best match is remembered; when the next search is at cur_ix + 1 with
+   max_length - 1 (lazy matching), the length of the match at the same
+   distance is known to be one less, and the bytes are not compared again. */
 static BROTLI_INLINE void FN(FindLongestMatch)(
     HashLongestMatch* BROTLI_RESTRICT self,
     const BrotliEncoderDictionary* dictionary,
@@ -174,20 +188,26 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
   score_t min_score = out->score;
   score_t best_score = out->score;
   size_t best_len = out->len;
+  size_t known_backward = 0;
+  size_t known_len = 0;
+  uint32_t candidates;
   size_t i;
   out->len = 0;
   out->len_code_delta = 0;
+  if (self->last_len_ > 1 && cur_ix == self->last_ix_ + 1 &&
+      max_length + 1 == self->last_max_length_) {
+    known_backward = self->last_backward_;
+    known_len = self->last_len_ - 1;
+  }
   /* Try last distance first. */
-  for (i = 0; i < (size_t)self->num_last_distances_to_check_; ++i) {
+  candidates = FilterDistanceCache(data, ring_buffer_mask, distance_cache,
+      (size_t)self->num_last_distances_to_check_, cur_ix, max_backward);
+  for (i = 0; candidates != 0; ++i, candidates >>= 1) {
     const size_t backward = (size_t)distance_cache[i];
-    size_t prev_ix = (size_t)(cur_ix - backward);
-    if (prev_ix >= cur_ix) {
-      continue;
-    }
-    if (BROTLI_PREDICT_FALSE(backward > max_backward)) {
+    const size_t prev_ix = (size_t)(cur_ix - backward) & ring_buffer_mask;
+    if ((candidates & 1) == 0) {
       continue;
     }
-    prev_ix &= ring_buffer_mask;
 
     if (cur_ix_masked + best_len > ring_buffer_mask ||
         prev_ix + best_len > ring_buffer_mask ||
@@ -195,9 +215,9 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
       continue;
     }
     {
-      const size_t len = FindMatchLengthWithLimit(&data[prev_ix],
-                                                  &data[cur_ix_masked],
-                                                  max_length);
+      const size_t len = (backward == known_backward) ? known_len :
+          FindMatchLengthWithLimit(&data[prev_ix], &data[cur_ix_masked],
+                                   max_length);
       if (len >= 3 || (len == 2 && i < 2)) {
         /* Comparing for >= 2 does not change the semantics, but just saves for
            a few unnecessary binary logarithms in backward reference score,
@@ -236,9 +256,9 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
         continue;
       }
       {
-        const size_t len = FindMatchLengthWithLimit(&data[prev_ix],
-                                                    &data[cur_ix_masked],
-                                                    max_length);
+        const size_t len = (backward == known_backward) ? known_len :
+            FindMatchLengthWithLimit(&data[prev_ix], &data[cur_ix_masked],
+                                     max_length);
         if (len >= 4) {
           /* Comparing for >= 3 does not change the semantics, but just saves
              for a few unnecessary binary logarithms in backward reference
@@ -257,6 +277,10 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
     bucket[num[key] & self->block_mask_] = (uint32_t)cur_ix;
     ++num[key];
   }
+  self->last_ix_ = cur_ix;
+  self->last_backward_ = out->distance;
+  self->last_len_ = out->len;
+  self->last_max_length_ = max_length;
   if (min_score == out->score) {
     SearchInStaticDictionary(dictionary,
         self->common_, &data[cur_ix_masked], max_length, dictionary_distance,
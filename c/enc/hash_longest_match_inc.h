@@ -5,7 +5,7 @@
    See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
 */
 
-/* template parameters: FN */
+/* template parameters: FN, POSITION_TYPE */
 
 /* A (forgetful) hash table to the data seen by the compressor, to
    help create backward references to previous data.
@@ -45,13 +45,19 @@ typedef struct HashLongestMatch {
   /* Shortcuts. */
   HasherCommon* common_;
 
+  /* Best match of the last search; see FN(FindLongestMatch). */
+  size_t last_ix_;
+  size_t last_backward_;
+  size_t last_len_;
+  size_t last_max_length_;
+
   /* --- Dynamic size members --- */
 
   /* Number of entries in a particular bucket. */
   uint16_t* num_;  /* uint16_t[bucket_size]; */
 
   /* Buckets containing block_size_ of backward references. */
-  uint32_t* buckets_;  /* uint32_t[bucket_size * block_size]; */
+  POSITION_TYPE* buckets_;  /* POSITION_TYPE[bucket_size * block_size]; */
 } HashLongestMatch;
 
 static BROTLI_INLINE uint16_t* FN(Num)(void* extra) {
@@ -69,10 +75,12 @@ static void FN(Initialize)(
   self->block_size_ = (size_t)1 << common->params.block_bits;
   self->block_mask_ = (uint32_t)(self->block_size_ - 1);
   self->num_ = (uint16_t*)common->extra;
-  self->buckets_ = (uint32_t*)(&self->num_[self->bucket_size_]);
+  self->buckets_ = (POSITION_TYPE*)(&self->num_[self->bucket_size_]);
   self->block_bits_ = common->params.block_bits;
   self->num_last_distances_to_check_ =
       common->params.num_last_distances_to_check;
+  self->last_ix_ = 0;
+  self->last_len_ = 0;
 }
 
 static void FN(Prepare)(
@@ -81,6 +89,8 @@ static void FN(Prepare)(
   uint16_t* BROTLI_RESTRICT num = self->num_;
   /* Partial preparation is 100 times slower (per socket). */
   size_t partial_prepare_threshold = self->bucket_size_ >> 6;
+  self->last_ix_ = 0;
+  self->last_len_ = 0;
   if (one_shot && input_size <= partial_prepare_threshold) {
     size_t i;
     for (i = 0; i < input_size; ++i) {
@@ -100,7 +110,7 @@ static BROTLI_INLINE size_t FN(HashMemAllocInBytes)(
   BROTLI_UNUSED(one_shot);
   BROTLI_UNUSED(input_size);
   return sizeof(uint16_t) * bucket_size +
-         sizeof(uint32_t) * bucket_size * block_size;
+         sizeof(POSITION_TYPE) * bucket_size * block_size;
 }
 
 /* Look at 4 bytes at &data[ix & mask].
@@ -111,7 +121,7 @@ static BROTLI_INLINE void FN(Store)(
   const uint32_t key = FN(HashBytes)(&data[ix & mask], self->hash_shift_);
   const size_t minor_ix = self->num_[key] & self->block_mask_;
   const size_t offset = minor_ix + (key << self->block_bits_);
-  self->buckets_[offset] = (uint32_t)ix;
+  self->buckets_[offset] = (POSITION_TYPE)ix;
   ++self->num_[key];
 }
 
@@ -154,7 +164,11 @@ static BROTLI_INLINE void FN(PrepareDistanceCache)(
    Does not look for matches longer than max_length.
    Does not look for matches further away than max_backward.
    Writes the best match into |out|.
-   |out|->score is updated only if a better match is found. */
+   |out|->score is updated only if a better match is found.
+
+   The best match is remembered; when the next search is at cur_ix + 1 with
+   max_length - 1 (lazy matching), the length of the match at the same
+   distance is known to be one less, and the bytes are not compared again. */
 static BROTLI_INLINE void FN(FindLongestMatch)(
     HashLongestMatch* BROTLI_RESTRICT self,
     const BrotliEncoderDictionary* dictionary,
@@ -164,26 +178,32 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
     const size_t dictionary_distance, const size_t max_distance,
     HasherSearchResult* BROTLI_RESTRICT out) {
   uint16_t* BROTLI_RESTRICT num = self->num_;
-  uint32_t* BROTLI_RESTRICT buckets = self->buckets_;
+  POSITION_TYPE* BROTLI_RESTRICT buckets = self->buckets_;
   const size_t cur_ix_masked = cur_ix & ring_buffer_mask;
   /* Don't accept a short copy from far away. */
   score_t min_score = out->score;
   score_t best_score = out->score;
   size_t best_len = out->len;
+  size_t known_backward = 0;
+  size_t known_len = 0;
+  uint32_t candidates;
   size_t i;
   out->len = 0;
   out->len_code_delta = 0;
+  if (self->last_len_ > 1 && cur_ix == self->last_ix_ + 1 &&
+      max_length + 1 == self->last_max_length_) {
+    known_backward = self->last_backward_;
+    known_len = self->last_len_ - 1;
+  }
   /* Try last distance first. */
-  for (i = 0; i < (size_t)self->num_last_distances_to_check_; ++i) {
+  candidates = FilterDistanceCache(data, ring_buffer_mask, distance_cache,
+      (size_t)self->num_last_distances_to_check_, cur_ix, max_backward);
+  for (i = 0; candidates != 0; ++i, candidates >>= 1) {
     const size_t backward = (size_t)distance_cache[i];
-    size_t prev_ix = (size_t)(cur_ix - backward);
-    if (prev_ix >= cur_ix) {
-      continue;
-    }
-    if (BROTLI_PREDICT_FALSE(backward > max_backward)) {
+    const size_t prev_ix = (size_t)(cur_ix - backward) & ring_buffer_mask;
+    if ((candidates & 1) == 0) {
       continue;
     }
-    prev_ix &= ring_buffer_mask;
 
     if (cur_ix_masked + best_len > ring_buffer_mask ||
         prev_ix + best_len > ring_buffer_mask ||
@@ -191,9 +211,9 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
       continue;
     }
     {
-      const size_t len = FindMatchLengthWithLimit(&data[prev_ix],
-                                                  &data[cur_ix_masked],
-                                                  max_length);
+      const size_t len = (backward == known_backward) ? known_len :
+          FindMatchLengthWithLimit(&data[prev_ix], &data[cur_ix_masked],
+                                   max_length);
       if (len >= 3 || (len == 2 && i < 2)) {
         /* Comparing for >= 2 does not change the semantics, but just saves for
            a few unnecessary binary logarithms in backward reference score,
@@ -215,25 +235,25 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
   {
     const uint32_t key =
         FN(HashBytes)(&data[cur_ix_masked], self->hash_shift_);
-    uint32_t* BROTLI_RESTRICT bucket = &buckets[key << self->block_bits_];
+    POSITION_TYPE* BROTLI_RESTRICT bucket = &buckets[key << self->block_bits_];
     const size_t down =
         (num[key] > self->block_size_) ? (num[key] - self->block_size_) : 0u;
     for (i = num[key]; i > down;) {
-      size_t prev_ix = bucket[--i & self->block_mask_];
-      const size_t backward = cur_ix - prev_ix;
-      if (BROTLI_PREDICT_FALSE(backward > max_backward)) {
+      const size_t backward =
+          (POSITION_TYPE)(cur_ix - bucket[--i & self->block_mask_]);
+      const size_t prev_ix = (cur_ix - backward) & ring_buffer_mask;
+      if (BROTLI_PREDICT_FALSE(backward == 0 || backward > max_backward)) {
         break;
       }
-      prev_ix &= ring_buffer_mask;
       if (cur_ix_masked + best_len > ring_buffer_mask ||
           prev_ix + best_len > ring_buffer_mask ||
           data[cur_ix_masked + best_len] != data[prev_ix + best_len]) {
         continue;
       }
       {
-        const size_t len = FindMatchLengthWithLimit(&data[prev_ix],
-                                                    &data[cur_ix_masked],
-                                                    max_length);
+        const size_t len = (backward == known_backward) ? known_len :
+            FindMatchLengthWithLimit(&data[prev_ix], &data[cur_ix_masked],
+                                     max_length);
         if (len >= 4) {
           /* Comparing for >= 3 does not change the semantics, but just saves
              for a few unnecessary binary logarithms in backward reference
@@ -249,9 +269,13 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
         }
       }
     }
-    bucket[num[key] & self->block_mask_] = (uint32_t)cur_ix;
+    bucket[num[key] & self->block_mask_] = (POSITION_TYPE)cur_ix;
     ++num[key];
   }
+  self->last_ix_ = cur_ix;
+  self->last_backward_ = out->distance;
+  self->last_len_ = out->len;
+  self->last_max_length_ = max_length;
   if (min_score == out->score) {
     SearchInStaticDictionary(dictionary,
         self->common_, &data[cur_ix_masked], max_length, dictionary_distance,
@@ -6,7 +6,7 @@
 */
 
 /* template parameters: FN, BUCKET_BITS, BUCKET_SWEEP_BITS, HASH_LEN,
-                        USE_DICTIONARY
+                        USE_DICTIONARY, POSITION_TYPE
  */
 
 #define HashLongestMatchQuickly HASHER()
@@ -40,7 +40,7 @@ typedef struct HashLongestMatchQuickly {
 
   /* --- Dynamic size members --- */
 
-  uint32_t* buckets_;  /* uint32_t[BUCKET_SIZE]; */
+  POSITION_TYPE* buckets_;  /* POSITION_TYPE[BUCKET_SIZE]; */
 } HashLongestMatchQuickly;
 
 static void FN(Initialize)(
@@ -49,13 +49,13 @@ static void FN(Initialize)(
   self->common = common;
 
   BROTLI_UNUSED(params);
-  self->buckets_ = (uint32_t*)common->extra;
+  self->buckets_ = (POSITION_TYPE*)common->extra;
 }
 
 static void FN(Prepare)(
     HashLongestMatchQuickly* BROTLI_RESTRICT self, BROTLI_BOOL one_shot,
     size_t input_size, const uint8_t* BROTLI_RESTRICT data) {
-  uint32_t* BROTLI_RESTRICT buckets = self->buckets_;
+  POSITION_TYPE* BROTLI_RESTRICT buckets = self->buckets_;
   /* Partial preparation is 100 times slower (per socket). */
   size_t partial_prepare_threshold = BUCKET_SIZE >> 5;
   if (one_shot && input_size <= partial_prepare_threshold) {
@@ -76,7 +76,7 @@ static void FN(Prepare)(
        not filling will make the results of the compression stochastic
        (but correct). This is because random data would cause the
        system to find accidentally good backward references here and there. */
-    memset(buckets, 0, sizeof(uint32_t) * BUCKET_SIZE);
+    memset(buckets, 0, sizeof(POSITION_TYPE) * BUCKET_SIZE);
   }
 }
 
@@ -86,7 +86,7 @@ static BROTLI_INLINE size_t FN(HashMemAllocInBytes)(
   BROTLI_UNUSED(params);
   BROTLI_UNUSED(one_shot);
   BROTLI_UNUSED(input_size);
-  return sizeof(uint32_t) * BUCKET_SIZE;
+  return sizeof(POSITION_TYPE) * BUCKET_SIZE;
 }
 
 /* Look at 5 bytes at &data[ix & mask].
@@ -97,11 +97,11 @@ static BROTLI_INLINE void FN(Store)(
     const uint8_t* BROTLI_RESTRICT data, const size_t mask, const size_t ix) {
   const uint32_t key = FN(HashBytes)(&data[ix & mask]);
   if (BUCKET_SWEEP == 1) {
-    self->buckets_[key] = (uint32_t)ix;
+    self->buckets_[key] = (POSITION_TYPE)ix;
   } else {
     /* Wiggle the value with the bucket sweep range. */
     const uint32_t off = ix & BUCKET_SWEEP_MASK;
-    self->buckets_[(key + off) & BUCKET_MASK] = (uint32_t)ix;
+    self->buckets_[(key + off) & BUCKET_MASK] = (POSITION_TYPE)ix;
   }
 }
 
@@ -152,7 +152,7 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
     const size_t cur_ix, const size_t max_length, const size_t max_backward,
     const size_t dictionary_distance, const size_t max_distance,
     HasherSearchResult* BROTLI_RESTRICT out) {
-  uint32_t* BROTLI_RESTRICT buckets = self->buckets_;
+  POSITION_TYPE* BROTLI_RESTRICT buckets = self->buckets_;
   const size_t best_len_in = out->len;
   const size_t cur_ix_masked = cur_ix & ring_buffer_mask;
   int compare_char = data[cur_ix_masked + best_len_in];
@@ -176,7 +176,7 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
           out->distance = cached_backward;
           out->score = score;
           if (BUCKET_SWEEP == 1) {
-            buckets[key] = (uint32_t)cur_ix;
+            buckets[key] = (POSITION_TYPE)cur_ix;
             return;
           } else {
             best_len = len;
@@ -191,10 +191,9 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
     size_t backward;
     size_t len;
     /* Only one to look for, don't bother to prepare for a loop. */
-    prev_ix = buckets[key];
-    buckets[key] = (uint32_t)cur_ix;
-    backward = cur_ix - prev_ix;
-    prev_ix &= (uint32_t)ring_buffer_mask;
+    backward = (POSITION_TYPE)(cur_ix - buckets[key]);
+    buckets[key] = (POSITION_TYPE)cur_ix;
+    prev_ix = (cur_ix - backward) & ring_buffer_mask;
     if (compare_char != data[prev_ix + best_len_in]) {
       return;
     }
@@ -223,9 +222,8 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
     for (i = 0; i < BUCKET_SWEEP; ++i) {
       size_t len;
       size_t backward;
-      prev_ix = buckets[keys[i]];
-      backward = cur_ix - prev_ix;
-      prev_ix &= (uint32_t)ring_buffer_mask;
+      backward = (POSITION_TYPE)(cur_ix - buckets[keys[i]]);
+      prev_ix = (cur_ix - backward) & ring_buffer_mask;
       if (compare_char != data[prev_ix + best_len]) {
         continue;
       }
@@ -254,7 +252,7 @@ static BROTLI_INLINE void FN(FindLongestMatch)(
         max_distance, out, BROTLI_TRUE);
   }
   if (BUCKET_SWEEP != 1) {
-    buckets[key_out] = (uint32_t)cur_ix;
+    buckets[key_out] = (POSITION_TYPE)cur_ix;
   }
 }
 
@@ -152,7 +152,13 @@ static BROTLI_INLINE BackwardMatch* FN(StoreAndFindMatches)(
     }
     {
       const size_t cur_len = BROTLI_MIN(size_t, best_len_left, best_len_right);
+      /* Children are adjacent in |forest|; while current node is compared,
+         fetch the data of both, since the walk continues to one of them. */
+      const size_t left = forest[FN(LeftChildIndex)(self, prev_ix)];
+      const size_t right = forest[FN(RightChildIndex)(self, prev_ix)];
       size_t len;
+      BROTLI_PREFETCH(&data[(left & ring_buffer_mask) + cur_len]);
+      BROTLI_PREFETCH(&data[(right & ring_buffer_mask) + cur_len]);
       BROTLI_DCHECK(cur_len <= MAX_TREE_COMP_LENGTH);
       len = cur_len +
           FindMatchLengthWithLimit(&data[cur_ix_masked + cur_len],
@@ -15,8 +15,10 @@
 #include <brotli/types.h>
 #include "./bit_cost.h"
 #include "./block_splitter.h"
+#include "./brotli_bit_stream.h"
 #include "./cluster.h"
 #include "./entropy_encode.h"
+#include "./fast_log.h"
 #include "./histogram.h"
 #include "./memory.h"
 #include "./quality.h"
@@ -283,16 +285,35 @@ void BrotliBuildMetaBlock(MemoryManager* m,
   BROTLI_FREE(m, distance_histograms);
 }
 
+/* p * log2(p), as summed up by ShannonEntropy. */
+static BROTLI_INLINE double PLog2P(size_t p) {
+  return (double)p * FastLog2(p);
+}
+
+/* Same as BitsEntropy, for a histogram given by the sum of p * log2(p) and
+   the sum of p over its symbols. */
+static BROTLI_INLINE double BitsEntropyFromSums(double plogp, size_t sum) {
+  double retval = (sum ? PLog2P(sum) : 0.0) - plogp;
+  if (retval < (double)sum) retval = (double)sum;
+  return retval;
+}
+
 #define FN(X) X ## Literal
+#define DATA_SIZE BROTLI_NUM_LITERAL_SYMBOLS
 #include "./metablock_inc.h"  /* NOLINT(build/include) */
+#undef DATA_SIZE
 #undef FN
 
 #define FN(X) X ## Command
+#define DATA_SIZE BROTLI_NUM_COMMAND_SYMBOLS
 #include "./metablock_inc.h"  /* NOLINT(build/include) */
+#undef DATA_SIZE
 #undef FN
 
 #define FN(X) X ## Distance
+#define DATA_SIZE BROTLI_NUM_HISTOGRAM_DISTANCE_SYMBOLS
 #include "./metablock_inc.h"  /* NOLINT(build/include) */
+#undef DATA_SIZE
 #undef FN
 
 #define BROTLI_MAX_STATIC_CONTEXTS 13
@@ -328,6 +349,14 @@ typedef struct ContextBlockSplitter {
   size_t last_histogram_ix_[2];
   /* Entropy of the previous two block types. */
   double last_entropy_[2 * BROTLI_MAX_STATIC_CONTEXTS];
+  /* Sum of p * log2(p) and sum of p over the histograms of the previous two
+     block types. */
+  double last_plogp_[2 * BROTLI_MAX_STATIC_CONTEXTS];
+  size_t last_sum_[2 * BROTLI_MAX_STATIC_CONTEXTS];
+  /* (context << 8) | symbol for the symbols that occur in the current block,
+     in order of appearance. */
+  uint16_t symbols_[BROTLI_MAX_STATIC_CONTEXTS * 256 + 1];
+  size_t num_symbols_;
   /* The number of times we merged the current block with the last one. */
   size_t merge_last_count_;
 } ContextBlockSplitter;
@@ -353,6 +382,7 @@ static void InitContextBlockSplitter(
   self->block_size_ = 0;
   self->curr_histogram_ix_ = 0;
   self->merge_last_count_ = 0;
+  self->num_symbols_ = 0;
 
   /* We have to allocate one more histogram than the maximum number of block
      types for the current histogram when the meta-block is too big. */
@@ -375,16 +405,81 @@ static void InitContextBlockSplitter(
   self->last_histogram_ix_[0] = self->last_histogram_ix_[1] = 0;
 }
 
+/* Computes the sums of p * log2(p) and of p for the current histograms and
+   for their unions with the histograms of the previous two block types. Only
+   symbols of the current block are visited. */
+static void ContextBlockSplitterEntropySums(ContextBlockSplitter* self,
+    double* plogp, size_t* sum, double* combined_plogp,
+    size_t* combined_sum) {
+  const size_t num_contexts = self->num_contexts_;
+  const HistogramLiteral* histo = &self->histograms_[self->curr_histogram_ix_];
+  const HistogramLiteral* last0 =
+      &self->histograms_[self->last_histogram_ix_[0]];
+  const HistogramLiteral* last1 =
+      &self->histograms_[self->last_histogram_ix_[1]];
+  size_t i;
+  size_t k;
+  for (i = 0; i < num_contexts; ++i) {
+    plogp[i] = 0.0;
+    sum[i] = 0;
+    combined_plogp[i] = self->last_plogp_[i];
+    combined_plogp[num_contexts + i] = self->last_plogp_[num_contexts + i];
+  }
+  for (k = 0; k < self->num_symbols_; ++k) {
+    size_t context = self->symbols_[k] >> 8;
+    size_t symbol = self->symbols_[k] & 0xFF;
+    size_t p = histo[context].data_[symbol];
+    size_t b0 = last0[context].data_[symbol];
+    size_t b1 = last1[context].data_[symbol];
+    if (symbol >= self->alphabet_size_) continue;
+    sum[context] += p;
+    plogp[context] += PLog2P(p);
+    combined_plogp[context] += PLog2P(p + b0) - PLog2P(b0);
+    combined_plogp[num_contexts + context] += PLog2P(p + b1) - PLog2P(b1);
+  }
+  for (i = 0; i < num_contexts; ++i) {
+    combined_sum[i] = self->last_sum_[i] + sum[i];
+    combined_sum[num_contexts + i] = self->last_sum_[num_contexts + i] + sum[i];
+  }
+}
+
+/* Adds the current histograms to the ones starting at |dst_ix| and clears
+   them. */
+static void ContextBlockSplitterMoveCurrent(
+    ContextBlockSplitter* self, size_t dst_ix) {
+  HistogramLiteral* histo = &self->histograms_[self->curr_histogram_ix_];
+  HistogramLiteral* dst = &self->histograms_[dst_ix];
+  size_t i;
+  size_t k;
+  for (k = 0; k < self->num_symbols_; ++k) {
+    size_t context = self->symbols_[k] >> 8;
+    size_t symbol = self->symbols_[k] & 0xFF;
+    dst[context].data_[symbol] += histo[context].data_[symbol];
+    histo[context].data_[symbol] = 0;
+  }
+  for (i = 0; i < self->num_contexts_; ++i) {
+    dst[i].total_count_ += histo[i].total_count_;
+    histo[i].total_count_ = 0;
+    histo[i].bit_cost_ = HUGE_VAL;
+  }
+  self->num_symbols_ = 0;
+}
+
 /* Does either of three things:
      (1) emits the current block with a new block type;
      (2) emits the current block with the type of the second last block;
      (3) merges the current block with the last block. */
 static void ContextBlockSplitterFinishBlock(
-    ContextBlockSplitter* self, MemoryManager* m, BROTLI_BOOL is_final) {
+    ContextBlockSplitter* self, BROTLI_BOOL is_final) {
   BlockSplit* split = self->split_;
   const size_t num_contexts = self->num_contexts_;
   double* last_entropy = self->last_entropy_;
-  HistogramLiteral* histograms = self->histograms_;
+  double* last_plogp = self->last_plogp_;
+  size_t* last_sum = self->last_sum_;
+  double plogp[BROTLI_MAX_STATIC_CONTEXTS];
+  size_t sum[BROTLI_MAX_STATIC_CONTEXTS];
+  double combined_plogp[2 * BROTLI_MAX_STATIC_CONTEXTS];
+  size_t combined_sum[2 * BROTLI_MAX_STATIC_CONTEXTS];
 
   if (self->block_size_ < self->min_block_size_) {
     self->block_size_ = self->min_block_size_;
@@ -392,14 +487,22 @@ static void ContextBlockSplitterFinishBlock(
   if (self->num_blocks_ == 0) {
     size_t i;
     /* Create first block. */
+    for (i = 0; i < 2 * num_contexts; ++i) {
+      last_plogp[i] = 0.0;
+      last_sum[i] = 0;
+    }
+    ContextBlockSplitterEntropySums(
+        self, plogp, sum, combined_plogp, combined_sum);
     split->lengths[0] = (uint32_t)self->block_size_;
     split->types[0] = 0;
 
     for (i = 0; i < num_contexts; ++i) {
-      last_entropy[i] =
-          BitsEntropy(histograms[i].data_, self->alphabet_size_);
+      last_entropy[i] = BitsEntropyFromSums(plogp[i], sum[i]);
       last_entropy[num_contexts + i] = last_entropy[i];
+      last_plogp[i] = last_plogp[num_contexts + i] = plogp[i];
+      last_sum[i] = last_sum[num_contexts + i] = sum[i];
     }
+    self->num_symbols_ = 0;
     ++self->num_blocks_;
     ++split->num_types;
     self->curr_histogram_ix_ += num_contexts;
@@ -414,25 +517,18 @@ static void ContextBlockSplitterFinishBlock(
        Decide over the split based on the total reduction of entropy across
        all contexts. */
     double entropy[BROTLI_MAX_STATIC_CONTEXTS];
-    HistogramLiteral* combined_histo =
-        BROTLI_ALLOC(m, HistogramLiteral, 2 * num_contexts);
     double combined_entropy[2 * BROTLI_MAX_STATIC_CONTEXTS];
     double diff[2] = { 0.0 };
     size_t i;
-    if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(combined_histo)) return;
+    ContextBlockSplitterEntropySums(
+        self, plogp, sum, combined_plogp, combined_sum);
     for (i = 0; i < num_contexts; ++i) {
-      size_t curr_histo_ix = self->curr_histogram_ix_ + i;
       size_t j;
-      entropy[i] = BitsEntropy(histograms[curr_histo_ix].data_,
-                               self->alphabet_size_);
+      entropy[i] = BitsEntropyFromSums(plogp[i], sum[i]);
       for (j = 0; j < 2; ++j) {
         size_t jx = j * num_contexts + i;
-        size_t last_histogram_ix = self->last_histogram_ix_[j] + i;
-        combined_histo[jx] = histograms[curr_histo_ix];
-        HistogramAddHistogramLiteral(&combined_histo[jx],
-            &histograms[last_histogram_ix]);
-        combined_entropy[jx] = BitsEntropy(
-            &combined_histo[jx].data_[0], self->alphabet_size_);
+        combined_entropy[jx] =
+            BitsEntropyFromSums(combined_plogp[jx], combined_sum[jx]);
         diff[j] += combined_entropy[jx] - entropy[i] - last_entropy[jx];
       }
     }
@@ -448,7 +544,12 @@ static void ContextBlockSplitterFinishBlock(
       for (i = 0; i < num_contexts; ++i) {
         last_entropy[num_contexts + i] = last_entropy[i];
         last_entropy[i] = entropy[i];
+        last_plogp[num_contexts + i] = last_plogp[i];
+        last_plogp[i] = plogp[i];
+        last_sum[num_contexts + i] = last_sum[i];
+        last_sum[i] = sum[i];
       }
+      self->num_symbols_ = 0;
       ++self->num_blocks_;
       ++split->num_types;
       self->curr_histogram_ix_ += num_contexts;
@@ -464,12 +565,14 @@ static void ContextBlockSplitterFinishBlock(
       split->lengths[self->num_blocks_] = (uint32_t)self->block_size_;
       split->types[self->num_blocks_] = split->types[self->num_blocks_ - 2];
       BROTLI_SWAP(size_t, self->last_histogram_ix_, 0, 1);
+      ContextBlockSplitterMoveCurrent(self, self->last_histogram_ix_[0]);
       for (i = 0; i < num_contexts; ++i) {
-        histograms[self->last_histogram_ix_[0] + i] =
-            combined_histo[num_contexts + i];
         last_entropy[num_contexts + i] = last_entropy[i];
         last_entropy[i] = combined_entropy[num_contexts + i];
-        HistogramClearLiteral(&histograms[self->curr_histogram_ix_ + i]);
+        last_plogp[num_contexts + i] = last_plogp[i];
+        last_plogp[i] = combined_plogp[num_contexts + i];
+        last_sum[num_contexts + i] = last_sum[i];
+        last_sum[i] = combined_sum[num_contexts + i];
       }
       ++self->num_blocks_;
       self->block_size_ = 0;
@@ -478,20 +581,22 @@ static void ContextBlockSplitterFinishBlock(
     } else {
       /* Combine this block with last block. */
       split->lengths[self->num_blocks_ - 1] += (uint32_t)self->block_size_;
+      ContextBlockSplitterMoveCurrent(self, self->last_histogram_ix_[0]);
       for (i = 0; i < num_contexts; ++i) {
-        histograms[self->last_histogram_ix_[0] + i] = combined_histo[i];
         last_entropy[i] = combined_entropy[i];
+        last_plogp[i] = combined_plogp[i];
+        last_sum[i] = combined_sum[i];
         if (split->num_types == 1) {
           last_entropy[num_contexts + i] = last_entropy[i];
+          last_plogp[num_contexts + i] = last_plogp[i];
+          last_sum[num_contexts + i] = last_sum[i];
         }
-        HistogramClearLiteral(&histograms[self->curr_histogram_ix_ + i]);
       }
       self->block_size_ = 0;
       if (++self->merge_last_count_ > 1) {
         self->target_block_size_ += self->min_block_size_;
       }
     }
-    BROTLI_FREE(m, combined_histo);
   }
   if (is_final) {
     *self->histograms_size_ = split->num_types * num_contexts;
@@ -502,14 +607,15 @@ static void ContextBlockSplitterFinishBlock(
 /* Adds the next symbol to the current block type and context. When the
    current block reaches the target size, decides on merging the block. */
 static void ContextBlockSplitterAddSymbol(
-    ContextBlockSplitter* self, MemoryManager* m,
-    size_t symbol, size_t context) {
-  HistogramAddLiteral(&self->histograms_[self->curr_histogram_ix_ + context],
-      symbol);
+    ContextBlockSplitter* self, size_t symbol, size_t context) {
+  HistogramLiteral* histo =
+      &self->histograms_[self->curr_histogram_ix_ + context];
+  self->symbols_[self->num_symbols_] = (uint16_t)((context << 8) | symbol);
+  self->num_symbols_ += (histo->data_[symbol] == 0) ? 1 : 0;
+  HistogramAddLiteral(histo, symbol);
   ++self->block_size_;
   if (self->block_size_ == self->target_block_size_) {
-    ContextBlockSplitterFinishBlock(self, m, /* is_final = */ BROTLI_FALSE);
-    if (BROTLI_IS_OOM(m)) return;
+    ContextBlockSplitterFinishBlock(self, /* is_final = */ BROTLI_FALSE);
   }
 }
 
@@ -582,9 +688,8 @@ static BROTLI_INLINE void BrotliBuildMetaBlockGreedyInternal(
       } else {
         size_t context =
             BROTLI_CONTEXT(prev_byte, prev_byte2, literal_context_lut);
-        ContextBlockSplitterAddSymbol(&lit_blocks.ctx, m, literal,
+        ContextBlockSplitterAddSymbol(&lit_blocks.ctx, literal,
                                       static_context_map[context]);
-        if (BROTLI_IS_OOM(m)) return;
       }
       prev_byte2 = prev_byte;
       prev_byte = literal;
@@ -605,8 +710,7 @@ static BROTLI_INLINE void BrotliBuildMetaBlockGreedyInternal(
         &lit_blocks.plain, /* is_final = */ BROTLI_TRUE);
   } else {
     ContextBlockSplitterFinishBlock(
-        &lit_blocks.ctx, m, /* is_final = */ BROTLI_TRUE);
-    if (BROTLI_IS_OOM(m)) return;
+        &lit_blocks.ctx, /* is_final = */ BROTLI_TRUE);
   }
   BlockSplitterFinishBlockCommand(&cmd_blocks, /* is_final = */ BROTLI_TRUE);
   BlockSplitterFinishBlockDistance(&dist_blocks, /* is_final = */ BROTLI_TRUE);
@@ -638,24 +742,56 @@ void BrotliBuildMetaBlockGreedy(MemoryManager* m,
   }
 }
 
-void BrotliOptimizeHistograms(uint32_t num_distance_codes,
+/* Returns the number of bits needed to store the prefix code built from
+   code_histogram together with the symbols counted in data_histogram. */
+static size_t HuffmanCodeBitCost(const uint32_t* code_histogram,
+    const uint32_t* data_histogram, size_t length, HuffmanTree* tree,
+    uint8_t* depth) {
+  size_t bits;
+  size_t i;
+  memset(depth, 0, length * sizeof(depth[0]));
+  BrotliCreateHuffmanTree(code_histogram, length, 15, tree, depth);
+  bits = BrotliHuffmanTreeBitCost(depth, length, length, tree);
+  for (i = 0; i < length; ++i) {
+    bits += (size_t)data_histogram[i] * depth[i];
+  }
+  return bits;
+}
+
+/* Smooths histogram[0:length] to make its prefix code cheaper to store,
+   unless the longer codes for the actual symbols outweigh the savings. */
+static void OptimizeHistogram(uint32_t* histogram, size_t length,
+    HuffmanTree* tree, uint32_t* smoothed, uint8_t* good_for_rle) {
+  uint8_t depth[BROTLI_NUM_COMMAND_SYMBOLS];
+  memcpy(smoothed, histogram, length * sizeof(histogram[0]));
+  BrotliOptimizeHuffmanCountsForRle(length, smoothed, good_for_rle);
+  if (memcmp(smoothed, histogram, length * sizeof(histogram[0])) == 0) return;
+  if (HuffmanCodeBitCost(smoothed, histogram, length, tree, depth) <=
+      HuffmanCodeBitCost(histogram, histogram, length, tree, depth)) {
+    memcpy(histogram, smoothed, length * sizeof(histogram[0]));
+  }
+}
+
+void BrotliOptimizeHistograms(MemoryManager* m, uint32_t num_distance_codes,
                               MetaBlockSplit* mb) {
+  uint32_t smoothed[BROTLI_NUM_COMMAND_SYMBOLS];
   uint8_t good_for_rle[BROTLI_NUM_COMMAND_SYMBOLS];
+  HuffmanTree* tree = BROTLI_ALLOC(m, HuffmanTree, MAX_HUFFMAN_TREE_SIZE);
   size_t i;
+  if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(tree)) return;
   for (i = 0; i < mb->literal_histograms_size; ++i) {
-    BrotliOptimizeHuffmanCountsForRle(256, mb->literal_histograms[i].data_,
-                                      good_for_rle);
+    OptimizeHistogram(mb->literal_histograms[i].data_,
+                      BROTLI_NUM_LITERAL_SYMBOLS, tree, smoothed, good_for_rle);
   }
   for (i = 0; i < mb->command_histograms_size; ++i) {
-    BrotliOptimizeHuffmanCountsForRle(BROTLI_NUM_COMMAND_SYMBOLS,
-                                      mb->command_histograms[i].data_,
-                                      good_for_rle);
+    OptimizeHistogram(mb->command_histograms[i].data_,
+                      BROTLI_NUM_COMMAND_SYMBOLS, tree, smoothed, good_for_rle);
   }
   for (i = 0; i < mb->distance_histograms_size; ++i) {
-    BrotliOptimizeHuffmanCountsForRle(num_distance_codes,
-                                      mb->distance_histograms[i].data_,
-                                      good_for_rle);
+    OptimizeHistogram(mb->distance_histograms[i].data_,
+                      num_distance_codes, tree, smoothed, good_for_rle);
   }
+  BROTLI_FREE(m, tree);
 }
 
 #if defined(__cplusplus) || defined(c_plusplus)
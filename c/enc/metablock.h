@@ -92,8 +92,10 @@ BROTLI_INTERNAL void BrotliBuildMetaBlockGreedy(
     size_t num_contexts, const uint32_t* static_context_map,
     const Command* commands, size_t n_commands, MetaBlockSplit* mb);
 
-BROTLI_INTERNAL void BrotliOptimizeHistograms(uint32_t num_distance_codes,
-                                              MetaBlockSplit* mb);
+/* Smooths the histograms where this makes the stored prefix codes plus
+   the coded symbols smaller. */
+BROTLI_INTERNAL void BrotliOptimizeHistograms(MemoryManager* m,
+    uint32_t num_distance_codes, MetaBlockSplit* mb);
 
 BROTLI_INTERNAL void BrotliInitDistanceParams(BrotliEncoderParams* params,
     uint32_t npostfix, uint32_t ndirect);
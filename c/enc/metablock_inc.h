@@ -5,7 +5,7 @@
    See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
 */
 
-/* template parameters: FN */
+/* template parameters: FN, DATA_SIZE */
 
 #define HistogramType FN(Histogram)
 
@@ -38,6 +38,14 @@ typedef struct FN(BlockSplitter) {
   size_t last_histogram_ix_[2];
   /* Entropy of the previous two block types. */
   double last_entropy_[2];
+  /* Sum of p * log2(p) and sum of p over the histograms of the previous two
+     block types; used to update the entropy of merged histograms. */
+  double last_plogp_[2];
+  size_t last_sum_[2];
+  /* Symbols that occur in the current histogram, in order of appearance.
+     One extra slot for the speculative store in AddSymbol. */
+  uint16_t symbols_[DATA_SIZE + 1];
+  size_t num_symbols_;
   /* The number of times we merged the current block with the last one. */
   size_t merge_last_count_;
 } FN(BlockSplitter);
@@ -61,6 +69,7 @@ static void FN(InitBlockSplitter)(
   self->block_size_ = 0;
   self->curr_histogram_ix_ = 0;
   self->merge_last_count_ = 0;
+  self->num_symbols_ = 0;
   BROTLI_ENSURE_CAPACITY(m, uint8_t,
       split->types, split->types_alloc_size, max_num_blocks);
   BROTLI_ENSURE_CAPACITY(m, uint32_t,
@@ -77,6 +86,52 @@ static void FN(InitBlockSplitter)(
   self->last_histogram_ix_[0] = self->last_histogram_ix_[1] = 0;
 }
 
+/* Computes the sum of p * log2(p) and the sum of p for the current histogram
+   and for its union with each of the previous two block types. Only symbols
+   of the current block are visited. */
+static void FN(BlockSplitterEntropySums)(FN(BlockSplitter)* self,
+    double* plogp, size_t* sum, double combined_plogp[2],
+    size_t combined_sum[2]) {
+  const uint32_t* histo =
+      self->histograms_[self->curr_histogram_ix_].data_;
+  const uint32_t* last0 = self->histograms_[self->last_histogram_ix_[0]].data_;
+  const uint32_t* last1 = self->histograms_[self->last_histogram_ix_[1]].data_;
+  double delta0 = 0.0;
+  double delta1 = 0.0;
+  size_t k;
+  *plogp = 0.0;
+  *sum = 0;
+  for (k = 0; k < self->num_symbols_; ++k) {
+    size_t symbol = self->symbols_[k];
+    size_t p = histo[symbol];
+    if (symbol >= self->alphabet_size_) continue;
+    *sum += p;
+    *plogp += PLog2P(p);
+    delta0 += PLog2P(p + last0[symbol]) - PLog2P(last0[symbol]);
+    delta1 += PLog2P(p + last1[symbol]) - PLog2P(last1[symbol]);
+  }
+  combined_plogp[0] = self->last_plogp_[0] + delta0;
+  combined_plogp[1] = self->last_plogp_[1] + delta1;
+  combined_sum[0] = self->last_sum_[0] + *sum;
+  combined_sum[1] = self->last_sum_[1] + *sum;
+}
+
+/* Adds the current histogram to |dst| and clears it. */
+static void FN(BlockSplitterMoveCurrent)(
+    FN(BlockSplitter)* self, HistogramType* dst) {
+  HistogramType* histo = &self->histograms_[self->curr_histogram_ix_];
+  size_t k;
+  for (k = 0; k < self->num_symbols_; ++k) {
+    size_t symbol = self->symbols_[k];
+    dst->data_[symbol] += histo->data_[symbol];
+    histo->data_[symbol] = 0;
+  }
+  dst->total_count_ += histo->total_count_;
+  histo->total_count_ = 0;
+  histo->bit_cost_ = HUGE_VAL;
+  self->num_symbols_ = 0;
+}
+
 /* Does either of three things:
      (1) emits the current block with a new block type;
      (2) emits the current block with the type of the second last block;
@@ -90,11 +145,20 @@ static void FN(BlockSplitterFinishBlock)(
       BROTLI_MAX(size_t, self->block_size_, self->min_block_size_);
   if (self->num_blocks_ == 0) {
     /* Create first block. */
+    double plogp;
+    size_t sum;
+    double unused_plogp[2];
+    size_t unused_sum[2];
+    self->last_plogp_[0] = self->last_plogp_[1] = 0.0;
+    self->last_sum_[0] = self->last_sum_[1] = 0;
+    FN(BlockSplitterEntropySums)(self, &plogp, &sum, unused_plogp, unused_sum);
     split->lengths[0] = (uint32_t)self->block_size_;
     split->types[0] = 0;
-    last_entropy[0] =
-        BitsEntropy(histograms[0].data_, self->alphabet_size_);
+    last_entropy[0] = BitsEntropyFromSums(plogp, sum);
     last_entropy[1] = last_entropy[0];
+    self->last_plogp_[0] = self->last_plogp_[1] = plogp;
+    self->last_sum_[0] = self->last_sum_[1] = sum;
+    self->num_symbols_ = 0;
     ++self->num_blocks_;
     ++split->num_types;
     ++self->curr_histogram_ix_;
@@ -102,19 +166,20 @@ static void FN(BlockSplitterFinishBlock)(
       FN(HistogramClear)(&histograms[self->curr_histogram_ix_]);
     self->block_size_ = 0;
   } else if (self->block_size_ > 0) {
-    double entropy = BitsEntropy(histograms[self->curr_histogram_ix_].data_,
-                                 self->alphabet_size_);
-    HistogramType combined_histo[2];
+    double plogp;
+    size_t sum;
+    double combined_plogp[2];
+    size_t combined_sum[2];
+    double entropy;
     double combined_entropy[2];
     double diff[2];
     size_t j;
+    FN(BlockSplitterEntropySums)(
+        self, &plogp, &sum, combined_plogp, combined_sum);
+    entropy = BitsEntropyFromSums(plogp, sum);
     for (j = 0; j < 2; ++j) {
-      size_t last_histogram_ix = self->last_histogram_ix_[j];
-      combined_histo[j] = histograms[self->curr_histogram_ix_];
-      FN(HistogramAddHistogram)(&combined_histo[j],
-          &histograms[last_histogram_ix]);
-      combined_entropy[j] = BitsEntropy(
-          &combined_histo[j].data_[0], self->alphabet_size_);
+      combined_entropy[j] =
+          BitsEntropyFromSums(combined_plogp[j], combined_sum[j]);
       diff[j] = combined_entropy[j] - entropy - last_entropy[j];
     }
 
@@ -128,6 +193,11 @@ static void FN(BlockSplitterFinishBlock)(
       self->last_histogram_ix_[0] = (uint8_t)split->num_types;
       last_entropy[1] = last_entropy[0];
       last_entropy[0] = entropy;
+      self->last_plogp_[1] = self->last_plogp_[0];
+      self->last_plogp_[0] = plogp;
+      self->last_sum_[1] = self->last_sum_[0];
+      self->last_sum_[0] = sum;
+      self->num_symbols_ = 0;
       ++self->num_blocks_;
       ++split->num_types;
       ++self->curr_histogram_ix_;
@@ -141,24 +211,32 @@ static void FN(BlockSplitterFinishBlock)(
       split->lengths[self->num_blocks_] = (uint32_t)self->block_size_;
       split->types[self->num_blocks_] = split->types[self->num_blocks_ - 2];
       BROTLI_SWAP(size_t, self->last_histogram_ix_, 0, 1);
-      histograms[self->last_histogram_ix_[0]] = combined_histo[1];
+      FN(BlockSplitterMoveCurrent)(
+          self, &histograms[self->last_histogram_ix_[0]]);
       last_entropy[1] = last_entropy[0];
       last_entropy[0] = combined_entropy[1];
+      self->last_plogp_[1] = self->last_plogp_[0];
+      self->last_plogp_[0] = combined_plogp[1];
+      self->last_sum_[1] = self->last_sum_[0];
+      self->last_sum_[0] = combined_sum[1];
       ++self->num_blocks_;
       self->block_size_ = 0;
-      FN(HistogramClear)(&histograms[self->curr_histogram_ix_]);
       self->merge_last_count_ = 0;
       self->target_block_size_ = self->min_block_size_;
     } else {
       /* Combine this block with last block. */
       split->lengths[self->num_blocks_ - 1] += (uint32_t)self->block_size_;
-      histograms[self->last_histogram_ix_[0]] = combined_histo[0];
+      FN(BlockSplitterMoveCurrent)(
+          self, &histograms[self->last_histogram_ix_[0]]);
       last_entropy[0] = combined_entropy[0];
+      self->last_plogp_[0] = combined_plogp[0];
+      self->last_sum_[0] = combined_sum[0];
       if (split->num_types == 1) {
         last_entropy[1] = last_entropy[0];
+        self->last_plogp_[1] = self->last_plogp_[0];
+        self->last_sum_[1] = self->last_sum_[0];
       }
       self->block_size_ = 0;
-      FN(HistogramClear)(&histograms[self->curr_histogram_ix_]);
       if (++self->merge_last_count_ > 1) {
         self->target_block_size_ += self->min_block_size_;
       }
@@ -173,7 +251,10 @@ static void FN(BlockSplitterFinishBlock)(
 /* Adds the next symbol to the current histogram. When the current histogram
    reaches the target size, decides on merging the block. */
 static void FN(BlockSplitterAddSymbol)(FN(BlockSplitter)* self, size_t symbol) {
-  FN(HistogramAdd)(&self->histograms_[self->curr_histogram_ix_], symbol);
+  HistogramType* histo = &self->histograms_[self->curr_histogram_ix_];
+  self->symbols_[self->num_symbols_] = (uint16_t)symbol;
+  self->num_symbols_ += (histo->data_[symbol] == 0) ? 1 : 0;
+  FN(HistogramAdd)(histo, symbol);
   ++self->block_size_;
   if (self->block_size_ == self->target_block_size_) {
     FN(BlockSplitterFinishBlock)(self, /* is_final = */ BROTLI_FALSE);
@@ -0,0 +1,108 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Minimal fork-join helper for running independent tasks on threads. */
+
+#include "./parallel.h"
+
+#include "../common/platform.h"
+#include <brotli/types.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#define BROTLI_HAVE_THREADS 1
+#elif defined(BROTLI_HAVE_PTHREAD) && BROTLI_HAVE_PTHREAD
+#include <pthread.h>
+#define BROTLI_HAVE_THREADS 1
+#endif
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+#if defined(BROTLI_HAVE_THREADS)
+
+typedef struct ParallelTask {
+  BrotliParallelTaskFunc func;
+  void* task;
+} ParallelTask;
+
+#if defined(_WIN32)
+
+typedef HANDLE ParallelThread;
+
+static DWORD WINAPI ParallelThreadMain(LPVOID arg) {
+  ParallelTask* task = (ParallelTask*)arg;
+  task->func(task->task);
+  return 0;
+}
+
+static BROTLI_BOOL StartThread(ParallelThread* thread, ParallelTask* task) {
+  *thread = CreateThread(NULL, 0, ParallelThreadMain, task, 0, NULL);
+  return TO_BROTLI_BOOL(*thread != NULL);
+}
+
+static void JoinThread(ParallelThread thread) {
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+}
+
+#else  /* _WIN32 */
+
+typedef pthread_t ParallelThread;
+
+static void* ParallelThreadMain(void* arg) {
+  ParallelTask* task = (ParallelTask*)arg;
+  task->func(task->task);
+  return NULL;
+}
+
+static BROTLI_BOOL StartThread(ParallelThread* thread, ParallelTask* task) {
+  return TO_BROTLI_BOOL(
+      pthread_create(thread, NULL, ParallelThreadMain, task) == 0);
+}
+
+static void JoinThread(ParallelThread thread) {
+  pthread_join(thread, NULL);
+}
+
+#endif  /* _WIN32 */
+
+void BrotliRunInParallel(BrotliParallelTaskFunc func,
+    void* tasks, size_t task_size, size_t num_tasks) {
+  ParallelTask args[BROTLI_MAX_PARALLEL_TASKS];
+  ParallelThread threads[BROTLI_MAX_PARALLEL_TASKS];
+  BROTLI_BOOL is_started[BROTLI_MAX_PARALLEL_TASKS];
+  size_t i;
+  BROTLI_DCHECK(num_tasks <= BROTLI_MAX_PARALLEL_TASKS);
+  for (i = 1; i < num_tasks; ++i) {
+    args[i].func = func;
+    args[i].task = (uint8_t*)tasks + i * task_size;
+    is_started[i] = StartThread(&threads[i], &args[i]);
+  }
+  if (num_tasks != 0) func(tasks);
+  for (i = 1; i < num_tasks; ++i) {
+    if (is_started[i]) {
+      JoinThread(threads[i]);
+    } else {
+      func(args[i].task);
+    }
+  }
+}
+
+#else  /* BROTLI_HAVE_THREADS */
+
+void BrotliRunInParallel(BrotliParallelTaskFunc func,
+    void* tasks, size_t task_size, size_t num_tasks) {
+  size_t i;
+  for (i = 0; i < num_tasks; ++i) func((uint8_t*)tasks + i * task_size);
+}
+
+#endif  /* BROTLI_HAVE_THREADS */
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}  /* extern "C" */
+#endif
@@ -0,0 +1,37 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Minimal fork-join helper for running independent tasks on threads. */
+
+#ifndef BROTLI_ENC_PARALLEL_H_
+#define BROTLI_ENC_PARALLEL_H_
+
+#include "../common/platform.h"
+#include <brotli/types.h>
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/* Upper limit for the number of simultaneously running tasks. */
+#define BROTLI_MAX_PARALLEL_TASKS 64
+
+typedef void (*BrotliParallelTaskFunc)(void* task);
+
+/* Runs |func| for each of |num_tasks| tasks; i-th task is located at
+   |tasks| + i * |task_size|. The first task is run by the calling thread,
+   others are given a thread each. If threads are not supported or could not
+   be started, tasks are run by the calling thread. Returns when all the tasks
+   are complete.
+   REQUIRED: |num_tasks| <= BROTLI_MAX_PARALLEL_TASKS */
+BROTLI_INTERNAL void BrotliRunInParallel(BrotliParallelTaskFunc func,
+    void* tasks, size_t task_size, size_t num_tasks);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}  /* extern "C" */
+#endif
+
+#endif  /* BROTLI_ENC_PARALLEL_H_ */
@@ -0,0 +1,123 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Heuristics for choosing the pre-filter (see BROTLI_PARAM_FILTER). */
+
+#include "./prefilter.h"
+
+#include <string.h>  /* memset */
+
+#include "../common/filter.h"
+#include "../common/platform.h"
+#include <brotli/encode.h>
+#include <brotli/types.h>
+#include "./bit_cost.h"
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/* Bytes, 16/24/32-bit samples and 64-bit values. */
+static const int kDeltaDistances[] = {1, 2, 3, 4, 8};
+#define NUM_DELTA_DISTANCES 5
+
+/* Automatic mode uses delta filter only if it makes order-0 entropy at least
+   that much smaller. */
+static const double kMinDeltaGain = 0.8;
+/* Do not bother filtering tiny inputs. */
+static const size_t kMinSampleSize = 512;
+
+/* Counts CALL / JMP instructions with near targets, as X86 filter sees them. */
+static size_t CountX86Branches(const uint8_t* data, size_t size) {
+  size_t count = 0;
+  size_t i = 0;
+  while (i + 4 < size) {
+    if ((data[i] & 0xFE) != 0xE8) {
+      ++i;
+      continue;
+    }
+    if ((uint8_t)(data[i + 4] + 1) <= 1) ++count;
+    i += 5;
+  }
+  return count;
+}
+
+/* Zero |distance| gives the entropy of unfiltered data. */
+static double DeltaEntropy(const uint8_t* data, size_t size, int distance) {
+  uint32_t histogram[256];
+  size_t i;
+  memset(histogram, 0, sizeof(histogram));
+  for (i = 0; i < size; ++i) {
+    uint8_t prev = (distance != 0 && i >= (size_t)distance) ?
+        data[i - (size_t)distance] : 0;
+    ++histogram[(uint8_t)(data[i] - prev)];
+  }
+  return BitsEntropy(histogram, 256);
+}
+
+static int BestDeltaDistance(const uint8_t* data, size_t size,
+                             int min_distance, double* cost) {
+  int best = 0;
+  double best_cost = 0.0;
+  size_t i;
+  for (i = 0; i < NUM_DELTA_DISTANCES; ++i) {
+    double c;
+    if (kDeltaDistances[i] < min_distance) continue;
+    c = DeltaEntropy(data, size, kDeltaDistances[i]);
+    if (best == 0 || c < best_cost) {
+      best = kDeltaDistances[i];
+      best_cost = c;
+    }
+  }
+  *cost = best_cost;
+  return best;
+}
+
+void BrotliSelectFilter(BrotliEncoderFilter mode,
+    int distance, const uint8_t* data, size_t size, int* id, int* param) {
+  double cost;
+  *id = BROTLI_FILTER_ID_NONE;
+  *param = 0;
+  switch (mode) {
+    case BROTLI_FILTER_DELTA:
+      *id = BROTLI_FILTER_ID_DELTA;
+      *param = distance ? distance : BestDeltaDistance(data, size, 1, &cost);
+      return;
+
+    case BROTLI_FILTER_TRANSPOSE:
+      *id = BROTLI_FILTER_ID_TRANSPOSE;
+      *param = distance ? distance : BestDeltaDistance(data, size, 2, &cost);
+      return;
+
+    case BROTLI_FILTER_X86:
+      *id = BROTLI_FILTER_ID_X86;
+      return;
+
+    case BROTLI_FILTER_AUTO:
+      if (size < kMinSampleSize) return;
+      /* In x86 code about 1% of bytes start near branches; in other data
+         such byte combinations are rare. */
+      if (CountX86Branches(data, size) * 256 > size) {
+        *id = BROTLI_FILTER_ID_X86;
+        return;
+      }
+      {
+        int best = BestDeltaDistance(data, size, 1, &cost);
+        if (cost < kMinDeltaGain * DeltaEntropy(data, size, 0)) {
+          *id = BROTLI_FILTER_ID_DELTA;
+          *param = best;
+        }
+      }
+      return;
+
+    default:
+      return;
+  }
+}
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}  /* extern "C" */
+#endif
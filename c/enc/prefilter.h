@@ -0,0 +1,30 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Heuristics for choosing the pre-filter (see BROTLI_PARAM_FILTER). */
+
+#ifndef BROTLI_ENC_PREFILTER_H_
+#define BROTLI_ENC_PREFILTER_H_
+
+#include "../common/platform.h"
+#include <brotli/encode.h>
+#include <brotli/types.h>
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/* Chooses filter id and parameter for the given |mode| looking at the first
+   |size| bytes of input. Zero |distance| means that delta distance /
+   transposition stride should be guessed as well. */
+BROTLI_INTERNAL void BrotliSelectFilter(BrotliEncoderFilter mode,
+    int distance, const uint8_t* data, size_t size, int* id, int* param);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}  /* extern "C" */
+#endif
+
+#endif  /* BROTLI_ENC_PREFILTER_H_ */
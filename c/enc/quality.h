@@ -118,6 +118,14 @@ static BROTLI_INLINE size_t LiteralSpreeLengthForSparseSearch(
   return params->quality < 9 ? 64 : 512;
 }
 
+/* Narrow hashers (H12 - H15) keep 16-bit positions; they are used if no
+   backward distance exceeds 64KiB, i.e. window or input is small enough. */
+#define MAX_INPUT_SIZE_FOR_NARROW_HASHER (1u << 16)
+
+static BROTLI_INLINE BROTLI_BOOL IsNarrowHasher(int type) {
+  return TO_BROTLI_BOOL(type >= 12 && type <= 15);
+}
+
 static BROTLI_INLINE void ChooseHasher(const BrotliEncoderParams* params,
                                        BrotliHasherParams* hparams) {
   if (params->quality > 9) {
@@ -143,6 +151,17 @@ static BROTLI_INLINE void ChooseHasher(const BrotliEncoderParams* params,
         params->quality < 7 ? 4 : params->quality < 9 ? 10 : 16;
   }
 
+  if (hparams->type >= 2 && hparams->type <= 5) {
+    /* Stream offset means there is history beyond the size hint; large
+       window streams keep the hashers below, that are good for long input. */
+    BROTLI_BOOL small_input = TO_BROTLI_BOOL(params->size_hint != 0 &&
+        params->size_hint <= MAX_INPUT_SIZE_FOR_NARROW_HASHER &&
+        params->stream_offset == 0 && params->lgwin <= 24);
+    if (params->lgwin <= 16 || small_input) {
+      hparams->type += 10;
+    }
+  }
+
   if (params->lgwin > 24) {
     /* Different hashers for large window brotli: not for qualities <= 2,
        these are too fast for large window. Not for qualities >= 10: their
@@ -84,8 +84,9 @@ typedef enum {
   BROTLI_ERROR_CODE(_ERROR_FORMAT_, PADDING_1, -14) SEPARATOR              \
   BROTLI_ERROR_CODE(_ERROR_FORMAT_, PADDING_2, -15) SEPARATOR              \
   BROTLI_ERROR_CODE(_ERROR_FORMAT_, DISTANCE, -16) SEPARATOR               \
+  BROTLI_ERROR_CODE(_ERROR_FORMAT_, FILTER, -17) SEPARATOR                 \
                                                                            \
-  /* -17..-18 codes are reserved */                                        \
+  /* -18 code is reserved */                                               \
                                                                            \
   BROTLI_ERROR_CODE(_ERROR_, DICTIONARY_NOT_SET, -19) SEPARATOR            \
   BROTLI_ERROR_CODE(_ERROR_, INVALID_ARGUMENTS, -20) SEPARATOR             \
@@ -98,7 +99,8 @@ typedef enum {
   BROTLI_ERROR_CODE(_ERROR_ALLOC_, CONTEXT_MAP, -25) SEPARATOR             \
   BROTLI_ERROR_CODE(_ERROR_ALLOC_, RING_BUFFER_1, -26) SEPARATOR           \
   BROTLI_ERROR_CODE(_ERROR_ALLOC_, RING_BUFFER_2, -27) SEPARATOR           \
-  /* -28..-29 codes are reserved for dynamic ring-buffer allocation */     \
+  /* -28 code is reserved for dynamic ring-buffer allocation */            \
+  BROTLI_ERROR_CODE(_ERROR_ALLOC_, FILTER_BUFFER, -29) SEPARATOR           \
   BROTLI_ERROR_CODE(_ERROR_ALLOC_, BLOCK_TYPE_TREES, -30) SEPARATOR        \
                                                                            \
   /* "Impossible" states */                                                \
@@ -139,7 +141,14 @@ typedef enum BrotliDecoderParameter {
   /**
    * Flag that determines if "Large Window Brotli" is used.
    */
-  BROTLI_DECODER_PARAM_LARGE_WINDOW = 1
+  BROTLI_DECODER_PARAM_LARGE_WINDOW = 1,
+  /**
+   * Flag that enables decoding of pre-filtered streams.
+   *
+   * Such streams are produced by encoder with ::BROTLI_PARAM_FILTER set. Plain
+   * brotli streams are decoded as usual.
+   */
+  BROTLI_DECODER_PARAM_FILTERS = 2
 } BrotliDecoderParameter;
 
 /**
@@ -247,6 +256,37 @@ BROTLI_DEC_API BrotliDecoderResult BrotliDecoderDecompressStream(
   BrotliDecoderState* state, size_t* available_in, const uint8_t** next_in,
   size_t* available_out, uint8_t** next_out, size_t* total_out);
 
+/**
+ * Decompresses scattered input stream to scattered output stream.
+ *
+ * Works like ::BrotliDecoderDecompressStream called on the concatenation of
+ * @p input segments with output going to the concatenation of @p output
+ * segments, without copying the segments to contiguous buffers. Segments are
+ * used in order; empty segments are skipped.
+ *
+ * After the call, @c data and @c size of each segment are advanced by the
+ * amount of bytes consumed / written; depleted segments have @c size @c 0.
+ *
+ * @param state decoder instance
+ * @param[in, out] input input segments
+ * @param num_input number of elements in @p input
+ * @param[in, out] output output segments
+ * @param num_output number of elements in @p output
+ * @param[out] total_out number of bytes decompressed so far; can be @c NULL
+ * @returns ::BROTLI_DECODER_RESULT_ERROR if input is corrupted, memory
+ *          allocation failed, arguments were invalid, etc.;
+ *          use ::BrotliDecoderGetErrorCode to get detailed error code
+ * @returns ::BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT decoding is blocked until
+ *          more input data is provided; all input segments are depleted
+ * @returns ::BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT decoding is blocked until
+ *          more output space is provided; all output segments are full
+ * @returns ::BROTLI_DECODER_RESULT_SUCCESS decoding is finished, no more
+ *          input might be consumed and no more output will be produced
+ */
+BROTLI_DEC_API BrotliDecoderResult BrotliDecoderDecompressStreamVec(
+    BrotliDecoderState* state, BrotliInputSegment* input, size_t num_input,
+    BrotliOutputSegment* output, size_t num_output, size_t* total_out);
+
 /**
  * Checks if decoder has more output.
  *
@@ -311,6 +351,77 @@ BROTLI_DEC_API BROTLI_BOOL BrotliDecoderIsUsed(const BrotliDecoderState* state);
 BROTLI_DEC_API BROTLI_BOOL BrotliDecoderIsFinished(
     const BrotliDecoderState* state);
 
+/**
+ * Gets the information required to append data to the decoded stream.
+ *
+ * Brotli stream could not be simply concatenated with another one, because
+ * the last meta-block is marked with ISLAST flag. To continue the stream:
+ *  - replace @p header_bits bits starting at bit @p header_offset with
+ *    @p header; replacement header has the same length, but ISLAST is cleared
+ *  - cut stream at bit @p end_offset, i.e. drop stream padding; in case of
+ *    empty last meta-block @p header_bits is @c 0 and @p end_offset is equal
+ *    to @p header_offset, i.e. the last meta-block is dropped altogether
+ *  - continue with encoder prepared by ::BrotliEncoderResumeStream
+ *  - if stream starts with the content size header, set the new total size
+ *    with ::BrotliDecoderUpdateContentSize; otherwise header keeps telling
+ *    the size before appending
+ *
+ * Bits are counted from the beginning of the stream, starting from the lowest
+ * bit of each byte.
+ *
+ * @param state decoder instance
+ * @param[out] window_bits window size used by the stream
+ * @param[out] large_window ::BROTLI_TRUE if stream uses "large window"
+ *             encoding
+ * @param[out] header_offset bit offset of the last meta-block header
+ * @param[out] header replacement meta-block header
+ * @param[out] header_bits number of bits in @p header
+ * @param[out] end_offset bit offset where the stream should be cut
+ * @returns ::BROTLI_FALSE if the stream is not decoded completely
+ * @returns ::BROTLI_TRUE otherwise
+ */
+BROTLI_DEC_API BROTLI_BOOL BrotliDecoderGetAppendPoint(
+    const BrotliDecoderState* state, uint32_t* window_bits,
+    BROTLI_BOOL* large_window, uint64_t* header_offset, uint32_t* header,
+    uint32_t* header_bits, uint64_t* end_offset);
+
+/**
+ * Reads the total uncompressed size from the stream header.
+ *
+ * Size is available only if the stream starts with the content size header,
+ * see ::BROTLI_PARAM_CONTENT_SIZE_HEADER. Nothing is decoded; the first
+ * @c 20 bytes of the stream are always enough. Streams wrapped into pre-filter
+ * container are supported too.
+ *
+ * @param size number of bytes available in @p input
+ * @param input the beginning of the stream
+ * @param[out] content_size total uncompressed size
+ * @returns ::BROTLI_FALSE if stream has no content size header, or @p size
+ *          is too small
+ * @returns ::BROTLI_TRUE otherwise
+ */
+BROTLI_DEC_API BROTLI_BOOL BrotliDecoderPeekContentSize(size_t size,
+    const uint8_t input[BROTLI_ARRAY_PARAM(size)], uint64_t* content_size);
+
+/**
+ * Rewrites the total uncompressed size in the stream header.
+ *
+ * Used after appending data to the stream, see
+ * ::BrotliDecoderGetAppendPoint. Header layout does not depend on the size
+ * value, so only the bytes of the size are changed. Same as with
+ * ::BrotliDecoderPeekContentSize, the first @c 20 bytes of the stream are
+ * enough.
+ *
+ * @param size number of bytes available in @p input
+ * @param[in, out] input the beginning of the stream
+ * @param content_size new total uncompressed size
+ * @returns ::BROTLI_FALSE if stream has no content size header, or @p size
+ *          is too small
+ * @returns ::BROTLI_TRUE otherwise
+ */
+BROTLI_DEC_API BROTLI_BOOL BrotliDecoderUpdateContentSize(size_t size,
+    uint8_t input[BROTLI_ARRAY_PARAM(size)], uint64_t content_size);
+
 /**
  * Acquires a detailed error code.
  *
@@ -56,6 +56,40 @@ typedef enum BrotliEncoderMode {
   BROTLI_MODE_FONT = 2
 } BrotliEncoderMode;
 
+/**
+ * Options for ::BROTLI_PARAM_FILTER parameter.
+ *
+ * Filters are reversible transforms applied to input before compression.
+ * Filtered output is not a plain brotli stream: it is wrapped into a container
+ * that could be decoded only if ::BROTLI_DECODER_PARAM_FILTERS is set.
+ */
+typedef enum BrotliEncoderFilter {
+  /** Plain brotli stream; default. */
+  BROTLI_FILTER_NONE = 0,
+  /**
+   * Each byte is replaced with the difference from the byte
+   * ::BROTLI_PARAM_FILTER_DISTANCE positions back.
+   *
+   * Suits tables of numbers, e.g. audio samples or raw images.
+   */
+  BROTLI_FILTER_DELTA = 1,
+  /**
+   * Input is treated as records of ::BROTLI_PARAM_FILTER_DISTANCE bytes;
+   * bytes with the same offset in the record are grouped together.
+   *
+   * Suits arrays of fixed-size structures.
+   */
+  BROTLI_FILTER_TRANSPOSE = 2,
+  /** Relative targets of x86 CALL / JMP instructions are made absolute. */
+  BROTLI_FILTER_X86 = 3,
+  /**
+   * Filter is chosen by looking at the first 64KiB of input.
+   *
+   * If none of filters seem to help, plain brotli stream is produced.
+   */
+  BROTLI_FILTER_AUTO = 4
+} BrotliEncoderFilter;
+
 /** Default value for ::BROTLI_PARAM_QUALITY parameter. */
 #define BROTLI_DEFAULT_QUALITY 11
 /** Default value for ::BROTLI_PARAM_LGWIN parameter. */
@@ -217,7 +251,98 @@ typedef enum BrotliEncoderParameter {
    * maximal window size have the same effect. Values greater than 2**30 are not
    * allowed.
    */
-  BROTLI_PARAM_STREAM_OFFSET = 9
+  BROTLI_PARAM_STREAM_OFFSET = 9,
+  /**
+   * Maximal number of threads used by streaming encoder.
+   *
+   * Currently only quality @c 1 streaming makes use of threads: input blocks
+   * of @c (1 << lgwin) bytes passed to a single ::BrotliEncoderCompressStream
+   * call are compressed concurrently. Output does not depend on the number of
+   * threads. Each thread requires about @c (2 << lgwin) bytes of additional
+   * memory. Custom memory allocators @b MUST be thread-safe when this value is
+   * greater than @c 1.
+   *
+   * The default value is @c 1. Values greater than @c 64 are clamped. This
+   * parameter could be changed at any time.
+   */
+  BROTLI_PARAM_NUM_THREADS = 10,
+  /**
+   * Reversible filter applied to input before compression.
+   *
+   * ::BrotliEncoderFilter enumerates all available values. Filter is not
+   * applied if ::BROTLI_PARAM_STREAM_OFFSET is not @c 0, or if stream is
+   * resumed with ::BrotliEncoderResumeStream.
+   *
+   * @note Filters that look ahead keep a few bytes of input buffered when
+   *       stream is flushed: X86 filter holds up to 4 bytes, transposition
+   *       holds up to 64KiB (incomplete block). Those are encoded when more
+   *       input arrives or the stream is finished.
+   */
+  BROTLI_PARAM_FILTER = 11,
+  /**
+   * Delta distance / transposition stride for ::BROTLI_PARAM_FILTER.
+   *
+   * Range is from @c 1 (@c 2 for transposition) to @c 255. The default value
+   * is @c 0, which means that it is guessed by looking at input.
+   */
+  BROTLI_PARAM_FILTER_DISTANCE = 12,
+  /**
+   * Flag that makes encoder start the stream with content size header.
+   *
+   * Header is a tiny metadata block that holds the total uncompressed size;
+   * it is read with ::BrotliDecoderPeekContentSize. Size is known if
+   * ::BROTLI_PARAM_SIZE_HINT is set, or if the whole input is passed to the
+   * first ::BrotliEncoderCompressStream call with
+   * ::BROTLI_OPERATION_FINISH; otherwise header is not written.
+   *
+   * @warning If ::BROTLI_PARAM_SIZE_HINT is set it @b MUST be exact;
+   *          encoder fails when given more input, or asked to finish
+   *          earlier.
+   *
+   * @note Header is not written if ::BROTLI_PARAM_STREAM_OFFSET is not @c 0,
+   *       or if stream is resumed with ::BrotliEncoderResumeStream; header of
+   *       the continued stream has to be updated with
+   *       ::BrotliDecoderUpdateContentSize when appending is complete.
+   */
+  BROTLI_PARAM_CONTENT_SIZE_HEADER = 13,
+  /**
+   * Maximal number of input bytes encoder holds before producing output.
+   *
+   * Normally input is gathered up to the input block size (see
+   * ::BROTLI_PARAM_LGBLOCK), and several blocks might be merged into one
+   * meta-block. With this limit set, a meta-block is emitted as soon as
+   * that many bytes are held. Unlike ::BROTLI_OPERATION_FLUSH no padding
+   * is added: up to 7 last bits of the meta-block are held until the next
+   * output, so the tail becomes decodable when the following meta-block is
+   * emitted, or on flush. Hasher state is kept across meta-blocks, so the
+   * ratio loss is mostly the cost of additional meta-block headers.
+   *
+   * The default value is @c 0, which means no limit. This parameter could
+   * be changed at any time.
+   *
+   * @note Streams started with qualities @c 0 and @c 1 do not hold input;
+   *       pre-filter (::BROTLI_PARAM_FILTER) buffers up to 64KiB of input
+   *       on its own.
+   */
+  BROTLI_PARAM_MAX_DELAY_BYTES = 14,
+  /**
+   * Flag that lets encoder advertise the smallest sufficient window in the
+   * stream header.
+   *
+   * When the whole input size is known before the header is written, no
+   * backward distance could exceed it; then header tells the smallest window
+   * (not bigger than ::BROTLI_PARAM_LGWIN) that covers the input, and
+   * decoders allocate correspondingly smaller ring buffer. Compressed data is
+   * otherwise the same. Size is known if the whole input is passed to the
+   * first ::BrotliEncoderCompressStream call with ::BROTLI_OPERATION_FINISH,
+   * or if ::BROTLI_PARAM_CONTENT_SIZE_HEADER is set along with
+   * ::BROTLI_PARAM_SIZE_HINT.
+   *
+   * The default value is @c 0. ::BrotliEncoderCompress always uses tight
+   * window. Ignored for "Large Window Brotli", and for streams with
+   * ::BROTLI_PARAM_STREAM_OFFSET, or resumed with ::BrotliEncoderResumeStream.
+   */
+  BROTLI_PARAM_TIGHT_WINDOW = 15
 } BrotliEncoderParameter;
 
 /**
@@ -231,6 +356,18 @@ typedef struct BrotliEncoderStateStruct BrotliEncoderState;
 /**
  * Sets the specified parameter to the given encoder instance.
  *
+ * After encoding is started only ::BROTLI_PARAM_QUALITY, ::BROTLI_PARAM_MODE,
+ * ::BROTLI_PARAM_LGBLOCK, ::BROTLI_PARAM_DISABLE_LITERAL_CONTEXT_MODELING,
+ * ::BROTLI_PARAM_NUM_THREADS and ::BROTLI_PARAM_MAX_DELAY_BYTES could be
+ * changed. New values (except the number of threads and the delay bound)
+ * take effect at the next meta-block boundary, i.e. after the data
+ * already passed to the encoder is emitted (use ::BROTLI_OPERATION_FLUSH to
+ * make the change apply immediately). If
+ * ::BROTLI_PARAM_LGBLOCK is not set again, it is chosen automatically for the
+ * new quality. Switching to quality @c 0 or @c 1 is refused if the stream was
+ * started with window smaller than @c 18 bits; qualities up to @c 2 are
+ * refused for large window streams.
+ *
  * @param state encoder instance
  * @param param parameter to set
  * @param value new parameter value
@@ -269,6 +406,85 @@ BROTLI_ENC_API BrotliEncoderState* BrotliEncoderCreateInstance(
  */
 BROTLI_ENC_API void BrotliEncoderDestroyInstance(BrotliEncoderState* state);
 
+/**
+ * Prepares the encoder to continue an existing stream.
+ *
+ * Encoder does not emit the stream header; instead it continues the bit
+ * sequence with @p last_byte_bits lowest bits of @p last_byte. The ring-buffer
+ * and the hasher are primed with @p history, so that new data could refer to
+ * the tail of the existing stream.
+ *
+ * Window size (::BROTLI_PARAM_LGWIN and ::BROTLI_PARAM_LARGE_WINDOW) @b MUST
+ * match the one used in the existing stream. The rest of parameters could be
+ * chosen freely, except that qualities @c 0 and @c 1 are bumped to @c 2 when
+ * window is smaller than @c 18 bits. ::BROTLI_PARAM_FILTER and
+ * ::BROTLI_PARAM_CONTENT_SIZE_HEADER are ignored: their headers could not be
+ * placed in the middle of the stream.
+ *
+ * Existing stream should be cut and its ISLAST flag should be cleared; its
+ * content size header, if any, should be updated once appending is complete,
+ * see ::BrotliDecoderGetAppendPoint.
+ *
+ * @param state encoder instance
+ * @param history_size number of bytes in @p history
+ * @param history the tail of uncompressed data of the existing stream;
+ *        only the last window size bytes are used
+ * @param total_size uncompressed size of the existing stream
+ * @param last_byte_bits number of bits in @p last_byte; range is @c 0 .. @c 7
+ * @param last_byte unfinished last byte of the existing stream
+ * @returns ::BROTLI_FALSE if encoding is already started, or arguments are
+ *          invalid
+ * @returns ::BROTLI_TRUE otherwise
+ */
+BROTLI_ENC_API BROTLI_BOOL BrotliEncoderResumeStream(
+    BrotliEncoderState* state, size_t history_size,
+    const uint8_t history[BROTLI_ARRAY_PARAM(history_size)],
+    uint64_t total_size, uint32_t last_byte_bits, uint8_t last_byte);
+
+/**
+ * Caller-supplied match candidate, see ::BrotliEncoderAddMatchHints.
+ *
+ * Hint tells that @p length bytes at @p position likely repeat the bytes
+ * @p distance bytes back.
+ */
+typedef struct BrotliEncoderMatchHint {
+  /** offset of the repeated data; counts bytes of input passed to encoder
+      instance, i.e. history passed to ::BrotliEncoderResumeStream is not
+      counted */
+  uint64_t position;
+  /** distance to the original data; @c 1 is the previous byte */
+  uint32_t distance;
+  /** length of the repeated data */
+  uint32_t length;
+} BrotliEncoderMatchHint;
+
+/**
+ * Adds match candidates, e.g. known from a deduplication index.
+ *
+ * Backward reference search considers hinted matches along with the ones
+ * found by the hasher; thus long repeats could be found beyond the reach of
+ * the hasher, as long as @p distance is within the window. Hinted data is
+ * verified by encoder, so wrong hints cost some time, but do not corrupt the
+ * output. Hashing of data covered by the hinted matches is mostly skipped.
+ *
+ * Hints are copied; they should be added before the corresponding input is
+ * passed to encoder. Hints for the already processed input are ignored.
+ *
+ * @note Qualities @c 0 and @c 1, and pre-filter (::BROTLI_PARAM_FILTER) do
+ *       not use hints.
+ *
+ * @param state encoder instance
+ * @param num_hints number of elements in @p hints
+ * @param hints match candidates; positions @b MUST not decrease, also with
+ *        respect to the previously added hints
+ * @returns ::BROTLI_FALSE if hints are not ordered, have zero distance or
+ *          length, or memory allocation failed
+ * @returns ::BROTLI_TRUE otherwise
+ */
+BROTLI_ENC_API BROTLI_BOOL BrotliEncoderAddMatchHints(
+    BrotliEncoderState* state, size_t num_hints,
+    const BrotliEncoderMatchHint hints[BROTLI_ARRAY_PARAM(num_hints)]);
+
 /**
  * Calculates the output size bound for the given @p input_size.
  *
@@ -295,6 +511,9 @@ BROTLI_ENC_API size_t BrotliEncoderMaxCompressedSize(size_t input_size);
  *       decoder should be configured with
  *       ::BROTLI_DECODER_PARAM_LARGE_WINDOW = @c 1
  *
+ * @note Otherwise stream header tells the smallest window that covers the
+ *       input (see ::BROTLI_PARAM_TIGHT_WINDOW); @p lgwin is the upper bound.
+ *
  * @param quality quality parameter value, e.g. ::BROTLI_DEFAULT_QUALITY
  * @param lgwin lgwin parameter value, e.g. ::BROTLI_DEFAULT_WINDOW
  * @param mode mode parameter value, e.g. ::BROTLI_DEFAULT_MODE
@@ -382,6 +601,83 @@ BROTLI_ENC_API BROTLI_BOOL BrotliEncoderCompressStream(
     const uint8_t** next_in, size_t* available_out, uint8_t** next_out,
     size_t* total_out);
 
+/**
+ * Compresses scattered input stream to scattered output stream.
+ *
+ * Works like ::BrotliEncoderCompressStream called on the concatenation of
+ * @p input segments with output going to the concatenation of @p output
+ * segments, without copying the segments to contiguous buffers. Segments are
+ * used in order; empty segments are skipped. @p op applies to the input as a
+ * whole, i.e. flush / finish happens only after the last segment is consumed.
+ *
+ * After the call, @c data and @c size of each segment are advanced by the
+ * amount of bytes consumed / written; depleted segments have @c size @c 0.
+ * The method returns when no more progress could be made; same as with
+ * ::BrotliEncoderCompressStream, flush and finish are complete only when all
+ * input is consumed and ::BrotliEncoderHasMoreOutput returns ::BROTLI_FALSE.
+ *
+ * @note For qualities @c 0 and @c 1, or when ::BROTLI_PARAM_SIZE_HINT is not
+ *       set, the compressed stream might differ from the one produced for the
+ *       same input passed in a single contiguous buffer, same as if segments
+ *       were passed in separate ::BrotliEncoderCompressStream calls.
+ *
+ * @param state encoder instance
+ * @param op requested operation; ::BROTLI_OPERATION_EMIT_METADATA is
+ *        supported only if at most one input segment is not empty
+ * @param[in, out] input input segments
+ * @param num_input number of elements in @p input
+ * @param[in, out] output output segments
+ * @param num_output number of elements in @p output
+ * @param[out] total_out number of bytes produced so far; can be @c NULL
+ * @returns ::BROTLI_FALSE if there was an error
+ * @returns ::BROTLI_TRUE otherwise
+ */
+BROTLI_ENC_API BROTLI_BOOL BrotliEncoderCompressStreamVec(
+    BrotliEncoderState* state, BrotliEncoderOperation op,
+    BrotliInputSegment* input, size_t num_input,
+    BrotliOutputSegment* output, size_t num_output, size_t* total_out);
+
+/**
+ * Compresses input into at most @p *available_out bytes and flushes.
+ *
+ * Encoder takes as much input as needed to fill the output budget and emits
+ * the longest prefix of the data, whose compressed form fits the budget.
+ * Prefix ends at a command boundary or inside a run of literals. Output ends
+ * on a byte boundary, like after ::BROTLI_OPERATION_FLUSH; i.e. the stream
+ * produced so far could be decoded up to the end of the prefix.
+ *
+ * Taken input that does not fit stays in the encoder and goes first to the
+ * next output. Thus @p *available_in is reduced by the amount of input taken,
+ * while @p *encoded_size tells how many bytes the produced output decodes to.
+ * If budget is too small to fit anything, nothing is written and
+ * @p *encoded_size is @c 0.
+ *
+ * Output is written to @p next_out directly; encoder never retains it.
+ * Encoding could be continued with ::BrotliEncoderCompressStream, e.g. to
+ * finish the stream with ::BROTLI_OPERATION_FINISH (that emits the remaining
+ * taken input too, regardless of any budget).
+ *
+ * @note Qualities @c 0 and @c 1, pre-filter (::BROTLI_PARAM_FILTER),
+ *       ::BROTLI_PARAM_STREAM_OFFSET and ::BROTLI_PARAM_CONTENT_SIZE_HEADER
+ *       are not supported.
+ *
+ * @param state encoder instance
+ * @param[in, out] available_in @b in: amount of available input; \n
+ *                 @b out: amount of unused input
+ * @param[in, out] next_in pointer to the next input byte
+ * @param[in, out] available_out @b in: output budget; \n
+ *                 @b out: remaining size of output buffer
+ * @param[in, out] next_out compressed output buffer cursor
+ * @param[out] encoded_size length of the data encoded in the output
+ * @returns ::BROTLI_FALSE if there was an error, parameters are not
+ *          supported, or encoder has unconsumed output or is in the middle
+ *          of an operation (e.g. flush or metadata)
+ * @returns ::BROTLI_TRUE otherwise
+ */
+BROTLI_ENC_API BROTLI_BOOL BrotliEncoderCompressWithBudget(
+    BrotliEncoderState* state, size_t* available_in, const uint8_t** next_in,
+    size_t* available_out, uint8_t** next_out, size_t* encoded_size);
+
 /**
  * Checks if encoder instance reached the final state.
  *
@@ -80,4 +80,32 @@ typedef void* (*brotli_alloc_func)(void* opaque, size_t size);
  */
 typedef void (*brotli_free_func)(void* opaque, void* address);
 
+/**
+ * Read-only memory region; element of scattered input.
+ *
+ * Used by ::BrotliEncoderCompressStreamVec and
+ * ::BrotliDecoderDecompressStreamVec; both advance @p data and reduce @p size
+ * by the amount of bytes consumed.
+ */
+typedef struct BrotliInputSegment {
+  /** first byte of the region; can be @c NULL if @p size is @c 0 */
+  const uint8_t* data;
+  /** number of bytes addressable at @p data */
+  size_t size;
+} BrotliInputSegment;
+
+/**
+ * Writable memory region; element of scattered output.
+ *
+ * Used by ::BrotliEncoderCompressStreamVec and
+ * ::BrotliDecoderDecompressStreamVec; both advance @p data and reduce @p size
+ * by the amount of bytes written.
+ */
+typedef struct BrotliOutputSegment {
+  /** first byte of the region; can be @c NULL if @p size is @c 0 */
+  uint8_t* data;
+  /** number of bytes addressable at @p data */
+  size_t size;
+} BrotliOutputSegment;
+
 #endif  /* BROTLI_COMMON_TYPES_H_ */
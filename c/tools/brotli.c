@@ -11,6 +11,11 @@
 #define _CRT_SECURE_NO_WARNINGS
 #endif
 
+/* Expose SEEK_DATA / SEEK_HOLE. */
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -24,17 +29,21 @@
 #include "../common/version.h"
 #include <brotli/decode.h>
 #include <brotli/encode.h>
+#include "./serve.h"
 
 #if !defined(_WIN32)
 #include <unistd.h>
 #include <utime.h>
 #define MAKE_BINARY(FILENO) (FILENO)
+#define MKDIR(PATH) mkdir((PATH), 0777)
 #else
+#include <direct.h>
 #include <io.h>
 #include <share.h>
 #include <sys/utime.h>
 
 #define MAKE_BINARY(FILENO) (_setmode((FILENO), _O_BINARY), (FILENO))
+#define MKDIR(PATH) _mkdir(PATH)
 
 #if !defined(__MINGW32__)
 #define STDIN_FILENO _fileno(stdin)
@@ -44,6 +53,8 @@
 #endif
 
 #define fdopen _fdopen
+#define fileno _fileno
+#define ftruncate _chsize_s
 #define isatty _isatty
 #define unlink _unlink
 #define utimbuf _utimbuf
@@ -73,6 +84,15 @@ static int ms_open(const char* filename, int oflag, int pmode) {
 }
 #endif  /* WIN32 */
 
+/* Holes of sparse input files are not read; all-zero pages of output are
+   skipped to become holes. */
+#if !defined(_WIN32)
+#define BROTLI_SPARSE_OUTPUT 1
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+#define BROTLI_SPARSE_INPUT 1
+#endif
+#endif
+
 typedef enum {
   COMMAND_COMPRESS,
   COMMAND_DECOMPRESS,
@@ -80,17 +100,25 @@ typedef enum {
   COMMAND_INVALID,
   COMMAND_TEST_INTEGRITY,
   COMMAND_NOOP,
+  COMMAND_SERVE,
+  COMMAND_STOP_SERVER,
   COMMAND_VERSION
 } Command;
 
 #define DEFAULT_LGWIN 24
 #define DEFAULT_SUFFIX ".br"
+#define DEFAULT_SERVE_WORKERS 4
+/* Window (and restart interval) of solid archives, unless set with -w. */
+#define DEFAULT_SOLID_LGWIN 22
 #define MAX_OPTIONS 20
 
 typedef struct {
   /* Parameters */
   int quality;
   int lgwin;
+  int num_threads;  /* 0, if not specified */
+  int filter;  /* BrotliEncoderFilter */
+  int filter_distance;  /* 0, if not specified */
   int verbosity;
   BROTLI_BOOL force_overwrite;
   BROTLI_BOOL junk_source;
@@ -99,8 +127,16 @@ typedef struct {
   BROTLI_BOOL test_integrity;
   BROTLI_BOOL decompress;
   BROTLI_BOOL large_window;
+  BROTLI_BOOL append;
+  BROTLI_BOOL sparse;
+  BROTLI_BOOL solid;
+  /* Solid archive member to extract; NULL to extract all. */
+  const char* extract_name;
   const char* output_path;
   const char* suffix;
+  /* UNIX socket of compression daemon. */
+  const char* socket_path;
+  BROTLI_BOOL use_server;
   int not_input_indices[MAX_OPTIONS];
   size_t longest_path_len;
   size_t input_count;
@@ -115,12 +151,23 @@ typedef struct {
   uint8_t* buffer;
   uint8_t* input;
   uint8_t* output;
+  size_t input_buffer_size;
   const char* current_input_path;
   const char* current_output_path;
   int64_t input_file_length;  /* -1, if impossible to calculate */
   FILE* fin;
   FILE* fout;
 
+  /* Sparse files */
+  BROTLI_BOOL sparse_input;
+  int64_t input_pos;
+  /* Next hole of input is [hole_start, hole_end). */
+  int64_t hole_start;
+  int64_t hole_end;
+  size_t input_zeros;  /* Leading bytes of input buffer known to be zero. */
+  BROTLI_BOOL sparse_output;
+  BROTLI_BOOL output_ends_with_hole;
+
   /* I/O buffers */
   size_t available_in;
   const uint8_t* next_in;
@@ -136,6 +183,22 @@ typedef struct {
   clock_t end_time;
 } Context;
 
+/* Original content of the output file bytes modified in append mode. */
+typedef struct {
+  int64_t size;
+  int64_t header_pos;
+  size_t header_len;
+  uint8_t header[5];
+  int64_t tail_pos;
+  size_t tail_len;
+  uint8_t tail[2];
+  /* Stream start; enough for content size header, even if pre-filtered. */
+  size_t start_len;
+  uint8_t start[24];
+  /* Uncompressed size of the existing stream. */
+  uint64_t total_size;
+} AppendUndo;
+
 /* Parse up to 5 decimal digits. */
 static BROTLI_BOOL ParseInt(const char* s, int low, int high, int* result) {
   int value = 0;
@@ -154,6 +217,29 @@ static BROTLI_BOOL ParseInt(const char* s, int low, int high, int* result) {
   return BROTLI_TRUE;
 }
 
+/* Parses "NAME" or "NAME:DISTANCE". */
+static BROTLI_BOOL ParseFilter(const char* s, int* filter, int* distance) {
+  static const char* kNames[] = {"none", "delta", "transpose", "x86", "auto"};
+  const char* colon = strchr(s, ':');
+  size_t name_len = colon ? (size_t)(colon - s) : strlen(s);
+  int i;
+  for (i = 0; i <= BROTLI_FILTER_AUTO; ++i) {
+    if (strlen(kNames[i]) == name_len &&
+        strncmp(kNames[i], s, name_len) == 0) {
+      break;
+    }
+  }
+  if (i > BROTLI_FILTER_AUTO) return BROTLI_FALSE;
+  *filter = i;
+  *distance = 0;
+  if (!colon) return BROTLI_TRUE;
+  if (i != BROTLI_FILTER_DELTA && i != BROTLI_FILTER_TRANSPOSE) {
+    return BROTLI_FALSE;
+  }
+  return ParseInt(colon + 1, (i == BROTLI_FILTER_DELTA) ? 1 : 2, 255,
+                  distance);
+}
+
 /* Returns "base file name" or its tail, if it contains '/' or '\'. */
 static const char* FileName(const char* path) {
   const char* separator_position = strrchr(path, '/');
@@ -190,6 +276,8 @@ static Command ParseParams(Context* params) {
   BROTLI_BOOL keep_set = BROTLI_FALSE;
   BROTLI_BOOL lgwin_set = BROTLI_FALSE;
   BROTLI_BOOL suffix_set = BROTLI_FALSE;
+  BROTLI_BOOL threads_set = BROTLI_FALSE;
+  BROTLI_BOOL filter_set = BROTLI_FALSE;
   BROTLI_BOOL after_dash_dash = BROTLI_FALSE;
   Command command = ParseAlias(argv[0]);
 
@@ -310,8 +398,9 @@ static Command ParseParams(Context* params) {
           params->quality = 11;
           continue;
         }
-        /* o/q/w/D/S with parameter is expected */
-        if (c != 'o' && c != 'q' && c != 'w' && c != 'D' && c != 'S') {
+        /* o/q/w/D/S/T with parameter is expected */
+        if (c != 'o' && c != 'q' && c != 'w' && c != 'D' && c != 'S' &&
+            c != 'T') {
           fprintf(stderr, "invalid argument -%c\n", c);
           return COMMAND_INVALID;
         }
@@ -366,11 +455,27 @@ static Command ParseParams(Context* params) {
           }
           suffix_set = BROTLI_TRUE;
           params->suffix = argv[i];
+        } else if (c == 'T') {
+          if (threads_set) {
+            fprintf(stderr, "number of threads already set\n");
+            return COMMAND_INVALID;
+          }
+          threads_set = ParseInt(argv[i], 1, 64, &params->num_threads);
+          if (!threads_set) {
+            fprintf(stderr, "error parsing threads value [%s]\n", argv[i]);
+            return COMMAND_INVALID;
+          }
         }
       }
     } else {  /* Double-dash. */
       arg = &arg[2];
-      if (strcmp("best", arg) == 0) {
+      if (strcmp("append", arg) == 0) {
+        if (params->append) {
+          fprintf(stderr, "argument --append already set\n");
+          return COMMAND_INVALID;
+        }
+        params->append = BROTLI_TRUE;
+      } else if (strcmp("best", arg) == 0) {
         if (quality_set) {
           fprintf(stderr, "quality already set\n");
           return COMMAND_INVALID;
@@ -406,6 +511,18 @@ static Command ParseParams(Context* params) {
           return COMMAND_INVALID;
         }
         params->copy_stat = BROTLI_FALSE;
+      } else if (strcmp("no-sparse", arg) == 0) {
+        if (!params->sparse) {
+          fprintf(stderr, "argument --no-sparse already set\n");
+          return COMMAND_INVALID;
+        }
+        params->sparse = BROTLI_FALSE;
+      } else if (strcmp("solid", arg) == 0) {
+        if (params->solid) {
+          fprintf(stderr, "argument --solid already set\n");
+          return COMMAND_INVALID;
+        }
+        params->solid = BROTLI_TRUE;
       } else if (strcmp("rm", arg) == 0) {
         if (keep_set) {
           fprintf(stderr, "argument --rm / -j or --keep / -k already set\n");
@@ -446,7 +563,24 @@ static Command ParseParams(Context* params) {
         }
         key_len = (size_t)(value - arg);
         value++;
-        if (strncmp("lgwin", arg, key_len) == 0) {
+        if (strncmp("extract", arg, key_len) == 0) {
+          if (params->extract_name) {
+            fprintf(stderr, "member to extract already set\n");
+            return COMMAND_INVALID;
+          }
+          params->extract_name = value;
+        } else if (strncmp("filter", arg, key_len) == 0) {
+          if (filter_set) {
+            fprintf(stderr, "filter already set\n");
+            return COMMAND_INVALID;
+          }
+          filter_set = ParseFilter(value,
+              &params->filter, &params->filter_distance);
+          if (!filter_set) {
+            fprintf(stderr, "error parsing filter value [%s]\n", value);
+            return COMMAND_INVALID;
+          }
+        } else if (strncmp("lgwin", arg, key_len) == 0) {
           if (lgwin_set) {
             fprintf(stderr, "lgwin parameter already set\n");
             return COMMAND_INVALID;
@@ -506,6 +640,35 @@ static Command ParseParams(Context* params) {
           }
           suffix_set = BROTLI_TRUE;
           params->suffix = value;
+        } else if (strncmp("threads", arg, key_len) == 0) {
+          if (threads_set) {
+            fprintf(stderr, "number of threads already set\n");
+            return COMMAND_INVALID;
+          }
+          threads_set = ParseInt(value, 1, 64, &params->num_threads);
+          if (!threads_set) {
+            fprintf(stderr, "error parsing threads value [%s]\n", value);
+            return COMMAND_INVALID;
+          }
+        } else if (strncmp("connect", arg, key_len) == 0 ||
+                   strncmp("serve", arg, key_len) == 0 ||
+                   strncmp("stop", arg, key_len) == 0) {
+          if (params->socket_path) {
+            fprintf(stderr, "server socket already set\n");
+            return COMMAND_INVALID;
+          }
+          params->socket_path = value;
+          if (strncmp("connect", arg, key_len) == 0) {
+            params->use_server = BROTLI_TRUE;
+          } else {
+            if (command_set) {
+              fprintf(stderr, "command already set when parsing --%s\n", arg);
+              return COMMAND_INVALID;
+            }
+            command_set = BROTLI_TRUE;
+            command = (strncmp("serve", arg, key_len) == 0) ?
+                COMMAND_SERVE : COMMAND_STOP_SERVER;
+          }
         } else {
           fprintf(stderr, "invalid parameter: [%s]\n", arg);
           return COMMAND_INVALID;
@@ -519,11 +682,43 @@ static Command ParseParams(Context* params) {
   params->decompress = (command == COMMAND_DECOMPRESS);
   params->test_integrity = (command == COMMAND_TEST_INTEGRITY);
 
-  if (input_count > 1 && output_set) return COMMAND_INVALID;
+  if (params->extract_name) params->solid = BROTLI_TRUE;
+
+  if (input_count > 1 && output_set && !params->solid) return COMMAND_INVALID;
   if (params->test_integrity) {
     if (params->output_path) return COMMAND_INVALID;
     if (params->write_to_stdout) return COMMAND_INVALID;
   }
+  if (params->append) {
+    if (command != COMMAND_COMPRESS) return COMMAND_INVALID;
+    if (params->write_to_stdout) return COMMAND_INVALID;
+    if (params->filter != BROTLI_FILTER_NONE) return COMMAND_INVALID;
+  }
+  if (params->use_server) {
+    if (command != COMMAND_COMPRESS && command != COMMAND_DECOMPRESS) {
+      return COMMAND_INVALID;
+    }
+    if (params->append) return COMMAND_INVALID;
+  }
+  if (params->solid) {
+    if (params->append || params->use_server) return COMMAND_INVALID;
+    if (params->filter != BROTLI_FILTER_NONE) return COMMAND_INVALID;
+    if (command == COMMAND_COMPRESS) {
+      if (!params->output_path && !params->write_to_stdout) {
+        return COMMAND_INVALID;
+      }
+      if (params->extract_name || params->junk_source) return COMMAND_INVALID;
+    } else if (command == COMMAND_DECOMPRESS ||
+               command == COMMAND_TEST_INTEGRITY) {
+      if (input_count != 1) return COMMAND_INVALID;
+      if (params->output_path && !params->extract_name) return COMMAND_INVALID;
+    } else {
+      return COMMAND_INVALID;
+    }
+  }
+  if (command == COMMAND_SERVE || command == COMMAND_STOP_SERVER) {
+    if (input_count > 0 || output_set) return COMMAND_INVALID;
+  }
   if (strchr(params->suffix, '/') || strchr(params->suffix, '\\')) {
     return COMMAND_INVALID;
   }
@@ -547,14 +742,25 @@ static void PrintHelp(const char* name, BROTLI_BOOL error) {
   fprintf(media,
 "Options:\n"
 "  -#                          compression level (0-9)\n"
+"  --append                    continue existing output file\n"
 "  -c, --stdout                write on standard output\n"
 "  -d, --decompress            decompress\n"
-"  -f, --force                 force output file overwrite\n"
+"  --extract=NAME              extract only member NAME of --solid archive\n"
+"  -f, --force                 force output file overwrite\n");
+  fprintf(media,
+"  --filter=NAME[:NUM]         apply reversible filter before compression:\n"
+"                              none (default), delta, transpose, x86 or auto;\n"
+"                              NUM is delta distance or transposition stride\n"
+"                              WARNING: filtered output is only decodable\n"
+"                              by decoders with filter support\n");
+  fprintf(media,
 "  -h, --help                  display this help and exit\n");
   fprintf(media,
 "  -j, --rm                    remove source file(s)\n"
 "  -k, --keep                  keep source file(s) (default)\n"
 "  -n, --no-copy-stat          do not copy source file(s) attributes\n"
+"  --no-sparse                 read holes of input file(s) and write zeros\n"
+"                              to output file(s) instead of creating holes\n"
 "  -o FILE, --output=FILE      output file (only if 1 input file)\n");
   fprintf(media,
 "  -q NUM, --quality=NUM       compression level (%d-%d)\n",
@@ -578,6 +784,21 @@ static void PrintHelp(const char* name, BROTLI_BOOL error) {
 "  -S SUF, --suffix=SUF        output file suffix (default:'%s')\n",
           DEFAULT_SUFFIX);
   fprintf(media,
+"  --solid                     pack all FILEs into one archive (-o or -c);\n"
+"                              with -d or -t, unpack or test the archive;\n"
+"                              members share the window; archive restarts\n"
+"                              after each window (-w) of input\n");
+  fprintf(media,
+"  --serve=SOCKET              run compression daemon on UNIX socket;\n"
+"                              -T sets the number of workers (default: %d)\n"
+"  --connect=SOCKET            (de)compress files with the daemon\n"
+"  --stop=SOCKET               stop the daemon\n",
+          DEFAULT_SERVE_WORKERS);
+  fprintf(media,
+"  -T NUM, --threads=NUM       use up to NUM threads for quality 1 (1-64);\n"
+"                              input is read in larger chunks, output does\n"
+"                              not depend on NUM\n");
+  fprintf(media,
 "  -V, --version               display version and exit\n"
 "  -Z, --best                  use best compression level (11) (default)\n"
 "Simple options could be coalesced, i.e. '-9kf' is equivalent to '-9 -k -f'.\n"
@@ -628,6 +849,29 @@ static BROTLI_BOOL OpenOutputFile(const char* output_path, FILE** f,
   return BROTLI_TRUE;
 }
 
+/* Opens existing output file for update, or creates a new one. */
+static BROTLI_BOOL OpenAppendFile(const char* output_path, FILE** f) {
+  int fd;
+  *f = NULL;
+  if (!output_path) {
+    fprintf(stderr, "output file must be specified to append\n");
+    return BROTLI_FALSE;
+  }
+  fd = open(output_path, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    fprintf(stderr, "failed to open output file [%s]: %s\n",
+            PrintablePath(output_path), strerror(errno));
+    return BROTLI_FALSE;
+  }
+  *f = fdopen(fd, "r+b");
+  if (!*f) {
+    fprintf(stderr, "failed to open output file [%s]: %s\n",
+            PrintablePath(output_path), strerror(errno));
+    return BROTLI_FALSE;
+  }
+  return BROTLI_TRUE;
+}
+
 static int64_t FileSize(const char* path) {
   FILE* f = fopen(path, "rb");
   int64_t retval;
@@ -721,6 +965,8 @@ static BROTLI_BOOL NextFile(Context* context) {
 
   if (context->output_path) return BROTLI_TRUE;
   if (context->write_to_stdout) return BROTLI_TRUE;
+  /* Solid archive members are named by the archive index. */
+  if (context->solid) return BROTLI_TRUE;
 
   strcpy(context->modified_path, arg);
   context->current_output_path = context->modified_path;
@@ -751,19 +997,56 @@ static BROTLI_BOOL NextFile(Context* context) {
   }
 }
 
+#if defined(BROTLI_SPARSE_OUTPUT)
+static BROTLI_BOOL IsRegularFile(FILE* f) {
+  struct stat statbuf;
+  if (fstat(fileno(f), &statbuf) != 0) return BROTLI_FALSE;
+  return TO_BROTLI_BOOL(S_ISREG(statbuf.st_mode));
+}
+#endif
+
+/* Holes are handled only in files opened by path; console could be redirected
+   to a file opened in append mode. */
+static void InitSparseFiles(Context* context) {
+  context->sparse_input = BROTLI_FALSE;
+  context->input_pos = 0;
+  context->hole_start = 0;
+  context->hole_end = 0;
+  context->input_zeros = 0;
+  context->sparse_output = BROTLI_FALSE;
+  context->output_ends_with_hole = BROTLI_FALSE;
+  if (!context->sparse) return;
+#if defined(BROTLI_SPARSE_INPUT)
+  if (!context->decompress && context->current_input_path &&
+      context->input_file_length > 0 && IsRegularFile(context->fin)) {
+    context->sparse_input = BROTLI_TRUE;
+  }
+#endif
+#if defined(BROTLI_SPARSE_OUTPUT)
+  if (context->decompress && !context->test_integrity &&
+      context->current_output_path && IsRegularFile(context->fout)) {
+    context->sparse_output = BROTLI_TRUE;
+  }
+#endif
+}
+
 static BROTLI_BOOL OpenFiles(Context* context) {
   BROTLI_BOOL is_ok = OpenInputFile(context->current_input_path, &context->fin);
-  if (!context->test_integrity && is_ok) {
+  if (context->append && is_ok) {
+    is_ok = OpenAppendFile(context->current_output_path, &context->fout);
+  } else if (!context->test_integrity && is_ok) {
     is_ok = OpenOutputFile(
         context->current_output_path, &context->fout, context->force_overwrite);
   }
+  if (is_ok) InitSparseFiles(context);
   return is_ok;
 }
 
 static BROTLI_BOOL CloseFiles(Context* context, BROTLI_BOOL success) {
   BROTLI_BOOL is_ok = BROTLI_TRUE;
   if (!context->test_integrity && context->fout) {
-    if (!success && context->current_output_path) {
+    /* In append mode output file is restored by UndoAppend. */
+    if (!success && context->current_output_path && !context->append) {
       unlink(context->current_output_path);
     }
     if (fclose(context->fout) != 0) {
@@ -775,7 +1058,7 @@ static BROTLI_BOOL CloseFiles(Context* context, BROTLI_BOOL success) {
     }
 
     /* TOCTOU violation, but otherwise it is impossible to set file times. */
-    if (success && is_ok && context->copy_stat) {
+    if (success && is_ok && context->copy_stat && !context->append) {
       CopyStat(context->current_input_path, context->current_output_path);
     }
   }
@@ -800,6 +1083,9 @@ static BROTLI_BOOL CloseFiles(Context* context, BROTLI_BOOL success) {
 }
 
 static const size_t kFileBufferSize = 1 << 19;
+/* Input chunk size when threads are requested; bigger chunks contain more
+   independent blocks that could be compressed concurrently. */
+static const size_t kParallelFileBufferSize = 1 << 26;
 
 static void InitializeBuffers(Context* context) {
   context->available_in = 0;
@@ -819,9 +1105,75 @@ static BROTLI_BOOL HasMoreInput(Context* context) {
   return feof(context->fin) ? BROTLI_FALSE : BROTLI_TRUE;
 }
 
+#if defined(BROTLI_SPARSE_INPUT)
+/* Finds the first hole at or after the input position. Sparse input is
+   turned off when there are no more holes. */
+static BROTLI_BOOL FindNextHole(Context* context) {
+  const int fd = fileno(context->fin);
+  const off_t pos = (off_t)context->input_pos;
+  const off_t size = (off_t)context->input_file_length;
+  off_t hole = -1;
+  off_t data = -1;
+  if (pos < size) {
+    hole = lseek(fd, pos, SEEK_HOLE);
+    if (hole >= 0 && hole < size) {
+      data = lseek(fd, hole, SEEK_DATA);
+      /* No data till the end of file. */
+      if (data < 0 && errno == ENXIO) data = size;
+    }
+  }
+  if (hole >= 0 && data > hole) {
+    context->hole_start = (int64_t)hole;
+    context->hole_end = (int64_t)data;
+  } else {
+    context->sparse_input = BROTLI_FALSE;
+  }
+  /* Descriptor offset is moved; sync the stream with it. */
+  if (fseek(context->fin, context->input_pos, SEEK_SET) != 0) {
+    fprintf(stderr, "failed to read input [%s]: %s\n",
+            PrintablePath(context->current_input_path), strerror(errno));
+    return BROTLI_FALSE;
+  }
+  return BROTLI_TRUE;
+}
+
+/* Provides the next chunk of the hole without reading it. */
+static BROTLI_BOOL ProvideHole(Context* context) {
+  int64_t hole_size = context->hole_end - context->input_pos;
+  size_t size = context->input_buffer_size;
+  if (hole_size < (int64_t)size) size = (size_t)hole_size;
+  if (context->input_zeros < size) {
+    memset(context->input, 0, size);
+    context->input_zeros = size;
+  }
+  context->input_pos += (int64_t)size;
+  context->available_in = size;
+  context->total_in += size;
+  context->next_in = context->input;
+  if (fseek(context->fin, context->input_pos, SEEK_SET) != 0) {
+    fprintf(stderr, "failed to read input [%s]: %s\n",
+            PrintablePath(context->current_input_path), strerror(errno));
+    return BROTLI_FALSE;
+  }
+  return BROTLI_TRUE;
+}
+#endif
+
 static BROTLI_BOOL ProvideInput(Context* context) {
-  context->available_in =
-      fread(context->input, 1, kFileBufferSize, context->fin);
+  size_t size = context->input_buffer_size;
+#if defined(BROTLI_SPARSE_INPUT)
+  if (context->sparse_input && context->input_pos >= context->hole_end) {
+    if (!FindNextHole(context)) return BROTLI_FALSE;
+  }
+  if (context->sparse_input) {
+    int64_t data_size = context->hole_start - context->input_pos;
+    if (data_size <= 0) return ProvideHole(context);
+    if (data_size < (int64_t)size) size = (size_t)data_size;
+  }
+  context->input_zeros = 0;
+#endif
+  context->available_in = fread(context->input, 1, size, context->fin);
+  context->input_pos += (int64_t)context->available_in;
   context->total_in += context->available_in;
   context->next_in = context->input;
   if (ferror(context->fin)) {
@@ -832,12 +1184,82 @@ static BROTLI_BOOL ProvideInput(Context* context) {
   return BROTLI_TRUE;
 }
 
+#if defined(BROTLI_SPARSE_OUTPUT)
+static const size_t kSparsePageSize = 4096;
+
+static BROTLI_BOOL WriteSpan(Context* context, const uint8_t* data,
+                             size_t size, BROTLI_BOOL is_hole) {
+  BROTLI_BOOL is_ok;
+  if (size == 0) return BROTLI_TRUE;
+  if (is_hole) {
+    is_ok = TO_BROTLI_BOOL(fseek(context->fout, (long)size, SEEK_CUR) == 0);
+  } else {
+    fwrite(data, 1, size, context->fout);
+    is_ok = TO_BROTLI_BOOL(!ferror(context->fout));
+  }
+  if (!is_ok) {
+    fprintf(stderr, "failed to write output [%s]: %s\n",
+            PrintablePath(context->current_output_path), strerror(errno));
+    return BROTLI_FALSE;
+  }
+  context->output_ends_with_hole = is_hole;
+  return BROTLI_TRUE;
+}
+
+static BROTLI_BOOL IsZeroPage(const uint8_t* data) {
+  return TO_BROTLI_BOOL(data[0] == 0 &&
+      memcmp(data, data + 1, kSparsePageSize - 1) == 0);
+}
+
+/* Seeks over aligned all-zero pages instead of writing them. */
+static BROTLI_BOOL WriteSparseOutput(Context* context, size_t size) {
+  const uint8_t* data = context->output;
+  size_t page_end = kSparsePageSize -
+      ((context->total_out - size) & (kSparsePageSize - 1));
+  size_t span_start = 0;
+  BROTLI_BOOL span_is_hole = BROTLI_FALSE;
+  size_t pos = 0;
+  while (pos < size) {
+    size_t end = page_end < size ? page_end : size;
+    BROTLI_BOOL is_hole = TO_BROTLI_BOOL(
+        end - pos == kSparsePageSize && IsZeroPage(data + pos));
+    if (is_hole != span_is_hole) {
+      if (!WriteSpan(context, data + span_start, pos - span_start,
+                     span_is_hole)) {
+        return BROTLI_FALSE;
+      }
+      span_start = pos;
+      span_is_hole = is_hole;
+    }
+    pos = end;
+    page_end += kSparsePageSize;
+  }
+  return WriteSpan(context, data + span_start, size - span_start,
+                   span_is_hole);
+}
+
+/* Holes in the end do not make the file longer. */
+static BROTLI_BOOL FinishSparseOutput(Context* context) {
+  if (!context->output_ends_with_hole) return BROTLI_TRUE;
+  if (fflush(context->fout) != 0 ||
+      ftruncate(fileno(context->fout), (off_t)context->total_out) != 0) {
+    fprintf(stderr, "failed to write output [%s]: %s\n",
+            PrintablePath(context->current_output_path), strerror(errno));
+    return BROTLI_FALSE;
+  }
+  return BROTLI_TRUE;
+}
+#endif
+
 /* Internal: should be used only in Provide-/Flush-Output. */
 static BROTLI_BOOL WriteOutput(Context* context) {
   size_t out_size = (size_t)(context->next_out - context->output);
   context->total_out += out_size;
   if (out_size == 0) return BROTLI_TRUE;
   if (context->test_integrity) return BROTLI_TRUE;
+#if defined(BROTLI_SPARSE_OUTPUT)
+  if (context->sparse_output) return WriteSparseOutput(context, out_size);
+#endif
 
   fwrite(context->output, 1, out_size, context->fout);
   if (ferror(context->fout)) {
@@ -881,6 +1303,78 @@ static void PrintFileProcessingProgress(Context* context) {
   fprintf(stderr, " in %1.2f sec", (double)(context->end_time - context->start_time) / CLOCKS_PER_SEC);
 }
 
+static uint32_t ChooseLgwin(Context* context) {
+  uint32_t lgwin = DEFAULT_LGWIN;
+  /* Specified by user. */
+  if (context->lgwin > 0) return (uint32_t)context->lgwin;
+  /* 0, or not specified by user; could be chosen by compressor. */
+  /* Use file size to limit lgwin. */
+  if (context->input_file_length >= 0) {
+    lgwin = BROTLI_MIN_WINDOW_BITS;
+    while (BROTLI_MAX_BACKWARD_LIMIT(lgwin) <
+           (uint64_t)context->input_file_length) {
+      lgwin++;
+      if (lgwin == BROTLI_MAX_WINDOW_BITS) break;
+    }
+  }
+  return lgwin;
+}
+
+/* Passes files to compression daemon instead of processing them locally. */
+static BROTLI_BOOL ProcessFilesWithServer(Context* context) {
+  BROTLI_BOOL is_ok = BROTLI_TRUE;
+  int connection = BrotliServeConnect(context->socket_path);
+  if (connection < 0) {
+    fprintf(stderr, "failed to connect to server [%s]: %s\n",
+            context->socket_path, strerror(errno));
+    return BROTLI_FALSE;
+  }
+  while (is_ok && NextFile(context)) {
+    BrotliServeJob job;
+    BrotliServeStatus status;
+    uint64_t total_in;
+    uint64_t total_out;
+    is_ok = OpenFiles(context);
+    if (is_ok && context->decompress && !context->current_input_path &&
+        !context->force_overwrite && isatty(STDIN_FILENO)) {
+      fprintf(stderr, "Use -h help. Use -f to force input from a terminal.\n");
+      is_ok = BROTLI_FALSE;
+    }
+    if (is_ok && !context->decompress && !context->current_output_path &&
+        !context->force_overwrite && isatty(STDOUT_FILENO)) {
+      fprintf(stderr, "Use -h help. Use -f to force output to a terminal.\n");
+      is_ok = BROTLI_FALSE;
+    }
+    if (is_ok) {
+      job.decompress = context->decompress;
+      job.quality = context->quality;
+      job.lgwin = (int)ChooseLgwin(context);
+      job.filter = context->filter;
+      job.filter_distance = context->filter_distance;
+      job.size_hint = context->input_file_length > 0 ?
+          (uint64_t)context->input_file_length : 0;
+      InitializeBuffers(context);
+      status = BrotliServeProcess(connection, &job, fileno(context->fin),
+          fileno(context->fout), &total_in, &total_out);
+      context->total_in = (size_t)total_in;
+      context->total_out = (size_t)total_out;
+      if (status != BROTLI_SERVE_OK) {
+        fprintf(stderr, "%s [%s]\n", BrotliServeStatusString(status),
+                PrintablePath(context->current_input_path));
+        is_ok = BROTLI_FALSE;
+      } else if (context->verbosity > 0) {
+        context->end_time = clock();
+        fprintf(stderr, context->decompress ? "Decompressed " : "Compressed ");
+        PrintFileProcessingProgress(context);
+        fprintf(stderr, "\n");
+      }
+    }
+    if (!CloseFiles(context, is_ok)) is_ok = BROTLI_FALSE;
+  }
+  BrotliServeDisconnect(connection);
+  return is_ok;
+}
+
 static BROTLI_BOOL DecompressFile(Context* context, BrotliDecoderState* s) {
   BrotliDecoderResult result = BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT;
   InitializeBuffers(context);
@@ -903,6 +1397,11 @@ static BROTLI_BOOL DecompressFile(Context* context, BrotliDecoderState* s) {
                 PrintablePath(context->current_input_path));
         return BROTLI_FALSE;
       }
+#if defined(BROTLI_SPARSE_OUTPUT)
+      if (context->sparse_output && !FinishSparseOutput(context)) {
+        return BROTLI_FALSE;
+      }
+#endif
       if (context->verbosity > 0) {
         context->end_time = clock();
         fprintf(stderr, "Decompressed ");
@@ -921,7 +1420,569 @@ static BROTLI_BOOL DecompressFile(Context* context, BrotliDecoderState* s) {
   }
 }
 
+static BROTLI_BOOL ReadBytesAt(FILE* f, int64_t pos, uint8_t* buf, size_t n) {
+  if (n == 0) return BROTLI_TRUE;
+  if (fseek(f, pos, SEEK_SET) != 0) return BROTLI_FALSE;
+  return TO_BROTLI_BOOL(fread(buf, 1, n, f) == n);
+}
+
+static BROTLI_BOOL WriteBytesAt(FILE* f, int64_t pos, const uint8_t* buf,
+                                size_t n) {
+  if (n == 0) return BROTLI_TRUE;
+  if (fseek(f, pos, SEEK_SET) != 0) return BROTLI_FALSE;
+  return TO_BROTLI_BOOL(fwrite(buf, 1, n, f) == n);
+}
+
+static void SetEncoderParameters(Context* context, BrotliEncoderState* s,
+                                 uint32_t lgwin) {
+  BrotliEncoderSetParameter(s,
+      BROTLI_PARAM_QUALITY, (uint32_t)context->quality);
+  /* Do not enable "large-window" extension, if not required. */
+  if (context->lgwin > BROTLI_MAX_WINDOW_BITS) {
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_LARGE_WINDOW, 1u);
+  }
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, lgwin);
+  if (context->num_threads > 0) {
+    BrotliEncoderSetParameter(s,
+        BROTLI_PARAM_NUM_THREADS, (uint32_t)context->num_threads);
+  }
+  if (context->filter != BROTLI_FILTER_NONE) {
+    BrotliEncoderSetParameter(s,
+        BROTLI_PARAM_FILTER, (uint32_t)context->filter);
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_FILTER_DISTANCE,
+        (uint32_t)context->filter_distance);
+  }
+}
+
+/* Solid archive is a sequence of independent brotli streams ("segments")
+   followed by an index and a trailer. Members are concatenated and share the
+   encoder window; a new segment is started at the member boundary once the
+   current one holds a window of input. Thus any member could be extracted by
+   decoding from the start of its segment. Index is compressed with brotli; it
+   is a list of entries:
+     offset of segment in archive (8), offset in decoded segment (8),
+     member size (8), NUL-terminated member name.
+   Trailer is: offset of index (8), decoded index size (8), magic (8).
+   All numbers are little-endian. */
+#define SOLID_ENTRY_HEADER_SIZE 24
+#define SOLID_TRAILER_SIZE 24
+static const uint8_t kSolidMagic[8] = {'B', 'R', 'S', 'O', 'L', 'I', 'D', '1'};
+
+typedef struct {
+  uint8_t* data;
+  size_t size;
+  size_t capacity;
+} SolidIndex;
+
+typedef struct {
+  BrotliDecoderState* decoder;
+  int64_t segment_pos;  /* Archive offset of the segment being decoded. */
+  uint64_t pos;  /* Number of decoded segment bytes consumed. */
+  int64_t index_pos;  /* Segments end where index starts. */
+} SolidReader;
+
+static void StoreU64(uint8_t* p, uint64_t value) {
+  size_t i;
+  for (i = 0; i < 8; ++i) p[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t LoadU64(const uint8_t* p) {
+  uint64_t value = 0;
+  size_t i;
+  for (i = 0; i < 8; ++i) value |= (uint64_t)p[i] << (8 * i);
+  return value;
+}
+
+static BROTLI_BOOL AppendToIndex(SolidIndex* index, const void* data,
+                                 size_t size) {
+  if (index->capacity - index->size < size) {
+    size_t capacity = index->capacity ? index->capacity : 4096;
+    uint8_t* new_data;
+    while (capacity - index->size < size) capacity *= 2;
+    new_data = (uint8_t*)realloc(index->data, capacity);
+    if (!new_data) return BROTLI_FALSE;
+    index->data = new_data;
+    index->capacity = capacity;
+  }
+  memcpy(index->data + index->size, data, size);
+  index->size += size;
+  return BROTLI_TRUE;
+}
+
+/* Archive offset of the next output byte. */
+static uint64_t SolidOutputPos(Context* context) {
+  return context->total_out + (size_t)(context->next_out - context->output);
+}
+
+/* Passes the whole input file to encoder, without finishing the stream. */
+static BROTLI_BOOL CompressSolidMember(Context* context,
+                                       BrotliEncoderState* s) {
+  for (;;) {
+    if (context->available_in == 0) {
+      if (!HasMoreInput(context)) return BROTLI_TRUE;
+      if (!ProvideInput(context)) return BROTLI_FALSE;
+      continue;
+    }
+    if (!BrotliEncoderCompressStream(s, BROTLI_OPERATION_PROCESS,
+        &context->available_in, &context->next_in,
+        &context->available_out, &context->next_out, NULL)) {
+      fprintf(stderr, "failed to compress data [%s]\n",
+              PrintablePath(context->current_input_path));
+      return BROTLI_FALSE;
+    }
+    if (context->available_out == 0 && !ProvideOutput(context)) {
+      return BROTLI_FALSE;
+    }
+  }
+}
+
+static BROTLI_BOOL FinishSolidSegment(Context* context,
+                                      BrotliEncoderState* s) {
+  while (!BrotliEncoderIsFinished(s)) {
+    if (context->available_out == 0 && !ProvideOutput(context)) {
+      return BROTLI_FALSE;
+    }
+    if (!BrotliEncoderCompressStream(s, BROTLI_OPERATION_FINISH,
+        &context->available_in, &context->next_in,
+        &context->available_out, &context->next_out, NULL)) {
+      fprintf(stderr, "failed to compress data [%s]\n",
+              PrintablePath(context->output_path));
+      return BROTLI_FALSE;
+    }
+  }
+  return BROTLI_TRUE;
+}
+
+static BROTLI_BOOL WriteSolidIndex(Context* context, const SolidIndex* index,
+                                   uint32_t lgwin) {
+  const uint64_t index_pos = SolidOutputPos(context);
+  size_t encoded_size = BrotliEncoderMaxCompressedSize(index->size);
+  uint8_t* encoded;
+  BROTLI_BOOL is_ok;
+  if (!FlushOutput(context)) return BROTLI_FALSE;
+  encoded = encoded_size ?
+      (uint8_t*)malloc(encoded_size + SOLID_TRAILER_SIZE) : NULL;
+  if (!encoded) {
+    fprintf(stderr, "out of memory\n");
+    return BROTLI_FALSE;
+  }
+  is_ok = BrotliEncoderCompress(context->quality, (int)lgwin,
+      BROTLI_MODE_GENERIC, index->size, index->data, &encoded_size, encoded);
+  if (!is_ok) {
+    fprintf(stderr, "failed to compress data [%s]\n",
+            PrintablePath(context->output_path));
+  } else {
+    StoreU64(encoded + encoded_size, index_pos);
+    StoreU64(encoded + encoded_size + 8, index->size);
+    memcpy(encoded + encoded_size + 16, kSolidMagic, sizeof(kSolidMagic));
+    encoded_size += SOLID_TRAILER_SIZE;
+    fwrite(encoded, 1, encoded_size, context->fout);
+    if (ferror(context->fout)) {
+      fprintf(stderr, "failed to write output [%s]: %s\n",
+              PrintablePath(context->output_path), strerror(errno));
+      is_ok = BROTLI_FALSE;
+    }
+    context->total_out += encoded_size;
+  }
+  free(encoded);
+  return is_ok;
+}
+
+/* Rejects names that would be extracted outside of the current directory. */
+static BROTLI_BOOL IsSafeMemberName(const char* name) {
+  if (name[0] == 0 || name[0] == '/' || name[0] == '\\') return BROTLI_FALSE;
+  if (name[1] == ':') return BROTLI_FALSE;
+  for (;;) {
+    size_t len = strcspn(name, "/\\");
+    if (len == 2 && name[0] == '.' && name[1] == '.') return BROTLI_FALSE;
+    if (name[len] == 0) return BROTLI_TRUE;
+    name += len + 1;
+  }
+}
+
+/* Skips drive prefix and leading separators, as tar does; stored names are
+   relative to the directory of extraction. */
+static const char* StoredMemberName(const char* path) {
+  if (((path[0] | 0x20) >= 'a' && (path[0] | 0x20) <= 'z') &&
+      path[1] == ':') {
+    path += 2;
+  }
+  while (path[0] == '/' || path[0] == '\\') path++;
+  return path;
+}
+
+static BROTLI_BOOL CompressSolid(Context* context) {
+  const uint32_t lgwin = context->lgwin > 0 ?
+      (uint32_t)context->lgwin : DEFAULT_SOLID_LGWIN;
+  const uint64_t segment_limit = BROTLI_MAX_BACKWARD_LIMIT(lgwin);
+  BrotliEncoderState* s = NULL;
+  SolidIndex index = {NULL, 0, 0};
+  uint64_t segment_pos = 0;
+  uint64_t segment_size = 0;
+  size_t num_members = 0;
+  BROTLI_BOOL is_ok = OpenOutputFile(
+      context->output_path, &context->fout, context->force_overwrite);
+  if (is_ok && !context->output_path &&
+      !context->force_overwrite && isatty(STDOUT_FILENO)) {
+    fprintf(stderr, "Use -h help. Use -f to force output to a terminal.\n");
+    is_ok = BROTLI_FALSE;
+  }
+  InitializeBuffers(context);
+  while (is_ok && NextFile(context)) {
+    const size_t total_in = context->total_in;
+    uint8_t header[SOLID_ENTRY_HEADER_SIZE];
+    const char* name;
+    if (!context->current_input_path) {
+      fprintf(stderr, "standard input could not be used with --solid\n");
+      is_ok = BROTLI_FALSE;
+      break;
+    }
+    name = StoredMemberName(context->current_input_path);
+    if (!IsSafeMemberName(name)) {
+      fprintf(stderr, "unsafe member name [%s]\n",
+              PrintablePath(context->current_input_path));
+      is_ok = BROTLI_FALSE;
+      break;
+    }
+    if (name != context->current_input_path && context->verbosity > 0) {
+      fprintf(stderr, "Storing [%s] as [%s]\n",
+              PrintablePath(context->current_input_path), name);
+    }
+    if (s && segment_size >= segment_limit) {
+      is_ok = FinishSolidSegment(context, s);
+      BrotliEncoderDestroyInstance(s);
+      s = NULL;
+      if (!is_ok) break;
+    }
+    if (!s) {
+      s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+      if (!s) {
+        fprintf(stderr, "out of memory\n");
+        is_ok = BROTLI_FALSE;
+        break;
+      }
+      SetEncoderParameters(context, s, lgwin);
+      segment_pos = SolidOutputPos(context);
+      segment_size = 0;
+    }
+    is_ok = OpenInputFile(context->current_input_path, &context->fin);
+    if (is_ok) is_ok = CompressSolidMember(context, s);
+    if (context->fin && fclose(context->fin) != 0 && is_ok) {
+      fprintf(stderr, "fclose failed [%s]: %s\n",
+              PrintablePath(context->current_input_path), strerror(errno));
+      is_ok = BROTLI_FALSE;
+    }
+    context->fin = NULL;
+    if (!is_ok) break;
+    StoreU64(header, segment_pos);
+    StoreU64(header + 8, segment_size);
+    StoreU64(header + 16, context->total_in - total_in);
+    segment_size += context->total_in - total_in;
+    num_members++;
+    if (!AppendToIndex(&index, header, sizeof(header)) ||
+        !AppendToIndex(&index, name, strlen(name) + 1)) {
+      fprintf(stderr, "out of memory\n");
+      is_ok = BROTLI_FALSE;
+    }
+  }
+  if (context->iterator_error) is_ok = BROTLI_FALSE;
+  if (is_ok && s) is_ok = FinishSolidSegment(context, s);
+  BrotliEncoderDestroyInstance(s);
+  if (is_ok) is_ok = WriteSolidIndex(context, &index, lgwin);
+  free(index.data);
+  if (context->fout) {
+    if (fclose(context->fout) != 0 && is_ok) {
+      fprintf(stderr, "fclose failed [%s]: %s\n",
+              PrintablePath(context->output_path), strerror(errno));
+      is_ok = BROTLI_FALSE;
+    }
+    if (!is_ok && context->output_path) unlink(context->output_path);
+    context->fout = NULL;
+  }
+  if (is_ok && context->verbosity > 0) {
+    context->end_time = clock();
+    fprintf(stderr, "Compressed %d files to [%s]: ", (int)num_members,
+            PrintablePath(context->output_path));
+    PrintBytes(context->total_in);
+    fprintf(stderr, " -> ");
+    PrintBytes(context->total_out);
+    fprintf(stderr, " in %1.2f sec\n",
+            (double)(context->end_time - context->start_time) / CLOCKS_PER_SEC);
+  }
+  return is_ok;
+}
+
+/* Reads and decodes archive index; returns NULL on failure. */
+static uint8_t* LoadSolidIndex(Context* context, int64_t* index_pos,
+                               size_t* index_size) {
+  const int64_t archive_size = context->input_file_length;
+  uint8_t trailer[SOLID_TRAILER_SIZE];
+  uint8_t* encoded = NULL;
+  uint8_t* index = NULL;
+  uint64_t pos;
+  uint64_t size;
+  size_t encoded_size;
+  size_t decoded_size;
+  BROTLI_BOOL is_ok = BROTLI_FALSE;
+  if (archive_size < SOLID_TRAILER_SIZE ||
+      !ReadBytesAt(context->fin, archive_size - SOLID_TRAILER_SIZE,
+                   trailer, SOLID_TRAILER_SIZE) ||
+      memcmp(trailer + 16, kSolidMagic, sizeof(kSolidMagic)) != 0) {
+    fprintf(stderr, "not a solid archive [%s]\n",
+            PrintablePath(context->current_input_path));
+    return NULL;
+  }
+  pos = LoadU64(trailer);
+  size = LoadU64(trailer + 8);
+  if (pos >= (uint64_t)(archive_size - SOLID_TRAILER_SIZE) || size == 0 ||
+      size > ((size_t)-1 >> 1)) {
+    fprintf(stderr, "corrupt input [%s]\n",
+            PrintablePath(context->current_input_path));
+    return NULL;
+  }
+  *index_pos = (int64_t)pos;
+  *index_size = (size_t)size;
+  encoded_size = (size_t)(archive_size - SOLID_TRAILER_SIZE - *index_pos);
+  encoded = (uint8_t*)malloc(encoded_size);
+  index = (uint8_t*)malloc(*index_size);
+  if (!encoded || !index) {
+    fprintf(stderr, "out of memory\n");
+  } else {
+    decoded_size = *index_size;
+    is_ok = ReadBytesAt(context->fin, *index_pos, encoded, encoded_size) &&
+        BrotliDecoderDecompress(encoded_size, encoded, &decoded_size, index) ==
+            BROTLI_DECODER_RESULT_SUCCESS &&
+        decoded_size == *index_size;
+    if (!is_ok) {
+      fprintf(stderr, "corrupt input [%s]\n",
+              PrintablePath(context->current_input_path));
+    }
+  }
+  free(encoded);
+  if (!is_ok) {
+    free(index);
+    return NULL;
+  }
+  return index;
+}
+
+/* Starts decoding the segment at the current input position. */
+static BROTLI_BOOL StartSolidSegment(Context* context, SolidReader* r) {
+  BrotliDecoderDestroyInstance(r->decoder);
+  r->segment_pos = context->input_pos - (int64_t)context->available_in;
+  r->pos = 0;
+  r->decoder = NULL;
+  if (r->segment_pos >= r->index_pos) {
+    fprintf(stderr, "corrupt input [%s]\n",
+            PrintablePath(context->current_input_path));
+    return BROTLI_FALSE;
+  }
+  r->decoder = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+  if (!r->decoder) {
+    fprintf(stderr, "out of memory\n");
+    return BROTLI_FALSE;
+  }
+  BrotliDecoderSetParameter(r->decoder, BROTLI_DECODER_PARAM_LARGE_WINDOW, 1u);
+  return BROTLI_TRUE;
+}
+
+/* Consumes |size| decoded bytes; writes them to |fout|, unless it is NULL.
+   Decoding continues to the following segment, if necessary. */
+static BROTLI_BOOL ReadSolid(Context* context, SolidReader* r, uint64_t size,
+                             FILE* fout, const char* output_path) {
+  while (size > 0) {
+    size_t available_out = 0;
+    BrotliDecoderResult result;
+    if (BrotliDecoderHasMoreOutput(r->decoder)) {
+      size_t n = size < kFileBufferSize ? (size_t)size : kFileBufferSize;
+      const uint8_t* data = BrotliDecoderTakeOutput(r->decoder, &n);
+      if (fout) {
+        fwrite(data, 1, n, fout);
+        if (ferror(fout)) {
+          fprintf(stderr, "failed to write output [%s]: %s\n",
+                  PrintablePath(output_path), strerror(errno));
+          return BROTLI_FALSE;
+        }
+      }
+      size -= n;
+      r->pos += n;
+      context->total_out += n;
+      continue;
+    }
+    if (BrotliDecoderIsFinished(r->decoder)) {
+      if (!StartSolidSegment(context, r)) return BROTLI_FALSE;
+      continue;
+    }
+    result = BrotliDecoderDecompressStream(r->decoder, &context->available_in,
+        &context->next_in, &available_out, NULL, NULL);
+    if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT) {
+      if (!HasMoreInput(context)) {
+        fprintf(stderr, "corrupt input [%s]\n",
+                PrintablePath(context->current_input_path));
+        return BROTLI_FALSE;
+      }
+      if (!ProvideInput(context)) return BROTLI_FALSE;
+    } else if (result == BROTLI_DECODER_RESULT_ERROR) {
+      fprintf(stderr, "corrupt input [%s]\n",
+              PrintablePath(context->current_input_path));
+      return BROTLI_FALSE;
+    }
+  }
+  return BROTLI_TRUE;
+}
+
+/* Positions reader at |offset| of the segment starting at |segment_pos|.
+   Sequential members are read without restarting the segment. */
+static BROTLI_BOOL SeekSolid(Context* context, SolidReader* r,
+                             uint64_t segment_pos, uint64_t offset) {
+  if (!r->decoder || (uint64_t)r->segment_pos != segment_pos ||
+      r->pos > offset) {
+    if (segment_pos >= (uint64_t)r->index_pos ||
+        fseek(context->fin, (int64_t)segment_pos, SEEK_SET) != 0) {
+      fprintf(stderr, "corrupt input [%s]\n",
+              PrintablePath(context->current_input_path));
+      return BROTLI_FALSE;
+    }
+    context->available_in = 0;
+    context->input_pos = (int64_t)segment_pos;
+    if (!StartSolidSegment(context, r)) return BROTLI_FALSE;
+  }
+  return ReadSolid(context, r, offset - r->pos, NULL, NULL);
+}
+
+/* Creates missing directories on the way to member |name|. */
+static BROTLI_BOOL CreateParentDirectories(const char* name) {
+  const size_t name_len = strlen(name);
+  char* path = (char*)malloc(name_len + 1);
+  size_t len = 0;
+  BROTLI_BOOL is_ok = BROTLI_TRUE;
+  if (!path) {
+    fprintf(stderr, "out of memory\n");
+    return BROTLI_FALSE;
+  }
+  memcpy(path, name, name_len + 1);
+  for (;;) {
+    len += strcspn(path + len, "/\\");
+    if (path[len] == 0) break;
+    path[len] = 0;
+    if (MKDIR(path) != 0 && errno != EEXIST) {
+      fprintf(stderr, "failed to create directory [%s]: %s\n", path,
+              strerror(errno));
+      is_ok = BROTLI_FALSE;
+      break;
+    }
+    path[len] = name[len];
+    len++;
+  }
+  free(path);
+  return is_ok;
+}
+
+static BROTLI_BOOL ExtractSolidMember(Context* context, SolidReader* r,
+    const uint8_t* entry, const char* name) {
+  const uint64_t size = LoadU64(entry + 16);
+  const char* output_path = context->extract_name ? context->output_path : name;
+  BROTLI_BOOL is_ok = BROTLI_TRUE;
+  FILE* fout = context->fout;
+  if (!context->test_integrity && !context->write_to_stdout) {
+    if (output_path == name && !IsSafeMemberName(name)) {
+      fprintf(stderr, "unsafe member name [%s]\n", name);
+      return BROTLI_FALSE;
+    }
+    if (output_path == name && !CreateParentDirectories(name)) {
+      return BROTLI_FALSE;
+    }
+    if (!OpenOutputFile(output_path, &fout, context->force_overwrite)) {
+      return BROTLI_FALSE;
+    }
+  }
+  is_ok = SeekSolid(context, r, LoadU64(entry), LoadU64(entry + 8)) &&
+      ReadSolid(context, r, size, fout, output_path);
+  if (fout && fout != context->fout) {
+    if (fclose(fout) != 0 && is_ok) {
+      fprintf(stderr, "fclose failed [%s]: %s\n",
+              PrintablePath(output_path), strerror(errno));
+      is_ok = BROTLI_FALSE;
+    }
+    if (!is_ok) unlink(output_path);
+  }
+  if (is_ok && context->verbosity > 0) {
+    fprintf(stderr, context->test_integrity ? "Tested [%s]: " :
+            "Extracted [%s]: ", name);
+    PrintBytes((size_t)size);
+    fprintf(stderr, "\n");
+  }
+  return is_ok;
+}
+
+static BROTLI_BOOL DecompressSolid(Context* context) {
+  SolidReader reader = {NULL, -1, 0, 0};
+  uint8_t* index = NULL;
+  size_t index_size = 0;
+  size_t pos = 0;
+  BROTLI_BOOL found = BROTLI_FALSE;
+  BROTLI_BOOL is_ok = NextFile(context);
+  if (is_ok && !context->current_input_path) {
+    fprintf(stderr, "standard input could not be used with --solid\n");
+    is_ok = BROTLI_FALSE;
+  }
+  if (is_ok) is_ok = OpenInputFile(context->current_input_path, &context->fin);
+  if (is_ok) {
+    index = LoadSolidIndex(context, &reader.index_pos, &index_size);
+    is_ok = TO_BROTLI_BOOL(index != NULL);
+  }
+  if (is_ok && context->write_to_stdout && !context->test_integrity) {
+    is_ok = OpenOutputFile(NULL, &context->fout, BROTLI_TRUE);
+  }
+  InitializeBuffers(context);
+  context->input_pos = 0;
+  while (is_ok && pos < index_size) {
+    const uint8_t* entry = index + pos;
+    const char* name = (const char*)entry + SOLID_ENTRY_HEADER_SIZE;
+    const uint8_t* name_end = NULL;
+    if (index_size - pos > SOLID_ENTRY_HEADER_SIZE) {
+      name_end = (const uint8_t*)memchr(name, 0,
+          index_size - pos - SOLID_ENTRY_HEADER_SIZE);
+    }
+    if (!name_end) {
+      fprintf(stderr, "corrupt input [%s]\n",
+              PrintablePath(context->current_input_path));
+      is_ok = BROTLI_FALSE;
+      break;
+    }
+    pos = (size_t)(name_end + 1 - index);
+    if (context->extract_name && strcmp(context->extract_name, name) != 0) {
+      continue;
+    }
+    found = BROTLI_TRUE;
+    is_ok = ExtractSolidMember(context, &reader, entry, name);
+    if (context->extract_name) break;
+  }
+  if (is_ok && context->extract_name && !found) {
+    fprintf(stderr, "member [%s] not found in [%s]\n", context->extract_name,
+            PrintablePath(context->current_input_path));
+    is_ok = BROTLI_FALSE;
+  }
+  BrotliDecoderDestroyInstance(reader.decoder);
+  free(index);
+  if (context->fout && fclose(context->fout) != 0 && is_ok) {
+    fprintf(stderr, "fclose failed [%s]: %s\n",
+            PrintablePath(NULL), strerror(errno));
+    is_ok = BROTLI_FALSE;
+  }
+  if (context->fin && fclose(context->fin) != 0 && is_ok) {
+    fprintf(stderr, "fclose failed [%s]: %s\n",
+            PrintablePath(context->current_input_path), strerror(errno));
+    is_ok = BROTLI_FALSE;
+  }
+  context->fin = NULL;
+  context->fout = NULL;
+  return is_ok;
+}
+
 static BROTLI_BOOL DecompressFiles(Context* context) {
+  if (context->use_server) return ProcessFilesWithServer(context);
+  if (context->solid) return DecompressSolid(context);
   while (NextFile(context)) {
     BROTLI_BOOL is_ok = BROTLI_TRUE;
     BrotliDecoderState* s = BrotliDecoderCreateInstance(NULL, NULL, NULL);
@@ -933,6 +1994,7 @@ static BROTLI_BOOL DecompressFiles(Context* context) {
        fragmentation (new builds decode streams that old builds don't),
        it is better from used experience perspective. */
     BrotliDecoderSetParameter(s, BROTLI_DECODER_PARAM_LARGE_WINDOW, 1u);
+    BrotliDecoderSetParameter(s, BROTLI_DECODER_PARAM_FILTERS, 1u);
     is_ok = OpenFiles(context);
     if (is_ok && !context->current_input_path &&
         !context->force_overwrite && isatty(STDIN_FILENO)) {
@@ -983,38 +2045,205 @@ static BROTLI_BOOL CompressFile(Context* context, BrotliEncoderState* s) {
   }
 }
 
+/* Longest history that could be referenced by the appended data. */
+#define MAX_APPEND_HISTORY BROTLI_MAX_BACKWARD_LIMIT(BROTLI_MAX_WINDOW_BITS)
+
+/* Decodes the existing output file and keeps the last MAX_APPEND_HISTORY bytes
+   of uncompressed data in |history|, which is twice as big. */
+static BROTLI_BOOL DecodeAppendHistory(Context* context, BrotliDecoderState* d,
+    uint8_t* history, size_t* history_size, uint64_t* total_size) {
+  BrotliDecoderResult result = BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT;
+  FILE* f = context->fout;
+  InitializeBuffers(context);
+  for (;;) {
+    if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT) {
+      if (feof(f)) break;
+      context->available_in = fread(context->input, 1, kFileBufferSize, f);
+      context->next_in = context->input;
+      if (ferror(f)) {
+        fprintf(stderr, "failed to read output [%s]: %s\n",
+                PrintablePath(context->current_output_path), strerror(errno));
+        return BROTLI_FALSE;
+      }
+    } else if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT ||
+               result == BROTLI_DECODER_RESULT_SUCCESS) {
+      size_t out_size = (size_t)(context->next_out - context->output);
+      if (*history_size + out_size > 2 * MAX_APPEND_HISTORY) {
+        size_t keep = MAX_APPEND_HISTORY - out_size;
+        memmove(history, history + *history_size - keep, keep);
+        *history_size = keep;
+      }
+      memcpy(history + *history_size, context->output, out_size);
+      *history_size += out_size;
+      *total_size += out_size;
+      context->available_out = kFileBufferSize;
+      context->next_out = context->output;
+      if (result == BROTLI_DECODER_RESULT_SUCCESS) {
+        if (context->available_in == 0 && fgetc(f) == EOF) return BROTLI_TRUE;
+        break;
+      }
+    } else {
+      break;
+    }
+    result = BrotliDecoderDecompressStream(d, &context->available_in,
+        &context->next_in, &context->available_out, &context->next_out, 0);
+  }
+  fprintf(stderr, "corrupt output [%s]\n",
+          PrintablePath(context->current_output_path));
+  return BROTLI_FALSE;
+}
+
+/* Rewrites the tail of the existing output file so that encoder |s| could
+   continue the stream. Modified bytes are saved to |undo|. */
+static BROTLI_BOOL PrepareAppend(Context* context, BrotliEncoderState* s,
+                                 AppendUndo* undo) {
+  FILE* f = context->fout;
+  BrotliDecoderState* d;
+  uint8_t* history;
+  size_t history_size = 0;
+  uint64_t total_size = 0;
+  uint32_t window_bits;
+  BROTLI_BOOL large_window;
+  uint64_t header_offset;
+  uint32_t header;
+  uint32_t header_bits;
+  uint64_t end_offset;
+  uint8_t patch[5];
+  uint8_t last_byte = 0;
+  BROTLI_BOOL is_ok;
+  uint32_t i;
+
+  undo->size = FileSize(context->current_output_path);
+  undo->header_pos = 0;
+  undo->header_len = 0;
+  undo->tail_pos = 0;
+  undo->tail_len = 0;
+  undo->start_len = 0;
+  undo->total_size = 0;
+  if (undo->size < 0) {
+    fprintf(stderr, "failed to get size of output file [%s]\n",
+            PrintablePath(context->current_output_path));
+    return BROTLI_FALSE;
+  }
+  /* Fresh file; regular stream is written. */
+  if (undo->size == 0) return BROTLI_TRUE;
+
+  d = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+  history = (uint8_t*)malloc(2 * MAX_APPEND_HISTORY);
+  if (!d || !history) {
+    fprintf(stderr, "out of memory\n");
+    BrotliDecoderDestroyInstance(d);
+    free(history);
+    return BROTLI_FALSE;
+  }
+  BrotliDecoderSetParameter(d, BROTLI_DECODER_PARAM_LARGE_WINDOW, 1u);
+  is_ok = DecodeAppendHistory(context, d, history, &history_size, &total_size);
+  if (is_ok) {
+    BrotliDecoderGetAppendPoint(d, &window_bits, &large_window,
+        &header_offset, &header, &header_bits, &end_offset);
+    if (large_window) {
+      fprintf(stderr, "can not append to large-window stream [%s]\n",
+              PrintablePath(context->current_output_path));
+      is_ok = BROTLI_FALSE;
+    }
+  }
+  BrotliDecoderDestroyInstance(d);
+
+  if (is_ok) {
+    undo->header_pos = (int64_t)(header_offset >> 3);
+    undo->header_len = header_bits ?
+        (size_t)(((header_offset & 7) + header_bits + 7) >> 3) : 0;
+    undo->tail_pos = (int64_t)(end_offset >> 3);
+    undo->tail_len = (size_t)(undo->size - undo->tail_pos);
+    undo->start_len = undo->size < (int64_t)sizeof(undo->start) ?
+        (size_t)undo->size : sizeof(undo->start);
+    undo->total_size = total_size;
+    is_ok = TO_BROTLI_BOOL(undo->tail_len <= sizeof(undo->tail)) &&
+        ReadBytesAt(f, undo->header_pos, undo->header, undo->header_len) &&
+        ReadBytesAt(f, undo->tail_pos, undo->tail, undo->tail_len) &&
+        ReadBytesAt(f, 0, undo->start, undo->start_len);
+    if (!is_ok) undo->header_len = undo->tail_len = undo->start_len = 0;
+  }
+  if (is_ok) {
+    /* Clear ISLAST flag of the last meta-block. */
+    memcpy(patch, undo->header, undo->header_len);
+    for (i = 0; i < header_bits; ++i) {
+      size_t bit = (size_t)(header_offset & 7) + i;
+      patch[bit >> 3] = (uint8_t)((patch[bit >> 3] & ~(1u << (bit & 7))) |
+          (((header >> i) & 1u) << (bit & 7)));
+    }
+    is_ok = WriteBytesAt(f, undo->header_pos, patch, undo->header_len);
+    if (is_ok && (end_offset & 7) != 0) {
+      is_ok = ReadBytesAt(f, undo->tail_pos, &last_byte, 1);
+    }
+    /* Drop padding and write the rest of the stream in its place. */
+    is_ok = is_ok && fflush(f) == 0 &&
+        ftruncate(fileno(f), undo->tail_pos) == 0 &&
+        fseek(f, undo->tail_pos, SEEK_SET) == 0;
+    if (!is_ok) {
+      fprintf(stderr, "failed to update output file [%s]: %s\n",
+              PrintablePath(context->current_output_path), strerror(errno));
+    }
+  }
+  if (is_ok) {
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, window_bits);
+    is_ok = BrotliEncoderResumeStream(s, history_size, history, total_size,
+        (uint32_t)(end_offset & 7), last_byte);
+    if (!is_ok) fprintf(stderr, "failed to resume stream\n");
+  }
+  free(history);
+  return is_ok;
+}
+
+/* Sets the new total size in the content size header of the continued
+   stream, if there is one. Only the bytes of the size value are written. */
+static BROTLI_BOOL FinishAppend(Context* context, const AppendUndo* undo) {
+  uint8_t start[sizeof(undo->start)];
+  size_t begin = 0;
+  size_t end = undo->start_len;
+  memcpy(start, undo->start, undo->start_len);
+  if (!BrotliDecoderUpdateContentSize(undo->start_len, start,
+                                      undo->total_size + context->total_in)) {
+    return BROTLI_TRUE;
+  }
+  while (begin < end && start[begin] == undo->start[begin]) begin++;
+  while (end > begin && start[end - 1] == undo->start[end - 1]) end--;
+  if (!WriteBytesAt(context->fout, (int64_t)begin, start + begin,
+                    end - begin)) {
+    fprintf(stderr, "failed to update output file [%s]: %s\n",
+            PrintablePath(context->current_output_path), strerror(errno));
+    return BROTLI_FALSE;
+  }
+  return BROTLI_TRUE;
+}
+
+/* Restores the output file modified by PrepareAppend and FinishAppend. */
+static void UndoAppend(Context* context, const AppendUndo* undo) {
+  FILE* f = context->fout;
+  BROTLI_BOOL is_ok = TO_BROTLI_BOOL(f != NULL);
+  if (!is_ok || undo->size < 0) return;
+  is_ok = fflush(f) == 0 && ftruncate(fileno(f), undo->size) == 0 &&
+      WriteBytesAt(f, 0, undo->start, undo->start_len) &&
+      WriteBytesAt(f, undo->tail_pos, undo->tail, undo->tail_len) &&
+      WriteBytesAt(f, undo->header_pos, undo->header, undo->header_len);
+  if (!is_ok) {
+    fprintf(stderr, "failed to restore output file [%s]: %s\n",
+            PrintablePath(context->current_output_path), strerror(errno));
+  }
+}
+
 static BROTLI_BOOL CompressFiles(Context* context) {
+  if (context->use_server) return ProcessFilesWithServer(context);
+  if (context->solid) return CompressSolid(context);
   while (NextFile(context)) {
     BROTLI_BOOL is_ok = BROTLI_TRUE;
+    AppendUndo undo;
     BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
     if (!s) {
       fprintf(stderr, "out of memory\n");
       return BROTLI_FALSE;
     }
-    BrotliEncoderSetParameter(s,
-        BROTLI_PARAM_QUALITY, (uint32_t)context->quality);
-    if (context->lgwin > 0) {
-      /* Specified by user. */
-      /* Do not enable "large-window" extension, if not required. */
-      if (context->lgwin > BROTLI_MAX_WINDOW_BITS) {
-        BrotliEncoderSetParameter(s, BROTLI_PARAM_LARGE_WINDOW, 1u);
-      }
-      BrotliEncoderSetParameter(s,
-          BROTLI_PARAM_LGWIN, (uint32_t)context->lgwin);
-    } else {
-      /* 0, or not specified by user; could be chosen by compressor. */
-      uint32_t lgwin = DEFAULT_LGWIN;
-      /* Use file size to limit lgwin. */
-      if (context->input_file_length >= 0) {
-        lgwin = BROTLI_MIN_WINDOW_BITS;
-        while (BROTLI_MAX_BACKWARD_LIMIT(lgwin) <
-               (uint64_t)context->input_file_length) {
-          lgwin++;
-          if (lgwin == BROTLI_MAX_WINDOW_BITS) break;
-        }
-      }
-      BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, lgwin);
-    }
+    SetEncoderParameters(context, s, ChooseLgwin(context));
     if (context->input_file_length > 0) {
       uint32_t size_hint = context->input_file_length < (1 << 30) ?
           (uint32_t)context->input_file_length : (1u << 30);
@@ -1026,7 +2255,11 @@ static BROTLI_BOOL CompressFiles(Context* context) {
       fprintf(stderr, "Use -h help. Use -f to force output to a terminal.\n");
       is_ok = BROTLI_FALSE;
     }
+    undo.size = -1;
+    if (is_ok && context->append) is_ok = PrepareAppend(context, s, &undo);
     if (is_ok) is_ok = CompressFile(context, s);
+    if (is_ok && context->append) is_ok = FinishAppend(context, &undo);
+    if (!is_ok && context->append) UndoAppend(context, &undo);
     BrotliEncoderDestroyInstance(s);
     if (!CloseFiles(context, is_ok)) is_ok = BROTLI_FALSE;
     if (!is_ok) return BROTLI_FALSE;
@@ -1034,6 +2267,24 @@ static BROTLI_BOOL CompressFiles(Context* context) {
   return BROTLI_TRUE;
 }
 
+static BROTLI_BOOL StopServer(Context* context) {
+  BrotliServeStatus status;
+  int connection = BrotliServeConnect(context->socket_path);
+  if (connection < 0) {
+    fprintf(stderr, "failed to connect to server [%s]: %s\n",
+            context->socket_path, strerror(errno));
+    return BROTLI_FALSE;
+  }
+  status = BrotliServeStop(connection);
+  BrotliServeDisconnect(connection);
+  if (status != BROTLI_SERVE_OK) {
+    fprintf(stderr, "%s [%s]\n", BrotliServeStatusString(status),
+            context->socket_path);
+    return BROTLI_FALSE;
+  }
+  return BROTLI_TRUE;
+}
+
 int main(int argc, char** argv) {
   Command command;
   Context context;
@@ -1042,6 +2293,9 @@ int main(int argc, char** argv) {
 
   context.quality = 11;
   context.lgwin = -1;
+  context.num_threads = 0;
+  context.filter = BROTLI_FILTER_NONE;
+  context.filter_distance = 0;
   context.verbosity = 0;
   context.force_overwrite = BROTLI_FALSE;
   context.junk_source = BROTLI_FALSE;
@@ -1050,8 +2304,14 @@ int main(int argc, char** argv) {
   context.write_to_stdout = BROTLI_FALSE;
   context.decompress = BROTLI_FALSE;
   context.large_window = BROTLI_FALSE;
+  context.append = BROTLI_FALSE;
+  context.sparse = BROTLI_TRUE;
+  context.solid = BROTLI_FALSE;
+  context.extract_name = NULL;
   context.output_path = NULL;
   context.suffix = DEFAULT_SUFFIX;
+  context.socket_path = NULL;
+  context.use_server = BROTLI_FALSE;
   for (i = 0; i < MAX_OPTIONS; ++i) context.not_input_indices[i] = 0;
   context.longest_path_len = 1;
   context.input_count = 0;
@@ -1067,6 +2327,8 @@ int main(int argc, char** argv) {
   context.current_output_path = NULL;
   context.fin = NULL;
   context.fout = NULL;
+  context.sparse_input = BROTLI_FALSE;
+  context.sparse_output = BROTLI_FALSE;
 
   command = ParseParams(&context);
 
@@ -1076,13 +2338,19 @@ int main(int argc, char** argv) {
       size_t modified_path_len =
           context.longest_path_len + strlen(context.suffix) + 1;
       context.modified_path = (char*)malloc(modified_path_len);
-      context.buffer = (uint8_t*)malloc(kFileBufferSize * 2);
+      context.input_buffer_size = kFileBufferSize;
+      if (command == COMMAND_COMPRESS && context.num_threads > 0 &&
+          context.quality <= 1) {
+        context.input_buffer_size = kParallelFileBufferSize;
+      }
+      context.buffer =
+          (uint8_t*)malloc(context.input_buffer_size + kFileBufferSize);
       if (!context.modified_path || !context.buffer) {
         fprintf(stderr, "out of memory\n");
         is_ok = BROTLI_FALSE;
       } else {
         context.input = context.buffer;
-        context.output = context.buffer + kFileBufferSize;
+        context.output = context.buffer + context.input_buffer_size;
       }
     }
   }
@@ -1106,6 +2374,15 @@ int main(int argc, char** argv) {
       is_ok = DecompressFiles(&context);
       break;
 
+    case COMMAND_SERVE:
+      is_ok = BrotliServe(context.socket_path, context.num_threads > 0 ?
+          context.num_threads : DEFAULT_SERVE_WORKERS, context.verbosity);
+      break;
+
+    case COMMAND_STOP_SERVER:
+      is_ok = StopServer(&context);
+      break;
+
     case COMMAND_HELP:
     case COMMAND_INVALID:
     default:
@@ -0,0 +1,1059 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Local compression daemon for brotli tool; see serve.h. */
+
+#include "./serve.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/constants.h"
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+
+#if !defined(_WIN32) && defined(BROTLI_HAVE_PTHREAD) && BROTLI_HAVE_PTHREAD
+#define BROTLI_SERVE_SUPPORTED 1
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+const char* BrotliServeStatusString(BrotliServeStatus status) {
+  switch (status) {
+    case BROTLI_SERVE_OK: return "success";
+    case BROTLI_SERVE_BAD_REQUEST: return "request rejected by server";
+    case BROTLI_SERVE_CORRUPT_INPUT: return "corrupt input";
+    case BROTLI_SERVE_READ_ERROR: return "failed to read input";
+    case BROTLI_SERVE_WRITE_ERROR: return "failed to write output";
+    case BROTLI_SERVE_ENCODER_ERROR: return "failed to compress data";
+    case BROTLI_SERVE_CONNECTION_ERROR: return "server connection failed";
+    default: return "unknown server error";
+  }
+}
+
+#if defined(BROTLI_SERVE_SUPPORTED)
+
+#define SERVE_MAGIC 0x56535242u  /* "BRSV" */
+
+#define SERVE_OP_COMPRESS 0
+#define SERVE_OP_DECOMPRESS 1
+#define SERVE_OP_STOP 2
+
+/* Both ends are on the same host; native layout is used. */
+typedef struct ServeRequest {
+  uint32_t magic;
+  uint32_t op;
+  int32_t quality;
+  int32_t lgwin;
+  int32_t filter;
+  int32_t filter_distance;
+  uint64_t size_hint;
+} ServeRequest;
+
+typedef struct ServeReply {
+  uint32_t magic;
+  uint32_t status;
+  uint64_t total_in;
+  uint64_t total_out;
+} ServeReply;
+
+#if defined(MSG_NOSIGNAL)
+#define SERVE_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SERVE_SEND_FLAGS 0
+#endif
+
+static const size_t kServeBufferSize = 1 << 19;
+/* Smaller allocations are cheap; caching them is not worth the effort. */
+static const size_t kMinCachedBlockSize = 1 << 15;
+#define MAX_CACHED_BLOCKS 32
+#define MAX_POOLS 32
+/* Client waits up to 2 seconds for the daemon that is being started. */
+#define MAX_CONNECT_ATTEMPTS 100
+static const long kConnectRetryNanos = 20000000;
+
+/* Precedes every arena allocation; size keeps payload aligned. */
+typedef union ArenaBlock {
+  struct {
+    size_t size;
+    /* Allocated during the current request. */
+    BROTLI_BOOL is_used;
+    union ArenaBlock* next;
+  } h;
+  uint8_t padding[32];
+} ArenaBlock;
+
+/* Allocator that keeps large freed blocks for the next request with the same
+   parameters: encoder / decoder allocate the same buffers again, and those
+   are already backed with memory pages. Cached block is reused only for the
+   allocation of exactly the same size; blocks that are not reused by the
+   request are released when it is finished. */
+typedef struct Arena {
+  ArenaBlock* cached;  /* most recently freed first */
+  size_t num_cached;
+  struct Arena* next;  /* next idle arena in pool */
+} Arena;
+
+static void* ArenaAlloc(void* opaque, size_t size) {
+  Arena* arena = (Arena*)opaque;
+  ArenaBlock* block;
+  if (size >= kMinCachedBlockSize) {
+    ArenaBlock** link = &arena->cached;
+    while (*link) {
+      block = *link;
+      if (block->h.size == size) {
+        *link = block->h.next;
+        arena->num_cached--;
+        block->h.is_used = BROTLI_TRUE;
+        return block + 1;
+      }
+      link = &block->h.next;
+    }
+  }
+  block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + size);
+  if (!block) return NULL;
+  block->h.size = size;
+  block->h.is_used = BROTLI_TRUE;
+  return block + 1;
+}
+
+static void ArenaFree(void* opaque, void* address) {
+  Arena* arena = (Arena*)opaque;
+  ArenaBlock* block;
+  if (!address) return;
+  block = (ArenaBlock*)address - 1;
+  if (block->h.size < kMinCachedBlockSize) {
+    free(block);
+    return;
+  }
+  if (arena->num_cached == MAX_CACHED_BLOCKS) {
+    /* Drop the least recently freed block. */
+    ArenaBlock** link = &arena->cached;
+    while ((*link)->h.next) link = &(*link)->h.next;
+    free(*link);
+    *link = NULL;
+    arena->num_cached--;
+  }
+  block->h.next = arena->cached;
+  arena->cached = block;
+  arena->num_cached++;
+}
+
+static void ArenaStartRequest(Arena* arena) {
+  ArenaBlock* block;
+  for (block = arena->cached; block; block = block->h.next) {
+    block->h.is_used = BROTLI_FALSE;
+  }
+}
+
+/* Should be invoked when all the request allocations are freed. */
+static void ArenaFinishRequest(Arena* arena) {
+  ArenaBlock** link = &arena->cached;
+  while (*link) {
+    ArenaBlock* block = *link;
+    if (block->h.is_used) {
+      link = &block->h.next;
+    } else {
+      *link = block->h.next;
+      arena->num_cached--;
+      free(block);
+    }
+  }
+}
+
+static void DestroyArena(Arena* arena) {
+  while (arena->cached) {
+    ArenaBlock* block = arena->cached;
+    arena->cached = block->h.next;
+    free(block);
+  }
+  free(arena);
+}
+
+/* Idle arenas for one parameter set. */
+typedef struct Pool {
+  BROTLI_BOOL is_taken;
+  uint32_t op;
+  int32_t quality;
+  int32_t lgwin;
+  Arena* idle;
+} Pool;
+
+typedef struct ConnectionList {
+  int* fds;
+  size_t size;
+  size_t capacity;
+} ConnectionList;
+
+typedef struct Server {
+  int listen_fd;
+  /* Workers write to [1] to wake up the dispatcher polling [0]. */
+  int wake_fds[2];
+  const char* socket_path;
+  int num_workers;
+  int verbosity;
+  pthread_mutex_t mutex;
+  /* Signalled when connection is queued to |ready| or daemon is stopping. */
+  pthread_cond_t ready_cond;
+  BROTLI_BOOL is_stopping;
+  /* Connections with pending request, waiting for a worker. */
+  ConnectionList ready;
+  /* Connections released by workers, to be polled by the dispatcher. */
+  ConnectionList returned;
+  Pool pools[MAX_POOLS];
+} Server;
+
+typedef struct Worker {
+  Server* server;
+  uint8_t* input;
+  uint8_t* output;
+} Worker;
+
+/* Decoder memory does not depend on encoder parameters. */
+static BROTLI_BOOL PoolMatches(const Pool* pool, const ServeRequest* request) {
+  if (!pool->is_taken || pool->op != request->op) return BROTLI_FALSE;
+  if (request->op == SERVE_OP_DECOMPRESS) return BROTLI_TRUE;
+  return TO_BROTLI_BOOL(pool->quality == request->quality &&
+                        pool->lgwin == request->lgwin);
+}
+
+static Arena* AcquireArena(Server* server, const ServeRequest* request) {
+  Arena* arena = NULL;
+  size_t i;
+  pthread_mutex_lock(&server->mutex);
+  for (i = 0; i < MAX_POOLS; ++i) {
+    Pool* pool = &server->pools[i];
+    if (PoolMatches(pool, request) && pool->idle) {
+      arena = pool->idle;
+      pool->idle = arena->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&server->mutex);
+  if (!arena) {
+    arena = (Arena*)malloc(sizeof(Arena));
+    if (!arena) return NULL;
+    arena->cached = NULL;
+    arena->num_cached = 0;
+  }
+  arena->next = NULL;
+  ArenaStartRequest(arena);
+  return arena;
+}
+
+static void ReleaseArena(
+    Server* server, const ServeRequest* request, Arena* arena) {
+  Pool* target = NULL;
+  size_t i;
+  ArenaFinishRequest(arena);
+  pthread_mutex_lock(&server->mutex);
+  for (i = 0; i < MAX_POOLS; ++i) {
+    Pool* pool = &server->pools[i];
+    if (PoolMatches(pool, request)) {
+      target = pool;
+      break;
+    }
+    if (!target && !pool->is_taken) target = pool;
+  }
+  if (target) {
+    if (!target->is_taken) {
+      target->is_taken = BROTLI_TRUE;
+      target->op = request->op;
+      target->quality = request->quality;
+      target->lgwin = request->lgwin;
+      target->idle = NULL;
+    }
+    arena->next = target->idle;
+    target->idle = arena;
+  }
+  pthread_mutex_unlock(&server->mutex);
+  /* Too many parameter sets in use; keep only the first ones warm. */
+  if (!target) DestroyArena(arena);
+}
+
+static BROTLI_BOOL WriteAll(int fd, const uint8_t* data, size_t size) {
+  while (size > 0) {
+    ssize_t result = write(fd, data, size);
+    if (result < 0) {
+      if (errno == EINTR) continue;
+      return BROTLI_FALSE;
+    }
+    data += result;
+    size -= (size_t)result;
+  }
+  return BROTLI_TRUE;
+}
+
+/* Returns -1 on error, 0 at end of input. */
+static ssize_t ReadSome(int fd, uint8_t* buffer, size_t size) {
+  for (;;) {
+    ssize_t result = read(fd, buffer, size);
+    if (result >= 0 || errno != EINTR) return result;
+  }
+}
+
+/* Input of a request; read chunk by chunk. Client owns the descriptor and
+   could modify the file concurrently, so the data is never mapped. */
+typedef struct ServeInput {
+  int fd;
+  /* Remaining size of regular file; only a hint for window size choice. */
+  uint64_t size;
+  uint8_t* buffer;
+  const uint8_t* next_in;
+  size_t available_in;
+  BROTLI_BOOL is_eof;
+  uint64_t total_in;
+} ServeInput;
+
+static void OpenInput(ServeInput* input, int fd, uint8_t* buffer) {
+  struct stat info;
+  off_t start;
+  input->fd = fd;
+  input->size = 0;
+  input->buffer = buffer;
+  input->next_in = NULL;
+  input->available_in = 0;
+  input->is_eof = BROTLI_FALSE;
+  input->total_in = 0;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) return;
+  start = lseek(fd, 0, SEEK_CUR);
+  if (start < 0 || start >= info.st_size) return;
+  input->size = (uint64_t)(info.st_size - start);
+}
+
+static BROTLI_BOOL ProvideInput(ServeInput* input) {
+  ssize_t result;
+  if (input->is_eof) return BROTLI_TRUE;
+  result = ReadSome(input->fd, input->buffer, kServeBufferSize);
+  if (result < 0) return BROTLI_FALSE;
+  input->next_in = input->buffer;
+  input->available_in = (size_t)result;
+  input->total_in += (size_t)result;
+  input->is_eof = TO_BROTLI_BOOL(result == 0);
+  return BROTLI_TRUE;
+}
+
+/* Leaves file offset after the consumed input, if descriptor is seekable. */
+static void CloseInput(ServeInput* input) {
+  if (input->available_in == 0) return;
+  lseek(input->fd, -(off_t)input->available_in, SEEK_CUR);
+}
+
+/* Same choice as brotli tool makes for the files of known size. */
+static uint32_t ChooseLgwin(const ServeRequest* request, uint64_t size) {
+  uint32_t lgwin;
+  if (request->lgwin > 0) return (uint32_t)request->lgwin;
+  if (size == 0) return BROTLI_DEFAULT_WINDOW;
+  lgwin = BROTLI_MIN_WINDOW_BITS;
+  while (BROTLI_MAX_BACKWARD_LIMIT(lgwin) < size &&
+         lgwin < BROTLI_MAX_WINDOW_BITS) {
+    lgwin++;
+  }
+  return lgwin;
+}
+
+static BrotliServeStatus Compress(Worker* worker, const ServeRequest* request,
+    Arena* arena, ServeInput* input, int out_fd, uint64_t* total_out) {
+  BrotliServeStatus status = BROTLI_SERVE_OK;
+  BrotliEncoderState* s =
+      BrotliEncoderCreateInstance(ArenaAlloc, ArenaFree, arena);
+  uint64_t size = input->size ? input->size : request->size_hint;
+  uint32_t lgwin = ChooseLgwin(request, size);
+  size_t available_out = kServeBufferSize;
+  uint8_t* next_out = worker->output;
+  if (!s) return BROTLI_SERVE_ENCODER_ERROR;
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY,
+                            (uint32_t)request->quality);
+  if (lgwin > BROTLI_MAX_WINDOW_BITS) {
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_LARGE_WINDOW, 1u);
+  }
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, lgwin);
+  if (size > 0) {
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_SIZE_HINT,
+        size < (1u << 30) ? (uint32_t)size : (1u << 30));
+  }
+  if (request->filter != BROTLI_FILTER_NONE) {
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_FILTER,
+                              (uint32_t)request->filter);
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_FILTER_DISTANCE,
+                              (uint32_t)request->filter_distance);
+  }
+  for (;;) {
+    if (input->available_in == 0 && !ProvideInput(input)) {
+      status = BROTLI_SERVE_READ_ERROR;
+      break;
+    }
+    if (!BrotliEncoderCompressStream(s,
+        input->is_eof ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS,
+        &input->available_in, &input->next_in, &available_out, &next_out,
+        NULL)) {
+      status = BROTLI_SERVE_ENCODER_ERROR;
+      break;
+    }
+    if (available_out == 0 || BrotliEncoderIsFinished(s)) {
+      size_t out_size = (size_t)(next_out - worker->output);
+      if (!WriteAll(out_fd, worker->output, out_size)) {
+        status = BROTLI_SERVE_WRITE_ERROR;
+        break;
+      }
+      *total_out += out_size;
+      available_out = kServeBufferSize;
+      next_out = worker->output;
+    }
+    if (BrotliEncoderIsFinished(s)) break;
+  }
+  BrotliEncoderDestroyInstance(s);
+  return status;
+}
+
+static BrotliServeStatus Decompress(Worker* worker, Arena* arena,
+    ServeInput* input, int out_fd, uint64_t* total_out) {
+  BrotliServeStatus status = BROTLI_SERVE_OK;
+  BrotliDecoderState* s =
+      BrotliDecoderCreateInstance(ArenaAlloc, ArenaFree, arena);
+  BrotliDecoderResult result = BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT;
+  size_t available_out = kServeBufferSize;
+  uint8_t* next_out = worker->output;
+  if (!s) return BROTLI_SERVE_CORRUPT_INPUT;
+  BrotliDecoderSetParameter(s, BROTLI_DECODER_PARAM_LARGE_WINDOW, 1u);
+  BrotliDecoderSetParameter(s, BROTLI_DECODER_PARAM_FILTERS, 1u);
+  for (;;) {
+    if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT) {
+      if (input->available_in == 0) {
+        if (input->is_eof) {
+          status = BROTLI_SERVE_CORRUPT_INPUT;
+          break;
+        }
+        if (!ProvideInput(input)) {
+          status = BROTLI_SERVE_READ_ERROR;
+          break;
+        }
+      }
+    } else if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT ||
+               result == BROTLI_DECODER_RESULT_SUCCESS) {
+      size_t out_size = (size_t)(next_out - worker->output);
+      if (!WriteAll(out_fd, worker->output, out_size)) {
+        status = BROTLI_SERVE_WRITE_ERROR;
+        break;
+      }
+      *total_out += out_size;
+      available_out = kServeBufferSize;
+      next_out = worker->output;
+      if (result == BROTLI_DECODER_RESULT_SUCCESS) {
+        /* Trailing garbage is not allowed. */
+        if (input->available_in == 0 && !ProvideInput(input)) {
+          status = BROTLI_SERVE_READ_ERROR;
+        } else if (input->available_in != 0) {
+          status = BROTLI_SERVE_CORRUPT_INPUT;
+        }
+        break;
+      }
+    } else {
+      status = BROTLI_SERVE_CORRUPT_INPUT;
+      break;
+    }
+    result = BrotliDecoderDecompressStream(s, &input->available_in,
+        &input->next_in, &available_out, &next_out, 0);
+  }
+  BrotliDecoderDestroyInstance(s);
+  return status;
+}
+
+static BrotliServeStatus ProcessRequest(Worker* worker,
+    const ServeRequest* request, int in_fd, int out_fd, ServeReply* reply) {
+  BrotliServeStatus status;
+  ServeInput input;
+  Arena* arena;
+  if (request->op == SERVE_OP_COMPRESS &&
+      (request->quality < BROTLI_MIN_QUALITY ||
+       request->quality > BROTLI_MAX_QUALITY ||
+       request->lgwin < 0 || request->lgwin > BROTLI_LARGE_MAX_WINDOW_BITS ||
+       (request->lgwin > 0 && request->lgwin < BROTLI_MIN_WINDOW_BITS) ||
+       request->filter < BROTLI_FILTER_NONE ||
+       request->filter > BROTLI_FILTER_AUTO)) {
+    return BROTLI_SERVE_BAD_REQUEST;
+  }
+  arena = AcquireArena(worker->server, request);
+  if (!arena) return BROTLI_SERVE_ENCODER_ERROR;
+  OpenInput(&input, in_fd, worker->input);
+  if (request->op == SERVE_OP_COMPRESS) {
+    status = Compress(worker, request, arena, &input, out_fd,
+                      &reply->total_out);
+  } else {
+    status = Decompress(worker, arena, &input, out_fd, &reply->total_out);
+  }
+  reply->total_in = input.total_in - input.available_in;
+  CloseInput(&input);
+  ReleaseArena(worker->server, request, arena);
+  return status;
+}
+
+static BROTLI_BOOL SendAll(int fd, const void* data, size_t size,
+                           const int* fds, int num_fds) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  union {
+    struct cmsghdr align;
+    char buffer[CMSG_SPACE(2 * sizeof(int))];
+  } control;
+  while (size > 0) {
+    struct msghdr message;
+    struct iovec iov;
+    ssize_t result;
+    memset(&message, 0, sizeof(message));
+    iov.iov_base = (void*)bytes;
+    iov.iov_len = size;
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    if (num_fds > 0) {
+      /* Descriptors travel with the first chunk. */
+      struct cmsghdr* header;
+      memset(&control, 0, sizeof(control));
+      message.msg_control = control.buffer;
+      message.msg_controllen = CMSG_SPACE((size_t)num_fds * sizeof(int));
+      header = CMSG_FIRSTHDR(&message);
+      header->cmsg_level = SOL_SOCKET;
+      header->cmsg_type = SCM_RIGHTS;
+      header->cmsg_len = CMSG_LEN((size_t)num_fds * sizeof(int));
+      memcpy(CMSG_DATA(header), fds, (size_t)num_fds * sizeof(int));
+    }
+    result = sendmsg(fd, &message, SERVE_SEND_FLAGS);
+    if (result < 0) {
+      if (errno == EINTR) continue;
+      return BROTLI_FALSE;
+    }
+    bytes += result;
+    size -= (size_t)result;
+    num_fds = 0;
+  }
+  return BROTLI_TRUE;
+}
+
+/* Receives up to 2 descriptors; extra ones are closed. */
+static BROTLI_BOOL ReceiveAll(int fd, void* data, size_t size,
+                              int* fds, int* num_fds) {
+  uint8_t* bytes = (uint8_t*)data;
+  union {
+    struct cmsghdr align;
+    char buffer[CMSG_SPACE(2 * sizeof(int))];
+  } control;
+  if (num_fds) *num_fds = 0;
+  while (size > 0) {
+    struct msghdr message;
+    struct iovec iov;
+    struct cmsghdr* header;
+    ssize_t result;
+    memset(&message, 0, sizeof(message));
+    iov.iov_base = bytes;
+    iov.iov_len = size;
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    result = recvmsg(fd, &message, 0);
+    if (result < 0) {
+      if (errno == EINTR) continue;
+      return BROTLI_FALSE;
+    }
+    for (header = CMSG_FIRSTHDR(&message); header;
+         header = CMSG_NXTHDR(&message, header)) {
+      size_t count;
+      size_t i;
+      if (header->cmsg_level != SOL_SOCKET ||
+          header->cmsg_type != SCM_RIGHTS) {
+        continue;
+      }
+      count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (i = 0; i < count; ++i) {
+        int received;
+        memcpy(&received, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+        if (num_fds && *num_fds < 2) {
+          fds[(*num_fds)++] = received;
+        } else {
+          close(received);
+        }
+      }
+    }
+    if (result == 0) return BROTLI_FALSE;
+    bytes += result;
+    size -= (size_t)result;
+  }
+  return BROTLI_TRUE;
+}
+
+static BROTLI_BOOL IsStopping(Server* server) {
+  BROTLI_BOOL result;
+  pthread_mutex_lock(&server->mutex);
+  result = server->is_stopping;
+  pthread_mutex_unlock(&server->mutex);
+  return result;
+}
+
+static int ConnectOnce(const char* socket_path) {
+  struct sockaddr_un address;
+  int fd;
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socket_path);
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return -1;
+  }
+  return fd;
+}
+
+static BROTLI_BOOL PushConnection(ConnectionList* list, int connection) {
+  if (list->size == list->capacity) {
+    size_t capacity = list->capacity ? 2 * list->capacity : 16;
+    int* fds = (int*)realloc(list->fds, capacity * sizeof(int));
+    if (!fds) return BROTLI_FALSE;
+    list->fds = fds;
+    list->capacity = capacity;
+  }
+  list->fds[list->size++] = connection;
+  return BROTLI_TRUE;
+}
+
+/* Connections are served in order of arrival. */
+static int PopConnection(ConnectionList* list) {
+  int connection = list->fds[0];
+  list->size--;
+  memmove(list->fds, list->fds + 1, list->size * sizeof(int));
+  return connection;
+}
+
+static void CloseConnections(ConnectionList* list) {
+  size_t i;
+  for (i = 0; i < list->size; ++i) close(list->fds[i]);
+  free(list->fds);
+  list->fds = NULL;
+  list->size = 0;
+  list->capacity = 0;
+}
+
+static void SetNonBlocking(int fd, BROTLI_BOOL non_blocking) {
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0) return;
+  flags = non_blocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+  fcntl(fd, F_SETFL, flags);
+}
+
+/* Interrupts poll in Dispatch. */
+static void WakeDispatcher(Server* server) {
+  const uint8_t byte = 0;
+  ssize_t result = write(server->wake_fds[1], &byte, 1);
+  /* Pipe is full: dispatcher is going to wake up anyway. */
+  (void)result;
+}
+
+static void Stop(Server* server) {
+  pthread_mutex_lock(&server->mutex);
+  server->is_stopping = BROTLI_TRUE;
+  pthread_cond_broadcast(&server->ready_cond);
+  pthread_mutex_unlock(&server->mutex);
+  WakeDispatcher(server);
+}
+
+/* Serves one request. Returns BROTLI_FALSE if connection should be closed:
+   client has disconnected, sent garbage or asked to stop the daemon. */
+static BROTLI_BOOL HandleRequest(Worker* worker, int connection) {
+  Server* server = worker->server;
+  ServeRequest request;
+  ServeReply reply;
+  BrotliServeStatus status = BROTLI_SERVE_BAD_REQUEST;
+  int fds[2];
+  int num_fds;
+  int i;
+  BROTLI_BOOL is_valid;
+  if (!ReceiveAll(connection, &request, sizeof(request), fds, &num_fds)) {
+    for (i = 0; i < num_fds; ++i) close(fds[i]);
+    return BROTLI_FALSE;
+  }
+  reply.magic = SERVE_MAGIC;
+  reply.total_in = 0;
+  reply.total_out = 0;
+  is_valid = TO_BROTLI_BOOL(request.magic == SERVE_MAGIC);
+  if (is_valid && request.op == SERVE_OP_STOP) {
+    status = BROTLI_SERVE_OK;
+  } else if (is_valid && num_fds == 2 &&
+      (request.op == SERVE_OP_COMPRESS ||
+       request.op == SERVE_OP_DECOMPRESS)) {
+    status = ProcessRequest(worker, &request, fds[0], fds[1], &reply);
+  }
+  for (i = 0; i < num_fds; ++i) close(fds[i]);
+  if (server->verbosity > 0 && is_valid) {
+    static const char* kOpNames[] = {"compress", "decompress", "stop"};
+    fprintf(stderr, "%s: %lu -> %lu bytes: %s\n",
+            request.op <= SERVE_OP_STOP ? kOpNames[request.op] : "unknown",
+            (unsigned long)reply.total_in, (unsigned long)reply.total_out,
+            BrotliServeStatusString(status));
+  }
+  reply.status = (uint32_t)status;
+  if (!SendAll(connection, &reply, sizeof(reply), NULL, 0)) return BROTLI_FALSE;
+  if (!is_valid) return BROTLI_FALSE;
+  if (request.op == SERVE_OP_STOP) {
+    Stop(server);
+    return BROTLI_FALSE;
+  }
+  return BROTLI_TRUE;
+}
+
+/* Takes connections with pending requests one by one; connection goes back
+   to the dispatcher after each request, so idle clients do not hold
+   workers. Queued requests are served even when daemon is stopping. */
+static void* WorkerMain(void* arg) {
+  Worker* worker = (Worker*)arg;
+  Server* server = worker->server;
+  for (;;) {
+    int connection;
+    BROTLI_BOOL keep;
+    pthread_mutex_lock(&server->mutex);
+    while (server->ready.size == 0 && !server->is_stopping) {
+      pthread_cond_wait(&server->ready_cond, &server->mutex);
+    }
+    if (server->ready.size == 0) {
+      pthread_mutex_unlock(&server->mutex);
+      break;
+    }
+    connection = PopConnection(&server->ready);
+    pthread_mutex_unlock(&server->mutex);
+    keep = HandleRequest(worker, connection);
+    if (keep) {
+      pthread_mutex_lock(&server->mutex);
+      keep = TO_BROTLI_BOOL(!server->is_stopping &&
+                            PushConnection(&server->returned, connection));
+      pthread_mutex_unlock(&server->mutex);
+    }
+    if (keep) {
+      WakeDispatcher(server);
+    } else {
+      close(connection);
+    }
+  }
+  return NULL;
+}
+
+/* Accepts connections and watches the idle ones; connection that becomes
+   readable (new request or hang-up) is queued for workers. */
+static void Dispatch(Server* server) {
+  ConnectionList idle = {NULL, 0, 0};
+  struct pollfd* polled = NULL;
+  size_t polled_capacity = 0;
+  while (!IsStopping(server)) {
+    const size_t num_polled = idle.size + 2;
+    size_t num_idle = 0;
+    size_t i;
+    if (num_polled > polled_capacity) {
+      struct pollfd* grown = (struct pollfd*)realloc(
+          polled, 2 * num_polled * sizeof(struct pollfd));
+      if (!grown) {
+        fprintf(stderr, "out of memory\n");
+        Stop(server);
+        break;
+      }
+      polled = grown;
+      polled_capacity = 2 * num_polled;
+    }
+    polled[0].fd = server->listen_fd;
+    polled[1].fd = server->wake_fds[0];
+    for (i = 0; i < idle.size; ++i) polled[i + 2].fd = idle.fds[i];
+    for (i = 0; i < num_polled; ++i) {
+      polled[i].events = POLLIN;
+      polled[i].revents = 0;
+    }
+    if (poll(polled, (nfds_t)num_polled, -1) < 0) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "failed to poll connections: %s\n", strerror(errno));
+      Stop(server);
+      break;
+    }
+    if (polled[1].revents != 0) {
+      uint8_t drain[64];
+      while (read(server->wake_fds[0], drain, sizeof(drain)) > 0) {}
+    }
+    pthread_mutex_lock(&server->mutex);
+    for (i = 0; i < idle.size; ++i) {
+      const int connection = idle.fds[i];
+      if (polled[i + 2].revents == 0) {
+        idle.fds[num_idle++] = connection;
+      } else if (PushConnection(&server->ready, connection)) {
+        pthread_cond_signal(&server->ready_cond);
+      } else {
+        close(connection);
+      }
+    }
+    idle.size = num_idle;
+    for (i = 0; i < server->returned.size; ++i) {
+      if (!PushConnection(&idle, server->returned.fds[i])) {
+        close(server->returned.fds[i]);
+      }
+    }
+    server->returned.size = 0;
+    pthread_mutex_unlock(&server->mutex);
+    if (polled[0].revents != 0) {
+      int connection = accept(server->listen_fd, NULL, NULL);
+      if (connection >= 0) {
+        /* Some systems pass non-blocking flag to accepted socket. */
+        SetNonBlocking(connection, BROTLI_FALSE);
+        if (!PushConnection(&idle, connection)) close(connection);
+      } else if (errno != EINTR && errno != ECONNABORTED &&
+                 errno != EAGAIN && errno != EWOULDBLOCK) {
+        fprintf(stderr, "failed to accept connection: %s\n", strerror(errno));
+        Stop(server);
+        break;
+      }
+    }
+  }
+  CloseConnections(&idle);
+  free(polled);
+}
+
+static int Listen(const char* socket_path) {
+  struct sockaddr_un address;
+  struct stat info;
+  mode_t old_mask;
+  int fd;
+  int result;
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  /* Replace the socket left by the daemon that was killed. */
+  if (lstat(socket_path, &info) == 0) {
+    if (!S_ISSOCK(info.st_mode)) {
+      errno = EEXIST;
+      return -1;
+    }
+    fd = ConnectOnce(socket_path);
+    if (fd >= 0) {
+      close(fd);
+      errno = EADDRINUSE;
+      return -1;
+    }
+    unlink(socket_path);
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socket_path);
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  /* Only the owner could connect: requests, including stop, are served with
+     daemon privileges. */
+  old_mask = umask(0077);
+  result = bind(fd, (struct sockaddr*)&address, sizeof(address));
+  umask(old_mask);
+  if (result != 0 || listen(fd, 64) != 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return -1;
+  }
+  /* Client could disconnect before the connection is accepted. */
+  SetNonBlocking(fd, BROTLI_TRUE);
+  return fd;
+}
+
+BROTLI_BOOL BrotliServe(
+    const char* socket_path, int num_workers, int verbosity) {
+  Server server;
+  Worker* workers;
+  pthread_t* threads;
+  int num_started = 0;
+  int i;
+  memset(&server, 0, sizeof(server));
+  server.socket_path = socket_path;
+  server.num_workers = num_workers;
+  server.verbosity = verbosity;
+  server.is_stopping = BROTLI_FALSE;
+  /* Clients could disappear without reading the reply. */
+  signal(SIGPIPE, SIG_IGN);
+  server.listen_fd = Listen(socket_path);
+  if (server.listen_fd < 0) {
+    fprintf(stderr, "failed to listen on [%s]: %s\n", socket_path,
+            strerror(errno));
+    return BROTLI_FALSE;
+  }
+  if (pipe(server.wake_fds) != 0) {
+    fprintf(stderr, "failed to create pipe: %s\n", strerror(errno));
+    close(server.listen_fd);
+    unlink(socket_path);
+    return BROTLI_FALSE;
+  }
+  SetNonBlocking(server.wake_fds[0], BROTLI_TRUE);
+  SetNonBlocking(server.wake_fds[1], BROTLI_TRUE);
+  pthread_mutex_init(&server.mutex, NULL);
+  pthread_cond_init(&server.ready_cond, NULL);
+  workers = (Worker*)calloc((size_t)num_workers, sizeof(Worker));
+  threads = (pthread_t*)calloc((size_t)num_workers, sizeof(pthread_t));
+  if (workers && threads) {
+    for (i = 0; i < num_workers; ++i) {
+      Worker* worker = &workers[i];
+      worker->server = &server;
+      worker->input = (uint8_t*)malloc(kServeBufferSize);
+      worker->output = (uint8_t*)malloc(kServeBufferSize);
+      if (!worker->input || !worker->output) break;
+      if (pthread_create(&threads[i], NULL, WorkerMain, worker) != 0) break;
+      num_started++;
+    }
+  }
+  if (num_started == 0) {
+    fprintf(stderr, "failed to start workers\n");
+  } else if (verbosity > 0) {
+    fprintf(stderr, "serving on [%s] with %d workers\n", socket_path,
+            num_started);
+  }
+  if (num_started < num_workers) Stop(&server);
+  Dispatch(&server);
+  for (i = 0; i < num_started; ++i) pthread_join(threads[i], NULL);
+
+  CloseConnections(&server.ready);
+  CloseConnections(&server.returned);
+  close(server.wake_fds[0]);
+  close(server.wake_fds[1]);
+  close(server.listen_fd);
+  unlink(socket_path);
+  for (i = 0; i < MAX_POOLS; ++i) {
+    Pool* pool = &server.pools[i];
+    while (pool->idle) {
+      Arena* arena = pool->idle;
+      pool->idle = arena->next;
+      DestroyArena(arena);
+    }
+  }
+  if (workers) {
+    for (i = 0; i < num_workers; ++i) {
+      free(workers[i].input);
+      free(workers[i].output);
+    }
+  }
+  free(workers);
+  free(threads);
+  pthread_cond_destroy(&server.ready_cond);
+  pthread_mutex_destroy(&server.mutex);
+  return TO_BROTLI_BOOL(num_started == num_workers);
+}
+
+int BrotliServeConnect(const char* socket_path) {
+  int attempt;
+  for (attempt = 1; ; ++attempt) {
+    struct timespec delay;
+    int fd = ConnectOnce(socket_path);
+    if (fd >= 0 || attempt == MAX_CONNECT_ATTEMPTS) return fd;
+    if (errno != ENOENT && errno != ECONNREFUSED) return -1;
+    delay.tv_sec = 0;
+    delay.tv_nsec = kConnectRetryNanos;
+    nanosleep(&delay, NULL);
+  }
+}
+
+void BrotliServeDisconnect(int connection) {
+  if (connection >= 0) close(connection);
+}
+
+static BrotliServeStatus Transact(int connection, const ServeRequest* request,
+    const int* fds, int num_fds, ServeReply* reply) {
+  if (!SendAll(connection, request, sizeof(*request), fds, num_fds) ||
+      !ReceiveAll(connection, reply, sizeof(*reply), NULL, NULL) ||
+      reply->magic != SERVE_MAGIC) {
+    return BROTLI_SERVE_CONNECTION_ERROR;
+  }
+  return (BrotliServeStatus)reply->status;
+}
+
+BrotliServeStatus BrotliServeProcess(int connection, const BrotliServeJob* job,
+    int in_fd, int out_fd, uint64_t* total_in, uint64_t* total_out) {
+  ServeRequest request;
+  ServeReply reply;
+  BrotliServeStatus status;
+  int fds[2];
+  memset(&request, 0, sizeof(request));
+  request.magic = SERVE_MAGIC;
+  request.op = job->decompress ? SERVE_OP_DECOMPRESS : SERVE_OP_COMPRESS;
+  request.quality = job->quality;
+  request.lgwin = job->lgwin;
+  request.filter = job->filter;
+  request.filter_distance = job->filter_distance;
+  request.size_hint = job->size_hint;
+  fds[0] = in_fd;
+  fds[1] = out_fd;
+  status = Transact(connection, &request, fds, 2, &reply);
+  *total_in = (status == BROTLI_SERVE_CONNECTION_ERROR) ? 0 : reply.total_in;
+  *total_out = (status == BROTLI_SERVE_CONNECTION_ERROR) ? 0 : reply.total_out;
+  return status;
+}
+
+BrotliServeStatus BrotliServeStop(int connection) {
+  ServeRequest request;
+  ServeReply reply;
+  memset(&request, 0, sizeof(request));
+  request.magic = SERVE_MAGIC;
+  request.op = SERVE_OP_STOP;
+  return Transact(connection, &request, NULL, 0, &reply);
+}
+
+#else  /* BROTLI_SERVE_SUPPORTED */
+
+BROTLI_BOOL BrotliServe(
+    const char* socket_path, int num_workers, int verbosity) {
+  BROTLI_UNUSED(socket_path);
+  BROTLI_UNUSED(num_workers);
+  BROTLI_UNUSED(verbosity);
+  fprintf(stderr, "daemon mode is not supported on this platform\n");
+  return BROTLI_FALSE;
+}
+
+int BrotliServeConnect(const char* socket_path) {
+  BROTLI_UNUSED(socket_path);
+  errno = ENOSYS;
+  return -1;
+}
+
+void BrotliServeDisconnect(int connection) {
+  BROTLI_UNUSED(connection);
+}
+
+BrotliServeStatus BrotliServeProcess(int connection, const BrotliServeJob* job,
+    int in_fd, int out_fd, uint64_t* total_in, uint64_t* total_out) {
+  BROTLI_UNUSED(connection);
+  BROTLI_UNUSED(job);
+  BROTLI_UNUSED(in_fd);
+  BROTLI_UNUSED(out_fd);
+  *total_in = 0;
+  *total_out = 0;
+  return BROTLI_SERVE_CONNECTION_ERROR;
+}
+
+BrotliServeStatus BrotliServeStop(int connection) {
+  BROTLI_UNUSED(connection);
+  return BROTLI_SERVE_CONNECTION_ERROR;
+}
+
+#endif  /* BROTLI_SERVE_SUPPORTED */
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}  /* extern "C" */
+#endif
@@ -0,0 +1,81 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Local compression daemon ("brotli --serve") and its client.
+
+   Daemon listens on UNIX domain socket. Client passes a request along with
+   two file descriptors: input and output. Daemon reads the whole input,
+   writes (de)compressed data to the output descriptor and replies with the
+   status and the number of bytes consumed / produced. Input is always read
+   (never mapped), so client that truncates or rewrites the file during the
+   request cannot crash the daemon; it could only spoil its own output.
+
+   Connection occupies a worker only while its request is processed; idle
+   connections are watched by the dispatcher thread. Socket is created
+   accessible only to the user running the daemon.
+
+   Daemon keeps pools of warm encoders / decoders memory per parameter set;
+   buffers (ring-buffer, hasher tables, etc.) allocated by one request are
+   reused by the next request with the same parameters. */
+
+#ifndef BROTLI_TOOLS_SERVE_H_
+#define BROTLI_TOOLS_SERVE_H_
+
+#include <brotli/types.h>
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+typedef struct BrotliServeJob {
+  BROTLI_BOOL decompress;
+  int quality;
+  /* 0 lets daemon choose the window size; values above
+     BROTLI_MAX_WINDOW_BITS turn on "large-window" extension. */
+  int lgwin;
+  int filter;
+  int filter_distance;
+  /* Expected input size; 0 if unknown. */
+  uint64_t size_hint;
+} BrotliServeJob;
+
+typedef enum BrotliServeStatus {
+  BROTLI_SERVE_OK = 0,
+  BROTLI_SERVE_BAD_REQUEST = 1,
+  BROTLI_SERVE_CORRUPT_INPUT = 2,
+  BROTLI_SERVE_READ_ERROR = 3,
+  BROTLI_SERVE_WRITE_ERROR = 4,
+  BROTLI_SERVE_ENCODER_ERROR = 5,
+  BROTLI_SERVE_CONNECTION_ERROR = 6
+} BrotliServeStatus;
+
+/* Serves requests on |socket_path| using |num_workers| threads, until stop
+   request is received. Returns BROTLI_FALSE if socket could not be set up,
+   or daemon is not supported on this platform. */
+BROTLI_BOOL BrotliServe(
+    const char* socket_path, int num_workers, int verbosity);
+
+/* Returns connection descriptor, or -1 on failure (errno is set). If daemon
+   is just being started, waits a bit for it to become ready. */
+int BrotliServeConnect(const char* socket_path);
+
+void BrotliServeDisconnect(int connection);
+
+/* Processes |in_fd| to |out_fd| with daemon; requests could be sent one by
+   one over the same connection. */
+BrotliServeStatus BrotliServeProcess(int connection, const BrotliServeJob* job,
+    int in_fd, int out_fd, uint64_t* total_in, uint64_t* total_out);
+
+/* Asks daemon to finish pending requests and exit. */
+BrotliServeStatus BrotliServeStop(int connection);
+
+const char* BrotliServeStatusString(BrotliServeStatus status);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}  /* extern "C" */
+#endif
+
+#endif  /* BROTLI_TOOLS_SERVE_H_ */
@@ -74,5 +74,5 @@ project "brotli"
   kind "ConsoleApp"
   language "C"
   linkoptions "-static"
-  files { "c/tools/brotli.c" }
+  files { "c/tools/brotli.c", "c/tools/serve.c", "c/tools/serve.h" }
   links { "brotlicommon_static", "brotlidec_static", "brotlienc_static" }
@@ -14,6 +14,18 @@
 
 static PyObject *BrotliError;
 
+/* Encoder / decoder instances are not thread-safe; each Python object owns a
+   lock that serializes calls. The GIL is released while waiting for the lock,
+   otherwise a thread holding the lock could not re-acquire the GIL. */
+#define ACQUIRE_LOCK(obj) do {                     \
+    if (!PyThread_acquire_lock((obj)->lock, 0)) {  \
+      Py_BEGIN_ALLOW_THREADS                       \
+      PyThread_acquire_lock((obj)->lock, 1);       \
+      Py_END_ALLOW_THREADS                         \
+    }                                              \
+  } while (0)
+#define RELEASE_LOCK(obj) PyThread_release_lock((obj)->lock)
+
 static int as_bounded_int(PyObject *o, int* result, int lower_bound, int upper_bound) {
   long value = PyInt_AsLong(o);
   if ((value < (long) lower_bound) || (value > (long) upper_bound)) {
@@ -140,16 +152,21 @@ PyDoc_STRVAR(brotli_Compressor_doc,
 "    Range is 16 to 24. If set to 0, the value will be set based on the\n"
 "    quality. Defaults to 0.\n"
 "\n"
+"Methods may be called from several threads; calls are serialized.\n"
+"\n"
 "Raises:\n"
 "  brotli.error: If arguments are invalid.\n");
 
 typedef struct {
   PyObject_HEAD
   BrotliEncoderState* enc;
+  PyThread_type_lock lock;
 } brotli_Compressor;
 
 static void brotli_Compressor_dealloc(brotli_Compressor* self) {
   BrotliEncoderDestroyInstance(self->enc);
+  if (self->lock)
+    PyThread_free_lock(self->lock);
   #if PY_MAJOR_VERSION >= 3
   Py_TYPE(self)->tp_free((PyObject*)self);
   #else
@@ -163,6 +180,11 @@ static PyObject* brotli_Compressor_new(PyTypeObject *type, PyObject *args, PyObj
 
   if (self != NULL) {
     self->enc = BrotliEncoderCreateInstance(0, 0, 0);
+    self->lock = PyThread_allocate_lock();
+    if (!self->lock) {
+      Py_DECREF(self);
+      return PyErr_NoMemory();
+    }
   }
 
   return (PyObject *)self;
@@ -188,6 +210,7 @@ static int brotli_Compressor_init(brotli_Compressor *self, PyObject *args, PyObj
   if (!self->enc)
     return -1;
 
+  ACQUIRE_LOCK(self);
   if ((int) mode != -1)
     BrotliEncoderSetParameter(self->enc, BROTLI_PARAM_MODE, (uint32_t)mode);
   if (quality != -1)
@@ -196,6 +219,7 @@ static int brotli_Compressor_init(brotli_Compressor *self, PyObject *args, PyObj
     BrotliEncoderSetParameter(self->enc, BROTLI_PARAM_LGWIN, (uint32_t)lgwin);
   if (lgblock != -1)
     BrotliEncoderSetParameter(self->enc, BROTLI_PARAM_LGBLOCK, (uint32_t)lgblock);
+  RELEASE_LOCK(self);
 
   return 0;
 }
@@ -240,8 +264,10 @@ static PyObject* brotli_Compressor_process(brotli_Compressor *self, PyObject *ar
     goto end;
   }
 
+  ACQUIRE_LOCK(self);
   ok = compress_stream(self->enc, BROTLI_OPERATION_PROCESS,
                        &output, static_cast<uint8_t*>(input.buf), input.len);
+  RELEASE_LOCK(self);
 
 end:
   PyBuffer_Release(&input);
@@ -278,8 +304,10 @@ static PyObject* brotli_Compressor_flush(brotli_Compressor *self) {
     goto end;
   }
 
+  ACQUIRE_LOCK(self);
   ok = compress_stream(self->enc, BROTLI_OPERATION_FLUSH,
                        &output, NULL, 0);
+  RELEASE_LOCK(self);
 
 end:
   if (ok) {
@@ -318,12 +346,14 @@ static PyObject* brotli_Compressor_finish(brotli_Compressor *self) {
     goto end;
   }
 
+  ACQUIRE_LOCK(self);
   ok = compress_stream(self->enc, BROTLI_OPERATION_FINISH,
                        &output, NULL, 0);
 
   if (ok) {
     ok = BrotliEncoderIsFinished(self->enc);
   }
+  RELEASE_LOCK(self);
 
 end:
   if (ok) {
@@ -426,16 +456,21 @@ PyDoc_STRVAR(brotli_Decompressor_doc,
 "Signature:\n"
 "  Decompressor()\n"
 "\n"
+"Methods may be called from several threads; calls are serialized.\n"
+"\n"
 "Raises:\n"
 "  brotli.error: If arguments are invalid.\n");
 
 typedef struct {
   PyObject_HEAD
   BrotliDecoderState* dec;
+  PyThread_type_lock lock;
 } brotli_Decompressor;
 
 static void brotli_Decompressor_dealloc(brotli_Decompressor* self) {
   BrotliDecoderDestroyInstance(self->dec);
+  if (self->lock)
+    PyThread_free_lock(self->lock);
   #if PY_MAJOR_VERSION >= 3
   Py_TYPE(self)->tp_free((PyObject*)self);
   #else
@@ -449,6 +484,11 @@ static PyObject* brotli_Decompressor_new(PyTypeObject *type, PyObject *args, PyO
 
   if (self != NULL) {
     self->dec = BrotliDecoderCreateInstance(0, 0, 0);
+    self->lock = PyThread_allocate_lock();
+    if (!self->lock) {
+      Py_DECREF(self);
+      return PyErr_NoMemory();
+    }
   }
 
   return (PyObject *)self;
@@ -509,7 +549,9 @@ static PyObject* brotli_Decompressor_process(brotli_Decompressor *self, PyObject
     goto end;
   }
 
+  ACQUIRE_LOCK(self);
   ok = decompress_stream(self->dec, &output, static_cast<uint8_t*>(input.buf), input.len);
+  RELEASE_LOCK(self);
 
 end:
   PyBuffer_Release(&input);
@@ -522,6 +564,68 @@ end:
   return ret;
 }
 
+PyDoc_STRVAR(brotli_Decompressor_process_into_doc,
+"Process \"string\" for decompression, writing decompressed output data\n"
+"directly into \"buffer\". Unlike \"process()\", decoding stops when \"buffer\"\n"
+"is full; the unconsumed tail of \"string\" should be passed to the next call.\n"
+"\n"
+"Signature:\n"
+"  process_into(string, buffer)\n"
+"\n"
+"Args:\n"
+"  string (bytes): The input data\n"
+"  buffer (writable bytes-like object): The output buffer\n"
+"\n"
+"Returns:\n"
+"  A tuple of the number of input bytes consumed and the number of output\n"
+"  bytes written\n"
+"\n"
+"Raises:\n"
+"  brotli.error: If decompression fails\n");
+
+static PyObject* brotli_Decompressor_process_into(brotli_Decompressor *self, PyObject *args) {
+  Py_buffer input;
+  Py_buffer output;
+  BrotliDecoderResult result = BROTLI_DECODER_RESULT_ERROR;
+  size_t available_in;
+  size_t available_out;
+  int ok;
+
+#if PY_MAJOR_VERSION >= 3
+  ok = PyArg_ParseTuple(args, "y*w*:process_into", &input, &output);
+#else
+  ok = PyArg_ParseTuple(args, "s*w*:process_into", &input, &output);
+#endif
+
+  if (!ok)
+    return NULL;
+
+  available_in = input.len;
+  available_out = output.len;
+
+  if (self->dec) {
+    ACQUIRE_LOCK(self);
+    Py_BEGIN_ALLOW_THREADS
+    const uint8_t* next_in = static_cast<uint8_t*>(input.buf);
+    uint8_t* next_out = static_cast<uint8_t*>(output.buf);
+    result = BrotliDecoderDecompressStream(self->dec,
+                                           &available_in, &next_in,
+                                           &available_out, &next_out, NULL);
+    Py_END_ALLOW_THREADS
+    RELEASE_LOCK(self);
+  }
+
+  PyBuffer_Release(&input);
+  PyBuffer_Release(&output);
+  if (result == BROTLI_DECODER_RESULT_ERROR) {
+    PyErr_SetString(BrotliError, "BrotliDecoderDecompressStream failed while processing the stream");
+    return NULL;
+  }
+
+  return Py_BuildValue("(nn)", (Py_ssize_t)(input.len - available_in),
+                       (Py_ssize_t)(output.len - available_out));
+}
+
 PyDoc_STRVAR(brotli_Decompressor_is_finished_doc,
 "Checks if decoder instance reached the final state.\n"
 "\n"
@@ -547,7 +651,10 @@ static PyObject* brotli_Decompressor_is_finished(brotli_Decompressor *self) {
     goto end;
   }
 
-  if (BrotliDecoderIsFinished(self->dec)) {
+  ACQUIRE_LOCK(self);
+  ok = BrotliDecoderIsFinished(self->dec);
+  RELEASE_LOCK(self);
+  if (ok) {
     Py_RETURN_TRUE;
   } else {
     Py_RETURN_FALSE;
@@ -569,6 +676,7 @@ static PyMemberDef brotli_Decompressor_members[] = {
 
 static PyMethodDef brotli_Decompressor_methods[] = {
   {"process", (PyCFunction)brotli_Decompressor_process, METH_VARARGS, brotli_Decompressor_process_doc},
+  {"process_into", (PyCFunction)brotli_Decompressor_process_into, METH_VARARGS, brotli_Decompressor_process_into_doc},
   {"is_finished", (PyCFunction)brotli_Decompressor_is_finished, METH_NOARGS, brotli_Decompressor_is_finished_doc},
   {NULL}  /* Sentinel */
 };
@@ -721,6 +829,15 @@ static struct PyModuleDef brotli_module = {
 
 PyMODINIT_FUNC INIT_BROTLI(void) {
   PyObject *m = CREATE_BROTLI;
+  if (m == NULL) {
+    RETURN_NULL;
+  }
+
+#ifdef Py_GIL_DISABLED
+  /* Compressor / Decompressor serialize access with their own locks; other
+     module state is immutable after initialization. */
+  PyUnstable_Module_SetGIL(m, Py_MOD_GIL_NOT_USED);
+#endif
 
   BrotliError = PyErr_NewException((char*) "brotli.error", NULL, NULL);
   if (BrotliError != NULL) {
@@ -0,0 +1,80 @@
+#! /usr/bin/env python
+"""Measures decompression speed of frequently flushed Brotli streams.
+
+Each flush ends a meta-block, so with small flush intervals most of the
+decoding time goes to meta-block headers (prefix codes, context maps,
+block switch codes) rather than to literals and copies.
+"""
+
+from __future__ import print_function
+import argparse
+import time
+
+import brotli
+
+
+def flushed_stream(data, quality, interval):
+    compressor = brotli.Compressor(quality=quality)
+    chunks = []
+    for pos in range(0, len(data), interval):
+        chunks.append(compressor.process(data[pos:pos + interval]))
+        chunks.append(compressor.flush())
+    chunks.append(compressor.finish())
+    return b''.join(chunks)
+
+
+def best_time(compressed, repeat):
+    best = None
+    for _ in range(repeat):
+        start = time.time()
+        brotli.decompress(compressed)
+        elapsed = time.time() - start
+        if best is None or elapsed < best:
+            best = elapsed
+    return best
+
+
+def main(args=None):
+    parser = argparse.ArgumentParser(
+        prog='bench.py',
+        description='Decompression speed of frequently flushed streams.')
+    parser.add_argument('input', metavar='FILE', help='Input file')
+    parser.add_argument(
+        '-q',
+        '--quality',
+        metavar='QUALITY',
+        type=int,
+        nargs='+',
+        default=[5, 11],
+        help='Compression qualities. Defaults to 5 and 11.')
+    parser.add_argument(
+        '-f',
+        '--flush',
+        metavar='BYTES',
+        type=int,
+        nargs='+',
+        default=[256, 1024, 4096, 65536],
+        help='Flush intervals in bytes. Defaults to 256 1024 4096 65536.')
+    parser.add_argument(
+        '-r',
+        '--repeat',
+        metavar='N',
+        type=int,
+        default=10,
+        help='Number of decompressions; the fastest one counts.')
+    options = parser.parse_args(args=args)
+
+    with open(options.input, 'rb') as infile:
+        data = infile.read()
+
+    print('quality  flush  compressed  MB/s')
+    for quality in options.quality:
+        for interval in options.flush:
+            compressed = flushed_stream(data, quality, interval)
+            speed = len(data) / best_time(compressed, options.repeat) / 1e6
+            print('%7d %6d %11d %5.1f' % (quality, interval, len(compressed),
+                                          speed))
+
+
+if __name__ == '__main__':
+    main()
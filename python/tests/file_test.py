@@ -0,0 +1,68 @@
+# Copyright 2026 The Brotli Authors. All rights reserved.
+#
+# Distributed under MIT license.
+# See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+import io
+import unittest
+
+from . import _test_utils
+import brotli
+
+
+class TestBrotliFile(_test_utils.TestCase):
+
+    def _test_write_and_read(self, test_data):
+        temp_compressed = _test_utils.get_temp_compressed_name(test_data)
+        with open(test_data, 'rb') as in_file:
+            original = in_file.read()
+        with brotli.open(temp_compressed, 'wb', quality=5) as f:
+            for i in range(0, len(original), 1000):
+                f.write(original[i:i + 1000])
+        with brotli.open(temp_compressed, 'rb') as f:
+            self.assertEqual(original, f.read())
+        with brotli.open(temp_compressed, 'rb') as f:
+            buffer = bytearray(4096)
+            output = bytearray()
+            size = f.readinto(buffer)
+            while size:
+                output += buffer[:size]
+                size = f.readinto(buffer)
+            self.assertEqual(original, output)
+
+    def test_text_mode(self):
+        stream = io.BytesIO()
+        with brotli.open(stream, 'wt', encoding='utf-8') as f:
+            f.write(u'first line\nsecond line\n')
+        stream.seek(0)
+        with brotli.open(stream, 'rt', encoding='utf-8') as f:
+            self.assertEqual([u'first line\n', u'second line\n'], list(f))
+
+    def test_flush(self):
+        stream = io.BytesIO()
+        with brotli.BrotliFile(stream, 'wb') as f:
+            f.write(b'a' * 100)
+            f.flush()
+            decompressor = brotli.Decompressor()
+            self.assertEqual(b'a' * 100, decompressor.process(stream.getvalue()))
+
+    def test_truncated(self):
+        data = brotli.compress(b'a' * 100000 + b'b' * 100000)
+        with brotli.BrotliFile(io.BytesIO(data[:-1])) as f:
+            with self.assertRaises(EOFError):
+                f.read()
+
+    def test_garbage_appended(self):
+        with brotli.BrotliFile(io.BytesIO(brotli.compress(b'a') + b'a')) as f:
+            with self.assertRaises(brotli.error):
+                f.read()
+
+    def test_invalid_mode(self):
+        with self.assertRaises(ValueError):
+            brotli.BrotliFile(io.BytesIO(), 'r+')
+
+
+_test_utils.generate_test_methods(TestBrotliFile)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,95 @@
+# Copyright 2026 The Brotli Authors. All rights reserved.
+#
+# Distributed under MIT license.
+# See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+import threading
+import unittest
+
+from . import _test_utils
+import brotli
+
+NUM_THREADS = 8
+NUM_CHUNKS = 200
+FEED_SIZE = 64
+
+
+def _chunk(thread, index):
+    # Chunks are distinct and have the same size.
+    return '{:02d}:{:04d};'.format(thread, index).encode('ascii') * 100
+
+
+class TestSharedInstances(_test_utils.TestCase):
+
+    def _run_threads(self, target):
+        errors = []
+
+        def run(thread):
+            try:
+                target(thread)
+            except Exception as e:  # pylint: disable=broad-except
+                errors.append(e)
+
+        threads = [
+            threading.Thread(target=run, args=(i,)) for i in range(NUM_THREADS)
+        ]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual([], errors)
+
+    def test_shared_compressor(self):
+        # Biggest input block, so that nothing is emitted before finish().
+        compressor = brotli.Compressor(quality=5, lgwin=24, lgblock=24)
+
+        def compress(thread):
+            for index in range(NUM_CHUNKS):
+                if compressor.process(_chunk(thread, index)):
+                    raise AssertionError('unexpected output')
+
+        self._run_threads(compress)
+        decompressed = brotli.decompress(compressor.finish())
+        # Calls are serialized: each chunk is intact, chunks of each thread
+        # are in order.
+        size = len(_chunk(0, 0))
+        chunks = [
+            decompressed[i:i + size] for i in range(0, len(decompressed), size)
+        ]
+        for thread in range(NUM_THREADS):
+            prefix = _chunk(thread, 0)[:3]
+            self.assertEqual([_chunk(thread, i) for i in range(NUM_CHUNKS)],
+                             [c for c in chunks if c.startswith(prefix)])
+        self.assertEqual(NUM_THREADS * NUM_CHUNKS, len(chunks))
+
+    def test_shared_decompressor(self):
+        data = b''.join(
+            _chunk(t, i) for t in range(NUM_THREADS) for i in range(NUM_CHUNKS))
+        compressed = brotli.compress(data)
+        decompressor = brotli.Decompressor()
+        output = []
+        done = threading.Event()
+
+        def decompress(thread):
+            if thread == 0:
+                try:
+                    for i in range(0, len(compressed), FEED_SIZE):
+                        output.append(
+                            decompressor.process(compressed[i:i + FEED_SIZE]))
+                finally:
+                    done.set()
+            else:
+                # Other threads poll the same instance; without input there
+                # is no output.
+                while not done.is_set():
+                    if decompressor.process(b''):
+                        raise AssertionError('unexpected output')
+                    decompressor.is_finished()
+
+        self._run_threads(decompress)
+        self.assertTrue(decompressor.is_finished())
+        self.assertEqual(data, b''.join(output))
+
+
+if __name__ == '__main__':
+    unittest.main()
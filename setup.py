@@ -163,6 +163,7 @@ CLASSIFIERS = [
     'Programming Language :: Python :: 3.3',
     'Programming Language :: Python :: 3.4',
     'Programming Language :: Python :: 3.5',
+    'Programming Language :: Python :: Free Threading :: 2 - Beta',
     'Programming Language :: Unix Shell',
     'Topic :: Software Development :: Libraries',
     'Topic :: Software Development :: Libraries :: Python Modules',
@@ -184,6 +185,7 @@ EXT_MODULES = [
             'c/common/constants.c',
             'c/common/context.c',
             'c/common/dictionary.c',
+            'c/common/filter.c',
             'c/common/platform.c',
             'c/common/transform.c',
             'c/dec/bit_reader.c',
@@ -208,6 +210,8 @@ EXT_MODULES = [
             'c/enc/literal_cost.c',
             'c/enc/memory.c',
             'c/enc/metablock.c',
+            'c/enc/parallel.c',
+            'c/enc/prefilter.c',
             'c/enc/static_dict.c',
             'c/enc/utf8_util.c',
         ],
@@ -215,6 +219,7 @@ EXT_MODULES = [
             'c/common/constants.h',
             'c/common/context.h',
             'c/common/dictionary.h',
+            'c/common/filter.h',
             'c/common/platform.h',
             'c/common/transform.h',
             'c/common/version.h',
@@ -256,7 +261,9 @@ EXT_MODULES = [
             'c/enc/memory.h',
             'c/enc/metablock.h',
             'c/enc/metablock_inc.h',
+            'c/enc/parallel.h',
             'c/enc/params.h',
+            'c/enc/prefilter.h',
             'c/enc/prefix.h',
             'c/enc/quality.h',
             'c/enc/ringbuffer.h',
@@ -0,0 +1,154 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Tests for BrotliEncoderCompressWithBudget. */
+
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+
+#define INPUT_SIZE 300000
+#define OUTPUT_SIZE (INPUT_SIZE + 4096)
+
+#include "./test_util.h"
+
+/* Feeds |size| new bytes of the stream to the decoder; checks that exactly
+   the data encoded so far is decoded. */
+static int CheckDecodable(BrotliDecoderState* d, const uint8_t* data,
+    size_t size, size_t* total_decoded, size_t expected) {
+  size_t available_out = INPUT_SIZE - *total_decoded;
+  uint8_t* next_out = decoded + *total_decoded;
+  BrotliDecoderResult result = BrotliDecoderDecompressStream(
+      d, &size, &data, &available_out, &next_out, NULL);
+  CHECK(result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT ||
+        result == BROTLI_DECODER_RESULT_SUCCESS);
+  CHECK(size == 0);
+  *total_decoded = (size_t)(next_out - decoded);
+  CHECK(*total_decoded == expected);
+  CHECK(memcmp(decoded, input, expected) == 0);
+  return 1;
+}
+
+static int TestBudget(int quality, size_t budget) {
+  BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+  BrotliDecoderState* d = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+  const uint8_t* next_in = input;
+  size_t available_in = INPUT_SIZE;
+  uint8_t* next_out = output;
+  size_t total_encoded = 0;
+  size_t total_decoded = 0;
+  size_t available_out;
+  int round;
+  CHECK(s && d);
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, (uint32_t)quality);
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, 18);
+  for (round = 0; round < 3; ++round) {
+    uint8_t* round_start = next_out;
+    size_t encoded_size = 123;
+    available_out = budget;
+    CHECK(BrotliEncoderCompressWithBudget(s, &available_in, &next_in,
+        &available_out, &next_out, &encoded_size));
+    CHECK((size_t)(next_out - round_start) == budget - available_out);
+    if (budget < 8) {
+      /* Nothing fits, not even the stream header. */
+      CHECK(next_out == round_start && encoded_size == 0);
+    } else {
+      /* Budget is hit: output is produced, but input is not exhausted. */
+      CHECK(next_out != round_start && encoded_size != 0);
+      CHECK(round != 0 || available_in != 0);
+    }
+    total_encoded += encoded_size;
+    CHECK(total_encoded <= INPUT_SIZE - available_in);
+    CHECK(CheckDecodable(d, round_start, (size_t)(next_out - round_start),
+        &total_decoded, total_encoded));
+  }
+  /* Taken but not emitted input goes to the regular stream output. */
+  {
+    uint8_t* tail_start = next_out;
+    available_out = OUTPUT_SIZE - (size_t)(next_out - output);
+    CHECK(BrotliEncoderCompressStream(s, BROTLI_OPERATION_FINISH,
+        &available_in, &next_in, &available_out, &next_out, NULL));
+    CHECK(BrotliEncoderIsFinished(s));
+    CHECK(CheckDecodable(d, tail_start, (size_t)(next_out - tail_start),
+        &total_decoded, INPUT_SIZE));
+    CHECK(BrotliDecoderIsFinished(d));
+  }
+  BrotliDecoderDestroyInstance(d);
+  BrotliEncoderDestroyInstance(s);
+  return 1;
+}
+
+/* Budgeted calls mixed with regular ones; PROCESS leaves unprocessed input
+   in the ring buffer that the next budgeted call has to account for. */
+static int TestInterleaved(int quality) {
+  BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+  const uint8_t* next_in = input;
+  size_t available_in = INPUT_SIZE;
+  uint8_t* next_out = output;
+  size_t available_out = 5000;
+  size_t encoded_size;
+  CHECK(s);
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, (uint32_t)quality);
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, 16);
+  CHECK(BrotliEncoderCompressWithBudget(s, &available_in, &next_in,
+      &available_out, &next_out, &encoded_size));
+  available_in = 100000;
+  available_out = OUTPUT_SIZE - (size_t)(next_out - output);
+  CHECK(BrotliEncoderCompressStream(s, BROTLI_OPERATION_PROCESS,
+      &available_in, &next_in, &available_out, &next_out, NULL));
+  CHECK(available_in == 0);
+  available_in = INPUT_SIZE - (size_t)(next_in - input);
+  available_out = 8000;
+  CHECK(BrotliEncoderCompressWithBudget(s, &available_in, &next_in,
+      &available_out, &next_out, &encoded_size));
+  available_out = OUTPUT_SIZE - (size_t)(next_out - output);
+  CHECK(BrotliEncoderCompressStream(s, BROTLI_OPERATION_FINISH,
+      &available_in, &next_in, &available_out, &next_out, NULL));
+  CHECK(BrotliEncoderIsFinished(s));
+  BrotliEncoderDestroyInstance(s);
+  return CheckDecoded(NULL, output, (size_t)(next_out - output), INPUT_SIZE);
+}
+
+static int TestUnsupported(void) {
+  BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+  const uint8_t* next_in = input;
+  size_t available_in = INPUT_SIZE;
+  uint8_t* next_out = output;
+  size_t available_out = 1000;
+  size_t encoded_size;
+  CHECK(s);
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, 1);
+  CHECK(!BrotliEncoderCompressWithBudget(s, &available_in, &next_in,
+      &available_out, &next_out, &encoded_size));
+  CHECK(available_out == 1000 && next_out == output);
+  BrotliEncoderDestroyInstance(s);
+  return 1;
+}
+
+int main(void) {
+  static const int kQualities[] = {2, 5, 9, 11};
+  static const size_t kBudgets[] = {0, 1, 100, 1000, 20000};
+  size_t q;
+  size_t b;
+  /* Text-like data with a fraction of noise; compresses roughly 4:1. */
+  GenerateInput(8);
+  for (q = 0; q < sizeof(kQualities) / sizeof(kQualities[0]); ++q) {
+    for (b = 0; b < sizeof(kBudgets) / sizeof(kBudgets[0]); ++b) {
+      if (!TestBudget(kQualities[q], kBudgets[b])) {
+        fprintf(stderr, "quality %d, budget %d\n", kQualities[q],
+                (int)kBudgets[b]);
+        return 1;
+      }
+    }
+  }
+  for (q = 7; q <= 11; ++q) {
+    if (!TestInterleaved((int)q)) {
+      fprintf(stderr, "interleaved, quality %d\n", (int)q);
+      return 1;
+    }
+  }
+  if (!TestUnsupported()) return 1;
+  return 0;
+}
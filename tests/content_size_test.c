@@ -0,0 +1,171 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Tests for content size header (BROTLI_PARAM_CONTENT_SIZE_HEADER) of
+   the streams that are continued with BrotliEncoderResumeStream.
+
+   Without arguments runs the library test. With arguments serves
+   run-content-size-test.cmake:
+     content_size_test write FILE  -- writes stream with content size header
+     content_size_test check FILE APPENDED_FILE  -- checks appended stream */
+
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+
+#define PART_SIZE 50000
+#define INPUT_SIZE (2 * PART_SIZE)
+#define OUTPUT_SIZE (4 * PART_SIZE)
+
+#include "./test_util.h"
+
+/* Compresses the first part into |output| with content size header. */
+static int WriteStream(int quality, size_t* size) {
+  BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+  const uint8_t* next_in = input;
+  size_t available_in = PART_SIZE;
+  uint8_t* next_out = output;
+  size_t available_out = OUTPUT_SIZE;
+  CHECK(s);
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, (uint32_t)quality);
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_CONTENT_SIZE_HEADER, 1);
+  CHECK(BrotliEncoderCompressStream(s, BROTLI_OPERATION_FINISH,
+      &available_in, &next_in, &available_out, &next_out, NULL));
+  CHECK(BrotliEncoderIsFinished(s));
+  BrotliEncoderDestroyInstance(s);
+  *size = (size_t)(next_out - output);
+  return 1;
+}
+
+/* Appends the second part to the stream, as BrotliDecoderGetAppendPoint
+   describes. */
+static int AppendStream(int quality, size_t* size) {
+  BrotliDecoderState* d = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+  BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+  const uint8_t* next_in = output;
+  size_t available_in = *size;
+  uint8_t* next_out = decoded;
+  size_t available_out = PART_SIZE;
+  uint32_t window_bits;
+  BROTLI_BOOL large_window;
+  uint64_t header_offset;
+  uint32_t header;
+  uint32_t header_bits;
+  uint64_t end_offset;
+  uint32_t i;
+  CHECK(d && s);
+  CHECK(BrotliDecoderDecompressStream(d, &available_in, &next_in,
+      &available_out, &next_out, NULL) == BROTLI_DECODER_RESULT_SUCCESS);
+  CHECK(BrotliDecoderGetAppendPoint(d, &window_bits, &large_window,
+      &header_offset, &header, &header_bits, &end_offset));
+  BrotliDecoderDestroyInstance(d);
+  for (i = 0; i < header_bits; ++i) {
+    const uint64_t bit = header_offset + i;
+    uint8_t* byte = &output[bit >> 3];
+    *byte = (uint8_t)((*byte & ~(1u << (bit & 7))) |
+        (((header >> i) & 1u) << (bit & 7)));
+  }
+  next_out = &output[end_offset >> 3];
+  available_out = OUTPUT_SIZE - (size_t)(end_offset >> 3);
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, (uint32_t)quality);
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, window_bits);
+  /* Filter container could not start in the middle of the stream; resumed
+     stream ignores the filter. */
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_FILTER, BROTLI_FILTER_DELTA);
+  CHECK(BrotliEncoderResumeStream(s, PART_SIZE, input, PART_SIZE,
+      (uint32_t)(end_offset & 7), *next_out));
+  next_in = &input[PART_SIZE];
+  available_in = PART_SIZE;
+  CHECK(BrotliEncoderCompressStream(s, BROTLI_OPERATION_FINISH,
+      &available_in, &next_in, &available_out, &next_out, NULL));
+  CHECK(BrotliEncoderIsFinished(s));
+  BrotliEncoderDestroyInstance(s);
+  *size = (size_t)(next_out - output);
+  return 1;
+}
+
+static int TestAppend(int quality) {
+  size_t size;
+  uint64_t content_size;
+  CHECK(WriteStream(quality, &size));
+  CHECK(BrotliDecoderPeekContentSize(size, output, &content_size));
+  CHECK(content_size == PART_SIZE);
+  CHECK(AppendStream(quality, &size));
+  /* Header is not updated by the encoder. */
+  CHECK(BrotliDecoderPeekContentSize(size, output, &content_size));
+  CHECK(content_size == PART_SIZE);
+  CHECK(BrotliDecoderUpdateContentSize(20, output, 2 * PART_SIZE));
+  CHECK(BrotliDecoderPeekContentSize(20, output, &content_size));
+  CHECK(content_size == 2 * PART_SIZE);
+  return CheckDecoded(NULL, output, size, INPUT_SIZE);
+}
+
+static int TestNoHeader(void) {
+  size_t size = OUTPUT_SIZE;
+  uint64_t content_size;
+  CHECK(BrotliEncoderCompress(5, 22, BROTLI_MODE_GENERIC, PART_SIZE, input,
+                              &size, output));
+  CHECK(!BrotliDecoderPeekContentSize(size, output, &content_size));
+  CHECK(!BrotliDecoderUpdateContentSize(size, output, 1));
+  return 1;
+}
+
+static int WriteFile(const char* path) {
+  size_t size;
+  FILE* f = fopen(path, "wb");
+  CHECK(f);
+  CHECK(WriteStream(5, &size));
+  CHECK(fwrite(output, 1, size, f) == size);
+  CHECK(fclose(f) == 0);
+  return 1;
+}
+
+/* Checks that |path| decodes to the first part followed by the contents of
+   |appended_path|, and that its header tells the total size. */
+static int CheckFile(const char* path, const char* appended_path) {
+  static uint8_t appended[OUTPUT_SIZE];
+  static uint8_t contents[PART_SIZE + OUTPUT_SIZE];
+  size_t size;
+  size_t appended_size;
+  size_t contents_size = sizeof(contents);
+  uint64_t content_size;
+  FILE* f = fopen(path, "rb");
+  CHECK(f);
+  size = fread(output, 1, OUTPUT_SIZE, f);
+  fclose(f);
+  f = fopen(appended_path, "rb");
+  CHECK(f);
+  appended_size = fread(appended, 1, OUTPUT_SIZE, f);
+  CHECK(feof(f));
+  fclose(f);
+  CHECK(BrotliDecoderDecompress(size, output, &contents_size, contents) ==
+        BROTLI_DECODER_RESULT_SUCCESS);
+  CHECK(contents_size == PART_SIZE + appended_size);
+  CHECK(memcmp(contents, input, PART_SIZE) == 0);
+  CHECK(memcmp(contents + PART_SIZE, appended, appended_size) == 0);
+  CHECK(BrotliDecoderPeekContentSize(size, output, &content_size));
+  CHECK(content_size == contents_size);
+  return 1;
+}
+
+int main(int argc, char** argv) {
+  static const int kQualities[] = {1, 5, 11};
+  size_t q;
+  GenerateInput(4);
+  if (argc == 3 && strcmp(argv[1], "write") == 0) {
+    return WriteFile(argv[2]) ? 0 : 1;
+  }
+  if (argc == 4 && strcmp(argv[1], "check") == 0) {
+    return CheckFile(argv[2], argv[3]) ? 0 : 1;
+  }
+  for (q = 0; q < sizeof(kQualities) / sizeof(kQualities[0]); ++q) {
+    if (!TestAppend(kQualities[q])) {
+      fprintf(stderr, "quality %d\n", kQualities[q]);
+      return 1;
+    }
+  }
+  if (!TestNoHeader()) return 1;
+  return 0;
+}
@@ -0,0 +1,142 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Tests that wrong match hints (BrotliEncoderAddMatchHints) do not corrupt
+   the output. */
+
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+
+#define LGWIN 18
+#define LGBLOCK 16
+#define INPUT_SIZE 300000
+/* Input is pushed in two parts; hints for the second part are added when
+   the first one is already processed. */
+#define SPLIT 220000
+/* Resumed stream continues the one that holds input up to this point. */
+#define RESUME_POS 150000
+#define OUTPUT_SIZE (INPUT_SIZE + 65536)
+
+#include "./test_util.h"
+
+#define HINT(POSITION, DISTANCE, LENGTH) {POSITION, DISTANCE, LENGTH}
+
+/* Hints for the first part; positions are not decreasing. */
+static const BrotliEncoderMatchHint kHints1[] = {
+  /* Distance beyond the beginning of input. */
+  HINT(10, 1000, 500),
+  HINT(50, 0xFFFFFFFFu, 100),
+  /* Data does not match; crosses the input block boundary. */
+  HINT(65500, 50, 200),
+  HINT(120000, 7, 300),
+  HINT(131000, 1, 1000),
+  /* Correct hint that crosses the input block boundary at 196608. */
+  HINT(160000, 130000, 40000),
+};
+
+/* Hints added after the first part is processed. */
+static const BrotliEncoderMatchHint kHints2[] = {
+  /* Behind the processed input. */
+  HINT(200000, 5, 100),
+  /* Correct hint. */
+  HINT(250000, 190000, 8000),
+  /* Distance within the input, but beyond the window. */
+  HINT(262000, 262100, 500),
+  /* Distance is the size of encoder ring-buffer (twice the window); hinted
+     data there is the data itself. */
+  HINT(270000, 2u << LGWIN, 500),
+  /* Goes past the end of input. */
+  HINT(299990, 1000, 100000),
+};
+
+/* Hints for the resumed stream; positions start at RESUME_POS. */
+static const BrotliEncoderMatchHint kResumedHints[] = {
+  /* Distance beyond the beginning of history. */
+  HINT(5, 200000, 100),
+  /* Data does not match. */
+  HINT(100, 140000, 1000),
+  /* Correct hints that refer to history. */
+  HINT(160000 - RESUME_POS, 130000, 40000),
+  HINT(250000 - RESUME_POS, 190000, 8000),
+  /* Distance is the size of encoder ring-buffer. */
+  HINT(270000 - RESUME_POS, 2u << LGWIN, 500),
+};
+
+/* Random data with two long repeats. */
+static void GenerateRepeats(void) {
+  GenerateInput(1);
+  memcpy(&input[160000], &input[30000], 40000);
+  memcpy(&input[250000], &input[60000], 8000);
+}
+
+static BrotliEncoderState* CreateEncoder(int quality) {
+  BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+  if (!s) return NULL;
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, (uint32_t)quality);
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, LGWIN);
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_LGBLOCK, LGBLOCK);
+  return s;
+}
+
+static int Encode(BrotliEncoderState* s, BrotliEncoderOperation op,
+    size_t from, size_t to, uint8_t** next_out) {
+  const uint8_t* next_in = &input[from];
+  size_t available_in = to - from;
+  size_t available_out = OUTPUT_SIZE - (size_t)(*next_out - output);
+  do {
+    CHECK(BrotliEncoderCompressStream(
+        s, op, &available_in, &next_in, &available_out, next_out, NULL));
+  } while (available_in != 0 || BrotliEncoderHasMoreOutput(s) ||
+           (op == BROTLI_OPERATION_FINISH && !BrotliEncoderIsFinished(s)));
+  return 1;
+}
+
+static int TestHints(int quality) {
+  BrotliEncoderState* s = CreateEncoder(quality);
+  uint8_t* next_out = output;
+  CHECK(s);
+  CHECK(BrotliEncoderAddMatchHints(
+      s, sizeof(kHints1) / sizeof(kHints1[0]), kHints1));
+  CHECK(Encode(s, BROTLI_OPERATION_FLUSH, 0, SPLIT, &next_out));
+  CHECK(BrotliEncoderAddMatchHints(
+      s, sizeof(kHints2) / sizeof(kHints2[0]), kHints2));
+  CHECK(Encode(s, BROTLI_OPERATION_FINISH, SPLIT, INPUT_SIZE, &next_out));
+  CHECK(BrotliEncoderIsFinished(s));
+  BrotliEncoderDestroyInstance(s);
+  return CheckDecoded(NULL, output, (size_t)(next_out - output), INPUT_SIZE);
+}
+
+static int TestResumedHints(int quality) {
+  BrotliEncoderState* s = CreateEncoder(quality);
+  uint8_t* next_out = output;
+  CHECK(s);
+  /* Flushed stream ends on a byte boundary and has no ISLAST meta-block. */
+  CHECK(Encode(s, BROTLI_OPERATION_FLUSH, 0, RESUME_POS, &next_out));
+  BrotliEncoderDestroyInstance(s);
+  s = CreateEncoder(quality);
+  CHECK(s);
+  CHECK(BrotliEncoderResumeStream(s, RESUME_POS, input, RESUME_POS, 0, 0));
+  CHECK(BrotliEncoderAddMatchHints(s,
+      sizeof(kResumedHints) / sizeof(kResumedHints[0]), kResumedHints));
+  CHECK(Encode(s, BROTLI_OPERATION_FINISH, RESUME_POS, INPUT_SIZE,
+               &next_out));
+  CHECK(BrotliEncoderIsFinished(s));
+  BrotliEncoderDestroyInstance(s);
+  return CheckDecoded(NULL, output, (size_t)(next_out - output), INPUT_SIZE);
+}
+
+int main(void) {
+  static const int kQualities[] = {1, 2, 4, 5, 9, 10, 11};
+  size_t q;
+  GenerateRepeats();
+  for (q = 0; q < sizeof(kQualities) / sizeof(kQualities[0]); ++q) {
+    if (!TestHints(kQualities[q]) || !TestResumedHints(kQualities[q])) {
+      fprintf(stderr, "quality %d\n", kQualities[q]);
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,78 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Tests for BROTLI_PARAM_MAX_DELAY_BYTES: input is fed in small pieces and
+   the output produced so far is decoded after each piece. */
+
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+
+#define INPUT_SIZE 200000
+#define OUTPUT_SIZE (INPUT_SIZE + 65536)
+#define PIECE_SIZE 97
+
+#include "./test_util.h"
+
+/* Meta-block is emitted without padding; its last command could be left
+   undecodable until the next output. Commands of test input are shorter. */
+#define MAX_COMMAND_LENGTH 256
+
+static int TestDelay(int quality, uint32_t max_delay) {
+  BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+  BrotliDecoderState* d = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+  const uint8_t* next_in = input;
+  uint8_t* next_out = output;
+  uint8_t* next_decoded = decoded;
+  const uint8_t* next_encoded = output;
+  size_t lag = 0;
+  CHECK(s && d);
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, (uint32_t)quality);
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_MAX_DELAY_BYTES, max_delay);
+  while (!BrotliEncoderIsFinished(s)) {
+    size_t piece = INPUT_SIZE - (size_t)(next_in - input);
+    const BrotliEncoderOperation op = piece > PIECE_SIZE ?
+        BROTLI_OPERATION_PROCESS : BROTLI_OPERATION_FINISH;
+    size_t available_out = OUTPUT_SIZE - (size_t)(next_out - output);
+    size_t available_encoded;
+    size_t available_decoded = INPUT_SIZE - (size_t)(next_decoded - decoded);
+    BrotliDecoderResult result;
+    if (piece > PIECE_SIZE) piece = PIECE_SIZE;
+    CHECK(BrotliEncoderCompressStream(s, op, &piece, &next_in,
+        &available_out, &next_out, NULL));
+    CHECK(piece == 0);
+    available_encoded = (size_t)(next_out - next_encoded);
+    result = BrotliDecoderDecompressStream(d, &available_encoded,
+        &next_encoded, &available_decoded, &next_decoded, NULL);
+    CHECK(result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT ||
+          (result == BROTLI_DECODER_RESULT_SUCCESS &&
+           BrotliEncoderIsFinished(s)));
+    lag = (size_t)((next_in - input) - (next_decoded - decoded));
+    CHECK(lag <= max_delay + MAX_COMMAND_LENGTH);
+  }
+  CHECK(BrotliDecoderIsFinished(d));
+  CHECK(lag == 0);
+  BrotliDecoderDestroyInstance(d);
+  BrotliEncoderDestroyInstance(s);
+  return CheckDecoded(NULL, output, (size_t)(next_out - output), INPUT_SIZE);
+}
+
+int main(void) {
+  static const int kQualities[] = {0, 1, 2, 4, 5, 9, 10, 11};
+  static const uint32_t kDelays[] = {100, 1000, 10000};
+  size_t q;
+  size_t i;
+  GenerateInput(4);
+  for (q = 0; q < sizeof(kQualities) / sizeof(kQualities[0]); ++q) {
+    for (i = 0; i < sizeof(kDelays) / sizeof(kDelays[0]); ++i) {
+      if (!TestDelay(kQualities[q], kDelays[i])) {
+        fprintf(stderr, "quality %d, delay %d\n", kQualities[q],
+                (int)kDelays[i]);
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,112 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Tests for BROTLI_PARAM_QUALITY changes in the middle of the stream: input
+   is passed in pieces, quality is switched before each of them. Flushed
+   output is decoded right away. */
+
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+
+#define INPUT_SIZE 200000
+#define OUTPUT_SIZE (INPUT_SIZE + 65536)
+#define NUM_PIECES 12
+#define PIECE_SIZE (INPUT_SIZE / NUM_PIECES)
+#define RUN_LENGTH 32
+
+#include "./test_util.h"
+
+/* Qualities of pieces, repeated; the first one is set before encoding. */
+static const int kSequences[][6] = {
+  {1, 5, 11, 5, 1, 11},
+  {11, 1, 5, 11, 1, 5},
+  {5, 11, 1, 5, 11, 1},
+  {0, 11, 0, 5, 0, 1},
+};
+#define NUM_SEQUENCES (sizeof(kSequences) / sizeof(kSequences[0]))
+#define SEQUENCE_LENGTH (sizeof(kSequences[0]) / sizeof(kSequences[0][0]))
+
+static int TestSwitch(const int* qualities, BROTLI_BOOL flush) {
+  BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+  BrotliDecoderState* d = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+  const uint8_t* next_in = input;
+  uint8_t* next_out = output;
+  uint8_t* next_decoded = decoded;
+  const uint8_t* next_encoded = output;
+  size_t i;
+  CHECK(s && d);
+  for (i = 0; i <= NUM_PIECES; ++i) {
+    const BrotliEncoderOperation op = (i == NUM_PIECES) ?
+        BROTLI_OPERATION_FINISH :
+        (flush ? BROTLI_OPERATION_FLUSH : BROTLI_OPERATION_PROCESS);
+    size_t available_in = (i == NUM_PIECES) ?
+        INPUT_SIZE - (size_t)(next_in - input) : PIECE_SIZE;
+    size_t available_encoded;
+    size_t available_decoded;
+    BrotliDecoderResult result;
+    CHECK(BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY,
+        (uint32_t)qualities[i % SEQUENCE_LENGTH]));
+    do {
+      size_t available_out = OUTPUT_SIZE - (size_t)(next_out - output);
+      CHECK(BrotliEncoderCompressStream(s, op, &available_in, &next_in,
+          &available_out, &next_out, NULL));
+    } while (available_in != 0 || BrotliEncoderHasMoreOutput(s));
+    if (!flush) continue;
+    available_encoded = (size_t)(next_out - next_encoded);
+    available_decoded = INPUT_SIZE - (size_t)(next_decoded - decoded);
+    result = BrotliDecoderDecompressStream(d, &available_encoded,
+        &next_encoded, &available_decoded, &next_decoded, NULL);
+    CHECK(result == ((i == NUM_PIECES) ? BROTLI_DECODER_RESULT_SUCCESS :
+                     BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT));
+    CHECK(next_decoded - decoded == next_in - input);
+    CHECK(memcmp(decoded, input, (size_t)(next_in - input)) == 0);
+  }
+  CHECK(BrotliEncoderIsFinished(s));
+  BrotliDecoderDestroyInstance(d);
+  BrotliEncoderDestroyInstance(s);
+  return CheckDecoded(NULL, output, (size_t)(next_out - output), INPUT_SIZE);
+}
+
+/* Fast qualities are refused if the window was not reserved for them. */
+static int TestRefused(void) {
+  BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+  size_t available_in = PIECE_SIZE;
+  const uint8_t* next_in = input;
+  size_t available_out = OUTPUT_SIZE;
+  uint8_t* next_out = output;
+  CHECK(s);
+  CHECK(BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, 5));
+  CHECK(BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, 16));
+  CHECK(BrotliEncoderCompressStream(s, BROTLI_OPERATION_FLUSH, &available_in,
+      &next_in, &available_out, &next_out, NULL));
+  CHECK(available_in == 0 && !BrotliEncoderHasMoreOutput(s));
+  CHECK(!BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, 1));
+  CHECK(BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, 11));
+  available_in = 0;
+  CHECK(BrotliEncoderCompressStream(s, BROTLI_OPERATION_FINISH, &available_in,
+      &next_in, &available_out, &next_out, NULL));
+  CHECK(BrotliEncoderIsFinished(s));
+  BrotliEncoderDestroyInstance(s);
+  return CheckDecoded(NULL, output, OUTPUT_SIZE - available_out, PIECE_SIZE);
+}
+
+int main(void) {
+  size_t i;
+  GenerateInput(4);
+  /* Runs are matched with short distance codes, which refer to the distance
+     cache of the previous piece. */
+  for (i = 0; i < NUM_PIECES; ++i) {
+    memset(&input[i * PIECE_SIZE], 'x', RUN_LENGTH);
+  }
+  for (i = 0; i < NUM_SEQUENCES; ++i) {
+    if (!TestSwitch(kSequences[i], BROTLI_TRUE) ||
+        !TestSwitch(kSequences[i], BROTLI_FALSE)) {
+      fprintf(stderr, "sequence %d\n", (int)i);
+      return 1;
+    }
+  }
+  return TestRefused() ? 0 : 1;
+}
@@ -0,0 +1,29 @@
+set(ENV{QEMU_LD_PREFIX} "${BROTLI_WRAPPER_LD_PREFIX}")
+
+# Stream with content size header is written by the test program, since
+# brotli tool does not produce such header.
+execute_process(
+  WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
+  COMMAND ${BROTLI_WRAPPER} ${TEST_PROGRAM} write ${OUTPUT}.br
+  RESULT_VARIABLE result)
+if(result)
+  message(FATAL_ERROR "Writing stream failed")
+endif()
+
+execute_process(
+  WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
+  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --append --quality=6 ${INPUT} --output=${OUTPUT}.br
+  RESULT_VARIABLE result
+  ERROR_VARIABLE result_stderr)
+if(result)
+  message(FATAL_ERROR "Appending failed: ${result_stderr}")
+endif()
+
+execute_process(
+  WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
+  COMMAND ${BROTLI_WRAPPER} ${TEST_PROGRAM} check ${OUTPUT}.br ${INPUT}
+  RESULT_VARIABLE result
+  ERROR_VARIABLE result_stderr)
+if(result)
+  message(FATAL_ERROR "Appended stream check failed: ${result_stderr}")
+endif()
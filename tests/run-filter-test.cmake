@@ -0,0 +1,28 @@
+set(ENV{QEMU_LD_PREFIX} "${BROTLI_WRAPPER_LD_PREFIX}")
+
+file(READ "${INPUT}" input_contents HEX)
+
+foreach(filter none delta delta:2 transpose:4 x86 auto)
+  string(REPLACE ":" "_" suffix "${filter}")
+  execute_process(
+    WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
+    COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --force --quality=5 --filter=${filter} ${INPUT} --output=${OUTPUT}.${suffix}.br
+    RESULT_VARIABLE result
+    ERROR_VARIABLE result_stderr)
+  if(result)
+    message(FATAL_ERROR "Compression with ${filter} filter failed: ${result_stderr}")
+  endif()
+
+  execute_process(
+    WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
+    COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --force --decompress ${OUTPUT}.${suffix}.br --output=${OUTPUT}.${suffix}.unbr
+    RESULT_VARIABLE result)
+  if(result)
+    message(FATAL_ERROR "Decompression with ${filter} filter failed")
+  endif()
+
+  file(READ "${OUTPUT}.${suffix}.unbr" output_contents HEX)
+  if(NOT "${input_contents}" STREQUAL "${output_contents}")
+    message(FATAL_ERROR "Files do not match for ${filter} filter")
+  endif()
+endforeach()
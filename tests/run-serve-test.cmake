@@ -0,0 +1,58 @@
+set(ENV{QEMU_LD_PREFIX} "${BROTLI_WRAPPER_LD_PREFIX}")
+
+# Daemon and client run concurrently; client stops daemon when done.
+if(NOT CLIENT)
+  execute_process(
+    WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
+    COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --serve=${OUTPUT}.sock
+    COMMAND "${CMAKE_COMMAND}"
+      -DCLIENT=1
+      -DBROTLI_WRAPPER=${BROTLI_WRAPPER}
+      -DBROTLI_WRAPPER_LD_PREFIX=${BROTLI_WRAPPER_LD_PREFIX}
+      -DBROTLI_CLI=${BROTLI_CLI}
+      -DINPUT=${INPUT}
+      -DOUTPUT=${OUTPUT}
+      -P ${CMAKE_CURRENT_LIST_FILE}
+    RESULT_VARIABLE result
+    ERROR_VARIABLE result_stderr)
+  if(result)
+    message(FATAL_ERROR "Daemon test failed: ${result_stderr}")
+  endif()
+  return()
+endif()
+
+execute_process(
+  WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
+  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --force --quality=5 --connect=${OUTPUT}.sock ${INPUT} --output=${OUTPUT}.br
+  RESULT_VARIABLE compress_result)
+execute_process(
+  WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
+  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --force --decompress --connect=${OUTPUT}.sock ${OUTPUT}.br --output=${OUTPUT}.unbr
+  RESULT_VARIABLE decompress_result)
+execute_process(
+  WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
+  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --stop=${OUTPUT}.sock
+  RESULT_VARIABLE stop_result)
+if(compress_result OR decompress_result OR stop_result)
+  message(FATAL_ERROR "Request to daemon failed")
+endif()
+
+execute_process(
+  WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
+  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --force --quality=5 ${INPUT} --output=${OUTPUT}.local.br
+  RESULT_VARIABLE result)
+if(result)
+  message(FATAL_ERROR "Compression failed")
+endif()
+
+file(READ "${OUTPUT}.br" served_contents HEX)
+file(READ "${OUTPUT}.local.br" local_contents HEX)
+if(NOT "${served_contents}" STREQUAL "${local_contents}")
+  message(FATAL_ERROR "Daemon output differs from local output")
+endif()
+
+file(READ "${INPUT}" input_contents HEX)
+file(READ "${OUTPUT}.unbr" output_contents HEX)
+if(NOT "${input_contents}" STREQUAL "${output_contents}")
+  message(FATAL_ERROR "Files do not match")
+endif()
@@ -0,0 +1,58 @@
+set(ENV{QEMU_LD_PREFIX} "${BROTLI_WRAPPER_LD_PREFIX}")
+
+# Small window forces several segments.
+set(MEMBERS c/enc/encode.c c/dec/decode.c c/common/dictionary.h README.md)
+# Absolute path is stored relative, with the leading separator stripped.
+set(ABSOLUTE_MEMBER "${SOURCE_DIR}/LICENSE")
+string(REGEX REPLACE "^([A-Za-z]:)?/+" "" STORED_MEMBER
+       "${ABSOLUTE_MEMBER}")
+
+execute_process(
+  WORKING_DIRECTORY "${SOURCE_DIR}"
+  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --force --quality=5 --lgwin=16 --solid ${MEMBERS} ${ABSOLUTE_MEMBER} --output=${OUTPUT}.br
+  RESULT_VARIABLE result
+  ERROR_VARIABLE result_stderr)
+if(result)
+  message(FATAL_ERROR "Compression failed: ${result_stderr}")
+endif()
+
+execute_process(
+  WORKING_DIRECTORY "${SOURCE_DIR}"
+  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --force --decompress --extract=c/dec/decode.c ${OUTPUT}.br --output=${OUTPUT}.unbr
+  RESULT_VARIABLE result
+  ERROR_VARIABLE result_stderr)
+if(result)
+  message(FATAL_ERROR "Extraction failed: ${result_stderr}")
+endif()
+
+file(READ "${SOURCE_DIR}/c/dec/decode.c" input_contents HEX)
+file(READ "${OUTPUT}.unbr" output_contents HEX)
+if(NOT "${input_contents}" STREQUAL "${output_contents}")
+  message(FATAL_ERROR "Extracted member does not match")
+endif()
+
+# Extraction creates the directories of nested members.
+file(REMOVE_RECURSE "${OUTPUT}.dir")
+file(MAKE_DIRECTORY "${OUTPUT}.dir")
+execute_process(
+  WORKING_DIRECTORY "${OUTPUT}.dir"
+  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --decompress --solid ${OUTPUT}.br
+  RESULT_VARIABLE result
+  ERROR_VARIABLE result_stderr)
+if(result)
+  message(FATAL_ERROR "Decompression failed: ${result_stderr}")
+endif()
+
+foreach(member ${MEMBERS})
+  file(READ "${SOURCE_DIR}/${member}" input_contents HEX)
+  file(READ "${OUTPUT}.dir/${member}" output_contents HEX)
+  if(NOT "${input_contents}" STREQUAL "${output_contents}")
+    message(FATAL_ERROR "Files do not match: ${member}")
+  endif()
+endforeach()
+
+file(READ "${ABSOLUTE_MEMBER}" input_contents HEX)
+file(READ "${OUTPUT}.dir/${STORED_MEMBER}" output_contents HEX)
+if(NOT "${input_contents}" STREQUAL "${output_contents}")
+  message(FATAL_ERROR "Files do not match: ${ABSOLUTE_MEMBER}")
+endif()
@@ -0,0 +1,63 @@
+set(ENV{QEMU_LD_PREFIX} "${BROTLI_WRAPPER_LD_PREFIX}")
+
+# Sparse file is made with truncate; allocated size is checked with du.
+find_program(TRUNCATE truncate)
+find_program(DU du)
+if(NOT TRUNCATE OR NOT DU)
+  message(STATUS "truncate / du not found; skipped")
+  return()
+endif()
+
+# Data, 16 MiB hole, data.
+configure_file("${INPUT}" "${OUTPUT}" COPYONLY)
+execute_process(COMMAND ${TRUNCATE} -s 16M "${OUTPUT}" RESULT_VARIABLE result)
+if(result)
+  message(FATAL_ERROR "Could not make sparse file")
+endif()
+file(APPEND "${OUTPUT}" "Tail after the hole.\n")
+
+# Holes are not read, but the output is the same.
+foreach(mode sparse no-sparse)
+  if(mode STREQUAL "sparse")
+    set(flags "")
+  else()
+    set(flags "--no-sparse")
+  endif()
+  execute_process(
+    COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --force --quality=9 ${flags} ${OUTPUT} --output=${OUTPUT}.${mode}.br
+    RESULT_VARIABLE result
+    ERROR_VARIABLE result_stderr)
+  if(result)
+    message(FATAL_ERROR "Compression failed: ${result_stderr}")
+  endif()
+endforeach()
+execute_process(
+  COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT}.sparse.br ${OUTPUT}.no-sparse.br
+  RESULT_VARIABLE result)
+if(result)
+  message(FATAL_ERROR "Sparse input changes compressed output")
+endif()
+
+execute_process(
+  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --force --decompress ${OUTPUT}.sparse.br --output=${OUTPUT}.unbr
+  RESULT_VARIABLE result
+  ERROR_VARIABLE result_stderr)
+if(result)
+  message(FATAL_ERROR "Decompression failed: ${result_stderr}")
+endif()
+execute_process(
+  COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT} ${OUTPUT}.unbr
+  RESULT_VARIABLE result)
+if(result)
+  message(FATAL_ERROR "Files do not match")
+endif()
+
+# Zero pages are skipped, so most of the output is not allocated.
+execute_process(
+  COMMAND ${DU} -k ${OUTPUT}.unbr
+  OUTPUT_VARIABLE du_output
+  RESULT_VARIABLE result)
+string(REGEX MATCH "^[0-9]+" allocated_kib "${du_output}")
+if(result OR NOT allocated_kib OR allocated_kib GREATER 4096)
+  message(FATAL_ERROR "Output is not sparse: ${du_output}")
+endif()
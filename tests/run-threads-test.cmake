@@ -0,0 +1,32 @@
+set(ENV{QEMU_LD_PREFIX} "${BROTLI_WRAPPER_LD_PREFIX}")
+
+foreach(threads 1 4)
+  execute_process(
+    WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
+    COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --force --quality=1 --lgwin=10 --threads=${threads} ${INPUT} --output=${OUTPUT}.${threads}.br
+    RESULT_VARIABLE result
+    ERROR_VARIABLE result_stderr)
+  if(result)
+    message(FATAL_ERROR "Compression failed: ${result_stderr}")
+  endif()
+endforeach()
+
+file(READ "${OUTPUT}.1.br" serial_contents HEX)
+file(READ "${OUTPUT}.4.br" parallel_contents HEX)
+if(NOT "${serial_contents}" STREQUAL "${parallel_contents}")
+  message(FATAL_ERROR "Output depends on number of threads")
+endif()
+
+execute_process(
+  WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
+  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --force --decompress ${OUTPUT}.4.br --output=${OUTPUT}.unbr
+  RESULT_VARIABLE result)
+if(result)
+  message(FATAL_ERROR "Decompression failed")
+endif()
+
+file(READ "${INPUT}" input_contents HEX)
+file(READ "${OUTPUT}.unbr" output_contents HEX)
+if(NOT "${input_contents}" STREQUAL "${output_contents}")
+  message(FATAL_ERROR "Files do not match")
+endif()
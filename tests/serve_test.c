@@ -0,0 +1,114 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Tests that idle connections to the compression daemon do not occupy its
+   workers, and that the socket is private.
+
+   Usage: serve_test SOCKET */
+
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+#include "../c/tools/serve.h"
+
+#define INPUT_SIZE 200000
+#define OUTPUT_SIZE (INPUT_SIZE + 4096)
+/* More connections than workers. */
+#define NUM_WORKERS 1
+#define NUM_CONNECTIONS 3
+
+#include "./test_util.h"
+
+typedef struct ServerArgs {
+  const char* socket_path;
+  BROTLI_BOOL result;
+} ServerArgs;
+
+static void* ServerMain(void* arg) {
+  ServerArgs* args = (ServerArgs*)arg;
+  args->result = BrotliServe(args->socket_path, NUM_WORKERS, 0);
+  return NULL;
+}
+
+/* Processes |in| to a new temporary file with daemon; returns its contents in
+   |data|. */
+static int Process(int connection, BROTLI_BOOL decompress, FILE* in,
+    uint8_t* data, size_t capacity, size_t* size) {
+  BrotliServeJob job;
+  FILE* out = tmpfile();
+  uint64_t total_in;
+  uint64_t total_out;
+  CHECK(out);
+  memset(&job, 0, sizeof(job));
+  job.decompress = decompress;
+  job.quality = 5;
+  CHECK(fseek(in, 0, SEEK_SET) == 0);
+  CHECK(BrotliServeProcess(connection, &job, fileno(in), fileno(out),
+      &total_in, &total_out) == BROTLI_SERVE_OK);
+  CHECK(fseek(out, 0, SEEK_SET) == 0);
+  *size = fread(data, 1, capacity, out);
+  CHECK(*size == total_out);
+  fclose(out);
+  return 1;
+}
+
+static int TestIdleConnections(const char* socket_path) {
+  int connections[NUM_CONNECTIONS];
+  struct stat info;
+  FILE* in = tmpfile();
+  FILE* compressed = tmpfile();
+  size_t compressed_size;
+  size_t decoded_size;
+  int i;
+  CHECK(in && compressed);
+  CHECK(fwrite(input, 1, INPUT_SIZE, in) == INPUT_SIZE);
+  for (i = 0; i < NUM_CONNECTIONS; ++i) {
+    connections[i] = BrotliServeConnect(socket_path);
+    CHECK(connections[i] >= 0);
+  }
+  CHECK(stat(socket_path, &info) == 0);
+  CHECK((info.st_mode & 0077) == 0);
+  /* Worker is not bound to the first connection. */
+  CHECK(Process(connections[NUM_CONNECTIONS - 1], BROTLI_FALSE, in, output,
+                OUTPUT_SIZE, &compressed_size));
+  CHECK(CheckDecoded(NULL, output, compressed_size, INPUT_SIZE));
+  CHECK(fwrite(output, 1, compressed_size, compressed) == compressed_size);
+  /* Connection returns to the pool after the request, not on disconnect. */
+  CHECK(Process(connections[0], BROTLI_TRUE, compressed, decoded,
+                INPUT_SIZE, &decoded_size));
+  CHECK(decoded_size == INPUT_SIZE);
+  CHECK(memcmp(decoded, input, INPUT_SIZE) == 0);
+  CHECK(BrotliServeStop(connections[1]) == BROTLI_SERVE_OK);
+  for (i = 0; i < NUM_CONNECTIONS; ++i) {
+    BrotliServeDisconnect(connections[i]);
+  }
+  fclose(in);
+  fclose(compressed);
+  return 1;
+}
+
+int main(int argc, char** argv) {
+  ServerArgs args;
+  pthread_t server;
+  int result;
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s SOCKET\n", argv[0]);
+    return 1;
+  }
+  GenerateInput(4);
+  /* Daemon that is stuck with an idle connection fails the test. */
+  alarm(60);
+  args.socket_path = argv[1];
+  args.result = BROTLI_FALSE;
+  if (pthread_create(&server, NULL, ServerMain, &args) != 0) return 1;
+  result = TestIdleConnections(argv[1]) ? 0 : 1;
+  if (result != 0) return result;
+  pthread_join(server, NULL);
+  return args.result ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Tests for BrotliEncoderCompressStreamVec and
+   BrotliDecoderDecompressStreamVec: data goes through scattered segments of
+   varying size, including empty and 1-byte ones; output segments are
+   separated by filler bytes that should stay intact. */
+
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+
+#define INPUT_SIZE 200000
+#define OUTPUT_SIZE (INPUT_SIZE + 4096)
+#define MAX_SEGMENTS 256
+#define GAP 3
+#define FILLER 0x5A
+#define SCATTERED_SIZE (OUTPUT_SIZE + MAX_SEGMENTS * GAP)
+/* Segments are passed to a single call in groups of this size. */
+#define WINDOW 5
+
+#include "./test_util.h"
+
+static uint8_t scattered_output[SCATTERED_SIZE];
+static uint8_t scattered_decoded[SCATTERED_SIZE];
+
+static const size_t kSegmentSizes[] = {0, 1, 0, 0, 1, 13, 1, 0, 4096, 1,
+    65536, 2};
+#define NUM_SEGMENT_SIZES (sizeof(kSegmentSizes) / sizeof(kSegmentSizes[0]))
+
+/* Splits |size| bytes at |buffer| into segments, with |gap| bytes between
+   them; sizes are taken from kSegmentSizes starting with |first|. The last
+   segment is empty. Returns the number of segments. */
+static size_t Scatter(uint8_t* buffer, size_t size, size_t gap, size_t first,
+    BrotliOutputSegment* segments) {
+  size_t n = 0;
+  size_t pos = 0;
+  while (size > 0) {
+    size_t length = kSegmentSizes[(first + n) % NUM_SEGMENT_SIZES];
+    if (length > size) length = size;
+    segments[n].data = buffer + pos;
+    segments[n].size = length;
+    pos += length + gap;
+    size -= length;
+    ++n;
+  }
+  segments[n].data = NULL;
+  segments[n].size = 0;
+  return n + 1;
+}
+
+/* Checks that segments were filled in order and that the filler after them
+   is intact; copies the written bytes to |dst|. */
+static int Gather(const BrotliOutputSegment* before,
+    const BrotliOutputSegment* after, size_t n, uint8_t* dst, size_t* size) {
+  BROTLI_BOOL partial = BROTLI_FALSE;
+  size_t k;
+  size_t g;
+  *size = 0;
+  for (k = 0; k < n; ++k) {
+    const size_t written = before[k].size - after[k].size;
+    CHECK(after[k].data == before[k].data + written);
+    CHECK(!partial || written == 0);
+    if (after[k].size != 0) partial = BROTLI_TRUE;
+    if (!before[k].data) continue;
+    for (g = 0; g < GAP; ++g) {
+      CHECK(before[k].data[before[k].size + g] == FILLER);
+    }
+    memcpy(dst + *size, before[k].data, written);
+    *size += written;
+  }
+  return 1;
+}
+
+static int TestRoundtrip(int quality) {
+  BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+  BrotliDecoderState* d = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+  BrotliOutputSegment pieces[MAX_SEGMENTS];
+  BrotliInputSegment in[MAX_SEGMENTS];
+  BrotliOutputSegment encoded[MAX_SEGMENTS];
+  BrotliOutputSegment encoded_end[MAX_SEGMENTS];
+  BrotliOutputSegment out[MAX_SEGMENTS];
+  BrotliOutputSegment out_end[MAX_SEGMENTS];
+  BrotliDecoderResult result = BROTLI_DECODER_RESULT_ERROR;
+  size_t num_in;
+  size_t num_encoded;
+  size_t num_out;
+  size_t encoded_size;
+  size_t decoded_size;
+  size_t total_out = 0;
+  size_t k;
+  size_t w;
+  CHECK(s && d);
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, (uint32_t)quality);
+  memset(scattered_output, FILLER, SCATTERED_SIZE);
+  memset(scattered_decoded, FILLER, SCATTERED_SIZE);
+
+  /* Input is flushed after each window and finished with the last one. */
+  num_in = Scatter(input, INPUT_SIZE, 0, 5, pieces);
+  for (k = 0; k < num_in; ++k) {
+    in[k].data = pieces[k].data;
+    in[k].size = pieces[k].size;
+  }
+  num_encoded = Scatter(scattered_output, OUTPUT_SIZE, GAP, 0, encoded);
+  memcpy(encoded_end, encoded, sizeof(encoded));
+  for (w = 0; w < num_in; w += WINDOW) {
+    const size_t num = (num_in - w < WINDOW) ? num_in - w : WINDOW;
+    const BrotliEncoderOperation op = (w + num == num_in) ?
+        BROTLI_OPERATION_FINISH : BROTLI_OPERATION_FLUSH;
+    CHECK(BrotliEncoderCompressStreamVec(s, op, &in[w], num,
+        encoded_end, num_encoded, &total_out));
+    for (k = w; k < w + num; ++k) CHECK(in[k].size == 0);
+    CHECK(!BrotliEncoderHasMoreOutput(s));
+  }
+  CHECK(BrotliEncoderIsFinished(s));
+  CHECK(Gather(encoded, encoded_end, num_encoded, output, &encoded_size));
+  CHECK(total_out == encoded_size);
+  CHECK(CheckDecoded(NULL, output, encoded_size, INPUT_SIZE));
+
+  /* Compressed data is read right from the scattered output; decoder output
+     space is given window by window. */
+  for (k = 0; k < num_encoded; ++k) {
+    in[k].data = encoded[k].data;
+    in[k].size = encoded[k].size - encoded_end[k].size;
+  }
+  num_out = Scatter(scattered_decoded, INPUT_SIZE, GAP, 3, out);
+  memcpy(out_end, out, sizeof(out));
+  for (w = 0; w < num_out; w += WINDOW) {
+    const size_t num = (num_out - w < WINDOW) ? num_out - w : WINDOW;
+    result = BrotliDecoderDecompressStreamVec(d, in, num_encoded,
+        &out_end[w], num, &total_out);
+    if (result == BROTLI_DECODER_RESULT_SUCCESS) break;
+    CHECK(result == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT);
+    for (k = w; k < w + num; ++k) CHECK(out_end[k].size == 0);
+  }
+  CHECK(result == BROTLI_DECODER_RESULT_SUCCESS);
+  for (k = 0; k < num_encoded; ++k) CHECK(in[k].size == 0);
+  CHECK(Gather(out, out_end, num_out, decoded, &decoded_size));
+  CHECK(decoded_size == INPUT_SIZE && total_out == INPUT_SIZE);
+  CHECK(memcmp(decoded, input, INPUT_SIZE) == 0);
+  BrotliDecoderDestroyInstance(d);
+  BrotliEncoderDestroyInstance(s);
+  return 1;
+}
+
+int main(void) {
+  static const int kQualities[] = {0, 1, 2, 5, 9, 11};
+  size_t q;
+  GenerateInput(4);
+  for (q = 0; q < sizeof(kQualities) / sizeof(kQualities[0]); ++q) {
+    if (!TestRoundtrip(kQualities[q])) {
+      fprintf(stderr, "quality %d\n", kQualities[q]);
+      return 1;
+    }
+  }
+  return 0;
+}
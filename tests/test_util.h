@@ -0,0 +1,76 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Fixture shared by the library API tests.
+
+   Test defines INPUT_SIZE and OUTPUT_SIZE before including this header.
+   Test functions return 1 on success; CHECK reports the failed condition and
+   returns 0. */
+
+#ifndef BROTLI_TESTS_TEST_UTIL_H_
+#define BROTLI_TESTS_TEST_UTIL_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#include <brotli/decode.h>
+#include <brotli/types.h>
+
+#if !defined(INPUT_SIZE) || !defined(OUTPUT_SIZE)
+#error "INPUT_SIZE and OUTPUT_SIZE should be defined"
+#endif
+
+#define CHECK(X) if (!(X)) { \
+    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #X); \
+    return 0; \
+  }
+
+static uint8_t input[INPUT_SIZE];
+static uint8_t output[OUTPUT_SIZE];
+static uint8_t decoded[INPUT_SIZE];
+
+/* Fills |input| with words (some of them are in the static dictionary); one
+   of |noise| tokens is a random byte instead. With |noise| 1 input is random
+   and practically incompressible. */
+static void GenerateInput(uint32_t noise) {
+  static const char* kWords[] = {"brotli ", "the ", "window ", "of ",
+      "stream ", "and ", "compressed ", "buffer ", "reference ", "data\n"};
+  uint32_t seed = 1;
+  size_t pos = 0;
+  while (pos < INPUT_SIZE) {
+    seed = seed * 1103515245u + 12345u;
+    if ((seed >> 16) % noise == 0) {
+      input[pos++] = (uint8_t)(seed >> 8);
+    } else {
+      const char* word = kWords[(seed >> 16) % 10];
+      while (*word && pos < INPUT_SIZE) input[pos++] = (uint8_t)*word++;
+    }
+  }
+}
+
+/* Decodes |encoded| with |d|, or with the default decoder if |d| is NULL,
+   and checks that it is a complete stream of the first |size| bytes of
+   |input|. */
+static int CheckDecoded(BrotliDecoderState* d, const uint8_t* encoded,
+    size_t encoded_size, size_t size) {
+  BrotliDecoderState* owned = NULL;
+  uint8_t* next_out = decoded;
+  size_t available_out = size;
+  BrotliDecoderResult result;
+  if (!d) {
+    owned = d = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+    CHECK(d);
+  }
+  result = BrotliDecoderDecompressStream(
+      d, &encoded_size, &encoded, &available_out, &next_out, NULL);
+  BrotliDecoderDestroyInstance(owned);
+  CHECK(result == BROTLI_DECODER_RESULT_SUCCESS);
+  CHECK(encoded_size == 0 && available_out == 0);
+  CHECK(memcmp(decoded, input, size) == 0);
+  return 1;
+}
+
+#endif  /* BROTLI_TESTS_TEST_UTIL_H_ */
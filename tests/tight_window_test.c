@@ -0,0 +1,77 @@
+/* Copyright 2026 The Brotli Authors. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Tests that streams produced by BrotliEncoderCompress (which advertises
+   tight window) decode with BROTLI_DECODER_PARAM_DISABLE_RING_BUFFER_-
+   REALLOCATION, i.e. with the ring buffer of the size told by the header.
+
+   Input size (1 << w) - 16 is the biggest one that is advertised with window
+   w, (1 << w) - 15 is the smallest one that needs w + 1. The last bytes of
+   input repeat its first bytes, so that the encoder emits a backward
+   reference whose distance is close to the input size; with input size
+   1 << w it is beyond the reach of window w. */
+
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+
+#define MIN_LGWIN BROTLI_MIN_WINDOW_BITS
+#define MAX_LGWIN BROTLI_MAX_WINDOW_BITS
+#define INPUT_SIZE ((size_t)1 << MAX_LGWIN)
+#define OUTPUT_SIZE (INPUT_SIZE + 65536)
+#define REPEAT_SIZE 12
+
+#include "./test_util.h"
+
+static int TestRoundtrip(int quality, int lgwin, size_t size) {
+  BrotliDecoderState* d;
+  size_t encoded_size = OUTPUT_SIZE;
+  uint8_t saved[REPEAT_SIZE];
+  int result;
+  memcpy(saved, &input[size - REPEAT_SIZE], REPEAT_SIZE);
+  memcpy(&input[size - REPEAT_SIZE], input, REPEAT_SIZE);
+  CHECK(BrotliEncoderCompress(quality, lgwin, BROTLI_MODE_GENERIC, size,
+                              input, &encoded_size, output));
+  d = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+  CHECK(d);
+  CHECK(BrotliDecoderSetParameter(d,
+      BROTLI_DECODER_PARAM_DISABLE_RING_BUFFER_REALLOCATION, 1));
+  result = CheckDecoded(d, output, encoded_size, size);
+  BrotliDecoderDestroyInstance(d);
+  memcpy(&input[size - REPEAT_SIZE], saved, REPEAT_SIZE);
+  return result;
+}
+
+/* Biggest tested window for |quality|; slower encoders are tested with
+   smaller inputs to keep the test fast. */
+static int MaxTestedWindow(int quality) {
+  if (quality < 2) return MAX_LGWIN;
+  if (quality < 10) return 20;
+  return 17;
+}
+
+int main(void) {
+  int quality;
+  int w;
+  int result = 0;
+  GenerateInput(4);
+  for (quality = BROTLI_MIN_QUALITY;
+       quality <= BROTLI_MAX_QUALITY && result == 0; ++quality) {
+    for (w = MIN_LGWIN; w <= MaxTestedWindow(quality) && result == 0; ++w) {
+      const size_t size = (size_t)1 << w;
+      /* With the biggest encoder window the header is tightened to w, w + 1
+         and w + 1 respectively; with window w the last distance does not
+         fit. */
+      if (!TestRoundtrip(quality, MAX_LGWIN, size - 16) ||
+          !TestRoundtrip(quality, MAX_LGWIN, size - 15) ||
+          !TestRoundtrip(quality, MAX_LGWIN, size) ||
+          !TestRoundtrip(quality, w, size)) {
+        fprintf(stderr, "quality %d, lgwin %d\n", quality, w);
+        result = 1;
+      }
+    }
+  }
+  return result;
+}